@@ -0,0 +1,125 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "Errors.h"
+
+/**
+ * Plain binary writer and reader used to persist in-memory structures.
+ * Values are written in native byte order as files are read back by the same build on the same host.
+ * Blobs are aligned to 8 bytes so that a mapped file can be read in place as typed data.
+ */
+namespace nebula {
+namespace common {
+
+class BinaryWriter {
+  static constexpr size_t ALIGNMENT = 8;
+
+public:
+  BinaryWriter() = default;
+  virtual ~BinaryWriter() = default;
+
+public:
+  template <typename T>
+  void write(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable values");
+    buffer_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  // a length prefixed string
+  void string(std::string_view str) {
+    write<uint64_t>(str.size());
+    buffer_.append(str.data(), str.size());
+  }
+
+  // a length prefixed bytes array starting at aligned position
+  void blob(const void* data, size_t size) {
+    write<uint64_t>(size);
+    buffer_.append((ALIGNMENT - buffer_.size() % ALIGNMENT) % ALIGNMENT, '\0');
+    buffer_.append(static_cast<const char*>(data), size);
+  }
+
+  inline size_t size() const {
+    return buffer_.size();
+  }
+
+  inline const std::string& buffer() const {
+    return buffer_;
+  }
+
+private:
+  std::string buffer_;
+};
+
+// reader of an external buffer, strings and blobs are views into the buffer
+class BinaryReader {
+  static constexpr size_t ALIGNMENT = 8;
+
+public:
+  BinaryReader(const char* data, size_t size) : data_{ data }, size_{ size }, pos_{ 0 } {}
+  virtual ~BinaryReader() = default;
+
+public:
+  template <typename T>
+  T read() {
+    static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable values");
+    T value;
+    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  std::string_view string() {
+    auto size = read<uint64_t>();
+    return std::string_view(take(size), size);
+  }
+
+  std::string_view blob() {
+    auto size = read<uint64_t>();
+    take((ALIGNMENT - pos_ % ALIGNMENT) % ALIGNMENT);
+    return std::string_view(take(size), size);
+  }
+
+  inline size_t remaining() const {
+    return size_ - pos_;
+  }
+
+  // address of the next byte to read
+  inline const char* cursor() const {
+    return data_ + pos_;
+  }
+
+private:
+  inline const char* take(size_t size) {
+    N_ENSURE_LE(size, remaining(), "reading out of binary buffer");
+    auto ptr = data_ + pos_;
+    pos_ += size;
+    return ptr;
+  }
+
+private:
+  const char* data_;
+  size_t size_;
+  size_t pos_;
+};
+
+} // namespace common
+} // namespace nebula
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Frame of reference and bit packing of integers.
+ * Values of a run are stored as their distance to the run minimum (base),
+ * using just enough bits for the run range, packed into 64-bit words.
+ * Metric columns such as status codes, durations and counters usually have
+ * a narrow range in a page, so they take a fraction of their full width.
+ *
+ * Unpacking is specialized for every bit width, 64 values of a group span exactly
+ * BITS words, so all shifts and masks in a group are constants and the compiler
+ * unrolls and vectorizes the loop.
+ */
+namespace nebula {
+namespace common {
+
+class BitPack {
+public:
+  // number of bits to hold any value in [0, range]
+  static inline uint8_t bits(uint64_t range) {
+    return range == 0 ? 0 : 64 - __builtin_clzll(range);
+  }
+
+  // bytes of n packed values in given bits, rounded up to whole words
+  static inline size_t bytes(size_t n, uint8_t bits) {
+    return (n * bits + 63) / 64 * sizeof(uint64_t);
+  }
+
+  // pack n values by their distance to base into words, out has at least bytes(n, bits)
+  template <typename T>
+  static void pack(const T* values, size_t n, T base, uint8_t bits, uint64_t* out) {
+    using U = std::make_unsigned_t<T>;
+    std::fill(out, out + bytes(n, bits) / sizeof(uint64_t), 0);
+    if (bits == 0) {
+      return;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+      const uint64_t v = (U)((U)values[i] - (U)base);
+      const auto bit = i * bits;
+      const auto w = bit >> 6;
+      const auto s = bit & 63;
+      out[w] |= v << s;
+      if (s + bits > 64) {
+        out[w + 1] |= v >> (64 - s);
+      }
+    }
+  }
+
+  // unpack n values of given bits and add base back
+  template <typename T>
+  static void unpack(const uint64_t* in, size_t n, T base, uint8_t bits, T* out) {
+    static constexpr auto kernels = table<T>(std::make_index_sequence<sizeof(T) * 8 + 1>{});
+    kernels.at(bits)(in, n, base, out);
+  }
+
+private:
+  template <typename T>
+  using Kernel = void (*)(const uint64_t*, size_t, T, T*);
+
+  template <typename T, size_t... B>
+  static constexpr std::array<Kernel<T>, sizeof...(B)> table(std::index_sequence<B...>) {
+    return { &unpackBits<T, B>... };
+  }
+
+  template <size_t BITS>
+  static inline uint64_t extract(const uint64_t* in, size_t bit) {
+    constexpr uint64_t MASK = BITS == 64 ? ~0ULL : (1ULL << BITS) - 1;
+    const auto w = bit >> 6;
+    const auto s = bit & 63;
+    auto v = in[w] >> s;
+    if (s + BITS > 64) {
+      v |= in[w + 1] << (64 - s);
+    }
+
+    return v & MASK;
+  }
+
+  template <typename T, size_t BITS>
+  static void unpackBits(const uint64_t* in, size_t n, T base, T* out) {
+    using U = std::make_unsigned_t<T>;
+    if constexpr (BITS == 0) {
+      std::fill(out, out + n, base);
+    } else {
+      size_t i = 0;
+      for (; i + 64 <= n; i += 64, in += BITS, out += 64) {
+        for (size_t k = 0; k < 64; ++k) {
+          out[k] = (T)((U)base + (U)extract<BITS>(in, k * BITS));
+        }
+      }
+
+      for (size_t k = 0; i + k < n; ++k) {
+        out[k] = (T)((U)base + (U)extract<BITS>(in, k * BITS));
+      }
+    }
+  }
+};
+
+} // namespace common
+} // namespace nebula
@@ -20,6 +20,7 @@
 #include <glog/logging.h>
 #include <memory>
 #include <vector>
+#include "Binary.h"
 #include "Bloom.h"
 #include "Evidence.h"
 
@@ -37,11 +38,12 @@ namespace common {
 template <typename T, size_t BITS = 16>
 class BloomFilter {
 public:
-  BloomFilter(size_t items) {
+  BloomFilter(size_t items) : BloomFilter(items, Evidence::ticks()) {}
+  BloomFilter(size_t items, size_t seed) : items_{ items }, seed_{ seed } {
     bloom_parameters parameters;
     parameters.projected_element_count = items;
     parameters.false_positive_probability = 0.01;
-    parameters.random_seed = Evidence::ticks();
+    parameters.random_seed = seed;
     parameters.compute_optimal_parameters();
 
     //Instantiate Bloom Filter
@@ -78,7 +80,28 @@ public:
     // return filter_.SizeInBytes();
   }
 
+  // write parameters and bits of this filter
+  void persist(BinaryWriter& writer) const {
+    writer.write<uint64_t>(items_);
+    writer.write<uint64_t>(seed_);
+    writer.blob(filter_->table(), filter_->size() / bits_per_char);
+  }
+
+  // restore a persisted filter, salts are derived from the same parameters
+  void restore(BinaryReader& reader) {
+    items_ = reader.read<uint64_t>();
+    seed_ = reader.read<uint64_t>();
+    BloomFilter restored(items_, seed_);
+    auto bits = reader.blob();
+    N_ENSURE_EQ(bits.size(), restored.filter_->size() / bits_per_char, "bloom filter size mismatches");
+    std::memcpy(const_cast<unsigned char*>(restored.filter_->table()), bits.data(), bits.size());
+    filter_ = std::move(restored.filter_);
+  }
+
 private:
+  // parameters to build the same filter again
+  size_t items_;
+  size_t seed_;
   std::unique_ptr<bloom_filter> filter_;
   // cuckoofilter::CuckooFilter<T, BITS> filter_;
 };
@@ -38,6 +38,12 @@ private:
   std::string format_;
 };
 
+// a query runs out of its memory budget, it fails the query rather than the process
+class MemoryExceededException : public NebulaException {
+public:
+  using NebulaException::NebulaException;
+};
+
 // fetch file name only
 using cstr = const char*;
 static constexpr size_t length(cstr str) {
@@ -69,6 +75,11 @@ static constexpr cstr lslash(cstr str) {
     throw nebula::common::NebulaException(__NFILE__, __LINE__, __FUNCTION__, "RuntimeError", MSG); \
   })
 
+#define THROW_MEMORY_EXCEEDED(MSG)                                                                           \
+  ({                                                                                                         \
+    throw nebula::common::MemoryExceededException(__NFILE__, __LINE__, __FUNCTION__, "MemoryExceeded", MSG); \
+  })
+
 #define THROW_IF_NOT_EXP(EXP, MSG)                                       \
   ({                                                                     \
     if (!(EXP)) {                                                        \
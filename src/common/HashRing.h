@@ -292,6 +292,28 @@ public:
 
 #undef DATA_OP
 
+  // locate the node owning given data key without attaching the key.
+  // bounded-load variant: walk the ring clockwise from the key's placement and
+  // return the first node accepted by the filter, e.g. a node not reaching its capacity.
+  // falls back to the owner node if every node is rejected.
+  template <typename F>
+  const NT& locate(const std::string& key, F&& accept) const {
+    N_ENSURE(!placements_.empty(), "locate on an empty ring");
+    const auto start = place(hash(key));
+    for (size_t i = start, size = placements_.size(); i < start + size; ++i) {
+      const auto& node = placements_.at(i % size).node->resource();
+      if (accept(node)) {
+        return node;
+      }
+    }
+
+    return placements_.at(start).node->resource();
+  }
+
+  inline const NT& locate(const std::string& key) const {
+    return locate(key, [](const NT&) { return true; });
+  }
+
   inline size_t numNodes() const {
     return nodes_.size();
   }
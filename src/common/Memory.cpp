@@ -16,56 +16,333 @@
 
 #include "Memory.h"
 
+#include <algorithm>
 #include <gflags/gflags.h>
 #include <lz4.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <zstd.h>
 
+#include "BitPack.h"
 #include "Bits.h"
 
 DEFINE_bool(ALLOC_CHECK, false, "check allocation and fail it grows too much");
+DEFINE_uint64(NODE_MEMORY_LIMIT, 0, "memory in bytes all queries can use in this process, 0 to use 3/4 of physical memory");
+DEFINE_uint64(QUERY_MEMORY_LIMIT, 8UL << 30, "memory in bytes a single query can use in this process, 0 for no limit");
+DEFINE_int32(ZSTD_LEVEL, 3, "zstd compression level of pages");
+DEFINE_uint32(CODEC_SAMPLE, 16384, "bytes of the first page sampled to choose codec of a paged slice");
+DEFINE_double(CODEC_MIN_SAVING, 0.1, "pages are kept raw if compression saves less than this ratio");
+DEFINE_double(ZSTD_MIN_GAIN, 0.25, "pages use zstd if it is smaller than lz4 by this ratio");
+DEFINE_uint64(POOL_THREAD_CACHE, 32UL << 20, "bytes of free query chunks cached by each thread, 0 to disable the caches");
+DEFINE_uint64(POOL_DEPOT, 512UL << 20, "bytes of free query chunks shared by all threads");
+DEFINE_bool(HUGE_PAGES, true, "align chunks of 2MB or more to huge pages and advise transparent huge pages for them");
 
 namespace nebula {
 namespace common {
 
+// budget bound to current thread
+static thread_local std::shared_ptr<MemoryBudget> CURRENT_BUDGET;
+
+const std::shared_ptr<MemoryBudget>& MemoryBudget::node() {
+  static const auto budget = []() {
+    auto limit = FLAGS_NODE_MEMORY_LIMIT;
+    if (limit == 0) {
+      limit = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGE_SIZE) / 4 * 3;
+    }
+
+    LOG(INFO) << "Memory limit of all queries: " << limit;
+    return std::make_shared<MemoryBudget>(limit);
+  }();
+
+  return budget;
+}
+
+std::shared_ptr<MemoryBudget> MemoryBudget::query() {
+  return std::make_shared<MemoryBudget>(FLAGS_QUERY_MEMORY_LIMIT, node());
+}
+
+const std::shared_ptr<MemoryBudget>& MemoryBudget::current() noexcept {
+  return CURRENT_BUDGET;
+}
+
+MemoryScope::MemoryScope(std::shared_ptr<MemoryBudget> budget) noexcept
+  : previous_{ std::exchange(CURRENT_BUDGET, std::move(budget)) } {}
+
+MemoryScope::~MemoryScope() noexcept {
+  CURRENT_BUDGET = std::move(previous_);
+}
+
+// size classes of query chunks, 4 classes in every power of 2 from 1KB to 64MB, so at most 25% is unused.
+// smaller chunks are cheap enough in malloc, larger ones are rare and grow by realloc.
+static constexpr size_t MIN_CHUNK_BITS = 10;
+static constexpr size_t MAX_CHUNK_BITS = 26;
+static constexpr size_t CLASSES = (MAX_CHUNK_BITS - MIN_CHUNK_BITS) * 4;
+static constexpr size_t NO_CLASS = CLASSES;
+
+static inline size_t classOf(size_t size) {
+  if (size <= (1UL << MIN_CHUNK_BITS) || size > (1UL << MAX_CHUNK_BITS)) {
+    return NO_CLASS;
+  }
+
+  // highest bit and the 2 bits following it
+  const size_t n = size - 1;
+  const size_t bits = 63 - __builtin_clzl(n);
+  return (bits - MIN_CHUNK_BITS) * 4 + ((n >> (bits - 2)) & 3);
+}
+
+static inline size_t capacityOf(size_t cls) {
+  return (5 + cls % 4) << (cls / 4 + MIN_CHUNK_BITS - 2);
+}
+
+// push without throwing, false if it runs out of memory
+template <typename T>
+static inline bool push(std::vector<T>& stack, T value) noexcept {
+  try {
+    stack.push_back(value);
+    return true;
+  } catch (const std::bad_alloc&) {
+    return false;
+  }
+}
+
+// large chunks start at a huge page boundary and ask for transparent huge pages to cut TLB misses on scans.
+// it is only a hint, nothing changes if THP is disabled in the system.
+static constexpr size_t HUGE_PAGE = 2UL << 20;
+
+static void advise(void* p, size_t size) noexcept {
+  static const uintptr_t PAGE = ::sysconf(_SC_PAGESIZE);
+  const auto begin = (reinterpret_cast<uintptr_t>(p) + PAGE - 1) & ~(PAGE - 1);
+  const auto end = (reinterpret_cast<uintptr_t>(p) + size) & ~(PAGE - 1);
+  if (end > begin) {
+    ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE);
+  }
+}
+
+static void* hugeAlloc(size_t size) noexcept {
+  void* p = nullptr;
+  if (::posix_memalign(&p, HUGE_PAGE, size) != 0) {
+    return nullptr;
+  }
+
+  advise(p, size);
+  return p;
+}
+
+// header in front of every chunk
+struct alignas(16) Pool::Chunk {
+  size_t capacity;
+  size_t cls;
+};
+
+// free chunks cached by current thread, one stack per size class
+struct ThreadChunks {
+  ThreadChunks();
+  ~ThreadChunks();
+
+  std::vector<std::vector<void*>> chunks;
+  size_t bytes;
+};
+
+// chunks may be freed by other thread locals after the cache is gone at thread exit
+static thread_local int CHUNKS_STATE = 0;
+static thread_local ThreadChunks CHUNKS;
+
+ThreadChunks::ThreadChunks() : chunks(CLASSES), bytes{ 0 } {
+  CHUNKS_STATE = 1;
+}
+
+ThreadChunks::~ThreadChunks() {
+  CHUNKS_STATE = 2;
+  for (auto& stack : chunks) {
+    for (auto chunk : stack) {
+      std::free(chunk);
+    }
+  }
+}
+
+static inline ThreadChunks* threadChunks() noexcept {
+  return CHUNKS_STATE == 2 ? nullptr : &CHUNKS;
+}
+
+Pool::Pool()
+  : allocated_{ 0 }, extended_{ 0 }, freed_{ 0 }, reused_{ 0 }, depot_(CLASSES), depotBytes_{ 0 } {}
+
 Pool& Pool::getDefault() {
   static Pool pool;
   return pool;
 }
 
+size_t Pool::capacity(size_t size) noexcept {
+  const auto cls = MemoryBudget::current() ? classOf(size) : NO_CLASS;
+  return cls == NO_CLASS ? size : capacityOf(cls);
+}
+
+void* Pool::allocate(size_t size) {
+  allocated_.fetch_add(size, std::memory_order_relaxed);
+  return std::memset(acquire(size) + 1, 0, size);
+}
+
+void Pool::free(void* p, size_t size) {
+  freed_.fetch_add(size, std::memory_order_relaxed);
+  recycle(static_cast<Chunk*>(p) - 1);
+}
+
+void* Pool::extend(void* p, size_t size, size_t newSize) {
+  N_ENSURE_GT(newSize, size, "new size should be larger than original size");
+  auto chunk = static_cast<Chunk*>(p) - 1;
+  auto delta = newSize - size;
+  extended_.fetch_add(delta, std::memory_order_relaxed);
+
+  // room left in its size class, nothing to copy
+  if (newSize <= chunk->capacity) {
+    std::memset(static_cast<NByte*>(p) + size, 0, delta);
+    return p;
+  }
+
+  // a chunk without class is extended in place if possible, large ones may be remapped without copy
+  if (chunk->cls == NO_CLASS && (!MemoryBudget::current() || classOf(newSize) == NO_CLASS)) {
+    auto extended = static_cast<Chunk*>(std::realloc(chunk, sizeof(Chunk) + newSize));
+    if (UNLIKELY(!extended)) {
+      free(p, size);
+      throw std::bad_alloc();
+    }
+
+    extended->capacity = newSize;
+    if (FLAGS_HUGE_PAGES && newSize >= HUGE_PAGE) {
+      advise(extended, sizeof(Chunk) + newSize);
+    }
+
+    auto ptr = reinterpret_cast<NByte*>(extended + 1);
+    std::memset(ptr + size, 0, delta);
+    return ptr;
+  }
+
+  // move to a chunk of larger class
+  auto ptr = reinterpret_cast<NByte*>(acquire(newSize) + 1);
+  std::memcpy(ptr, p, size);
+  std::memset(ptr + size, 0, delta);
+  recycle(chunk);
+  return ptr;
+}
+
+Pool::Chunk* Pool::acquire(size_t size) {
+  // only chunks of queries are in size classes, chunks of blocks live long in their exact size
+  const auto cls = MemoryBudget::current() ? classOf(size) : NO_CLASS;
+  if (cls != NO_CLASS) {
+    auto cache = threadChunks();
+    if (cache && (!cache->chunks[cls].empty() || refill(cls))) {
+      auto& stack = cache->chunks[cls];
+      auto chunk = static_cast<Chunk*>(stack.back());
+      stack.pop_back();
+      cache->bytes -= chunk->capacity;
+      reused_.fetch_add(chunk->capacity, std::memory_order_relaxed);
+      return chunk;
+    }
+  }
+
+  const auto capacity = cls == NO_CLASS ? size : capacityOf(cls);
+  const auto bytes = sizeof(Chunk) + capacity;
+  auto chunk = static_cast<Chunk*>(FLAGS_HUGE_PAGES && bytes >= HUGE_PAGE ? hugeAlloc(bytes) : std::malloc(bytes));
+  if (UNLIKELY(!chunk)) {
+    throw std::bad_alloc();
+  }
+
+  chunk->capacity = capacity;
+  chunk->cls = cls;
+  return chunk;
+}
+
+void Pool::recycle(Chunk* chunk) noexcept {
+  auto cache = threadChunks();
+  if (chunk->cls == NO_CLASS || cache == nullptr || FLAGS_POOL_THREAD_CACHE == 0) {
+    std::free(chunk);
+    return;
+  }
+
+  if (!push<void*>(cache->chunks[chunk->cls], chunk)) {
+    std::free(chunk);
+    return;
+  }
+
+  cache->bytes += chunk->capacity;
+  if (cache->bytes > FLAGS_POOL_THREAD_CACHE) {
+    spill();
+  }
+}
+
+bool Pool::refill(size_t cls) noexcept {
+  auto& stack = CHUNKS.chunks[cls];
+  std::lock_guard<std::mutex> lock(depotMux_);
+  auto& shared = depot_[cls];
+  if (shared.empty()) {
+    return false;
+  }
+
+  // take a few at once so the lock is not taken for every chunk
+  const auto capacity = capacityOf(cls);
+  auto count = std::min(shared.size(), std::max<size_t>(1, FLAGS_POOL_THREAD_CACHE / 4 / capacity));
+  try {
+    stack.insert(stack.end(), shared.end() - count, shared.end());
+  } catch (const std::bad_alloc&) {
+    return false;
+  }
+
+  shared.resize(shared.size() - count);
+  depotBytes_ -= count * capacity;
+  CHUNKS.bytes += count * capacity;
+  return true;
+}
+
+void Pool::spill() noexcept {
+  // move larger chunks first until the thread keeps half of its cache
+  auto& cache = CHUNKS;
+  std::lock_guard<std::mutex> lock(depotMux_);
+  for (size_t cls = CLASSES; cls > 0 && cache.bytes > FLAGS_POOL_THREAD_CACHE / 2; --cls) {
+    auto& stack = cache.chunks[cls - 1];
+    auto& shared = depot_[cls - 1];
+    const auto capacity = capacityOf(cls - 1);
+    while (!stack.empty() && cache.bytes > FLAGS_POOL_THREAD_CACHE / 2) {
+      auto chunk = stack.back();
+      stack.pop_back();
+      cache.bytes -= capacity;
+
+      // depot is full, release it to the system
+      if (depotBytes_ + capacity > FLAGS_POOL_DEPOT || !push(shared, static_cast<Chunk*>(chunk))) {
+        std::free(chunk);
+        continue;
+      }
+
+      depotBytes_ += capacity;
+    }
+  }
+}
+
 // not-threadsafe
 void ExtendableSlice::ensure(size_t size) {
   // increase 10 slices requests, logging warning, increase over 30 slices requests, logging error.
   static constexpr size_t errors[] = { 50, 100 };
   if (UNLIKELY(size >= capacity())) {
-    // TODO(cao): a bit prediction here, is this effective?
-    // OR we just need real paged slices without continous memory chunk
-    if (numExtended_ > 4) {
-      // give 2 times of what asked
-      size *= 2;
-    } else if (numExtended_ > 8) {
-      size *= 4;
-    } else if (numExtended_ > 16) {
-      size *= 8;
-    }
-
-    auto slices = slices_;
-    while (slices * size_ <= size) {
-      ++slices;
-
-      if (FLAGS_ALLOC_CHECK) {
-        auto detects = slices - slices_;
-        if (detects >= errors[0]) {
-          LOG(WARNING) << "Slices increased too fast in single request";
-
-          // over error bound - fail it
-          if (UNLIKELY(detects > errors[1])) {
-            LOG(FATAL) << fmt::format(
-              "Slices grows too fast: page size ({0}) too small or allocation leak towards {1}", size_, size);
-          }
+    // slices needed by this request
+    const auto required = size / size_ + 1;
+    if (FLAGS_ALLOC_CHECK) {
+      auto detects = required - slices_;
+      if (detects >= errors[0]) {
+        LOG(WARNING) << "Slices increased too fast in single request";
+
+        // over error bound - fail it
+        if (UNLIKELY(detects > errors[1])) {
+          LOG(FATAL) << fmt::format(
+            "Slices grows too fast: page size ({0}) too small or allocation leak towards {1}", size_, size);
         }
       }
     }
 
+    // grow by half of current slices at least, so a growing slice is moved O(log n) times,
+    // and it is extended in place while it fits in its size class of the pool.
+    auto slices = std::max(required, slices_ + slices_ / 2);
     N_ENSURE_GT(slices, slices_, "required slices should be more than existing capacity");
+    // a chunk extended in place keeps its capacity charged already
+    recharge(std::max(charged_, Pool::capacity(slices * size_)));
     ++numExtended_;
     this->ptr_ = static_cast<NByte*>(this->pool_.extend(this->ptr_, capacity(), slices * size_));
     std::swap(slices, slices_);
@@ -106,6 +383,7 @@ void ExtendableSlice::seal(size_t max) {
       pool_.free(static_cast<void*>(ptr_), size_);
       ptr_ = static_cast<NByte*>(buffer);
       size_ = max;
+      recharge(Pool::capacity(max));
     }
   }
 }
@@ -198,9 +476,7 @@ std::string_view PagedSlice::read(size_t position, size_t size) const {
 
   // because we make sure every single element is captured in single block
   // so we don't have single item across block
-  if (!read_.include(position)) {
-    uncompress(position);
-  }
+  locate(position);
 
   // build data using copy elision
   // note that, we're returning a string view on top of current buffer
@@ -217,6 +493,7 @@ void PagedSlice::ensure(size_t size) {
       newSize *= 2;
     }
 
+    recharge(std::max(charged_, Pool::capacity(newSize)));
     ptr_ = static_cast<NByte*>(pool_.extend(ptr_, size_, newSize));
     size_ = newSize;
   }
@@ -229,8 +506,15 @@ void PagedSlice::seal() {
   // if buffer is valid
   N_ENSURE(ownbuffer_, "buffer is owned");
 
+  // last page of integers is encoded too, it is usually the only page of a small block
+  if (width_ > 0 && codec_ != PageCodec::NONE && write_.size > 0) {
+    compress(write_.offset + write_.size);
+  }
+
+  single_ = write_.size == 0 && !blocks_.empty() && std::next(blocks_.begin()) == blocks_.end();
+
   // we are asking at least keep a word in the buffer
-  const auto validSize = write_.size;
+  const auto validSize = std::max(write_.size, (uint32_t)sizeof(size_t));
   auto wasted = size_ - validSize;
   // wasted is more than valid or absolute value is more than 4KB
   // let's reclaim it
@@ -238,11 +522,60 @@ void PagedSlice::seal() {
     // Do we need alignment here to improvement fragmentation?
     auto buffer = pool_.allocate(validSize);
     N_ENSURE_NOT_NULL(buffer, "buffer not null");
-    std::memcpy(buffer, ptr_, validSize);
+    std::memcpy(buffer, ptr_, write_.size);
     pool_.free(static_cast<void*>(ptr_), size_);
     ptr_ = static_cast<NByte*>(buffer);
     size_ = validSize;
+    recharge(Pool::capacity(validSize));
+  }
+}
+
+void PagedSlice::persist(BinaryWriter& writer) const {
+  writer.write<uint8_t>((uint8_t)codec_);
+  writer.write<uint64_t>(width_);
+  writer.write<uint32_t>(write_.offset);
+  writer.write<uint32_t>(write_.size);
+  writer.blob(ptr_, write_.size);
+
+  // pages in the order of the chain
+  writer.write<uint64_t>(std::distance(blocks_.begin(), blocks_.end()));
+  for (const auto& block : blocks_) {
+    writer.write<uint32_t>(block.range.offset);
+    writer.write<uint32_t>(block.range.size);
+    writer.write<uint8_t>((uint8_t)block.encoding);
+    writer.blob(block.data->ptr(), block.data->size());
+  }
+}
+
+void PagedSlice::restore(BinaryReader& reader) {
+  N_ENSURE(blocks_.empty(), "restoring into a slice without pages only");
+  codec_ = (PageCodec)reader.read<uint8_t>();
+  width_ = reader.read<uint64_t>();
+  write_.offset = reader.read<uint32_t>();
+  write_.size = reader.read<uint32_t>();
+
+  // write buffer is copied as it is the only mutable part, sized as a sealed slice
+  auto buffer = reader.blob();
+  const auto size = std::max(buffer.size(), sizeof(size_t));
+  auto ptr = static_cast<NByte*>(pool_.allocate(size));
+  std::memcpy(ptr, buffer.data(), buffer.size());
+  pool_.free(static_cast<void*>(ptr_), size_);
+  ptr_ = ptr;
+  size_ = size;
+  recharge(Pool::capacity(size));
+
+  auto tail = blocks_.before_begin();
+  for (size_t i = 0, count = reader.read<uint64_t>(); i < count; ++i) {
+    const auto offset = reader.read<uint32_t>();
+    const auto length = reader.read<uint32_t>();
+    const auto encoding = (PageEncoding)reader.read<uint8_t>();
+    auto data = reader.blob();
+    tail = blocks_.emplace_after(
+      tail, CRange{ offset, length }, encoding, std::make_unique<OneSlice>((const NByte*)data.data(), data.size()));
   }
+
+  read_ = CRange{ 0, 0 };
+  single_ = write_.size == 0 && !blocks_.empty() && std::next(blocks_.begin()) == blocks_.end();
 }
 
 // compress current buffer and link it to the chain
@@ -253,24 +586,45 @@ void PagedSlice::compress(size_t position) {
   // output should be maximum size of input
   const auto srcSize = write_.size;
 
-  // try to compress it
-  auto slice = std::make_unique<OneSlice>(srcSize);
-  // if codec is not-compressed, we just put this slice in
-  if (type_ == folly::io::CodecType::NO_COMPRESSION) {
-    std::memcpy(slice->ptr(), ptr_, srcSize);
-    blocks_.emplace_front(write_, false, std::move(slice));
+  // integers in a narrow range are bit packed instead, they decode much faster than LZ4
+  std::unique_ptr<OneSlice> packed;
+  if (codec_ != PageCodec::NONE && srcSize % std::max<size_t>(width_, 1) == 0) {
+    switch (width_) {
+    case 2: packed = pack<int16_t>(); break;
+    case 4: packed = pack<int32_t>(); break;
+    case 8: packed = pack<int64_t>(); break;
+    default: break;
+    }
+  }
+
+  if (packed) {
+    blocks_.emplace_front(write_, PageEncoding::PACKED, std::move(packed));
   } else {
-    auto compressedSize = LZ4_compress_default((char*)ptr_, (char*)slice->ptr(), srcSize, srcSize);
+    // the codec of a slice is decided by its first page not packed
+    if (codec_ == PageCodec::AUTO) {
+      codec_ = choose();
+    }
+
+    // try to compress it, size 0 means not compressed or not good to compress
+    auto slice = std::make_unique<OneSlice>(srcSize);
+    size_t compressedSize = 0;
+    if (codec_ == PageCodec::ZSTD) {
+      // output not fitting in raw size is reported as an error
+      compressedSize = ZSTD_compress(slice->ptr(), srcSize, ptr_, srcSize, FLAGS_ZSTD_LEVEL);
+      compressedSize = ZSTD_isError(compressedSize) ? 0 : compressedSize;
+    } else if (codec_ == PageCodec::LZ4) {
+      compressedSize = LZ4_compress_default((char*)ptr_, (char*)slice->ptr(), srcSize, srcSize);
+    }
 
-    // not good to compress, keep it as raw
     if (compressedSize == 0) {
       std::memcpy(slice->ptr(), ptr_, srcSize);
-      blocks_.emplace_front(write_, false, std::move(slice));
+      blocks_.emplace_front(write_, PageEncoding::RAW, std::move(slice));
     } else {
       // copy into a smaller buffer
       auto fit = std::make_unique<OneSlice>(compressedSize);
       std::memcpy(fit->ptr(), slice->ptr(), compressedSize);
-      blocks_.emplace_front(write_, true, std::move(fit));
+      blocks_.emplace_front(
+        write_, codec_ == PageCodec::ZSTD ? PageEncoding::ZSTD : PageEncoding::LZ4, std::move(fit));
     }
   }
 
@@ -288,22 +642,16 @@ void PagedSlice::uncompress(size_t position) const {
   // otherwise this linear loop might require optimization for fast locating.
   for (auto& block : blocks_) {
     if (block.range.include(position)) {
-      // TODO(cao) - I was looking for an interface to use existing buffer to hold the raw data
-      // auto raw = codec_->uncompress(, block.range.size);
-      auto compressedSize = block.data->size();
-
-      N_ENSURE(type_ == folly::io::CodecType::NO_COMPRESSION || type_ == folly::io::CodecType::LZ4,
-               "only supporting LZ4 or NONE for now");
-      if (block.compressed) {
-        // prepare the read buffer for this block
-        if (buffer_ == nullptr || buffer_->size() < block.range.size) {
-          auto buffer = std::make_unique<OneSlice>(block.range.size);
-          buffer.swap(const_cast<std::unique_ptr<OneSlice>&>(buffer_));
+      // every page records its own encoding, so pages of different codecs can be read
+      if (block.encoding == PageEncoding::PACKED) {
+        switch (width_) {
+        case 2: unpack<int16_t>(block); break;
+        case 4: unpack<int32_t>(block); break;
+        case 8: unpack<int64_t>(block); break;
+        default: throw NException("packed block without integer width");
         }
-
-        auto ret = (uint32_t)LZ4_decompress_safe((char*)block.data->ptr(), (char*)buffer_->ptr(), compressedSize, buffer_->size());
-        N_ENSURE_EQ(ret, block.range.size, "raw data size mismatches.");
-        *const_cast<NByte**>(&bufferPtr_) = buffer_->ptr();
+      } else if (block.encoding == PageEncoding::LZ4 || block.encoding == PageEncoding::ZSTD) {
+        decompress(block);
       } else {
         *const_cast<NByte**>(&bufferPtr_) = block.data->ptr();
       }
@@ -317,5 +665,113 @@ void PagedSlice::uncompress(size_t position) const {
   throw NException(fmt::format("invalid position to uncompress: {0}", position));
 }
 
+void PagedSlice::decompress(const CompressionBlock& block) const {
+  // prepare the read buffer for this block, it lives with the slice
+  // rather than the query reading it, so it is not charged to the query budget.
+  if (buffer_ == nullptr || buffer_->size() < block.range.size) {
+    MemoryScope scope(nullptr);
+    auto buffer = std::make_unique<OneSlice>(block.range.size);
+    buffer.swap(const_cast<std::unique_ptr<OneSlice>&>(buffer_));
+  }
+
+  auto compressedSize = block.data->size();
+  size_t ret = 0;
+  if (block.encoding == PageEncoding::ZSTD) {
+    ret = ZSTD_decompress(buffer_->ptr(), buffer_->size(), block.data->ptr(), compressedSize);
+    N_ENSURE(!ZSTD_isError(ret), "zstd decompression failed");
+  } else {
+    ret = (uint32_t)LZ4_decompress_safe((char*)block.data->ptr(), (char*)buffer_->ptr(), compressedSize, buffer_->size());
+  }
+
+  N_ENSURE_EQ(ret, block.range.size, "raw data size mismatches.");
+  *const_cast<NByte**>(&bufferPtr_) = buffer_->ptr();
+}
+
+// dense data such as hashes or uuids gains little from any codec and is kept raw,
+// zstd is picked only if it saves notably more than lz4 as it decodes a few times slower
+PageCodec PagedSlice::choose() const {
+  const auto size = std::min<size_t>(write_.size, FLAGS_CODEC_SAMPLE);
+  if (size == 0) {
+    return PageCodec::LZ4;
+  }
+
+  OneSlice sample(ZSTD_compressBound(size));
+  auto lz4 = (size_t)LZ4_compress_default((char*)ptr_, (char*)sample.ptr(), size, sample.size());
+  if (lz4 == 0 || lz4 > size * (1 - FLAGS_CODEC_MIN_SAVING)) {
+    return PageCodec::NONE;
+  }
+
+  auto zstd = ZSTD_compress(sample.ptr(), sample.size(), ptr_, size, FLAGS_ZSTD_LEVEL);
+  if (!ZSTD_isError(zstd) && zstd < lz4 * (1 - FLAGS_ZSTD_MIN_GAIN)) {
+    return PageCodec::ZSTD;
+  }
+
+  return PageCodec::LZ4;
+}
+
+PageCodec PagedSlice::codec(const std::string& name) {
+  if (name == "none") {
+    return PageCodec::NONE;
+  }
+
+  if (name == "lz4") {
+    return PageCodec::LZ4;
+  }
+
+  if (name == "zstd") {
+    return PageCodec::ZSTD;
+  }
+
+  N_ENSURE(name == "auto", fmt::format("unknown codec: {0}", name));
+  return PageCodec::AUTO;
+}
+
+// a packed block starts with its base and bits, followed by packed words
+struct PackedHeader {
+  int64_t base;
+  uint64_t bits;
+};
+
+template <typename T>
+std::unique_ptr<OneSlice> PagedSlice::pack() const {
+  const auto values = reinterpret_cast<const T*>(ptr_);
+  const auto n = write_.size / sizeof(T);
+  if (n == 0) {
+    return nullptr;
+  }
+
+  const auto [min, max] = std::minmax_element(values, values + n);
+  using U = std::make_unsigned_t<T>;
+  const auto bits = BitPack::bits((U)((U)*max - (U)*min));
+  if (bits * 2 > sizeof(T) * 8) {
+    return nullptr;
+  }
+
+  auto slice = std::make_unique<OneSlice>(sizeof(PackedHeader) + BitPack::bytes(n, bits));
+  const PackedHeader header{ (int64_t)*min, bits };
+  std::memcpy(slice->ptr(), &header, sizeof(PackedHeader));
+  BitPack::pack(values, n, *min, bits, reinterpret_cast<uint64_t*>(slice->ptr() + sizeof(PackedHeader)));
+  return slice;
+}
+
+template <typename T>
+void PagedSlice::unpack(const CompressionBlock& block) const {
+  if (buffer_ == nullptr || buffer_->size() < block.range.size) {
+    MemoryScope scope(nullptr);
+    auto buffer = std::make_unique<OneSlice>(block.range.size);
+    buffer.swap(const_cast<std::unique_ptr<OneSlice>&>(buffer_));
+  }
+
+  PackedHeader header;
+  std::memcpy(&header, block.data->ptr(), sizeof(PackedHeader));
+  BitPack::unpack(
+    reinterpret_cast<const uint64_t*>(block.data->ptr() + sizeof(PackedHeader)),
+    block.range.size / sizeof(T),
+    (T)header.base,
+    (uint8_t)header.bits,
+    reinterpret_cast<T*>(buffer_->ptr()));
+  *const_cast<NByte**>(&bufferPtr_) = buffer_->ptr();
+}
+
 } // namespace common
 } // namespace nebula
\ No newline at end of file
@@ -16,12 +16,17 @@
 
 #pragma once
 
+#include <atomic>
 #include <folly/compression/Compression.h>
 #include <forward_list>
 #include <glog/logging.h>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <numeric>
+#include <vector>
 
+#include "Binary.h"
 #include "Errors.h"
 #include "Hash.h"
 #include "Int128.h"
@@ -46,51 +51,180 @@
 namespace nebula {
 namespace common {
 
-// maintain a memory pool tracking memory chunks
-// it gurantees memory are set to 0 for all allocated chunks through `memset`.
-class Pool {
+// memory budget of a query or the whole process.
+// memory chunks (slices, row indexes) are charged when allocated or extended and released when freed,
+// so the cost is a couple of atomics per chunk rather than per row.
+// a query budget charges its parent (node) budget as well, either limit can fail a charge.
+class MemoryBudget {
 public:
-  virtual ~Pool() = default;
+  explicit MemoryBudget(size_t limit, std::shared_ptr<MemoryBudget> parent = nullptr)
+    : limit_{ limit }, parent_{ std::move(parent) }, used_{ 0 }, peak_{ 0 }, exceeded_{ false } {}
+  virtual ~MemoryBudget() = default;
+
+  // budget of this process shared by all queries, limited by NODE_MEMORY_LIMIT
+  static const std::shared_ptr<MemoryBudget>& node();
+
+  // a new query budget limited by QUERY_MEMORY_LIMIT under the node budget
+  static std::shared_ptr<MemoryBudget> query();
+
+  // budget that new chunks of calling thread are charged to, null if no query bound to the thread
+  static const std::shared_ptr<MemoryBudget>& current() noexcept;
+
+public:
+  // charge bytes, return false without charging anything if it exceeds any limit
+  bool tryCharge(size_t bytes) noexcept {
+    if (reserve(bytes)) {
+      return true;
+    }
+
+    exceeded_.store(true, std::memory_order_relaxed);
+    return false;
+  }
+
+  // charge bytes or throw MemoryExceededException
+  inline void charge(size_t bytes) {
+    if (UNLIKELY(!tryCharge(bytes))) {
+      THROW_MEMORY_EXCEEDED(fmt::format("Query memory budget exceeded: charging {0} bytes on {1}", bytes, report()));
+    }
+  }
+
+  void release(size_t bytes) noexcept {
+    used_.fetch_sub(bytes, std::memory_order_relaxed);
+    if (parent_) {
+      parent_->release(bytes);
+    }
+  }
+
+  // mark this budget exceeded, such as a remote part of the query ran out of memory
+  inline void exceed() noexcept {
+    exceeded_.store(true, std::memory_order_relaxed);
+  }
+
+  inline bool exceeded() const noexcept {
+    return exceeded_.load(std::memory_order_relaxed);
+  }
+
+  // fail current task if any charge of the budget has failed
+  inline void check() const {
+    if (UNLIKELY(exceeded())) {
+      THROW_MEMORY_EXCEEDED(fmt::format("Query memory budget exceeded: {0}", report()));
+    }
+  }
+
+  inline size_t used() const noexcept {
+    return used_.load(std::memory_order_relaxed);
+  }
+
+  inline size_t peak() const noexcept {
+    return peak_.load(std::memory_order_relaxed);
+  }
+
+  // 0 means unlimited
+  inline size_t limit() const noexcept {
+    return limit_;
+  }
 
-  inline void* allocate(size_t size) {
-    allocated_ += size;
-    return std::memset(std::malloc(size), 0, size);
+  // highest usage ratio of this budget and its parents, 0 if none is limited
+  double pressure() const noexcept {
+    auto ratio = limit_ > 0 ? (double)used() / limit_ : 0;
+    return parent_ ? std::max(ratio, parent_->pressure()) : ratio;
   }
 
-  inline void free(void* p, size_t size) {
-    freed_ += size;
-    std::free(p);
+  std::string report() const {
+    return fmt::format("used:{0}, peak:{1}, limit:{2}", used(), peak(), limit_);
   }
 
-  void* extend(void* p, size_t size, size_t newSize) {
-    N_ENSURE_GT(newSize, size, "new size should be larger than original size");
+private:
+  bool reserve(size_t bytes) noexcept {
+    auto now = used_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    if ((limit_ > 0 && now > limit_) || (parent_ && !parent_->reserve(bytes))) {
+      used_.fetch_sub(bytes, std::memory_order_relaxed);
+      return false;
+    }
 
-    // extend the memory if possible
-    NByte* newP = (NByte*)std::realloc(p, newSize);
-    if (UNLIKELY(!newP)) {
-      free(p, size);
-      throw std::bad_alloc();
+    auto peak = peak_.load(std::memory_order_relaxed);
+    while (now > peak && !peak_.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
     }
 
-    auto delta = newSize - size;
-    extended_ += delta;
-    std::memset(newP + size, 0, delta);
-    return newP;
+    return true;
   }
 
+private:
+  const size_t limit_;
+  const std::shared_ptr<MemoryBudget> parent_;
+  std::atomic<size_t> used_;
+  std::atomic<size_t> peak_;
+  std::atomic<bool> exceeded_;
+};
+
+// bind a budget to current thread in a scope, chunks allocated in the scope are charged to it.
+// the previous binding is restored when the scope ends, so scopes can be nested.
+class MemoryScope {
+public:
+  explicit MemoryScope(std::shared_ptr<MemoryBudget>) noexcept;
+  ~MemoryScope() noexcept;
+
+  MemoryScope(const MemoryScope&) = delete;
+  MemoryScope& operator=(const MemoryScope&) = delete;
+
+private:
+  std::shared_ptr<MemoryBudget> previous_;
+};
+
+// maintain a memory pool tracking memory chunks
+// it gurantees memory are set to 0 for all allocated chunks through `memset`.
+// chunks allocated for a query (a budget is bound to the thread) are rounded up to size classes,
+// freed ones are cached by the freeing thread and a shared depot, so the next query reuses them
+// without taking allocator locks or faulting in new pages.
+// every chunk has a header of its class and capacity, so it is freed and extended by its real capacity.
+class Pool {
+public:
+  virtual ~Pool() = default;
+
+  void* allocate(size_t size);
+
+  void free(void* p, size_t size);
+
+  void* extend(void* p, size_t size, size_t newSize);
+
   std::string report() const {
-    return fmt::format("Allocated:{0}, Extended:{1}, Freed:{2}", allocated_, extended_, freed_);
+    return fmt::format("Allocated:{0}, Extended:{1}, Freed:{2}, Reused:{3}",
+                       allocated_.load(std::memory_order_relaxed),
+                       extended_.load(std::memory_order_relaxed),
+                       freed_.load(std::memory_order_relaxed),
+                       reused_.load(std::memory_order_relaxed));
   }
 
   static Pool& getDefault();
 
+  // bytes taken by a chunk of given size allocated in current thread, the capacity of its size class if it has one.
+  // chunks are charged to query budgets by this, so rounding up to size classes is accounted.
+  static size_t capacity(size_t size) noexcept;
+
 private:
-  // TODO(cao): a start point of pool impl, need a better pool management
-  Pool() : allocated_{ 0 }, extended_{ 0 }, freed_{ 0 } {}
+  struct Chunk;
+
+  Pool();
+
+  // get a chunk of given size, from caches if it has a size class
+  Chunk* acquire(size_t);
 
-  size_t allocated_;
-  size_t extended_;
-  size_t freed_;
+  // put a chunk back to caches if it has a size class, otherwise free it
+  void recycle(Chunk*) noexcept;
+
+  // move chunks of a size class from the depot to current thread, or from current thread to the depot
+  bool refill(size_t) noexcept;
+  void spill() noexcept;
+
+  std::atomic<size_t> allocated_;
+  std::atomic<size_t> extended_;
+  std::atomic<size_t> freed_;
+  std::atomic<size_t> reused_;
+
+  // free chunks shared by all threads, one stack per size class
+  std::mutex depotMux_;
+  std::vector<std::vector<Chunk*>> depot_;
+  size_t depotBytes_;
 };
 
 enum class SliceType {
@@ -112,6 +246,10 @@ public:
       } else {
         LOG(ERROR) << "A slice should hold a valid pointer";
       }
+
+      if (budget_) {
+        budget_->release(charged_);
+      }
     }
   }
 
@@ -123,6 +261,11 @@ public:
     return ptr_;
   }
 
+  // false if it is a view of an external buffer, such as a mapped file
+  inline bool owned() const {
+    return ownbuffer_;
+  }
+
   inline void reset() const {
     std::memset(ptr_, 0, size_);
   }
@@ -130,16 +273,48 @@ public:
 protected:
   // A read-only slice!! wrapping an external buffer but not owning it
   Slice(const NByte* buffer, size_t size, bool own = false)
-    : pool_{ Pool::getDefault() }, size_{ size }, ptr_{ const_cast<NByte*>(buffer) }, ownbuffer_{ own } {}
-  Slice(size_t size) : pool_{ Pool::getDefault() }, size_{ size }, ptr_{ static_cast<NByte*>(pool_.allocate(size)) }, ownbuffer_{ true } {}
+    : pool_{ Pool::getDefault() }, charged_{ 0 }, size_{ size }, ptr_{ const_cast<NByte*>(buffer) }, ownbuffer_{ own } {}
+  Slice(size_t size)
+    : pool_{ Pool::getDefault() },
+      budget_{ MemoryBudget::current() },
+      charged_{ charge(budget_, Pool::capacity(size)) },
+      size_{ size },
+      ptr_{ static_cast<NByte*>(pool_.allocate(size)) },
+      ownbuffer_{ true } {}
   Slice(Slice&) = delete;
   Slice(Slice&&) = delete;
   Slice& operator=(Slice&) = delete;
   Slice& operator=(Slice&&) = delete;
 
+  // charge a chunk to the budget before allocating it, it throws if over budget
+  static inline size_t charge(const std::shared_ptr<MemoryBudget>& budget, size_t size) {
+    if (budget) {
+      budget->charge(size);
+    }
+
+    return size;
+  }
+
+  // adjust charged bytes after the buffer is resized
+  inline void recharge(size_t bytes) {
+    if (bytes > charged_) {
+      charge(budget_, bytes - charged_);
+    } else if (budget_) {
+      budget_->release(charged_ - bytes);
+    }
+
+    charged_ = bytes;
+  }
+
   // memory pool implementation
   Pool& pool_;
 
+  // budget of the query which allocates this slice, if any
+  std::shared_ptr<MemoryBudget> budget_;
+
+  // bytes charged to the budget
+  size_t charged_;
+
   // size of current buffer
   size_t size_;
 
@@ -153,6 +328,8 @@ protected:
 class OneSlice : public Slice {
 public:
   OneSlice(size_t size) : Slice{ size } {}
+  // a read-only slice of an external buffer such as a page of a mapped file
+  OneSlice(const NByte* buffer, size_t size) : Slice{ buffer, size } {}
   ~OneSlice() = default;
 };
 
@@ -323,15 +500,108 @@ class PagedSlice;
 using PRange = Range<ExtendableSlice>;
 using CRange = Range<PagedSlice>;
 
+// a 16 bytes string slot: 4 bytes size, first 4 bytes of the string, and the next 8 bytes inline
+// if the string is no longer than 12 bytes, otherwise offset of the whole string in a data slice.
+// unused bytes are zero, so inline strings are compared and hashed by their slots only,
+// and long strings differing in size or prefix never touch the data slice.
+struct InlineString {
+  static constexpr size_t WIDTH = 16;
+  static constexpr size_t PREFIX = 4;
+  static constexpr size_t INLINE = 12;
+
+  uint32_t size;
+  char prefix[PREFIX];
+  // bytes after prefix for inline string, offset in data slice for long string
+  uint64_t rest;
+
+  inline bool isInline() const {
+    return size <= INLINE;
+  }
+
+  // write slot of a string at position, a long string is written into data at given offset.
+  // return number of bytes written into data.
+  static size_t write(ExtendableSlice& slice, size_t position, ExtendableSlice& data, size_t offset, std::string_view str) {
+    InlineString s{ (uint32_t)str.size(), {}, 0 };
+    std::memcpy(s.prefix, str.data(), std::min(str.size(), PREFIX));
+    size_t len = 0;
+    if (s.isInline()) {
+      if (str.size() > PREFIX) {
+        std::memcpy(&s.rest, str.data() + PREFIX, str.size() - PREFIX);
+      }
+    } else {
+      len = data.write(offset, str.data(), str.size());
+      s.rest = offset;
+    }
+
+    slice.write(position, reinterpret_cast<const NByte*>(&s), WIDTH);
+    return len;
+  }
+
+  static inline InlineString make(const ExtendableSlice& slice, size_t position) {
+    InlineString s;
+    std::memcpy(&s, slice.read(position, WIDTH).data(), WIDTH);
+    return s;
+  }
+
+  // read a string, inline bytes are read in place of its slot
+  static inline std::string_view read(const ExtendableSlice& slice, size_t position, const ExtendableSlice& data) {
+    auto s = make(slice, position);
+    return s.isInline() ? slice.read(position + sizeof(uint32_t), s.size) : data.read(s.rest, s.size);
+  }
+
+  // order by size then bytes, enough for equality and stable grouping
+  inline int compare(const InlineString& other, const ExtendableSlice& data) const {
+    if (size != other.size) {
+      return size < other.size ? -1 : 1;
+    }
+
+    auto c = std::memcmp(prefix, other.prefix, PREFIX);
+    if (c != 0 || size <= PREFIX) {
+      return c;
+    }
+
+    if (isInline()) {
+      return std::memcmp(&rest, &other.rest, sizeof(rest));
+    }
+
+    return std::memcmp(data.ptr() + rest, data.ptr() + other.rest, size);
+  }
+
+  inline size_t hash(const ExtendableSlice& data) const {
+    return isInline() ? Hasher::hash64(this, WIDTH) : Hasher::hash64(data.ptr() + rest, size);
+  }
+};
+
+static_assert(sizeof(InlineString) == InlineString::WIDTH, "inline string slot is 16 bytes");
+
 // compression buffer will manage a fixed size buffer
 // to receive input writes, when the buffer is full, it will compress it
 // and output the compressed bytes into the designated slice, reset the buffer.
 // it records the range of raw data for each compressed block
+enum class PageEncoding : uint8_t {
+  RAW,
+  LZ4,
+  // frame of reference and bit packing of integers, see BitPack
+  PACKED,
+  ZSTD
+};
+
+// codec to compress pages of a paged slice
+enum class PageCodec : uint8_t {
+  NONE,
+  // fast to decode, for hot columns
+  LZ4,
+  // denser at slower decoding, for cold columns
+  ZSTD,
+  // sample the first page to pick one of above for the slice
+  AUTO
+};
+
 struct CompressionBlock {
-  explicit CompressionBlock(CRange r, bool c, std::unique_ptr<OneSlice> d)
-    : range{ std::move(r) }, compressed{ c }, data{ std::move(d) } {}
+  explicit CompressionBlock(CRange r, PageEncoding e, std::unique_ptr<OneSlice> d)
+    : range{ std::move(r) }, encoding{ e }, data{ std::move(d) } {}
   CRange range;
-  bool compressed;
+  PageEncoding encoding;
   std::unique_ptr<OneSlice> data;
 };
 
@@ -339,16 +609,32 @@ class PagedSlice : public Slice {
   static constexpr auto EMPTY_STRING = "";
 
 public:
-  PagedSlice(size_t size, folly::io::CodecType type = folly::io::CodecType::LZ4)
+  PagedSlice(size_t size, PageCodec codec = PageCodec::AUTO)
     : Slice{ size },
       write_{ 0, 0 },
       read_{ 0, 0 },
-      type_{ type },
-      codec_{ folly::io::getCodec(type) } {
+      codec_{ codec },
+      width_{ 0 },
+      single_{ false } {
   }
   ~PagedSlice() = default;
 
+  // codec by its name: none, lz4, zstd or auto
+  static PageCodec codec(const std::string&);
+
 public:
+  // the codec used by pages, AUTO until the first page is compressed
+  inline PageCodec codec() const {
+    return codec_;
+  }
+
+  // values in this slice are signed integers of given width (2, 4 or 8 bytes),
+  // a compressed page is bit packed by frame of reference if its range is narrow
+  inline void pack(size_t width) {
+    N_ENSURE(width == 2 || width == 4 || width == 8, "packing 2, 4 or 8 bytes integers only");
+    width_ = width;
+  }
+
   // append a bytes array of length bytes to position
   inline size_t write(size_t position, const char* data, size_t length) {
     return write(position, (const NByte*)data, length);
@@ -374,9 +660,9 @@ public:
 
   // total memory allocation for current slice
   inline size_t size() const {
-    // 2*size_ to count for the read/write buffers
+    // 2*size_ to count for the read/write buffers, pages read in place of a file are not in memory
     return std::accumulate(blocks_.begin(), blocks_.end(), 2 * size_, [](size_t init, const CompressionBlock& b) {
-      return init + b.data->size();
+      return b.data->owned() ? init + b.data->size() : init;
     });
   }
 
@@ -394,9 +680,7 @@ public:
     }
 
     // check if position is in current range
-    if (!read_.include(position)) {
-      uncompress(position);
-    }
+    locate(position);
 
     // buffer index = position - range.offset
     return *reinterpret_cast<T*>(bufferPtr_ + position - read_.offset);
@@ -408,6 +692,13 @@ public:
   // seal the slice and no more writes expected
   void seal();
 
+  // write a sealed slice, its pages are written as they are
+  void persist(BinaryWriter&) const;
+
+  // restore a persisted slice into this new one,
+  // pages are not copied but read in place, so the reader's buffer has to outlive this slice
+  void restore(BinaryReader&);
+
 private:
   // ensure the buffer is big enough to hold single item
   void ensure(size_t);
@@ -420,6 +711,30 @@ private:
   // and load it into current buffer (ptr_)
   void uncompress(size_t) const;
 
+  // make the block covering given position current for reading.
+  // a sealed single page is decoded only once, so concurrent readers share it without racing.
+  inline void locate(size_t position) const {
+    if (single_) {
+      std::call_once(decoded_, [this, position]() { uncompress(position); });
+    } else if (!read_.include(position)) {
+      uncompress(position);
+    }
+  }
+
+  // choose codec by compressing a sample of current buffer
+  PageCodec choose() const;
+
+  // decompress a LZ4 or ZSTD block into read buffer
+  void decompress(const CompressionBlock&) const;
+
+  // bit pack current buffer as integers of type T, null if it doesn't save half of the space
+  template <typename T>
+  std::unique_ptr<OneSlice> pack() const;
+
+  // unpack a packed block into read buffer
+  template <typename T>
+  void unpack(const CompressionBlock&) const;
+
 private:
   // write index in current buffer
   CRange write_;
@@ -439,8 +754,14 @@ private:
   NByte* bufferPtr_;
 
   // the codec used to compress the buffer
-  folly::io::CodecType type_;
-  std::unique_ptr<folly::io::Codec> codec_;
+  PageCodec codec_;
+
+  // integer width to bit pack pages, 0 if not packable
+  size_t width_;
+
+  // sealed with one compressed page and nothing left in write buffer
+  bool single_;
+  mutable std::once_flag decoded_;
 };
 
 } // namespace common
@@ -0,0 +1,200 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Numa.h"
+
+#include <cctype>
+#include <fmt/format.h>
+#include <fstream>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <limits>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+DEFINE_bool(NUMA, true, "place block memory and block tasks by NUMA node, no-op on single node machines");
+DEFINE_bool(NUMA_PIN, true, "pin threads taking block tasks to a NUMA node");
+
+/**
+ * NUMA topology and placement.
+ */
+namespace nebula {
+namespace common {
+
+static constexpr auto NODE_DIR = "/sys/devices/system/node";
+static constexpr size_t NO_NODE = std::numeric_limits<size_t>::max();
+
+// node preferred by memory policy of calling thread in placement scopes,
+// and the policy it had before the outermost scope
+static thread_local size_t PREFERRED = NO_NODE;
+static thread_local size_t PLACEMENTS = 0;
+static thread_local int SAVED_MODE = MPOL_DEFAULT;
+static thread_local unsigned long SAVED_MASK = 0;
+
+Numa::Placement::Placement() noexcept {
+  if (PLACEMENTS++ > 0 || Numa::singleton().nodes() < 2) {
+    return;
+  }
+
+  // the default policy if it can not be read
+  if (::syscall(SYS_get_mempolicy, &SAVED_MODE, &SAVED_MASK, sizeof(SAVED_MASK) * 8, nullptr, 0) != 0) {
+    SAVED_MODE = MPOL_DEFAULT;
+    SAVED_MASK = 0;
+  }
+}
+
+Numa::Placement::~Placement() noexcept {
+  if (--PLACEMENTS > 0 || PREFERRED == NO_NODE) {
+    return;
+  }
+
+  // other work of this thread, such as queries, allocates by the policy it had before
+  const auto mask = SAVED_MODE == MPOL_DEFAULT ? nullptr : &SAVED_MASK;
+  if (::syscall(SYS_set_mempolicy, SAVED_MODE, mask, mask ? sizeof(SAVED_MASK) * 8 : 0) != 0) {
+    LOG(WARNING) << "Failed to restore memory policy of thread";
+  }
+
+  PREFERRED = NO_NODE;
+}
+
+Numa::Pin::Pin() noexcept : node_{ 0 }, pinned_{ false } {
+  auto& numa = Numa::singleton();
+  if (numa.nodes() < 2) {
+    return;
+  }
+
+  node_ = numa.current();
+  if (!FLAGS_NUMA_PIN || ::pthread_getaffinity_np(::pthread_self(), sizeof(saved_), &saved_) != 0) {
+    return;
+  }
+
+  // stay on current node, so the thread is not moved away from blocks it picks for the node
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : numa.cpus_.at(node_)) {
+    CPU_SET(cpu, &set);
+  }
+
+  pinned_ = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+  if (!pinned_) {
+    LOG(WARNING) << "Failed to pin thread to NUMA node " << node_;
+  }
+}
+
+Numa::Pin::~Pin() noexcept {
+  if (pinned_ && ::pthread_setaffinity_np(::pthread_self(), sizeof(saved_), &saved_) != 0) {
+    LOG(WARNING) << "Failed to restore affinity of thread";
+  }
+}
+
+Numa& Numa::singleton() {
+  static Numa numa{ FLAGS_NUMA };
+  return numa;
+}
+
+std::vector<size_t> Numa::parse(std::string_view list) {
+  std::vector<size_t> cpus;
+  while (!list.empty()) {
+    auto end = list.find(',');
+    auto item = list.substr(0, end);
+    list = end == std::string_view::npos ? std::string_view{} : list.substr(end + 1);
+
+    // trailing new line or spaces
+    while (!item.empty() && std::isspace(item.back())) {
+      item.remove_suffix(1);
+    }
+
+    if (item.empty()) {
+      continue;
+    }
+
+    auto pos = item.find('-');
+    auto first = std::stoul(std::string(item.substr(0, pos)));
+    auto last = pos == std::string_view::npos ? first : std::stoul(std::string(item.substr(pos + 1)));
+    for (auto i = first; i <= last; ++i) {
+      cpus.push_back(i);
+    }
+  }
+
+  return cpus;
+}
+
+Numa::Numa(bool enabled) : placed_{ 0 } {
+  // nodes are numbered from 0 without holes in practice, stop at the first missing one
+  for (size_t n = 0; enabled; ++n) {
+    std::ifstream file(fmt::format("{0}/node{1}/cpulist", NODE_DIR, n));
+    std::string list;
+    if (!file || !std::getline(file, list)) {
+      break;
+    }
+
+    auto cpus = parse(list);
+    for (auto cpu : cpus) {
+      if (cpu >= cpuNodes_.size()) {
+        cpuNodes_.resize(cpu + 1, 0);
+      }
+
+      cpuNodes_[cpu] = n;
+    }
+
+    cpus_.push_back(std::move(cpus));
+  }
+
+  // a single node covering everything otherwise, node masks of memory policy are in a word
+  if (cpus_.size() < 2 || cpus_.size() > 64) {
+    cpus_.assign(1, {});
+    cpuNodes_.clear();
+  }
+
+  LOG(INFO) << "NUMA nodes: " << cpus_.size();
+}
+
+size_t Numa::current() const noexcept {
+  if (nodes() < 2) {
+    return 0;
+  }
+
+  auto cpu = ::sched_getcpu();
+  return cpu < 0 ? 0 : node(cpu);
+}
+
+size_t Numa::place() noexcept {
+  if (nodes() < 2) {
+    return 0;
+  }
+
+  return placed_.fetch_add(1, std::memory_order_relaxed) % nodes();
+}
+
+void Numa::prefer(size_t node) noexcept {
+  if (nodes() < 2 || PLACEMENTS == 0 || PREFERRED == node) {
+    return;
+  }
+
+  // pages touched by this thread from now on go to the node as long as it has free memory
+  unsigned long mask = 1UL << node;
+  if (::syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) != 0) {
+    LOG(WARNING) << "Failed to prefer NUMA node " << node;
+  }
+
+  PREFERRED = node;
+}
+
+} // namespace common
+} // namespace nebula
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <sched.h>
+#include <string_view>
+#include <vector>
+
+/**
+ * NUMA topology of current machine read from sysfs, without depending on libnuma.
+ * Block memory is placed on a node chosen in round robin, and threads taking block tasks are pinned
+ * to their node while running a task so that they prefer blocks placed on their own node.
+ * Both are scoped, a thread gets back its memory policy and affinity when it is done.
+ * Everything is a no-op on a single node machine.
+ */
+namespace nebula {
+namespace common {
+
+class Numa {
+public:
+  // scope of building blocks in calling thread, memory of a block goes to its node while in the scope.
+  // memory policy of the thread is restored when the outermost scope ends.
+  class Placement {
+  public:
+    Placement() noexcept;
+    ~Placement() noexcept;
+    Placement(const Placement&) = delete;
+    Placement& operator=(const Placement&) = delete;
+  };
+
+  // pin calling thread to cpus of the node it runs on in a scope, its affinity is restored when it ends.
+  class Pin {
+  public:
+    Pin() noexcept;
+    ~Pin() noexcept;
+    Pin(const Pin&) = delete;
+    Pin& operator=(const Pin&) = delete;
+
+    // node of the thread, which is current node if pinning is disabled
+    inline size_t node() const {
+      return node_;
+    }
+
+  private:
+    size_t node_;
+    bool pinned_;
+    cpu_set_t saved_;
+  };
+
+public:
+  // topology of current machine, a single node if NUMA is disabled
+  static Numa& singleton();
+
+  // parse a cpu list of sysfs such as "0-3,8-11"
+  static std::vector<size_t> parse(std::string_view);
+
+public:
+  inline size_t nodes() const {
+    return cpus_.size();
+  }
+
+  // node of given cpu, 0 if unknown
+  inline size_t node(size_t cpu) const {
+    return cpu < cpuNodes_.size() ? cpuNodes_[cpu] : 0;
+  }
+
+  // node that calling thread is running on
+  size_t current() const noexcept;
+
+  // choose a node for a new block in round robin
+  size_t place() noexcept;
+
+  // prefer given node for memory allocated by calling thread in current placement scope,
+  // no-op outside of a placement scope.
+  void prefer(size_t) noexcept;
+
+private:
+  explicit Numa(bool);
+
+private:
+  // cpus of every node
+  std::vector<std::vector<size_t>> cpus_;
+  // node of every cpu
+  std::vector<size_t> cpuNodes_;
+
+  std::atomic<size_t> placed_;
+};
+
+} // namespace common
+} // namespace nebula
@@ -14,9 +14,11 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <fmt/format.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
+#include <pthread.h>
 #include <regex>
 #include <valarray>
 #include <xxh3.h>
@@ -34,6 +36,7 @@
 #include "common/Int128.h"
 #include "common/Likely.h"
 #include "common/Memory.h"
+#include "common/Numa.h"
 #include "common/Params.h"
 #include "common/Spark.h"
 #include "common/StackTree.h"
@@ -216,6 +219,92 @@ TEST(CommonTest, TestSliceWrite) {
   EXPECT_EQ(slice.read<int>(0), value);
 }
 
+TEST(CommonTest, TestPoolSizeClass) {
+  auto& pool = nebula::common::Pool::getDefault();
+
+  // chunks of a query are cached once freed and reused by next one of the same size class
+  nebula::common::MemoryScope scope(std::make_shared<nebula::common::MemoryBudget>(0));
+  auto p = static_cast<NByte*>(pool.allocate(5000));
+  p[4999] = 1;
+  pool.free(p, 5000);
+
+  auto q = static_cast<NByte*>(pool.allocate(4500));
+  EXPECT_EQ(q, p);
+  EXPECT_EQ(std::count(q, q + 4500, 0), 4500);
+
+  // extended in place within its size class, moved with its content beyond that
+  q[0] = 7;
+  auto r = static_cast<NByte*>(pool.extend(q, 4500, 5120));
+  EXPECT_EQ(r, q);
+  EXPECT_EQ(r[5119], 0);
+  r = static_cast<NByte*>(pool.extend(r, 5120, 100000));
+  EXPECT_EQ(r[0], 7);
+  EXPECT_EQ(std::count(r + 1, r + 100000, 0), 99999);
+  pool.free(r, 100000);
+
+  // a growing slice keeps its content
+  nebula::common::ExtendableSlice slice(1024);
+  for (size_t i = 0; i < 100000; ++i) {
+    slice.write(i * sizeof(size_t), i);
+  }
+
+  for (size_t i = 0; i < 100000; ++i) {
+    EXPECT_EQ(slice.read<size_t>(i * sizeof(size_t)), i);
+  }
+}
+
+TEST(CommonTest, TestPoolCapacityCharge) {
+  // a query chunk is charged by the capacity of its size class
+  auto budget = std::make_shared<nebula::common::MemoryBudget>(0);
+  nebula::common::MemoryScope scope(budget);
+  {
+    nebula::common::ExtendableSlice slice(5000);
+    EXPECT_EQ(nebula::common::Pool::capacity(5000), 5120);
+    EXPECT_EQ(budget->used(), 5120);
+
+    // moved to a larger class when grown beyond its capacity
+    slice.write(5100, 1L);
+    EXPECT_EQ(budget->used(), nebula::common::Pool::capacity(10000));
+  }
+
+  EXPECT_EQ(budget->used(), 0);
+}
+
+TEST(CommonTest, TestNuma) {
+  using nebula::common::Numa;
+  EXPECT_EQ(Numa::parse("0-3,8-9\n"), std::vector<size_t>({ 0, 1, 2, 3, 8, 9 }));
+  EXPECT_EQ(Numa::parse("5"), std::vector<size_t>({ 5 }));
+  EXPECT_TRUE(Numa::parse("").empty());
+
+  // every placement is on a known node, the only one on single node machines
+  auto& numa = Numa::singleton();
+  EXPECT_GE(numa.nodes(), 1);
+  EXPECT_LT(numa.place(), numa.nodes());
+  EXPECT_LT(numa.current(), numa.nodes());
+
+  // affinity of the thread is restored when a pin ends
+  cpu_set_t before;
+  ASSERT_EQ(pthread_getaffinity_np(pthread_self(), sizeof(before), &before), 0);
+  {
+    Numa::Pin pin;
+    EXPECT_LT(pin.node(), numa.nodes());
+    if (numa.nodes() == 1) {
+      EXPECT_EQ(pin.node(), 0);
+    }
+
+    // nested placement scopes
+    Numa::Placement placement;
+    {
+      Numa::Placement inner;
+      numa.prefer(numa.place());
+    }
+  }
+
+  cpu_set_t after;
+  ASSERT_EQ(pthread_getaffinity_np(pthread_self(), sizeof(after), &after), 0);
+  EXPECT_TRUE(CPU_EQUAL(&before, &after));
+}
+
 TEST(CommonTest, TestTimeParsing) {
   LOG(INFO) << "2019-04-01 = " << Evidence::time("2019-04-01", "%Y-%m-%d");
 
@@ -758,6 +847,45 @@ TEST(CommonTest, TestRange) {
   EXPECT_EQ(r6.size, max);
 }
 
+TEST(CommonTest, TestInlineString) {
+  using nebula::common::InlineString;
+  nebula::common::ExtendableSlice slice(1024);
+  nebula::common::ExtendableSlice data(1024);
+
+  // short strings never touch data slice
+  size_t offset = 0;
+  offset += InlineString::write(slice, 0, data, offset, "abc");
+  offset += InlineString::write(slice, 16, data, offset, "twelve bytes");
+  EXPECT_EQ(offset, 0);
+  EXPECT_EQ(InlineString::read(slice, 0, data), "abc");
+  EXPECT_EQ(InlineString::read(slice, 16, data), "twelve bytes");
+  EXPECT_TRUE(InlineString::make(slice, 16).isInline());
+
+  // long strings sharing the same prefix
+  offset += InlineString::write(slice, 32, data, offset, "twelve bytes plus");
+  offset += InlineString::write(slice, 48, data, offset, "twelve bytes minus");
+  offset += InlineString::write(slice, 64, data, offset, "twelve bytes plus");
+  EXPECT_EQ(offset, 52);
+  EXPECT_EQ(InlineString::read(slice, 32, data), "twelve bytes plus");
+  EXPECT_EQ(InlineString::read(slice, 48, data), "twelve bytes minus");
+  EXPECT_FALSE(InlineString::make(slice, 32).isInline());
+
+  auto s1 = InlineString::make(slice, 32);
+  auto s3 = InlineString::make(slice, 64);
+  EXPECT_EQ(s1.compare(s3, data), 0);
+  EXPECT_EQ(s1.hash(data), s3.hash(data));
+  EXPECT_NE(s1.compare(InlineString::make(slice, 48), data), 0);
+  EXPECT_NE(s1.compare(InlineString::make(slice, 16), data), 0);
+
+  // same short strings in different slots
+  InlineString::write(slice, 80, data, offset, "abc");
+  auto a1 = InlineString::make(slice, 0);
+  auto a2 = InlineString::make(slice, 80);
+  EXPECT_EQ(a1.compare(a2, data), 0);
+  EXPECT_EQ(a1.hash(data), a2.hash(data));
+  EXPECT_EQ(InlineString::read(slice, 80, data), "abc");
+}
+
 TEST(CommonTest, TestWriteAlign) {
   nebula::common::ExtendableSlice slice(1024);
   int8_t v = 126;
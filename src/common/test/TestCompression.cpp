@@ -17,7 +17,9 @@
 #include <folly/compression/Compression.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
+#include <thread>
 
+#include "common/BitPack.h"
 #include "common/Delta.h"
 #include "common/Evidence.h"
 #include "common/Memory.h"
@@ -31,6 +33,9 @@ namespace test {
 
 using folly::io::CodecType;
 using folly::io::getCodec;
+using nebula::common::BitPack;
+using nebula::common::Hasher;
+using nebula::common::PageCodec;
 using nebula::common::PagedSlice;
 
 TEST(CompressionTest, TestBasicCompressionApi) {
@@ -104,6 +109,133 @@ TEST(CompressionTest, TestStringPagedSlice) {
   LOG(INFO) << nebula::common::Pool::getDefault().report();
 }
 
+TEST(CompressionTest, TestBitPack) {
+#define test_type(T, MIN, MAX)                                           \
+  {                                                                      \
+    auto rand = nebula::common::Evidence::rand<T>(MIN, MAX);             \
+    constexpr auto size = 1000;                                          \
+    std::vector<T> values(size);                                         \
+    for (auto& v : values) {                                             \
+      v = rand();                                                        \
+    }                                                                    \
+    const auto [min, max] = std::minmax_element(values.begin(), values.end()); \
+    using U = std::make_unsigned_t<T>;                                   \
+    auto bits = BitPack::bits((U)((U)*max - (U)*min));                   \
+    std::vector<uint64_t> words(BitPack::bytes(size, bits) / 8);         \
+    BitPack::pack(values.data(), size, *min, bits, words.data());        \
+    std::vector<T> unpacked(size);                                       \
+    BitPack::unpack(words.data(), size, *min, bits, unpacked.data());    \
+    EXPECT_EQ(values, unpacked);                                         \
+  }
+
+  test_type(int16_t, -300, 300)
+  test_type(int32_t, 200, 1223)
+  test_type(int64_t, 1600000000, 1600086400)
+  test_type(int64_t, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max())
+
+#undef test_type
+
+  // a constant run takes no bits
+  EXPECT_EQ(BitPack::bits(0), 0);
+  EXPECT_EQ(BitPack::bytes(1000, 0), 0);
+  std::vector<int32_t> constants(10);
+  BitPack::unpack<int32_t>(nullptr, 10, 7, 0, constants.data());
+  EXPECT_EQ(constants, std::vector<int32_t>(10, 7));
+}
+
+TEST(CompressionTest, TestPackedPagedSlice) {
+  PagedSlice slice(1024);
+  slice.pack(sizeof(int32_t));
+  constexpr auto width = sizeof(int32_t);
+  constexpr auto total = 10500;
+
+  // narrow ranges are packed, the wide page in the middle falls back to LZ4
+  auto narrow = nebula::common::Evidence::rand<int32_t>(1000, 2023);
+  auto wide = nebula::common::Evidence::rand<int32_t>(std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max());
+  std::vector<int32_t> values;
+  values.reserve(total);
+  for (auto i = 0; i < total; ++i) {
+    values.push_back(i / 256 == 5 ? wide() : narrow());
+    slice.write(i * width, values.back());
+  }
+
+  slice.seal();
+  LOG(INFO) << "raw=" << (total * width) << ", real=" << slice.size();
+  EXPECT_LT(slice.size(), total * width / 2);
+
+  for (auto i = 0; i < total; ++i) {
+    EXPECT_EQ(slice.read<int32_t>(i * width), values.at(i));
+  }
+}
+
+TEST(CompressionTest, TestSinglePageConcurrentReads) {
+  PagedSlice slice(1024);
+  slice.pack(sizeof(int64_t));
+  constexpr auto width = sizeof(int64_t);
+  constexpr auto total = 100;
+
+  // a small block is sealed into its only page, readers of the block share its decoded buffer
+  for (auto i = 0; i < total; ++i) {
+    slice.write(i * width, (int64_t)(1600000000 + i));
+  }
+  slice.seal();
+
+  std::vector<std::thread> readers;
+  std::atomic<size_t> mismatches{ 0 };
+  for (auto t = 0; t < 8; ++t) {
+    readers.emplace_back([&slice, &mismatches]() {
+      for (auto r = 0; r < 1000; ++r) {
+        for (auto i = 0; i < total; ++i) {
+          if (slice.read<int64_t>(i * width) != 1600000000 + i) {
+            ++mismatches;
+          }
+        }
+      }
+    });
+  }
+
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  EXPECT_EQ(mismatches, 0);
+}
+
+TEST(CompressionTest, TestPageCodec) {
+  // hash like dense bytes, repeated text and text with every codec
+  auto dense = [](size_t i) { return (char)(Hasher::hash64(&i, sizeof(i)) & 0xFF); };
+  auto text = [](size_t i) { return "nebula-page-codec-"[i % 18]; };
+  auto verify = [](PagedSlice& slice, auto gen) {
+    constexpr size_t total = 100000;
+    for (size_t i = 0; i < total; ++i) {
+      const char c = gen(i);
+      slice.write(i, &c, 1);
+    }
+
+    slice.seal();
+    for (size_t i = 0; i < total; ++i) {
+      EXPECT_EQ(slice.read(i, 1)[0], gen(i));
+    }
+  };
+
+  PagedSlice auto1(1024);
+  verify(auto1, dense);
+  EXPECT_EQ(auto1.codec(), PageCodec::NONE);
+
+  PagedSlice auto2(1024);
+  verify(auto2, text);
+  EXPECT_NE(auto2.codec(), PageCodec::NONE);
+  EXPECT_LT(auto2.size(), 100000 / 4);
+
+  for (auto codec : { "none", "lz4", "zstd" }) {
+    PagedSlice slice(1024, PagedSlice::codec(codec));
+    verify(slice, text);
+    LOG(INFO) << codec << ": raw=100000, real=" << slice.size();
+  }
+
+  EXPECT_THROW(PagedSlice::codec("snappy"), NException);
+}
+
 TEST(CompressionTest, TestDeltaEncoding) {
 // generate 10K values range from 0 to 1000 and delta encoding them
 #define test_type(T)                                                                                      \
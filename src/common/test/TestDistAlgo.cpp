@@ -170,6 +170,51 @@ TEST(HashRingTest, TestAddOneNodeEachTime) {
   }
 }
 
+TEST(HashRingTest, TestLocateWithBoundedLoad) {
+  auto build = [](size_t nodes) {
+    std::vector<std::unique_ptr<Machine>> machines;
+    for (size_t i = 0; i < nodes; ++i) {
+      machines.push_back(std::make_unique<Machine>(fmt::format("NODE-{0}", i)));
+    }
+    return std::make_unique<HashRing<Machine, Data>>(machines);
+  };
+
+  // locate is stable for the same node set
+  const auto DATA_ITEMS = 1000;
+  auto r10 = build(10);
+  auto r10b = build(10);
+  auto r11 = build(11);
+  auto moved = 0;
+  for (auto i = 0; i < DATA_ITEMS; ++i) {
+    auto key = fmt::format("DATA-{0}", i);
+    EXPECT_EQ(r10->locate(key).id(), r10b->locate(key).id());
+    if (r10->locate(key).id() != r11->locate(key).id()) {
+      ++moved;
+      // moved keys can only go to the new node
+      EXPECT_EQ(r11->locate(key).id(), "NODE-10");
+    }
+  }
+
+  // a new node takes about 1/N of the keys
+  LOG(INFO) << "keys moved to new node: " << moved;
+  EXPECT_GT(moved, 0);
+  EXPECT_LT(moved, DATA_ITEMS / 5);
+
+  // bounded load spills keys over to next nodes on the ring
+  const size_t capacity = DATA_ITEMS / 10 + 5;
+  nebula::common::unordered_map<std::string, size_t> load;
+  for (auto i = 0; i < DATA_ITEMS; ++i) {
+    const auto& m = r10->locate(fmt::format("DATA-{0}", i), [&load, capacity](const Machine& n) {
+      return load[n.id()] < capacity;
+    });
+    ++load[m.id()];
+  }
+
+  for (auto& kv : load) {
+    EXPECT_LE(kv.second, capacity);
+  }
+}
+
 } // namespace test
 } // namespace common
 } // namespace nebula
\ No newline at end of file
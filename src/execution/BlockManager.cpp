@@ -16,7 +16,14 @@
 
 #include "BlockManager.h"
 
+#include <algorithm>
+#include <folly/hash/Hash.h>
+#include <limits>
+#include <tuple>
+
 #include "common/Folly.h"
+#include "core/PartialCache.h"
+#include "io/BlockStore.h"
 #include "type/Tree.h"
 
 /**
@@ -25,9 +32,11 @@
 namespace nebula {
 namespace execution {
 
+using nebula::common::unordered_map;
 using nebula::execution::io::BatchBlock;
 using nebula::execution::io::BlockList;
 using nebula::memory::Batch;
+using nebula::memory::BatchPtr;
 using nebula::meta::BlockSignature;
 using nebula::meta::BlockState;
 using nebula::meta::NBlock;
@@ -53,6 +62,7 @@ std::shared_ptr<BlockManager> BlockManager::init() {
 
 // query all nodes that hold data for given table
 const std::vector<NNode> BlockManager::query(const std::string& table) {
+  std::shared_lock<std::shared_mutex> lock(dataMux_);
   std::vector<NNode> nodes;
 
   // go through all nodes's block set
@@ -66,24 +76,144 @@ const std::vector<NNode> BlockManager::query(const std::string& table) {
   return nodes;
 }
 
+TableStates BlockManager::states(const NNode& node) const {
+  std::shared_lock<std::shared_mutex> lock(dataMux_);
+  auto entry = data_.find(node);
+  if (entry == data_.end()) {
+    return {};
+  }
+
+  // table states change in place when blocks come and go, copy them out of the lock
+  TableStates states;
+  for (const auto& ts : entry->second) {
+    states.emplace(ts.first, std::make_shared<TableState>(*ts.second));
+  }
+
+  return states;
+}
+
+unordered_map<std::string, std::vector<NNode>> BlockManager::placement(const std::string& table) const {
+  unordered_map<std::string, std::vector<NNode>> specs;
+  {
+    std::shared_lock<std::shared_mutex> lock(dataMux_);
+    for (auto n = data_.begin(); n != data_.end(); ++n) {
+      const auto& states = n->second;
+      auto ts = states.find(table);
+      if (ts == states.end()) {
+        continue;
+      }
+
+      for (const auto& spec : ts->second->specs()) {
+        specs[spec].push_back(n->first);
+      }
+    }
+  }
+
+  // keep holders in a stable order regardless of node map
+  for (auto& s : specs) {
+    std::sort(s.second.begin(), s.second.end(), [](const NNode& n1, const NNode& n2) {
+      return n1.toString() < n2.toString();
+    });
+  }
+
+  return specs;
+}
+
+size_t BlockManager::estimate(const std::string& table, const QueryWindow& window) const {
+  std::shared_lock<std::shared_mutex> lock(dataMux_);
+  size_t rows = 0;
+  for (auto n = data_.begin(); n != data_.end(); ++n) {
+    const auto& states = n->second;
+    auto ts = states.find(table);
+    if (ts == states.end()) {
+      continue;
+    }
+
+    ts->second->iterate([&rows, &window](const BatchBlock& block) {
+      if (block.start() <= window.second && block.end() >= window.first) {
+        rows += block.state().numRows;
+      }
+    });
+  }
+
+  return rows;
+}
+
+size_t BlockManager::fingerprint(const std::string& table, const QueryWindow& window) const {
+  std::shared_lock<std::shared_mutex> lock(dataMux_);
+  // order independent sum of block hashes, so it doesn't depend on iteration order
+  size_t sign = 0;
+  for (auto n = data_.begin(); n != data_.end(); ++n) {
+    const auto& states = n->second;
+    auto ts = states.find(table);
+    if (ts == states.end()) {
+      continue;
+    }
+
+    const auto node = std::hash<std::string>()(n->first.toString());
+    ts->second->iterate([&sign, &window, node](const BatchBlock& block) {
+      if (block.start() <= window.second && block.end() >= window.first) {
+        const auto& bs = block.signature();
+        sign += folly::hash::hash_combine(node, bs.spec, bs.id, bs.start, bs.end, block.state().numRows);
+      }
+    });
+
+    // open blocks in local node have no fixed range, their versions are the rows appended so far
+    ts->second->iterateOpen([&sign, node](const BatchBlock& block) {
+      const auto& bs = block.signature();
+      const auto& data = block.data();
+      sign += folly::hash::hash_combine(node, bs.spec, bs.id, data ? data->getRows() : 0);
+    });
+  }
+
+  return sign;
+}
+
+QueryWindow BlockManager::window(const std::string& table) const {
+  std::shared_lock<std::shared_mutex> lock(dataMux_);
+  QueryWindow window{ std::numeric_limits<size_t>::max(), 0 };
+  for (auto n = data_.begin(); n != data_.end(); ++n) {
+    const auto& states = n->second;
+    auto ts = states.find(table);
+    if (ts == states.end()) {
+      continue;
+    }
+
+    const auto& w = ts->second->timeWindow();
+    window.first = std::min(window.first, w.first);
+    window.second = std::max(window.second, w.second);
+  }
+
+  return window;
+}
+
 static constexpr auto BATCH_SIZE = 100;
 folly::Future<FilteredBlocks> batch(folly::ThreadPoolExecutor& pool,
                                     const nebula::surface::eval::ValueEval& filter,
-                                    std::array<Batch*, BATCH_SIZE> input,
+                                    std::shared_ptr<PlanGuard> guard,
+                                    std::array<BatchPtr, BATCH_SIZE> input,
                                     size_t size) {
   auto p = std::make_shared<folly::Promise<FilteredBlocks>>();
   pool.addWithPriority(
-    [&filter, input, size, p]() {
+    [&filter, guard, input, size, p]() {
+      // filter belongs to the plan, no block is selected once the plan is released
       FilteredBlocks blocks;
-      blocks.reserve(BATCH_SIZE);
-      for (size_t i = 0; i < size; ++i) {
-        auto ptr = input[i];
-
-        auto eval = filter.eval(*ptr);
-        if (eval != BlockEval::NONE) {
-          blocks.emplace_back(ptr, eval);
+      guard->run([&]() {
+        blocks.reserve(BATCH_SIZE);
+        for (size_t i = 0; i < size; ++i) {
+          const auto& ptr = input[i];
+
+          // stats of an open batch are read under its snapshot
+          auto snapshot = ptr->snapshot();
+          auto eval = filter.eval(*ptr);
+          if (eval != BlockEval::NONE) {
+            // start reading pages of a block on disk while it waits for its turn to be scanned
+            ptr->touch();
+            ptr->prefetch();
+            blocks.emplace_back(ptr, eval);
+          }
         }
-      }
+      });
 
       // compute phase on block and return the result
       p->setValue(blocks);
@@ -92,59 +222,74 @@ folly::Future<FilteredBlocks> batch(folly::ThreadPoolExecutor& pool,
   return p->getFuture();
 }
 
-const FilteredBlocks BlockManager::query(const Table& table, const ExecutionPlan& plan, folly::ThreadPoolExecutor& pool) {
+const FilteredBlocks BlockManager::query(const Table& table, const ExecutionPlan& plan, folly::ThreadPoolExecutor& pool, const SpecFilter& specs) {
+  return queryAsync(table, plan, pool, specs).get();
+}
+
+folly::Future<FilteredBlocks> BlockManager::queryAsync(
+  const Table& table, const ExecutionPlan& plan, folly::ThreadPoolExecutor& pool, const SpecFilter& specs) {
   // 1. a table and a predicate should determined by meta service how many blocks we should query
   // 2. determine how many blocks are not in memory yet, if they are not, load them in
   // 3. fan out the query plan to execute on each block in parallel (not this function but the caller)
-  auto total = 0;
+  size_t total = 0;
   const auto& window = plan.getWindow();
 
   // check if there are some predicates we can evaluate here
   const auto& filter = plan.fetch<PhaseType::COMPUTE>().filter();
 
-  std::array<Batch*, BATCH_SIZE> list;
+  std::array<BatchPtr, BATCH_SIZE> list;
   std::vector<folly::Future<FilteredBlocks>> futures;
   futures.reserve(1024);
 
-  const auto& self = local();
-  auto ts = self.find(table.name());
-  if (ts == self.end()) {
-    return {};
+  // blocks in the window, they stay alive by the pointers even if removed from the states meanwhile
+  std::vector<nebula::memory::BatchPtr> batches;
+  {
+    std::shared_lock<std::shared_mutex> lock(dataMux_);
+    const auto& self = local();
+    auto ts = self.find(table.name());
+    if (ts == self.end()) {
+      return folly::makeFuture<FilteredBlocks>({});
+    }
+
+    batches = ts->second->query(window, specs);
   }
 
   auto index = 0;
-  for (auto& b : ts->second->query(window)) {
+  for (auto& b : batches) {
     ++total;
-    list[index++] = b.get();
+    list[index++] = b;
 
     if (index == BATCH_SIZE) {
-      futures.push_back(batch(pool, filter, list, index));
+      futures.push_back(batch(pool, filter, plan.guard(), list, index));
       index = 0;
     }
   }
 
   if (index > 0) {
-    futures.push_back(batch(pool, filter, list, index));
+    futures.push_back(batch(pool, filter, plan.guard(), list, index));
   }
 
-  // collect futures
-  FilteredBlocks tableBlocks;
-  tableBlocks.reserve(total);
-  auto x = folly::collectAll(futures).get();
-  for (auto it = x.begin(); it < x.end(); ++it) {
-    // if the result is empty
-    if (!it->hasValue()) {
-      continue;
-    }
+  // collect futures without blocking current thread
+  return folly::collectAll(futures)
+    .via(&pool)
+    .thenValue([total, window, name = table.name()](std::vector<folly::Try<FilteredBlocks>> x) {
+      FilteredBlocks tableBlocks;
+      tableBlocks.reserve(total);
+      for (auto it = x.begin(); it < x.end(); ++it) {
+        // if the result is empty
+        if (!it->hasValue()) {
+          continue;
+        }
 
-    for (auto& item : it->value()) {
-      tableBlocks.push_back(item);
-    }
-  }
+        for (auto& item : it->value()) {
+          tableBlocks.push_back(item);
+        }
+      }
 
-  LOG(INFO) << fmt::format("Fetch blcoks {0} / {1} for table {2} in window [{3}, {4}]. ",
-                           tableBlocks.size(), total, table.name(), window.first, window.second);
-  return tableBlocks;
+      LOG(INFO) << fmt::format("Fetch blcoks {0} / {1} for table {2} in window [{3}, {4}]. ",
+                               tableBlocks.size(), total, name, window.first, window.second);
+      return tableBlocks;
+    });
 }
 
 // add block into the target table states
@@ -165,6 +310,11 @@ bool BlockManager::addBlock(TableStates& target, std::shared_ptr<io::BatchBlock>
 }
 
 bool BlockManager::add(std::shared_ptr<io::BatchBlock> block) {
+  std::unique_lock<std::shared_mutex> lock(dataMux_);
+  return insert(block);
+}
+
+bool BlockManager::insert(std::shared_ptr<io::BatchBlock> block) {
   const auto& node = block->residence();
 
   // remote blocks will not have data pointer
@@ -176,31 +326,60 @@ bool BlockManager::add(std::shared_ptr<io::BatchBlock> block) {
   ++blocks_;
 
   auto itr = data_.find(node);
-  if (itr != data_.end()) {
-    return addBlock(itr->second, block);
+  if (itr == data_.end()) {
+    itr = data_.emplace(node, TableStates{}).first;
+  }
+
+  auto added = addBlock(itr->second, block);
+  if (added && node.isInProc()) {
+    journal(true, block);
   }
 
-  data_.emplace(node, TableStates{});
-  return addBlock(data_.at(node), block);
+  return added;
 }
 
 bool BlockManager::add(BlockList& range) {
+  std::unique_lock<std::shared_mutex> lock(dataMux_);
   bool result = true;
   for (auto itr = range.begin(); itr != range.end(); ++itr) {
-    result = result && add(*itr);
+    result = result && insert(*itr);
   }
 
   return result;
 }
 
 // remove all blocks that share the given spec
-// NOTE: thread-unsafe~!
 size_t BlockManager::removeBySpec(const std::string& table, const std::string& spec) {
+  std::unique_lock<std::shared_mutex> lock(dataMux_);
+  size_t count = 0;
+  auto& self = local();
+  auto state = self.find(table);
+  if (state != self.end()) {
+    std::vector<std::shared_ptr<BatchBlock>> removed;
+    count += state->second->remove(spec, &removed);
+    for (auto& b : removed) {
+      journal(false, b);
+    }
+  }
+
+  // decrement blocks counter
+  blocks_ -= count;
+
+  return count;
+}
+
+// remove blocks of given spec that end before given time
+size_t BlockManager::removeBefore(const std::string& table, const std::string& spec, size_t time) {
+  std::unique_lock<std::shared_mutex> lock(dataMux_);
   size_t count = 0;
   auto& self = local();
   auto state = self.find(table);
   if (state != self.end()) {
-    count += state->second->remove(spec);
+    std::vector<std::shared_ptr<BatchBlock>> removed;
+    count += state->second->remove(spec, time, &removed);
+    for (auto& b : removed) {
+      journal(false, b);
+    }
   }
 
   // decrement blocks counter
@@ -209,5 +388,271 @@ size_t BlockManager::removeBySpec(const std::string& table, const std::string& s
   return count;
 }
 
+// register open block of given spec, or close it if block is null
+void BlockManager::open(const std::string& table, const std::string& spec, std::shared_ptr<BatchBlock> block) {
+  std::unique_lock<std::shared_mutex> lock(dataMux_);
+  auto& self = local();
+  auto state = self.find(table);
+  if (state == self.end()) {
+    // nothing to close
+    if (block == nullptr) {
+      return;
+    }
+
+    state = self.emplace(table, std::make_shared<TableState>(table)).first;
+  }
+
+  state->second->open(spec, block);
+}
+
+std::vector<std::vector<std::shared_ptr<BatchBlock>>> BlockManager::compactable(size_t small, size_t max) const {
+  std::shared_lock<std::shared_mutex> lock(dataMux_);
+  std::vector<std::vector<std::shared_ptr<BatchBlock>>> groups;
+  for (auto& ts : local()) {
+    auto list = ts.second->compactable(small, max);
+    std::move(list.begin(), list.end(), std::back_inserter(groups));
+  }
+
+  return groups;
+}
+
+// replace blocks by merged block
+bool BlockManager::replace(const std::vector<std::shared_ptr<BatchBlock>>& blocks, std::shared_ptr<BatchBlock> merged) {
+  std::unique_lock<std::shared_mutex> lock(dataMux_);
+  auto& self = local();
+  auto state = self.find(merged->table());
+  if (state == self.end()) {
+    return false;
+  }
+
+  if (!state->second->replace(blocks, merged)) {
+    return false;
+  }
+
+  // files of the blocks are replaced by the merged file in one step of the store
+  for (auto& b : blocks) {
+    journal(false, b, false);
+  }
+  journal(true, merged, false);
+  io::BlockStore::singleton().replaceAsync(blocks, merged);
+
+  // decrement blocks counter
+  blocks_ -= blocks.size() - 1;
+  return true;
+}
+
+std::vector<std::shared_ptr<BatchBlock>> BlockManager::cold(size_t before, size_t memory) const {
+  std::vector<std::shared_ptr<BatchBlock>> resident;
+  size_t total = 0;
+  std::shared_lock<std::shared_mutex> lock(dataMux_);
+  for (auto& ts : local()) {
+    for (auto& b : ts.second->resident()) {
+      // ephemeral blocks are never written to disk
+      if (!b->signature().isEphemeral()) {
+        total += b->data()->getMemory();
+        resident.push_back(b);
+      }
+    }
+  }
+  lock.unlock();
+
+  // least recently queried first
+  std::sort(resident.begin(), resident.end(), [](const auto& x, const auto& y) {
+    return x->data()->touched() < y->data()->touched();
+  });
+
+  std::vector<std::shared_ptr<BatchBlock>> blocks;
+  for (auto& b : resident) {
+    if (b->end() < before || (memory > 0 && total > memory)) {
+      total -= b->data()->getMemory();
+      blocks.push_back(b);
+    }
+  }
+
+  return blocks;
+}
+
+// swap a block by the same block paged from disk
+bool BlockManager::swap(const std::shared_ptr<BatchBlock>& block, std::shared_ptr<BatchBlock> paged) {
+  std::unique_lock<std::shared_mutex> lock(dataMux_);
+  auto& self = local();
+  auto state = self.find(block->table());
+  if (state == self.end() || !state->second->replace({ block }, paged)) {
+    return false;
+  }
+
+  lock.unlock();
+  // partial results are keyed by batch id which is changed
+  nebula::execution::core::PartialCache::singleton().evict(block->data()->id());
+  return true;
+}
+
+void BlockManager::journal(bool added, const std::shared_ptr<BatchBlock>& block, bool store) {
+  // cached partial results of a removed block are never hit again
+  if (!added && block->data()) {
+    nebula::execution::core::PartialCache::singleton().evict(block->data()->id());
+  }
+
+  // sealed local blocks are kept on disk to restore them on restart, written off this thread
+  if (store) {
+    if (added) {
+      io::BlockStore::singleton().persistAsync(block);
+    } else {
+      io::BlockStore::singleton().removeAsync(block);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(journalMux_);
+  journal_.push_back({ ++version_, added, block->signature(), block->state() });
+
+  // drop oldest changes, syncing from a version before them requires a full list
+  while (journal_.size() > FLAGS_BLOCK_JOURNAL_SIZE) {
+    floor_ = journal_.front().version;
+    journal_.pop_front();
+  }
+}
+
+size_t BlockManager::version() const noexcept {
+  std::lock_guard<std::mutex> lock(journalMux_);
+  return version_;
+}
+
+bool BlockManager::changes(size_t epoch, size_t version, std::vector<BlockChange>& list) const {
+  std::lock_guard<std::mutex> lock(journalMux_);
+  if (epoch != epoch_ || version < floor_ || version > version_) {
+    return false;
+  }
+
+  // journal is ordered by version
+  auto from = std::upper_bound(journal_.begin(), journal_.end(), version, [](size_t v, const BlockChange& c) {
+    return v < c.version;
+  });
+
+  // only the latest change of each block is listed, in version order,
+  // so a block is never both added and removed in a delta no matter how it is applied.
+  nebula::common::unordered_map<std::string, size_t> latest;
+  for (auto itr = from; itr != journal_.end(); ++itr) {
+    latest[itr->sign.toString()] = itr->version;
+  }
+
+  for (auto itr = from; itr != journal_.end(); ++itr) {
+    if (latest.at(itr->sign.toString()) == itr->version) {
+      list.push_back(*itr);
+    }
+  }
+
+  return true;
+}
+
+std::pair<size_t, size_t> BlockManager::cursor(const NNode& node) const {
+  std::lock_guard<std::mutex> lock(syncMux_);
+  auto itr = cursors_.find(node);
+  if (itr == cursors_.end()) {
+    return { 0, 0 };
+  }
+
+  return itr->second;
+}
+
+// apply changes of a remote node.
+// table states are copied on write so that readers holding current states are not affected.
+void BlockManager::apply(const NNode& node, BlockDelta delta) {
+  std::lock_guard<std::mutex> lock(syncMux_);
+
+  // skip a stale delta as concurrent polls of the same node may arrive out of order
+  auto cursor = cursors_.find(node);
+  if (cursor != cursors_.end() && cursor->second.first == delta.epoch && cursor->second.second >= delta.version) {
+    return;
+  }
+
+  TableStates states;
+  if (!delta.full) {
+    std::shared_lock<std::shared_mutex> dataLock(dataMux_);
+    auto found = data_.find(node);
+    if (found != data_.end()) {
+      states = found->second;
+    }
+  }
+
+  // time ranges of changed blocks to notify listeners, a full list may drop any previous block
+  std::vector<std::tuple<std::string, size_t, size_t>> changed;
+  if (delta.full) {
+    std::shared_lock<std::shared_mutex> dataLock(dataMux_);
+    auto found = data_.find(node);
+    if (found != data_.end()) {
+      for (const auto& ts : found->second) {
+        changed.emplace_back(ts.first, 0, std::numeric_limits<size_t>::max());
+      }
+    }
+  }
+
+  for (const auto& sign : delta.removed) {
+    changed.emplace_back(sign.table, sign.start, sign.end);
+  }
+
+  for (const auto& b : delta.added) {
+    changed.emplace_back(b->table(), b->start(), b->end());
+  }
+
+  // a delta has at most one change per block, so all removes go before all adds.
+  // group removed blocks by table, an added block replaces the same one if it exists
+  nebula::common::unordered_map<std::string, std::vector<BlockSignature>> removes;
+  for (auto& sign : delta.removed) {
+    removes[sign.table].push_back(std::move(sign));
+  }
+
+  if (!delta.full) {
+    for (auto& b : delta.added) {
+      removes[b->table()].push_back(b->signature());
+    }
+  }
+
+  nebula::common::unordered_set<std::string> copied;
+  auto writable = [&states, &copied](const std::string& table) {
+    auto itr = states.find(table);
+    if (itr != states.end() && copied.emplace(table).second) {
+      itr->second = std::make_shared<TableState>(*itr->second);
+    }
+
+    return itr;
+  };
+
+  for (auto& r : removes) {
+    auto itr = writable(r.first);
+    if (itr != states.end()) {
+      itr->second->remove(r.second);
+    }
+  }
+
+  for (auto& b : delta.added) {
+    writable(b->table());
+    addBlock(states, b);
+  }
+
+  // drop tables without blocks in the node
+  for (auto itr = states.begin(); itr != states.end();) {
+    if (itr->second->numBlocks() == 0) {
+      itr = states.erase(itr);
+      continue;
+    }
+
+    ++itr;
+  }
+
+  {
+    std::unique_lock<std::shared_mutex> dataLock(dataMux_);
+    data_[node] = std::move(states);
+  }
+
+  cursors_[node] = { delta.epoch, delta.version };
+
+  // listeners are notified after table states are released
+  for (const auto& listener : listeners_) {
+    for (const auto& c : changed) {
+      listener(std::get<0>(c), std::get<1>(c), std::get<2>(c));
+    }
+  }
+}
+
 } // namespace execution
-} // namespace nebula
\ No newline at end of file
+} // namespace nebula
@@ -16,11 +16,15 @@
 
 #pragma once
 
+#include <atomic>
+#include <deque>
 #include <forward_list>
 #include <mutex>
+#include <shared_mutex>
 
 #include "ExecutionPlan.h"
 #include "TableState.h"
+#include "common/Evidence.h"
 #include "common/Folly.h"
 #include "common/Hash.h"
 
@@ -29,6 +33,8 @@
  * This object should be singleton per node. It manages all data segments that loaded in memory.
  * And their attributes, such as their time range, partition keys, and of course table name.
  * 
+ * Blocks are added and removed by ingestion threads while queries and node sync read them,
+ * so all table states are guarded by a shared mutex. Readers get copies rather than references.
  */
 namespace nebula {
 namespace execution {
@@ -49,6 +55,28 @@ struct Equal {
 using TableStates = nebula::common::unordered_map<std::string, std::shared_ptr<TableState>>;
 using FilteredBlocks = std::vector<nebula::memory::EvaledBlock>;
 
+// a change of local blocks, removed blocks are described by signature and state only
+struct BlockChange {
+  size_t version;
+  bool added;
+  nebula::meta::BlockSignature sign;
+  nebula::meta::BlockState state;
+};
+
+// listener of remote block changes applied, called with table and time range of each changed block
+using BlockListener = std::function<void(const std::string&, size_t, size_t)>;
+
+// block changes of a node since the version known by server
+struct BlockDelta {
+  // epoch and version of the node after applying this delta
+  size_t epoch;
+  size_t version;
+  // added blocks are all blocks of the node if it's full
+  bool full;
+  std::vector<std::shared_ptr<io::BatchBlock>> added;
+  std::vector<nebula::meta::BlockSignature> removed;
+};
+
 class BlockManager {
 public:
   BlockManager(BlockManager&) = delete;
@@ -58,11 +86,30 @@ public:
   static std::shared_ptr<BlockManager> init();
 
 public:
-  const FilteredBlocks query(const nebula::meta::Table&, const ExecutionPlan&, folly::ThreadPoolExecutor&);
+  // query local blocks of given table for the plan, filtered by their specs
+  const FilteredBlocks query(const nebula::meta::Table&, const ExecutionPlan&, folly::ThreadPoolExecutor&, const SpecFilter& = {});
+
+  // the same as query but the result is delivered through a future rather than waiting for it
+  folly::Future<FilteredBlocks> queryAsync(
+    const nebula::meta::Table&, const ExecutionPlan&, folly::ThreadPoolExecutor&, const SpecFilter& = {});
 
   // query all nodes that hold data for given table
   const std::vector<nebula::meta::NNode> query(const std::string&);
 
+  // query nodes holding blocks of each spec for given table,
+  // a spec has multiple nodes when it is replicated.
+  nebula::common::unordered_map<std::string, std::vector<nebula::meta::NNode>> placement(const std::string&) const;
+
+  // estimate rows to scan for given table in the time window by known blocks of all nodes
+  size_t estimate(const std::string&, const QueryWindow&) const;
+
+  // identity of all known blocks of given table in the time window with their rows,
+  // it changes once any of these blocks is added, removed or grows, including open blocks in local node.
+  size_t fingerprint(const std::string&, const QueryWindow&) const;
+
+  // time window covered by sealed blocks of given table known in all nodes
+  QueryWindow window(const std::string&) const;
+
   // add given block into the target table states repo
   static bool addBlock(TableStates&, std::shared_ptr<io::BatchBlock>);
 
@@ -84,33 +131,81 @@ public:
   // return number of blocks removed
   size_t removeBySpec(const std::string&, const std::string&);
 
-  // get table state for given table name
-  const TableState& state(const std::string& table) const {
+  // remove blocks by table name and spec signature which end before given time
+  // return number of blocks removed
+  size_t removeBefore(const std::string&, const std::string&, size_t);
+
+  // register or replace the open block of a spec in local node, nullptr closes it
+  void open(const std::string&, const std::string&, std::shared_ptr<io::BatchBlock>);
+
+  // find groups of small blocks in local node that can be merged,
+  // see TableState::compactable for the grouping rule
+  std::vector<std::vector<std::shared_ptr<io::BatchBlock>>> compactable(size_t, size_t) const;
+
+  // replace a group of local blocks by the block merged from them
+  bool replace(const std::vector<std::shared_ptr<io::BatchBlock>>&, std::shared_ptr<io::BatchBlock>);
+
+  // local blocks to move out of memory, least recently queried first.
+  // they are blocks ending before given time, and more blocks until those left fit in given memory (0 for no limit).
+  std::vector<std::shared_ptr<io::BatchBlock>> cold(size_t, size_t) const;
+
+  // swap a local block with the same block reading its pages from disk,
+  // it is not a change of blocks so it is not in the journal.
+  bool swap(const std::shared_ptr<io::BatchBlock>&, std::shared_ptr<io::BatchBlock>);
+
+  // epoch identifies lifetime of local blocks, version is bumped by every local block change
+  inline size_t epoch() const noexcept {
+    return epoch_;
+  }
+
+  size_t version() const noexcept;
+
+  // collect local block changes after given epoch and version, the latest change of each block only.
+  // return false if the journal doesn't cover it and a full block list is needed.
+  bool changes(size_t, size_t, std::vector<BlockChange>&) const;
+
+  // epoch and version of a remote node known by this block manager, {0, 0} if never synced
+  std::pair<size_t, size_t> cursor(const nebula::meta::NNode&) const;
+
+  // apply block changes polled from a remote node
+  void apply(const nebula::meta::NNode&, BlockDelta);
+
+  // register a listener of block changes applied from remote nodes
+  inline void listen(BlockListener listener) {
+    std::lock_guard<std::mutex> lock(syncMux_);
+    listeners_.push_back(std::move(listener));
+  }
+
+  // get a copy of table state for given table name
+  TableState state(const std::string& table) const {
+    std::shared_lock<std::shared_mutex> lock(dataMux_);
     const auto& self = local();
-    if (self.find(table) == self.end()) {
+    auto ts = self.find(table);
+    if (ts == self.end()) {
       return TableState::empty();
     }
 
-    return *self.at(table);
+    return *ts->second;
   }
 
-  // get all table states for given node
-  inline const TableStates& states(const nebula::meta::NNode& node = nebula::meta::NNode::inproc()) {
-    // it may reutrn empty result if the node is not in
-    return data_[node];
-  }
+  // get a copy of all table states for given node
+  TableStates states(const nebula::meta::NNode& node = nebula::meta::NNode::inproc()) const;
 
   // swap table states for given node
   inline void swap(const nebula::meta::NNode& node, TableStates states) {
-    data_[node] = states;
+    std::lock_guard<std::mutex> lock(syncMux_);
+    std::unique_lock<std::shared_mutex> dataLock(dataMux_);
+    data_[node] = std::move(states);
+    cursors_.erase(node);
   }
 
   inline size_t numBlocks() const {
-    return blocks_;
+    return blocks_.load(std::memory_order_relaxed);
   }
 
   // get table list of current node
   nebula::common::unordered_set<std::string> tables(const size_t limit) const noexcept {
+    std::shared_lock<std::shared_mutex> lock(dataMux_);
     nebula::common::unordered_set<std::string> tables;
     for (const auto& node : data_) {
       for (const auto& ts : node.second) {
@@ -127,7 +222,8 @@ public:
   }
 
   // has spec in node
-  bool hasSpec(const nebula::meta::NNode& node, const std::string& table, const std::string& spec) {
+  bool hasSpec(const nebula::meta::NNode& node, const std::string& table, const std::string& spec) const {
+    std::shared_lock<std::shared_mutex> lock(dataMux_);
     auto entry = data_.find(node);
     if (entry != data_.end()) {
       const auto& states = entry->second;
@@ -141,6 +237,7 @@ public:
   }
 
   TableState metrics(const std::string& table) const {
+    std::shared_lock<std::shared_mutex> lock(dataMux_);
     TableState metricsOnly{ table };
     // aggregate all nodes for given table
     for (auto& ts : data_) {
@@ -155,7 +252,7 @@ public:
   }
 
 private:
-  BlockManager() : blocks_{ 0 } {
+  BlockManager() : blocks_{ 0 }, epoch_{ nebula::common::Evidence::ticks() }, version_{ 0 }, floor_{ 0 } {
     data_.emplace(nebula::meta::NNode::inproc(), TableStates{});
   }
 
@@ -167,13 +264,36 @@ private:
     return data_.at(nebula::meta::NNode::inproc());
   }
 
+  // add a block while holding the exclusive lock
+  bool insert(std::shared_ptr<io::BatchBlock>);
+
+  // record a local block change in the journal, and in the block store unless the caller updates it
+  void journal(bool, const std::shared_ptr<io::BatchBlock>&, bool = true);
+
 private:
   // counter for in/out of blocks
-  size_t blocks_;
+  std::atomic<size_t> blocks_;
+
+  // guards all table states, exclusive for adding and removing blocks
+  mutable std::shared_mutex dataMux_;
 
   // meta data for remote blocks
   nebula::common::unordered_map<nebula::meta::NNode, TableStates, nebula::meta::NodeHash, nebula::meta::NodeEqual> data_;
 
+  // journal of local block changes for incremental sync,
+  // changes not newer than floor are dropped out of the journal
+  const size_t epoch_;
+  size_t version_;
+  size_t floor_;
+  std::deque<BlockChange> journal_;
+  mutable std::mutex journalMux_;
+
+  // epoch and version of each remote node applied,
+  // locks are taken in order of sync mutex, data mutex and journal mutex
+  nebula::common::unordered_map<nebula::meta::NNode, std::pair<size_t, size_t>, nebula::meta::NodeHash, nebula::meta::NodeEqual> cursors_;
+  std::vector<BlockListener> listeners_;
+  mutable std::mutex syncMux_;
+
 private:
   static std::mutex smux;
   static std::shared_ptr<BlockManager> inst;
@@ -16,7 +16,14 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+#include "common/Errors.h"
 #include "common/Hash.h"
+#include "common/Memory.h"
 #include "meta/ClusterInfo.h"
 
 /**
@@ -58,12 +65,108 @@ struct QueryStats {
   }
 };
 
+// cooperative cancellation of a query shared by all its tasks in a process.
+// a token is cancelled explicitly (client gone, timeout) or when its deadline passes,
+// long running loops check it every CHECK_INTERVAL rows and abort early.
+class CancelToken {
+public:
+  using Clock = std::chrono::steady_clock;
+  static constexpr size_t CHECK_INTERVAL = 1024;
+
+  CancelToken() : cancelled_{ false }, deadline_{ Clock::time_point::max().time_since_epoch().count() }, seq_{ 0 } {}
+
+  // cancel and notify all subscribers
+  void cancel() {
+    if (cancelled_.exchange(true)) {
+      return;
+    }
+
+    // callbacks run under lock, so a subscriber is safe to release its resources after unsubscribe
+    std::lock_guard<std::mutex> lock(mux_);
+    for (auto& cb : callbacks_) {
+      cb.second();
+    }
+  }
+
+  // set a deadline, it only moves earlier
+  void expireAt(Clock::time_point time) noexcept {
+    auto ticks = time.time_since_epoch().count();
+    auto current = deadline_.load();
+    while (ticks < current && !deadline_.compare_exchange_weak(current, ticks)) {
+    }
+  }
+
+  // deadline of wall clock such as the one from a rpc
+  void expireAt(std::chrono::system_clock::time_point time) noexcept {
+    if (time != std::chrono::system_clock::time_point::max()) {
+      expireAt(Clock::now() + std::chrono::duration_cast<Clock::duration>(time - std::chrono::system_clock::now()));
+    }
+  }
+
+  inline void expireAfter(std::chrono::milliseconds ms) noexcept {
+    expireAt(Clock::now() + ms);
+  }
+
+  inline Clock::time_point deadline() const noexcept {
+    return Clock::time_point(Clock::duration(deadline_.load()));
+  }
+
+  inline bool cancelled() const noexcept {
+    return cancelled_.load(std::memory_order_relaxed)
+           || Clock::now().time_since_epoch().count() >= deadline_.load(std::memory_order_relaxed);
+  }
+
+  // abort current task by exception if cancelled
+  inline void check() const {
+    if (cancelled()) {
+      throw NException("Query is cancelled or exceeds its deadline");
+    }
+  }
+
+  // run the callback once cancelled explicitly, return an id to unsubscribe it
+  size_t subscribe(std::function<void()> callback) {
+    std::unique_lock<std::mutex> lock(mux_);
+    if (cancelled_) {
+      lock.unlock();
+      callback();
+      return 0;
+    }
+
+    callbacks_.emplace(++seq_, std::move(callback));
+    return seq_;
+  }
+
+  void unsubscribe(size_t id) {
+    std::lock_guard<std::mutex> lock(mux_);
+    callbacks_.erase(id);
+  }
+
+private:
+  std::atomic<bool> cancelled_;
+  std::atomic<Clock::rep> deadline_;
+  std::mutex mux_;
+  size_t seq_;
+  nebula::common::unordered_map<size_t, std::function<void()>> callbacks_;
+};
+
+// scheduling priority of a query, decided by its estimated cost at admission.
+// block tasks of a higher priority query run before those of lower ones in a node.
+enum class Priority : int8_t {
+  HIGH = 0,
+  NORMAL = 1,
+  LOW = 2
+};
+
 class QueryContext {
 public:
   QueryContext(const std::string& user, nebula::common::unordered_set<std::string> groups)
     : user_{ user },
       groups_{ std::move(groups) },
       error_{ Error::NONE },
+      priority_{ Priority::NORMAL },
+      token_{ std::make_shared<CancelToken>() },
+      budget_{ nebula::common::MemoryBudget::query() },
+      partial_{ false },
       stats_{} {}
 
   inline bool isAuth() const {
@@ -87,6 +190,43 @@ public:
     return error_;
   }
 
+  // result misses some data as a node failed, timed out or was answered by its replicas
+  inline void markPartial() noexcept {
+    partial_ = true;
+  }
+
+  inline bool partial() const noexcept {
+    return partial_;
+  }
+
+  // queries are scheduled fairly across tenants, a tenant is the user sending the query
+  inline const std::string& tenant() const {
+    return user_;
+  }
+
+  inline void setPriority(Priority priority) {
+    priority_ = priority;
+  }
+
+  inline Priority priority() const {
+    return priority_;
+  }
+
+  // cancellation token of the query, shared with its tasks which may outlive the plan
+  inline const std::shared_ptr<CancelToken>& token() const {
+    return token_;
+  }
+
+  // adopt a token created before the query, such as the one bound to its rpc call
+  inline void setToken(std::shared_ptr<CancelToken> token) {
+    token_ = std::move(token);
+  }
+
+  // memory budget of the query in this process, charged by chunks allocated in its tasks
+  inline const std::shared_ptr<nebula::common::MemoryBudget>& budget() const {
+    return budget_;
+  }
+
   inline bool requireAuth() const {
     // check if current system requires auth
     return nebula::meta::ClusterInfo::singleton().server().authRequired;
@@ -111,6 +251,10 @@ private:
   std::string user_;
   nebula::common::unordered_set<std::string> groups_;
   Error error_;
+  Priority priority_;
+  std::shared_ptr<CancelToken> token_;
+  std::shared_ptr<nebula::common::MemoryBudget> budget_;
+  std::atomic<bool> partial_;
   QueryStats stats_;
 };
 
@@ -41,7 +41,8 @@ ExecutionPlan::ExecutionPlan(
     ctx_{ std::move(ctx) },
     plan_{ std::move(plan) },
     nodes_{ std::move(nodes) },
-    output_{ output } {}
+    output_{ output },
+    guard_{ std::make_shared<PlanGuard>() } {}
 
 void ExecutionPlan::display() const {
   LOG(INFO) << "Query will be executed in nodes: " << nodes_.size();
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <numeric>
+#include <shared_mutex>
 
 #include "Context.h"
 #include "common/Cursor.h"
@@ -68,6 +69,39 @@ using BlockPhase = Phase<PhaseType::COMPUTE>;
 using NodePhase = Phase<PhaseType::PARTIAL>;
 using FinalPhase = Phase<PhaseType::GLOBAL>;
 
+// guard plan access from callbacks which may outlive the plan,
+// such as a node response arriving after a hedged request already answered.
+class PlanGuard {
+public:
+  PlanGuard() : closed_{ false } {}
+  ~PlanGuard() = default;
+
+  // run given function if the plan is still alive, plan can not be released during the run.
+  // functions run concurrently with each other, they should be short accesses such as a block task,
+  // never a wait for a whole execution, as releasing the plan waits for them.
+  template <typename F>
+  bool run(F&& func) {
+    std::shared_lock<std::shared_mutex> lock(mux_);
+    if (closed_) {
+      return false;
+    }
+
+    func();
+    return true;
+  }
+
+  // close the guard when the plan is released, it waits for running functions only,
+  // tasks picked up later find the plan gone and drop their results
+  inline void close() {
+    std::unique_lock<std::shared_mutex> lock(mux_);
+    closed_ = true;
+  }
+
+private:
+  std::shared_mutex mux_;
+  bool closed_;
+};
+
 // An execution plan that can be serialized and passed around
 // protobuf?
 class ExecutionPlan {
@@ -76,7 +110,9 @@ public:
                 std::unique_ptr<ExecutionPhase>,
                 std::vector<nebula::meta::NNode>,
                 nebula::type::Schema);
-  virtual ~ExecutionPlan() = default;
+  virtual ~ExecutionPlan() {
+    guard_->close();
+  }
 
 public:
   void display() const;
@@ -109,6 +145,10 @@ public:
     return *ctx_;
   }
 
+  inline std::shared_ptr<PlanGuard> guard() const noexcept {
+    return guard_;
+  }
+
 private:
   const ExecutionPhase& fetch(PhaseType type) const;
 
@@ -119,6 +159,7 @@ private:
   std::vector<nebula::meta::NNode> nodes_;
   nebula::type::Schema output_;
   QueryWindow window_;
+  std::shared_ptr<PlanGuard> guard_;
 };
 
 // base execution phase definition - templated lambda - looking for C++ 20?
@@ -16,6 +16,9 @@
 
 #include "TableState.h"
 
+#include <algorithm>
+#include <map>
+
 namespace nebula {
 namespace execution {
 
@@ -47,6 +50,12 @@ void TableState::iterate(std::function<void(const BatchBlock&)> func) const {
   }
 }
 
+void TableState::iterateOpen(std::function<void(const BatchBlock&)> func) const {
+  for (auto& b : open_) {
+    func(*b.second);
+  }
+}
+
 bool TableState::add(std::shared_ptr<BatchBlock> block) {
   const auto& spec = block->spec();
 
@@ -59,9 +68,165 @@ bool TableState::add(std::shared_ptr<BatchBlock> block) {
   return true;
 }
 
-size_t TableState::remove(const std::string& spec) {
+size_t TableState::remove(const std::string& spec, std::vector<std::shared_ptr<BatchBlock>>* removed) {
+  open_.erase(spec);
+  if (removed) {
+    auto range = data_.equal_range(spec);
+    for (auto itr = range.first; itr != range.second; ++itr) {
+      removed->push_back(itr->second);
+    }
+  }
+
   auto count = data_.erase(spec);
+  refresh();
+  return count;
+}
+
+size_t TableState::remove(const std::string& spec, size_t before, std::vector<std::shared_ptr<BatchBlock>>* removed) {
+  size_t count = 0;
+  auto range = data_.equal_range(spec);
+  for (auto itr = range.first; itr != range.second;) {
+    if (itr->second->end() < before) {
+      if (removed) {
+        removed->push_back(itr->second);
+      }
+
+      itr = data_.erase(itr);
+      ++count;
+      continue;
+    }
+
+    ++itr;
+  }
+
+  if (count > 0) {
+    refresh();
+  }
+
+  return count;
+}
+
+size_t TableState::remove(const std::vector<BlockSignature>& signs) {
+  size_t count = 0;
+  for (const auto& sign : signs) {
+    auto range = data_.equal_range(sign.spec);
+    auto itr = std::find_if(range.first, range.second, [&sign](const auto& e) {
+      return e.second->signature() == sign;
+    });
+
+    if (itr != range.second) {
+      data_.erase(itr);
+      ++count;
+    }
+  }
+
+  if (count > 0) {
+    refresh();
+  }
+
+  return count;
+}
+
+void TableState::open(const std::string& spec, std::shared_ptr<BatchBlock> block) {
+  if (block == nullptr) {
+    open_.erase(spec);
+    return;
+  }
+
+  open_[spec] = block;
+}
+
+std::vector<std::vector<std::shared_ptr<BatchBlock>>> TableState::compactable(size_t small, size_t max) const {
+  // small blocks of the same spec and partition
+  std::map<std::pair<std::string, size_t>, std::vector<std::shared_ptr<BatchBlock>>> candidates;
+  for (auto& b : data_) {
+    const auto& batch = b.second->data();
+    if (batch == nullptr || batch->getRows() >= small) {
+      continue;
+    }
+
+    candidates[{ b.first, batch->pid() }].push_back(b.second);
+  }
+
+  std::vector<std::vector<std::shared_ptr<BatchBlock>>> groups;
+  for (auto& c : candidates) {
+    auto& blocks = c.second;
+    if (blocks.size() < 2) {
+      continue;
+    }
+
+    // pack adjacent blocks by time
+    std::sort(blocks.begin(), blocks.end(), [](const auto& x, const auto& y) {
+      return x->start() < y->start();
+    });
+
+    std::vector<std::shared_ptr<BatchBlock>> group;
+    size_t rows = 0;
+    for (auto& b : blocks) {
+      auto n = b->state().numRows;
+      if (rows + n > max) {
+        if (group.size() > 1) {
+          groups.push_back(std::move(group));
+        }
+
+        group = {};
+        rows = 0;
+      }
 
+      group.push_back(b);
+      rows += n;
+    }
+
+    if (group.size() > 1) {
+      groups.push_back(std::move(group));
+    }
+  }
+
+  return groups;
+}
+
+std::vector<std::shared_ptr<BatchBlock>> TableState::resident() const {
+  std::vector<std::shared_ptr<BatchBlock>> blocks;
+  for (auto& b : data_) {
+    const auto& batch = b.second->data();
+    if (batch != nullptr && batch->sealed() && !batch->paged()) {
+      blocks.push_back(b.second);
+    }
+  }
+
+  return blocks;
+}
+
+bool TableState::replace(const std::vector<std::shared_ptr<BatchBlock>>& blocks, std::shared_ptr<BatchBlock> merged) {
+  const auto& spec = merged->spec();
+  auto range = data_.equal_range(spec);
+
+  // make sure all blocks are still present, they may be expired meanwhile
+  std::vector<decltype(range.first)> found;
+  found.reserve(blocks.size());
+  for (auto& b : blocks) {
+    auto itr = std::find_if(range.first, range.second, [&b](const auto& e) {
+      return e.second == b;
+    });
+
+    if (itr == range.second) {
+      return false;
+    }
+
+    found.push_back(itr);
+  }
+
+  // swap them in one go
+  for (auto& itr : found) {
+    data_.erase(itr);
+  }
+
+  data_.emplace(spec, merged);
+  refresh();
+  return true;
+}
+
+void TableState::refresh() {
   // update the metrics
   size_t rows = 0;
   size_t bytes = 0;
@@ -74,22 +239,58 @@ size_t TableState::remove(const std::string& spec) {
   rows_ = rows;
   bytes_ = bytes;
   window_ = window;
-
-  return count;
 }
 
-std::vector<nebula::memory::BatchPtr> TableState::query(const Window& window) const {
+std::vector<nebula::memory::BatchPtr> TableState::query(const Window& window, const SpecFilter& filter) const {
   std::vector<nebula::memory::BatchPtr> batches;
   batches.reserve(data_.size());
 
   for (auto& b : data_) {
+    if (filter.excluded(b.first)) {
+      continue;
+    }
+
     if (b.second->overlap(window)) {
       batches.push_back(b.second->data());
     }
   }
 
+  // open blocks don't have a fixed time range in signature,
+  // use the time histogram maintained incrementally to prune them.
+  for (auto& b : open_) {
+    if (filter.excluded(b.first)) {
+      continue;
+    }
+
+    const auto& batch = b.second->data();
+    auto snapshot = batch->snapshot();
+    if (batch->getRows() == 0) {
+      continue;
+    }
+
+    const auto& h = batch->histogram<nebula::surface::eval::IntHistogram>(nebula::meta::Table::TIME_COLUMN);
+    if ((size_t)h.max() < window.first || (size_t)h.min() > window.second) {
+      continue;
+    }
+
+    batches.push_back(batch);
+  }
+
   return batches;
 }
 
+SpecSet TableState::specs() const {
+  SpecSet specs;
+  for (auto& b : data_) {
+    specs.emplace(b.first);
+  }
+
+  for (auto& b : open_) {
+    specs.emplace(b.first);
+  }
+
+  return specs;
+}
+
 } // namespace execution
 } // namespace nebula
\ No newline at end of file
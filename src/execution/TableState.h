@@ -27,6 +27,31 @@
 // It also provides management of real-data
 namespace nebula {
 namespace execution {
+
+// a set of block specs
+using SpecSet = nebula::common::unordered_set<std::string>;
+
+// blocks of a query in a node by their specs, either all but the skipped specs,
+// or only the given specs. default filter scans all blocks.
+// a node skips replicated specs assigned to other nodes so that its new and open blocks are never missed,
+// a hedge request scans only the specs it takes over.
+struct SpecFilter {
+  SpecSet specs;
+  bool only = false;
+
+  inline bool excluded(const std::string& spec) const {
+    return (specs.find(spec) != specs.end()) != only;
+  }
+
+  inline static SpecFilter skip(SpecSet specs) {
+    return SpecFilter{ std::move(specs), false };
+  }
+
+  inline static SpecFilter include(SpecSet specs) {
+    return SpecFilter{ std::move(specs), true };
+  }
+};
+
 class TableState {
   using Window = std::pair<size_t, size_t>;
 
@@ -83,11 +108,42 @@ public:
   // add a block already loaded
   bool add(std::shared_ptr<nebula::execution::io::BatchBlock>);
 
-  // remove all blocks for given spec
-  size_t remove(const std::string&);
+  // remove all blocks for given spec, removed blocks are collected if a list is given
+  size_t remove(const std::string&, std::vector<std::shared_ptr<nebula::execution::io::BatchBlock>>* = nullptr);
+
+  // remove blocks for given spec which end before given time
+  size_t remove(const std::string&, size_t, std::vector<std::shared_ptr<nebula::execution::io::BatchBlock>>* = nullptr);
 
-  // get all data batch pointers by given window
-  std::vector<nebula::memory::BatchPtr> query(const Window&) const;
+  // remove blocks of given signatures, return number of blocks found and removed
+  size_t remove(const std::vector<nebula::meta::BlockSignature>&);
+
+  // register the open block of its spec which is still appended by ingestion,
+  // it replaces previous open block of the same spec, nullptr data closes it.
+  // open blocks are queryable but not counted in table metrics until sealed.
+  void open(const std::string&, std::shared_ptr<nebula::execution::io::BatchBlock>);
+
+  inline size_t numOpenBlocks() const {
+    return open_.size();
+  }
+
+  // group sealed blocks having less rows than given small size by spec and partition.
+  // blocks in a group are adjacent in time and their total rows don't exceed given max.
+  // only groups of more than one block are returned.
+  std::vector<std::vector<std::shared_ptr<nebula::execution::io::BatchBlock>>> compactable(size_t, size_t) const;
+
+  // replace a group of blocks of the same spec by the one merged from them.
+  // nothing changes and return false if any of them is not present anymore.
+  bool replace(const std::vector<std::shared_ptr<nebula::execution::io::BatchBlock>>&,
+               std::shared_ptr<nebula::execution::io::BatchBlock>);
+
+  // sealed blocks holding their pages in memory, not paged from disk
+  std::vector<std::shared_ptr<nebula::execution::io::BatchBlock>> resident() const;
+
+  // get all data batch pointers by given window, filtered by their specs
+  std::vector<nebula::memory::BatchPtr> query(const Window&, const SpecFilter& = {}) const;
+
+  // all specs having blocks in this table, including open ones
+  SpecSet specs() const;
 
   // merge metrics only from other table state object
   void merge(const TableState&, bool metricsOnly = true);
@@ -95,6 +151,13 @@ public:
   // iterate every single block to feed the given lambda
   void iterate(std::function<void(const nebula::execution::io::BatchBlock&)>) const;
 
+  // iterate open blocks to feed the given lambda
+  void iterateOpen(std::function<void(const nebula::execution::io::BatchBlock&)>) const;
+
+private:
+  // recompute metrics from all blocks
+  void refresh();
+
 private:
   // table name
   std::string table_;
@@ -108,6 +171,8 @@ private:
   size_t bytes_;
   // time window covers blocks
   Window window_;
+  // spec signature -> open block being appended
+  nebula::common::unordered_map<std::string, std::shared_ptr<nebula::execution::io::BatchBlock>> open_;
 };
 } // namespace execution
 } // namespace nebula
\ No newline at end of file
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Admission.h"
+
+#include <fmt/format.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <tuple>
+
+#include "common/Errors.h"
+
+DEFINE_uint32(MAX_QUERIES, 32, "max number of queries running concurrently in server");
+DEFINE_uint32(MAX_QUEUED_QUERIES, 1000, "max number of queries waiting for admission, more are rejected");
+DEFINE_uint64(INTERACTIVE_ROWS, 10000000, "queries scanning fewer rows run in high priority");
+DEFINE_uint64(HEAVY_ROWS, 500000000, "queries scanning more rows run in low priority");
+DEFINE_uint64(ADMISSION_AGING_MS, 5000, "cost of a query waiting for admission is halved every this many miliseconds");
+
+/**
+ * Admission control of queries in nebula server.
+ */
+namespace nebula {
+namespace execution {
+namespace core {
+
+Admission& Admission::singleton() {
+  static Admission admission{ FLAGS_MAX_QUERIES, FLAGS_MAX_QUEUED_QUERIES };
+  return admission;
+}
+
+Priority Admission::classify(size_t cost) {
+  if (cost < FLAGS_INTERACTIVE_ROWS) {
+    return Priority::HIGH;
+  }
+
+  return cost > FLAGS_HEAVY_ROWS ? Priority::LOW : Priority::NORMAL;
+}
+
+folly::Future<Admission::TicketPtr> Admission::admit(
+  const std::string& tenant, size_t cost, std::shared_ptr<CancelToken> token) {
+  std::vector<folly::Promise<TicketPtr>> expired;
+  folly::Future<TicketPtr> future = folly::Future<TicketPtr>::makeEmpty();
+  {
+    std::lock_guard<std::mutex> lock(mux_);
+    if (running_ < concurrency_) {
+      ++running_;
+      ++tenants_[tenant];
+      return folly::makeFuture(std::make_shared<Ticket>(*this, tenant));
+    }
+
+    // abandoned queries don't hold places in a full queue
+    if (waiting_.size() >= queue_) {
+      expire(expired);
+    }
+
+    if (waiting_.size() >= queue_) {
+      LOG(WARNING) << "Reject query of " << tenant << " with " << waiting_.size() << " queries waiting.";
+      future = folly::makeFuture<TicketPtr>(
+        NException(fmt::format("Server is busy: {0} queries running, {1} waiting", running_, waiting_.size())));
+    } else {
+      waiting_.push_back({ tenant, cost, seq_++, CancelToken::Clock::now(), std::move(token), folly::Promise<TicketPtr>() });
+      future = waiting_.back().promise.getFuture();
+    }
+  }
+
+  for (auto& p : expired) {
+    p.setException(NException("Query is cancelled while waiting for admission"));
+  }
+
+  return future;
+}
+
+void Admission::expire(std::vector<folly::Promise<TicketPtr>>& expired) {
+  for (auto w = waiting_.begin(); w != waiting_.end();) {
+    if (w->token && w->token->cancelled()) {
+      expired.push_back(std::move(w->promise));
+      w = waiting_.erase(w);
+      continue;
+    }
+
+    ++w;
+  }
+}
+
+void Admission::release(const std::string& tenant) {
+  std::vector<folly::Promise<TicketPtr>> expired;
+  folly::Promise<TicketPtr> next = folly::Promise<TicketPtr>::makeEmpty();
+  std::string admitted;
+  {
+    std::lock_guard<std::mutex> lock(mux_);
+    --running_;
+    auto itr = tenants_.find(tenant);
+    if (itr != tenants_.end() && --itr->second == 0) {
+      tenants_.erase(itr);
+    }
+
+    expire(expired);
+    if (!waiting_.empty()) {
+      // least running tenant first, then cheaper query, then earlier one.
+      // cost is halved every aging period the query waits.
+      auto load = [this](const std::string& t) {
+        auto found = tenants_.find(t);
+        return found == tenants_.end() ? size_t{ 0 } : found->second;
+      };
+
+      const auto now = CancelToken::Clock::now();
+      auto aged = [now](const Waiter& w) {
+        const size_t waited = std::chrono::duration_cast<std::chrono::milliseconds>(now - w.arrival).count();
+        const auto periods = FLAGS_ADMISSION_AGING_MS == 0 ? 0 : waited / FLAGS_ADMISSION_AGING_MS;
+        return periods >= 64 ? size_t{ 0 } : w.cost >> periods;
+      };
+
+      auto key = [&load, &aged](const Waiter& w) {
+        return std::make_tuple(load(w.tenant), aged(w), w.seq);
+      };
+
+      auto pick = waiting_.begin();
+      for (auto w = std::next(pick); w != waiting_.end(); ++w) {
+        if (key(*w) < key(*pick)) {
+          pick = w;
+        }
+      }
+
+      ++running_;
+      ++tenants_[pick->tenant];
+      admitted = pick->tenant;
+      next = std::move(pick->promise);
+      waiting_.erase(pick);
+    }
+  }
+
+  // fulfill out of lock as continuations may run inline
+  for (auto& p : expired) {
+    p.setException(NException("Query is cancelled while waiting for admission"));
+  }
+
+  if (next.valid()) {
+    next.setValue(std::make_shared<Ticket>(*this, admitted));
+  }
+}
+
+} // namespace core
+} // namespace execution
+} // namespace nebula
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <vector>
+
+#include "common/Folly.h"
+#include "common/Hash.h"
+#include "execution/Context.h"
+
+/**
+ * Admission control of queries in nebula server.
+ * At most a fixed number of queries run concurrently, the others wait in a bounded queue.
+ * When a query completes, the waiting query whose tenant has the least running queries
+ * is admitted next, ties are broken by smaller estimated cost, then arrival order.
+ * The cost of a waiting query is halved every aging period so that heavy queries are not starved,
+ * and queries cancelled or past their deadline leave the queue without being admitted.
+ */
+namespace nebula {
+namespace execution {
+namespace core {
+
+class Admission {
+public:
+  // a running slot of an admitted query, released when the ticket is destroyed
+  class Ticket {
+  public:
+    Ticket(Admission& admission, const std::string& tenant) : admission_{ admission }, tenant_{ tenant } {}
+    ~Ticket() {
+      admission_.release(tenant_);
+    }
+
+  private:
+    Admission& admission_;
+    std::string tenant_;
+  };
+
+  using TicketPtr = std::shared_ptr<Ticket>;
+
+  Admission(size_t concurrency, size_t queue)
+    : concurrency_{ concurrency }, queue_{ queue }, running_{ 0 }, seq_{ 0 } {}
+  virtual ~Admission() = default;
+
+  // admission of the server configured by MAX_QUERIES and MAX_QUEUED_QUERIES
+  static Admission& singleton();
+
+  // priority of a query by its estimated cost in rows to scan
+  static Priority classify(size_t);
+
+public:
+  // admit a query of given tenant and estimated cost,
+  // the future completes with a ticket once it can run, or fails if the queue is full
+  // or the query is cancelled by its token while waiting.
+  folly::Future<TicketPtr> admit(const std::string&, size_t, std::shared_ptr<CancelToken> = nullptr);
+
+  inline size_t running() const {
+    std::lock_guard<std::mutex> lock(mux_);
+    return running_;
+  }
+
+  inline size_t waiting() const {
+    std::lock_guard<std::mutex> lock(mux_);
+    return waiting_.size();
+  }
+
+private:
+  void release(const std::string&);
+
+private:
+  struct Waiter {
+    std::string tenant;
+    size_t cost;
+    size_t seq;
+    CancelToken::Clock::time_point arrival;
+    std::shared_ptr<CancelToken> token;
+    folly::Promise<TicketPtr> promise;
+  };
+
+  // move waiters cancelled or past their deadline out of the queue
+  void expire(std::vector<folly::Promise<TicketPtr>>&);
+
+  const size_t concurrency_;
+  const size_t queue_;
+
+  mutable std::mutex mux_;
+  size_t running_;
+  size_t seq_;
+
+  // running queries by tenant
+  nebula::common::unordered_map<std::string, size_t> tenants_;
+  std::list<Waiter> waiting_;
+};
+
+} // namespace core
+} // namespace execution
+} // namespace nebula
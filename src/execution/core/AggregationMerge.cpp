@@ -22,7 +22,7 @@
 #include "common/Fold.h"
 #include "execution/serde/RowCursorSerde.h"
 #include "memory/keyed/FlatRowCursor.h"
-#include "memory/keyed/HashFlat.h"
+#include "memory/keyed/SpillFlat.h"
 #include "surface/eval/UDF.h"
 
 DEFINE_uint64(MULTI_FOLD_WIDTH, 1,
@@ -39,8 +39,9 @@ namespace execution {
 namespace core {
 
 using nebula::common::CompositeCursor;
+using nebula::execution::CancelToken;
 using nebula::memory::keyed::FlatRowCursor;
-using nebula::memory::keyed::HashFlat;
+using nebula::memory::keyed::SpillFlat;
 using nebula::surface::EmptyRowCursor;
 using nebula::surface::RowCursorPtr;
 using nebula::surface::RowData;
@@ -53,7 +54,8 @@ RowCursorPtr merge(
   const Schema schema,
   const std::vector<std::unique_ptr<ValueEval>>& fields,
   const bool hasAggregation,
-  const std::vector<folly::Try<nebula::surface::RowCursorPtr>>& sources) {
+  const std::vector<folly::Try<nebula::surface::RowCursorPtr>>& sources,
+  const CancelToken* token) {
   const auto size = sources.size();
   LOG(INFO) << fmt::format("Merge sources: {0} with aggregation: {1}", size, hasAggregation);
   if (size == 0) {
@@ -67,7 +69,8 @@ RowCursorPtr merge(
     // transform folly tries into HashFlat
     // std::vector<std::unique_ptr<HashFlat>> blocks;
     // blocks.reserve(size);
-    auto hf = std::make_unique<HashFlat>(schema, fields);
+    // groups spill to disk by hash partitions if they grow over query memory budget
+    SpillFlat flat(schema, fields);
     for (auto it = sources.begin(); it < sources.end(); ++it) {
       // if the result is empty
       if (!it->hasValue()) {
@@ -75,13 +78,18 @@ RowCursorPtr merge(
       }
 
       auto blockResult = it->value();
-      while (blockResult->hasNext()) {
+      for (size_t rows = 0; blockResult->hasNext(); ++rows) {
+        // stop merging for a cancelled query
+        if (token && rows % CancelToken::CHECK_INTERVAL == 0) {
+          token->check();
+        }
+
         const auto& row = blockResult->next();
-        hf->update(row);
+        flat.update(row);
       }
     }
 
-    return std::make_shared<FlatRowCursor>(std::move(hf));
+    return flat.finish();
   }
 
   // TODO(cao) - I'm seeing multi-fold problems and even worse performance
@@ -17,6 +17,7 @@
 #pragma once
 
 #include "common/Folly.h"
+#include "execution/Context.h"
 #include "surface/DataSurface.h"
 #include "surface/eval/ValueEval.h"
 #include "type/Type.h"
@@ -33,7 +34,8 @@ nebula::surface::RowCursorPtr merge(
   const nebula::type::Schema,
   const nebula::surface::eval::Fields&,
   const bool,
-  const std::vector<folly::Try<nebula::surface::RowCursorPtr>>&);
+  const std::vector<folly::Try<nebula::surface::RowCursorPtr>>&,
+  const nebula::execution::CancelToken* = nullptr);
 } // namespace core
 } // namespace execution
 } // namespace nebula
\ No newline at end of file
@@ -17,7 +17,8 @@
 #include "BlockExecutor.h"
 
 #include "AggregationMerge.h"
-#include "memory/keyed/HashFlat.h"
+#include "memory/keyed/FlatRowCursor.h"
+#include "memory/keyed/SpillFlat.h"
 #include "surface/eval/UDF.h"
 
 /**
@@ -27,8 +28,11 @@ namespace nebula {
 namespace execution {
 namespace core {
 
+using nebula::execution::CancelToken;
 using nebula::memory::EvaledBlock;
-using nebula::memory::keyed::HashFlat;
+using nebula::memory::keyed::FlatBuffer;
+using nebula::memory::keyed::FlatRowCursor;
+using nebula::memory::keyed::SpillFlat;
 using nebula::surface::RowCursorPtr;
 using nebula::surface::SchemaRow;
 using nebula::surface::eval::BlockEval;
@@ -37,18 +41,21 @@ using nebula::surface::eval::ScriptData;
 using nebula::type::Kind;
 using nebula::type::Schema;
 
-RowCursorPtr compute(const EvaledBlock& data, const nebula::execution::BlockPhase& plan) {
+// rows scanned while holding snapshot of an open batch
+static constexpr size_t SNAPSHOT_ROWS = 1024;
+
+RowCursorPtr compute(const EvaledBlock& data, const nebula::execution::BlockPhase& plan, const CancelToken* token) {
   // TODO(cao) - SamplesExecutor seems having trouble evaluating scripts
   // see TestQuery: ApiTest.TestScriptSamples for repro
   if (plan.hasAggregation() || plan.hasScript()) {
-    return std::make_shared<BlockExecutor>(data, plan);
+    return std::make_shared<BlockExecutor>(data, plan, token);
   }
 
   return std::make_shared<SamplesExecutor>(data, plan);
 }
 
 void BlockExecutor::compute() {
-  // process every single row and put result in HashFlat
+  // process every single row and aggregate result in a hash flat which spills under memory pressure
   auto accessor = data_.first->makeAccessor();
   const auto& fields = plan_.fields();
   const auto& filter = plan_.filter();
@@ -56,6 +63,9 @@ void BlockExecutor::compute() {
   // build context and computed row associated with this context
   auto ctx = std::make_shared<EvalContext>(plan_.cacheEval(), makeScriptData(plan_));
 
+  // filter and aggregation over a sealed block without nulls skip all null checks
+  ctx->nullFree(data_.first->nullFree());
+
   // predicate pushdown evaluation on block metadata
   auto result = data_.second;
 
@@ -64,7 +74,7 @@ void BlockExecutor::compute() {
 
   auto fieldMap = SchemaRow::name2index(plan_.outputSchema());
   ComputedRow cr(fieldMap, plan_.fields(), ctx);
-  result_ = std::make_unique<HashFlat>(plan_.outputSchema(), fields);
+  SpillFlat flat(plan_.outputSchema(), fields);
 
   // we want to evaluate here for the whole block before we go to iterations of computing
   // by leveraging its metadata including histogram, bloom filter, dictionary etc.
@@ -77,19 +87,41 @@ void BlockExecutor::compute() {
   // and these methods will be used in each individual ValueEval and give result like above.
   // So we need an special operator to be implemented to have this function
 
-  for (size_t i = 0, size = data_.first->getRows(); i < size; ++i) {
-    ctx->reset(accessor->seek(i));
-
-    // if not fullfil the condition
-    // ignore valid here - if system can't determine how to act on NULL value
-    // we don't know how to make decision here too
-    bool valid = true;
-    if (!scanAll && !ctx->eval<bool>(filter, valid)) {
-      continue;
+  // an open batch is scanned up to its watermark at this moment.
+  // its snapshot is held per range of rows so that the writer may append in between.
+  const auto size = data_.first->getRows();
+  for (size_t begin = 0; begin < size; begin += SNAPSHOT_ROWS) {
+    auto snapshot = data_.first->snapshot();
+    for (size_t i = begin, end = std::min(size, begin + SNAPSHOT_ROWS); i < end; ++i) {
+      // abandoned query stops scanning
+      if (token_ && i % CancelToken::CHECK_INTERVAL == 0) {
+        token_->check();
+      }
+
+      ctx->reset(accessor->seek(i));
+
+      // if not fullfil the condition
+      // ignore valid here - if system can't determine how to act on NULL value
+      // we don't know how to make decision here too
+      bool valid = true;
+      if (!scanAll && !ctx->eval<bool>(filter, valid)) {
+        continue;
+      }
+
+      // flat compute every new value of each field and set to corresponding column in flat
+      flat.update(cr);
     }
+  }
 
-    // flat compute every new value of each field and set to corresponding column in flat
-    result_->update(cr);
+  // block result is kept as a flat buffer, a spilled one is merged back into it
+  auto groups = flat.finish();
+  if (auto cursor = dynamic_cast<FlatRowCursor*>(groups.get())) {
+    result_ = cursor->takeResult();
+  } else {
+    result_ = std::make_unique<FlatBuffer>(plan_.outputSchema(), fields);
+    while (groups->hasNext()) {
+      result_->add(groups->next());
+    }
   }
 
   // after the compute flat should contain all the data we need.
@@ -98,11 +130,25 @@ void BlockExecutor::compute() {
 }
 
 void SamplesExecutor::compute() {
+  index_ = 0;
+
+  // samples are read lazily, copy samples of an open batch out while holding its snapshot
+  if (data_.first->isOpen()) {
+    auto snapshot = data_.first->snapshot();
+    ReferenceRows samples(plan_, *data_.first);
+    copy_ = std::make_unique<FlatBuffer>(plan_.outputSchema(), plan_.fields());
+    while (samples.hasNext()) {
+      copy_->add(samples.next());
+    }
+
+    size_ = copy_->getRows();
+    return;
+  }
+
   // build context and computed row associated with this context
   samples_ = std::make_unique<ReferenceRows>(plan_, *data_.first);
 
   // after the compute flat should contain all the data we need.
-  index_ = 0;
   size_ = samples_->size();
 }
 
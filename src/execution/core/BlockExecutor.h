@@ -38,8 +38,11 @@ namespace core {
 class BlockExecutor : public nebula::surface::RowCursor {
 
 public:
-  BlockExecutor(const nebula::memory::EvaledBlock& data, const nebula::execution::BlockPhase& plan)
-    : nebula::surface::RowCursor(0), data_{ data }, plan_{ plan } {
+  BlockExecutor(
+    const nebula::memory::EvaledBlock& data,
+    const nebula::execution::BlockPhase& plan,
+    const nebula::execution::CancelToken* token = nullptr)
+    : nebula::surface::RowCursor(0), data_{ data }, plan_{ plan }, token_{ token } {
     // compute will finish the compute and fill the data state in
     this->compute();
   }
@@ -53,6 +56,10 @@ public:
     return result_->crow(index);
   }
 
+  inline const nebula::memory::keyed::FlatBuffer& result() const {
+    return *result_;
+  }
+
   inline std::unique_ptr<nebula::memory::keyed::FlatBuffer> takeResult() {
     auto temp = std::move(result_);
     result_ = nullptr;
@@ -63,9 +70,12 @@ private:
   void compute();
 
 private:
-  const nebula::memory::EvaledBlock& data_;
+  // a copy holds the batch alive as long as this cursor
+  const nebula::memory::EvaledBlock data_;
   const nebula::execution::BlockPhase& plan_;
-  std::unique_ptr<nebula::memory::keyed::HashFlat> result_;
+  // scan aborts once the query is cancelled
+  const nebula::execution::CancelToken* token_;
+  std::unique_ptr<nebula::memory::keyed::FlatBuffer> result_;
 };
 
 class SamplesExecutor : public nebula::surface::RowCursor {
@@ -78,24 +88,34 @@ public:
   virtual ~SamplesExecutor() = default;
 
   inline virtual const nebula::surface::RowData& next() override {
+    if (copy_) {
+      return copy_->row(index_++);
+    }
+
     index_++;
     return samples_->next();
   }
 
   inline virtual std::unique_ptr<nebula::surface::RowData> item(size_t index) const override {
-    return samples_->item(index);
+    return copy_ ? copy_->crow(index) : samples_->item(index);
   }
 
 private:
   void compute();
 
 private:
-  const nebula::memory::EvaledBlock& data_;
+  // a copy holds the batch alive as long as this cursor
+  const nebula::memory::EvaledBlock data_;
   const nebula::execution::BlockPhase& plan_;
   std::unique_ptr<ReferenceRows> samples_;
+  // samples copied from an open batch which may change after compute
+  std::unique_ptr<nebula::memory::keyed::FlatBuffer> copy_;
 };
 
-nebula::surface::RowCursorPtr compute(const nebula::memory::EvaledBlock&, const nebula::execution::BlockPhase&);
+nebula::surface::RowCursorPtr compute(
+  const nebula::memory::EvaledBlock&,
+  const nebula::execution::BlockPhase&,
+  const nebula::execution::CancelToken* = nullptr);
 
 } // namespace core
 } // namespace execution
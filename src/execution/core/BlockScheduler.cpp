@@ -0,0 +1,162 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BlockScheduler.h"
+
+#include <algorithm>
+#include <folly/Conv.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "common/Chars.h"
+#include "common/Errors.h"
+#include "common/Numa.h"
+
+DEFINE_string(TENANT_WEIGHTS, "", "share weights of tenants in block scheduling, such as 'dash:4,adhoc:1'");
+DEFINE_uint32(NUMA_LOOKAHEAD, 16, "number of queued tasks of a tenant a thread looks through for a block on its NUMA node");
+
+/**
+ * Priority and weighted fair scheduling of block tasks.
+ */
+namespace nebula {
+namespace execution {
+namespace core {
+
+using nebula::common::Chars;
+using nebula::common::Numa;
+
+BlockScheduler& BlockScheduler::singleton() {
+  static BlockScheduler scheduler;
+  static std::once_flag loaded;
+  std::call_once(loaded, []() {
+    const auto& conf = FLAGS_TENANT_WEIGHTS;
+    for (const auto& item : Chars::split(conf.data(), conf.size())) {
+      // a malformed entry is skipped rather than failing the process
+      auto pos = item.find(':');
+      auto weight = pos == std::string::npos ? 0 : folly::tryTo<double>(item.substr(pos + 1)).value_or(0);
+      if (!(weight > 0)) {
+        LOG(WARNING) << "Invalid tenant weight: " << item;
+        continue;
+      }
+
+      scheduler.weight(item.substr(0, pos), weight);
+    }
+  });
+
+  return scheduler;
+}
+
+void BlockScheduler::weight(const std::string& tenant, double weight) {
+  N_ENSURE_GT(weight, 0, "tenant weight should be positive");
+  std::lock_guard<std::mutex> lock(mux_);
+  weights_[tenant] = weight;
+
+  // applies to tasks taken from now on
+  auto itr = tenants_.find(tenant);
+  if (itr != tenants_.end()) {
+    itr->second.weight = weight;
+  }
+}
+
+void BlockScheduler::schedule(
+  folly::Executor& pool,
+  const std::string& tenant,
+  Priority priority,
+  size_t cost,
+  std::function<void()> work,
+  size_t node) {
+  {
+    std::lock_guard<std::mutex> lock(mux_);
+    auto itr = tenants_.find(tenant);
+    if (itr == tenants_.end()) {
+      // a tenant becoming busy starts from system virtual time, idle time earns no credit
+      auto w = weights_.find(tenant);
+      itr = tenants_.emplace(tenant, Tenant{ vtime_, w == weights_.end() ? 1.0 : w->second, {} }).first;
+    }
+
+    itr->second.queues.at((size_t)priority).push_back({ (double)std::max<size_t>(cost, 1), std::move(work), node });
+    ++pending_;
+  }
+
+  // every task posts one token to the pool, the token runs whichever task is due
+  auto token = [this]() { next(); };
+  if (pool.getNumPriorities() > 1) {
+    pool.addWithPriority(std::move(token), folly::Executor::HI_PRI);
+  } else {
+    pool.add(std::move(token));
+  }
+}
+
+bool BlockScheduler::next() {
+  // node of this thread, it stays on the node while running the task
+  Numa::Pin pin;
+  const auto local = Numa::singleton().nodes() > 1 ? pin.node() : ANY_NODE;
+
+  std::function<void()> work;
+  {
+    std::lock_guard<std::mutex> lock(mux_);
+    for (size_t p = 0; p < 3 && !work; ++p) {
+      // tenant with least virtual time in this priority goes next
+      auto pick = tenants_.end();
+      for (auto itr = tenants_.begin(); itr != tenants_.end(); ++itr) {
+        if (!itr->second.queues[p].empty() && (pick == tenants_.end() || itr->second.vtime < pick->second.vtime)) {
+          pick = itr;
+        }
+      }
+
+      if (pick == tenants_.end()) {
+        continue;
+      }
+
+      // a block on this node within the next few tasks, otherwise steal the first one
+      auto& tenant = pick->second;
+      auto& queue = tenant.queues[p];
+      auto task = queue.begin();
+      if (local != ANY_NODE) {
+        auto end = queue.begin() + std::min<size_t>(queue.size(), FLAGS_NUMA_LOOKAHEAD);
+        auto found = std::find_if(queue.begin(), end, [local](const Task& t) {
+          return t.node == local || t.node == ANY_NODE;
+        });
+
+        if (found != end) {
+          task = found;
+        }
+      }
+
+      vtime_ = std::max(vtime_, tenant.vtime);
+      tenant.vtime += task->cost / tenant.weight;
+      work = std::move(task->work);
+      queue.erase(task);
+      --pending_;
+
+      // drop idle tenant
+      if (std::all_of(tenant.queues.begin(), tenant.queues.end(), [](const auto& q) { return q.empty(); })) {
+        tenants_.erase(pick);
+      }
+    }
+  }
+
+  if (!work) {
+    return false;
+  }
+
+  work();
+  return true;
+}
+
+} // namespace core
+} // namespace execution
+} // namespace nebula
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+
+#include "common/Folly.h"
+#include "common/Hash.h"
+#include "execution/Context.h"
+
+/**
+ * Schedule block tasks of all queries in a node.
+ * Instead of running block tasks in FIFO order of the pool, every task is queued by its
+ * query's tenant and priority, and a pool thread picks the next one when it is free:
+ *   1. tasks of higher priority run first, so a light query overtakes a heavy one
+ *      at block granularity rather than waiting for all its blocks.
+ *   2. within a priority, tenants share the node by weighted fair queueing on scanned rows.
+ *   3. on a NUMA machine, a thread takes a task of the tenant whose block is on its own node,
+ *      or steals the first task if none of the next few is local.
+ */
+namespace nebula {
+namespace execution {
+namespace core {
+
+class BlockScheduler {
+public:
+  BlockScheduler() : vtime_{ 0 }, pending_{ 0 } {}
+  virtual ~BlockScheduler() = default;
+
+  // scheduler shared by all queries in the node, weights are loaded from TENANT_WEIGHTS
+  static BlockScheduler& singleton();
+
+public:
+  // any node can run a task without NUMA placement
+  static constexpr size_t ANY_NODE = std::numeric_limits<size_t>::max();
+
+  // queue a block task of given cost (rows) for the tenant, one pool thread will pick it up.
+  // threads on the NUMA node of its block are preferred to run it.
+  void schedule(folly::Executor&, const std::string&, Priority, size_t, std::function<void()>, size_t = ANY_NODE);
+
+  // run the next task by priority and fairness, return false if nothing is pending
+  bool next();
+
+  // set share weight of a tenant, default weight is 1
+  void weight(const std::string&, double);
+
+  inline size_t pending() const {
+    std::lock_guard<std::mutex> lock(mux_);
+    return pending_;
+  }
+
+private:
+  struct Task {
+    double cost;
+    std::function<void()> work;
+    size_t node;
+  };
+
+  struct Tenant {
+    // virtual finish time of tasks of this tenant taken so far
+    double vtime;
+    double weight;
+    std::array<std::deque<Task>, 3> queues;
+  };
+
+private:
+  mutable std::mutex mux_;
+  nebula::common::unordered_map<std::string, double> weights_;
+
+  // only tenants with pending tasks are tracked
+  nebula::common::unordered_map<std::string, Tenant> tenants_;
+
+  // virtual time of the system, start time of the latest task taken
+  double vtime_;
+  size_t pending_;
+};
+
+} // namespace core
+} // namespace execution
+} // namespace nebula
@@ -25,16 +25,29 @@ namespace execution {
 namespace core {
 
 using nebula::common::Cursor;
+using nebula::surface::EmptyRowCursor;
 using nebula::surface::RowCursorPtr;
 using nebula::surface::RowData;
 
-folly::Future<RowCursorPtr> NodeClient::execute(const ExecutionPlan& plan) {
+folly::Future<RowCursorPtr> NodeClient::execute(const ExecutionPlan& plan, const SpecFilter& specs) {
   auto p = std::make_shared<folly::Promise<RowCursorPtr>>();
 
-  // start to full fill the future
-  pool_.add([&plan, &pool = pool_, p]() {
-    NodeExecutor nodeExec(BlockManager::init(), true);
-    p->setValue(nodeExec.execute(pool, plan));
+  // start to full fill the future, skip if the plan is done when it's picked up.
+  // the guard is held only to launch the execution, its tasks check the guard by themselves,
+  // so the plan is released without waiting for the execution to complete.
+  pool_.add([&plan, &pool = pool_, p, specs, guard = plan.guard()]() {
+    auto f = folly::Future<RowCursorPtr>::makeEmpty();
+    auto run = guard->run([&]() {
+      NodeExecutor nodeExec(BlockManager::init(), true);
+      f = folly::makeFutureWith([&]() { return nodeExec.executeAsync(pool, plan, specs); });
+    });
+
+    if (!run) {
+      p->setValue(EmptyRowCursor::instance());
+      return;
+    }
+
+    std::move(f).thenTry([p](folly::Try<RowCursorPtr> result) { p->setTry(std::move(result)); });
   });
 
   return p->getFuture();
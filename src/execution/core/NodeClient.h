@@ -36,17 +36,34 @@ public:
     : node_{ node }, pool_{ pool } {}
   virtual ~NodeClient() = default;
 
-  virtual folly::Future<nebula::surface::RowCursorPtr> execute(const ExecutionPlan& plan);
+  // execute the plan in the node, filtered by block specs
+  virtual folly::Future<nebula::surface::RowCursorPtr> execute(const ExecutionPlan& plan, const SpecFilter& specs);
 
   // state is used to pull state of a node - do nothing for inproc node client
   virtual void update() {}
 
+  // poll block changes of the node since given epoch and version, return false if failed
+  virtual bool poll(size_t, size_t, BlockDelta&) {
+    return false;
+  }
+
   // task is used to send task to node and get state of the assignment
   virtual nebula::common::TaskState task(const nebula::common::Task&) {
     // this result can be viewed as failure since it doesn't get echo from target
     return nebula::common::TaskState::UNKNOWN;
   }
 
+  // send a batch of tasks to node, states are in the same order of tasks
+  virtual std::vector<nebula::common::TaskState> tasks(const std::vector<nebula::common::Task>& list) {
+    std::vector<nebula::common::TaskState> states;
+    states.reserve(list.size());
+    for (const auto& t : list) {
+      states.push_back(task(t));
+    }
+
+    return states;
+  }
+
 protected:
   nebula::meta::NNode node_;
   folly::ThreadPoolExecutor& pool_;
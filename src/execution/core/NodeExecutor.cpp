@@ -20,8 +20,11 @@
 
 #include "AggregationMerge.h"
 #include "BlockExecutor.h"
+#include "BlockScheduler.h"
+#include "PartialCache.h"
 #include "TopSort.h"
 #include "execution/meta/TableService.h"
+#include "memory/keyed/FlatRowCursor.h"
 #include "surface/eval/UDF.h"
 
 DEFINE_uint64(TOP_SORT_SCALE,
@@ -41,8 +44,11 @@ namespace nebula {
 namespace execution {
 namespace core {
 
+using nebula::common::MemoryExceededException;
+using nebula::common::MemoryScope;
 using nebula::execution::meta::TableService;
 using nebula::memory::Batch;
+using nebula::memory::keyed::FlatRowCursor;
 using nebula::surface::EmptyRowCursor;
 using nebula::surface::RowCursorPtr;
 using nebula::surface::eval::BlockEval;
@@ -50,69 +56,161 @@ using nebula::surface::eval::BlockEval;
 // set 10 seconds for now as max time to complete a query
 static const auto NODE_TIMEOUT = std::chrono::milliseconds(FLAGS_NODE_TIMEOUT);
 
-// distribute the compute task into a promise
+// compute phase on a block, partial aggregation of a closed block is reused across queries
+RowCursorPtr compute(
+  const nebula::memory::EvaledBlock& block,
+  const BlockPhase& phase,
+  const QueryWindow& window,
+  const CancelToken* token) {
+  auto key = PartialCache::key(phase, window, *block.first);
+  if (key.empty()) {
+    return nebula::execution::core::compute(block, phase, token);
+  }
+
+  auto& cache = PartialCache::singleton();
+  auto cached = cache.get(key, phase.outputSchema(), phase.fields());
+  if (cached) {
+    return std::make_shared<FlatRowCursor>(std::move(cached));
+  }
+
+  auto result = nebula::execution::core::compute(block, phase, token);
+  if (auto executor = dynamic_cast<BlockExecutor*>(result.get())) {
+    cache.put(block.first->id(), key, executor->result(), phase.fields());
+  }
+
+  return result;
+}
+
+// distribute the compute task into a promise,
+// it is queued by the query's tenant and priority and scanned rows as its cost.
 folly::Future<RowCursorPtr> dist(
   folly::ThreadPoolExecutor& pool,
   const nebula::memory::EvaledBlock& block,
-  const BlockPhase& phase) {
+  const BlockPhase& phase,
+  const ExecutionPlan& plan) {
+  const auto& ctx = plan.ctx();
   auto p = std::make_shared<folly::Promise<RowCursorPtr>>();
-  pool.addWithPriority(
-    [&block, &phase, p]() {
-      // compute phase on block and return the result
-      p->setValue(nebula::execution::core::compute(block, phase));
+  BlockScheduler::singleton().schedule(
+    pool,
+    ctx.tenant(),
+    ctx.priority(),
+    block.first->getRows(),
+    [block, &phase, &plan, p, token = ctx.token(), budget = ctx.budget(), guard = plan.guard()]() {
+      // a cancelled query sheds its pending blocks, its plan may be released already
+      p->setWith([&]() {
+        RowCursorPtr result;
+        auto alive = guard->run([&]() {
+          token->check();
+          // compute phase on block and return the result, its buffers are charged to the query budget.
+          // once the budget is exceeded, the query fails and its other blocks are shed.
+          MemoryScope scope(budget);
+          try {
+            result = compute(block, phase, plan.getWindow(), token.get());
+          } catch (const MemoryExceededException&) {
+            token->cancel();
+            throw;
+          }
+        });
+
+        if (!alive) {
+          throw NException("Query plan is released");
+        }
+
+        return result;
+      });
     },
-    folly::Executor::HI_PRI);
+    block.first->node());
 
   return p->getFuture();
 }
 
 /**
  * Execute a plan on a node level.
- * 
- * TODO(cao) - 
- * This will fanout to multiple blocks in a executor pool before return.
- * So the interfaces will be changed as async interfaces using future and promise.
+ * It fans out to multiple blocks in the executor pool and waits for the result.
  */
-RowCursorPtr NodeExecutor::execute(folly::ThreadPoolExecutor& pool, const ExecutionPlan& plan) {
+RowCursorPtr NodeExecutor::execute(folly::ThreadPoolExecutor& pool, const ExecutionPlan& plan, const SpecFilter& specs) {
+  return executeAsync(pool, plan, specs).get();
+}
+
+/**
+ * Execute a plan on a node level through continuations in the executor pool,
+ * no thread is blocked waiting for block executions.
+ * The plan needs to live through this call, its continuations access it under its guard
+ * and fail if it is released in the meantime.
+ */
+folly::Future<RowCursorPtr> NodeExecutor::executeAsync(
+  folly::ThreadPoolExecutor& pool, const ExecutionPlan& plan, const SpecFilter& specs) {
   const BlockPhase& blockPhase = plan.fetch<PhaseType::COMPUTE>();
+  // block tasks give up when the node timeout passes
+  plan.ctx().token()->expireAfter(NODE_TIMEOUT);
+
   // query total number of blocks to  executor on and
   // launch block executor on each in parallel
   // TODO(cao): this table service instance potentially can be carried by a query context on each node
   auto ts = TableService::singleton();
-  const FilteredBlocks blocks = blockManager_->query(*ts->query(blockPhase.table()).table(), plan, pool);
-
-  LOG(INFO) << "Processing total blocks: " << blocks.size();
-  std::vector<folly::Future<RowCursorPtr>> results;
-  auto& stats = plan.ctx().stats();
-  results.reserve(blocks.size());
-  std::transform(blocks.begin(), blocks.end(), std::back_inserter(results),
-                 [&blockPhase, &pool, &stats](const auto& block) {
-                   // increment the stats counter
-                   stats.blocksScan += 1;
-                   stats.rowsScan += block.first->getRows();
-                   return dist(pool, block, blockPhase);
-                 });
-
-  // compile the results into a single row cursor
-  auto x = folly::collectAll(results).get(NODE_TIMEOUT);
-
-  // single response optimization
-  if (x.size() == 1) {
-    return x.at(0).value();
-  }
-
-  // depends on the query plan, if there is no aggregation
-  // the results set from different block exeuction can be simply composite together
-  // but the query needs to aggregate on keys, then we have to merge the results based on partial aggregatin plan
-  const NodePhase& phase = plan.fetch<PhaseType::PARTIAL>();
-  auto merged = merge(pool, phase.outputSchema(), phase.fields(), phase.hasAggregation(), x);
-
-  // if scale is 0 or this query has no limit on it
-  if (local_ || FLAGS_TOP_SORT_SCALE == 0 || phase.top() == 0) {
-    return merged;
-  }
-
-  return topSort<>(merged, phase, FLAGS_TOP_SORT_SCALE);
+  return blockManager_->queryAsync(*ts->query(blockPhase.table()).table(), plan, pool, specs)
+    .thenValue([&pool, &plan, local = local_, guard = plan.guard()](FilteredBlocks blocks) {
+      std::vector<folly::Future<RowCursorPtr>> results;
+      auto alive = guard->run([&]() {
+        const BlockPhase& blockPhase = plan.fetch<PhaseType::COMPUTE>();
+
+        LOG(INFO) << "Processing total blocks: " << blocks.size();
+        auto& stats = plan.ctx().stats();
+        results.reserve(blocks.size());
+        std::transform(blocks.begin(), blocks.end(), std::back_inserter(results),
+                       [&blockPhase, &pool, &plan, &stats](const auto& block) {
+                         // increment the stats counter
+                         stats.blocksScan += 1;
+                         stats.rowsScan += block.first->getRows();
+                         return dist(pool, block, blockPhase, plan);
+                       });
+      });
+
+      if (!alive) {
+        throw NException("Query plan is released");
+      }
+
+      // compile the results into a single row cursor
+      return folly::collectAll(results)
+        .via(&pool)
+        .within(NODE_TIMEOUT)
+        .thenValue([&pool, &plan, local, guard](std::vector<folly::Try<RowCursorPtr>> x) -> RowCursorPtr {
+          RowCursorPtr result;
+          auto alive = guard->run([&]() {
+            // partial results of a cancelled query are not worth merging,
+            // running out of memory fails the query rather than returning partial results
+            const auto& ctx = plan.ctx();
+            const auto& token = ctx.token();
+            ctx.budget()->check();
+            token->check();
+
+            // single response optimization
+            if (x.size() == 1) {
+              result = x.at(0).value();
+              return;
+            }
+
+            // depends on the query plan, if there is no aggregation
+            // the results set from different block exeuction can be simply composite together
+            // but the query needs to aggregate on keys, then we have to merge the results based on partial aggregatin plan
+            const NodePhase& phase = plan.fetch<PhaseType::PARTIAL>();
+            MemoryScope scope(ctx.budget());
+            result = merge(pool, phase.outputSchema(), phase.fields(), phase.hasAggregation(), x, token.get());
+
+            // if scale is 0 or this query has no limit on it
+            if (!local && FLAGS_TOP_SORT_SCALE > 0 && phase.top() > 0) {
+              result = topSort<>(result, phase, FLAGS_TOP_SORT_SCALE);
+            }
+          });
+
+          // a late result is dropped once the plan is released
+          if (!alive) {
+            throw NException("Query plan is released");
+          }
+
+          return result;
+        });
+    });
 }
 
 } // namespace core
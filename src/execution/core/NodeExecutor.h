@@ -38,7 +38,11 @@ public:
     : blockManager_{ blockManager }, local_{ local } {}
 
 public:
-  nebula::surface::RowCursorPtr execute(folly::ThreadPoolExecutor&, const ExecutionPlan&);
+  // execute the plan on local blocks, filtered by block specs
+  nebula::surface::RowCursorPtr execute(folly::ThreadPoolExecutor&, const ExecutionPlan&, const SpecFilter& = {});
+
+  // execute the plan without blocking current thread, the result is delivered through the future
+  folly::Future<nebula::surface::RowCursorPtr> executeAsync(folly::ThreadPoolExecutor&, const ExecutionPlan&, const SpecFilter& = {});
 
 private:
   const std::shared_ptr<BlockManager> blockManager_;
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PartialCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fmt/format.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "meta/Table.h"
+#include "surface/eval/Histogram.h"
+
+DEFINE_uint64(PARTIAL_CACHE_MB, 512, "memory in MB to cache partial aggregation results of blocks in node, 0 to disable it");
+
+/**
+ * Cache of partial aggregation results of blocks in a node.
+ */
+namespace nebula {
+namespace execution {
+namespace core {
+
+using nebula::common::Pool;
+using nebula::memory::Batch;
+using nebula::memory::keyed::FlatBuffer;
+using nebula::meta::Table;
+using nebula::surface::eval::Fields;
+using nebula::surface::eval::IntHistogram;
+using nebula::type::Schema;
+
+PartialCache& PartialCache::singleton() {
+  static PartialCache cache{ FLAGS_PARTIAL_CACHE_MB << 20 };
+  return cache;
+}
+
+std::string PartialCache::key(const BlockPhase& phase, const QueryWindow& window, const Batch& batch) {
+  // an open block is still growing, and scripts are only identified by their column names
+  if (!phase.hasAggregation() || phase.hasScript() || batch.isOpen() || batch.getRows() == 0) {
+    return {};
+  }
+
+  std::string filter{ phase.filter().signature() };
+
+  // time range filter is true for all rows of a block covered by the window,
+  // drop it so that the same block is reused by a sliding window
+  const auto& h = batch.histogram<IntHistogram>(Table::TIME_COLUMN);
+  if ((size_t)h.min() >= window.first && (size_t)h.max() <= window.second) {
+    auto time = fmt::format("(F:{0}>=C:{1})&&(F:{0}<=C:{2})", Table::TIME_COLUMN, (int64_t)window.first, (int64_t)window.second);
+    auto pos = filter.find(time);
+    if (pos != std::string::npos) {
+      filter.replace(pos, time.size(), "*");
+    }
+  }
+
+  auto key = fmt::format("{0}|{1}|", batch.id(), filter);
+  for (const auto& f : phase.fields()) {
+    key.append(f->signature()).append(",");
+  }
+
+  key.append("|");
+  for (auto k : phase.keys()) {
+    key.append(std::to_string(k)).append(",");
+  }
+
+  return key;
+}
+
+std::unique_ptr<FlatBuffer> PartialCache::get(const std::string& key, const Schema& schema, const Fields& fields) {
+  NByte* chunk = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mux_);
+    auto found = index_.find(key);
+    if (found == index_.end()) {
+      ++misses_;
+      return nullptr;
+    }
+
+    // move it to front as most recently used
+    entries_.splice(entries_.begin(), entries_, found->second);
+    const auto& data = found->second->data;
+    chunk = static_cast<NByte*>(Pool::getDefault().allocate(data.size()));
+    std::memcpy(chunk, data.data(), data.size());
+    ++hits_;
+  }
+
+  // the flat buffer owns the chunk and frees it when done
+  return std::make_unique<FlatBuffer>(schema, fields, chunk);
+}
+
+void PartialCache::put(size_t block, const std::string& key, const FlatBuffer& flat, const Fields& fields) {
+  if (capacity_ == 0 || flat.memory() > capacity_ / 8) {
+    return;
+  }
+
+  // serializing sketches appends them to the buffer, the result is still consumed by the query,
+  // so serialize a copy of it which shares sketches of the result but owns its data.
+  FlatBuffer copy(flat.schema(), fields);
+  for (size_t i = 0, rows = flat.getRows(); i < rows; ++i) {
+    copy.add(*flat.crow(i));
+  }
+
+  auto size = copy.prepareSerde();
+  if (size > capacity_ / 8) {
+    return;
+  }
+
+  std::vector<NByte> data(size);
+  auto written = copy.serialize(data.data());
+  N_ENSURE_LE(written, size, "serialized size out of prepared size");
+  data.resize(written);
+
+  std::lock_guard<std::mutex> lock(mux_);
+  auto found = index_.find(key);
+  if (found != index_.end()) {
+    erase(found->second);
+  }
+
+  entries_.push_front(Entry{ block, key, std::move(data) });
+  index_.emplace(key, entries_.begin());
+  blocks_[block].push_back(entries_.begin());
+  bytes_ += key.size() + entries_.front().data.size();
+
+  // evict least recently used ones
+  while (bytes_ > capacity_ && !entries_.empty()) {
+    erase(std::prev(entries_.end()));
+  }
+}
+
+void PartialCache::evict(size_t block) {
+  std::lock_guard<std::mutex> lock(mux_);
+  auto found = blocks_.find(block);
+  if (found == blocks_.end()) {
+    return;
+  }
+
+  // erase drops the block from the index with its last entry
+  auto entries = found->second;
+  for (auto itr : entries) {
+    erase(itr);
+  }
+}
+
+void PartialCache::erase(std::list<Entry>::iterator itr) {
+  bytes_ -= itr->key.size() + itr->data.size();
+  index_.erase(itr->key);
+
+  auto found = blocks_.find(itr->block);
+  auto& entries = found->second;
+  entries.erase(std::find(entries.begin(), entries.end(), itr));
+  if (entries.empty()) {
+    blocks_.erase(found);
+  }
+
+  entries_.erase(itr);
+}
+
+} // namespace core
+} // namespace execution
+} // namespace nebula
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <list>
+#include <mutex>
+
+#include "common/Hash.h"
+#include "execution/ExecutionPlan.h"
+#include "memory/Batch.h"
+#include "memory/keyed/FlatBuffer.h"
+
+/**
+ * Cache of partial aggregation results of blocks in a node.
+ * Dashboards refresh the same aggregation over a sliding window, only the newest blocks change.
+ * The result of a closed block is keyed by the block id and the signature of the block phase
+ * (fields, keys and filter), the time range filter is dropped from it if the block is fully
+ * covered by the query window, so later windows reuse it and only scan new blocks.
+ * Results are kept serialized, every hit rebuilds its own flat buffer with fields of the hitting query.
+ */
+namespace nebula {
+namespace execution {
+namespace core {
+
+class PartialCache {
+public:
+  explicit PartialCache(size_t capacity) : capacity_{ capacity }, bytes_{ 0 }, hits_{ 0 }, misses_{ 0 } {}
+  virtual ~PartialCache() = default;
+
+  // cache of the node sized by PARTIAL_CACHE_MB
+  static PartialCache& singleton();
+
+  // key of a block phase computing given block in the query window, empty if it can't be cached
+  static std::string key(const BlockPhase&, const QueryWindow&, const nebula::memory::Batch&);
+
+public:
+  // rebuild the cached result of given key, null if not found
+  std::unique_ptr<nebula::memory::keyed::FlatBuffer> get(
+    const std::string&, const nebula::type::Schema&, const nebula::surface::eval::Fields&);
+
+  // cache result of given block id and key, the result is left untouched for its query
+  void put(size_t, const std::string&, const nebula::memory::keyed::FlatBuffer&, const nebula::surface::eval::Fields&);
+
+  // drop all results of a block once it is removed
+  void evict(size_t);
+
+  inline size_t size() const {
+    std::lock_guard<std::mutex> lock(mux_);
+    return entries_.size();
+  }
+
+  inline size_t bytes() const {
+    std::lock_guard<std::mutex> lock(mux_);
+    return bytes_;
+  }
+
+  inline std::pair<size_t, size_t> stats() const {
+    std::lock_guard<std::mutex> lock(mux_);
+    return { hits_, misses_ };
+  }
+
+private:
+  struct Entry {
+    size_t block;
+    std::string key;
+    std::vector<NByte> data;
+  };
+
+  // remove an entry, lock is held by caller
+  void erase(std::list<Entry>::iterator);
+
+private:
+  const size_t capacity_;
+  mutable std::mutex mux_;
+
+  // most recently used at front
+  std::list<Entry> entries_;
+  nebula::common::unordered_map<std::string, std::list<Entry>::iterator> index_;
+  // entries of every block, a removed block drops them without scanning the cache
+  nebula::common::unordered_map<size_t, std::vector<std::list<Entry>::iterator>> blocks_;
+  size_t bytes_;
+  size_t hits_;
+  size_t misses_;
+};
+
+} // namespace core
+} // namespace execution
+} // namespace nebula
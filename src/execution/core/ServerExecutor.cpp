@@ -19,6 +19,7 @@
 #include "Finalize.h"
 #include "NodeConnector.h"
 #include "TopSort.h"
+#include "common/Evidence.h"
 #include "common/Folly.h"
 #include "surface/eval/UDF.h"
 
@@ -27,6 +28,13 @@ DEFINE_uint64(RPC_TIMEOUT,
               35000,
               "maximum time nebula can torelate for each query in miliseconds");
 
+DEFINE_uint32(HEDGE_PERCENTILE,
+              95,
+              "a node request not answered by this percentile latency of its query shape "
+              "is reissued to replicas of its blocks, 0 to disable hedging");
+
+DEFINE_uint64(HEDGE_MIN_MS, 20, "minimum delay in miliseconds before hedging a node request");
+
 /**
  * Nebula runtime / online meta data.
  */
@@ -34,7 +42,12 @@ namespace nebula {
 namespace execution {
 namespace core {
 
+using nebula::common::Evidence;
+using nebula::common::MemoryScope;
+using nebula::common::unordered_map;
 using nebula::meta::NNode;
+using nebula::meta::NodeEqual;
+using nebula::meta::NodeHash;
 using nebula::surface::EmptyRowCursor;
 using nebula::surface::RowCursorPtr;
 using nebula::surface::SchemaRow;
@@ -42,48 +55,342 @@ using nebula::surface::SchemaRow;
 // set 10 seconds for now as max time to complete a query
 static const auto RPC_TIMEOUT = std::chrono::milliseconds(FLAGS_RPC_TIMEOUT);
 
+// latency samples kept for each query shape, and samples needed before hedging
+static constexpr size_t HEDGE_WINDOW = 128;
+static constexpr size_t HEDGE_SAMPLES = 20;
+
+HedgePolicy& HedgePolicy::singleton() {
+  static HedgePolicy policy;
+  return policy;
+}
+
+void HedgePolicy::record(const std::string& shape, size_t ms) {
+  std::lock_guard<std::mutex> lock(mux_);
+  auto& samples = samples_[shape];
+  if (samples.values.size() < HEDGE_WINDOW) {
+    samples.values.push_back(ms);
+    return;
+  }
+
+  samples.values[samples.next] = ms;
+  samples.next = (samples.next + 1) % HEDGE_WINDOW;
+}
+
+size_t HedgePolicy::delay(const std::string& shape) const {
+  if (FLAGS_HEDGE_PERCENTILE == 0) {
+    return 0;
+  }
+
+  std::vector<size_t> values;
+  {
+    std::lock_guard<std::mutex> lock(mux_);
+    auto itr = samples_.find(shape);
+    if (itr == samples_.end() || itr->second.values.size() < HEDGE_SAMPLES) {
+      return 0;
+    }
+
+    values = itr->second.values;
+  }
+
+  const auto rank = std::min<size_t>(values.size() - 1, values.size() * FLAGS_HEDGE_PERCENTILE / 100);
+  std::nth_element(values.begin(), values.begin() + rank, values.end());
+  return std::max<size_t>(values.at(rank), FLAGS_HEDGE_MIN_MS);
+}
+
+std::string HedgePolicy::shape(const ExecutionPlan& plan) {
+  const auto& phase = plan.fetch<PhaseType::COMPUTE>();
+  const auto& window = plan.getWindow();
+
+  // window scale in power of 2 hours
+  size_t hours = window.second > window.first ? (window.second - window.first) / Evidence::HOUR_SECONDS : 0;
+  size_t scale = 0;
+  while (hours > 0) {
+    ++scale;
+    hours >>= 1;
+  }
+
+  return fmt::format("{0}/{1}/{2}/{3}", phase.table(), phase.keys().size(), phase.hasAggregation(), scale);
+}
+
+std::vector<NodeTarget> ServerExecutor::route(
+  const std::vector<NNode>& nodes,
+  const unordered_map<std::string, std::vector<NNode>>& placement) {
+  std::vector<NodeTarget> targets;
+  targets.reserve(nodes.size());
+  for (const auto& node : nodes) {
+    targets.push_back(NodeTarget{ node, {}, {} });
+  }
+
+  // every node scans all its blocks if no spec is replicated
+  auto replicated = std::any_of(placement.begin(), placement.end(), [](const auto& p) {
+    return p.second.size() > 1;
+  });
+
+  if (!replicated) {
+    return targets;
+  }
+
+  unordered_map<NNode, size_t, NodeHash, NodeEqual> index;
+  for (size_t i = 0, size = nodes.size(); i < size; ++i) {
+    index.emplace(nodes.at(i), i);
+  }
+
+  std::vector<bool> hedgeable(nodes.size(), true);
+  for (const auto& p : placement) {
+    // holders of the spec participating in this query
+    std::vector<size_t> holders;
+    for (const auto& n : p.second) {
+      auto found = index.find(n);
+      if (found != index.end()) {
+        holders.push_back(found->second);
+      }
+    }
+
+    if (holders.empty()) {
+      continue;
+    }
+
+    if (holders.size() == 1) {
+      hedgeable[holders.front()] = false;
+      continue;
+    }
+
+    // spread specs across their holders, the other holders skip it and the next one is to hedge with
+    const auto k = std::hash<std::string>()(p.first) % holders.size();
+    for (size_t i = 0, size = holders.size(); i < size; ++i) {
+      if (i != k) {
+        targets.at(holders.at(i)).skips.emplace(p.first);
+      }
+    }
+
+    targets.at(holders.at(k)).hedges[nodes.at(holders.at((k + 1) % holders.size()))].emplace(p.first);
+  }
+
+  for (size_t i = 0, size = targets.size(); i < size; ++i) {
+    if (!hedgeable.at(i)) {
+      targets.at(i).hedges.clear();
+    }
+  }
+
+  return targets;
+}
+
+folly::Future<RowCursorPtr> ServerExecutor::dispatch(
+  folly::ThreadPoolExecutor& pool,
+  const ExecutionPlan& plan,
+  const std::shared_ptr<NodeConnector> connector,
+  const NodeTarget& target,
+  const std::string& shape) {
+  auto& policy = HedgePolicy::singleton();
+  const Evidence::Duration duration;
+  auto primary = connector->makeClient(target.node, pool)
+                   ->execute(plan, SpecFilter::skip(target.skips))
+                   .thenValue([&policy, shape, duration](RowCursorPtr result) {
+                     policy.record(shape, duration.elapsedMs());
+                     return result;
+                   });
+
+  // a failed request leaves the result partial
+  auto fallback = [&plan, guard = plan.guard()](const folly::exception_wrapper& e) -> RowCursorPtr {
+    LOG(ERROR) << "Node request failed: " << e.what();
+    guard->run([&plan]() { plan.ctx().markPartial(); });
+    return EmptyRowCursor::instance();
+  };
+
+  const auto delay = policy.delay(shape);
+  if (delay == 0 || target.hedges.empty()) {
+    return std::move(primary).thenTry([fallback](folly::Try<RowCursorPtr> result) {
+      return result.hasValue() ? result.value() : fallback(result.exception());
+    });
+  }
+
+  // the first successful answer of the node and its hedge settles the request,
+  // a failed side waits for the other and the request fails only when both fail.
+  // node requests still running when it is settled are cancelled.
+  struct Hedge {
+    folly::Promise<RowCursorPtr> promise;
+    std::atomic<bool> done{ false };
+    std::atomic<bool> launched{ false };
+    std::atomic<size_t> failures{ 0 };
+    std::mutex mux;
+    std::vector<folly::Future<folly::Unit>> calls;
+  };
+
+  auto state = std::make_shared<Hedge>();
+  auto track = [state](folly::Future<folly::Unit> call) {
+    std::lock_guard<std::mutex> lock(state->mux);
+    if (state->done.load()) {
+      call.cancel();
+      return;
+    }
+
+    state->calls.push_back(std::move(call));
+  };
+
+  // replicas only answer for blocks known to server, open blocks and blocks not polled yet are missed
+  auto settle = [state, &plan, guard = plan.guard()](RowCursorPtr result, bool hedged) {
+    if (state->done.exchange(true)) {
+      return;
+    }
+
+    if (hedged) {
+      guard->run([&plan]() { plan.ctx().markPartial(); });
+    }
+
+    std::vector<folly::Future<folly::Unit>> calls;
+    {
+      std::lock_guard<std::mutex> lock(state->mux);
+      calls.swap(state->calls);
+    }
+
+    state->promise.setValue(std::move(result));
+    for (auto& call : calls) {
+      call.cancel();
+    }
+  };
+
+  auto fail = [state, settle, fallback](const folly::exception_wrapper& e) {
+    if (++state->failures == 2) {
+      settle(fallback(e), false);
+    }
+  };
+
+  // plan is accessed under its guard since the hedge may fire or return after query is answered
+  auto hedge = [&pool, &plan, connector, state, track, settle, fail, delay,
+                node = target.node, hedges = target.hedges, guard = plan.guard()]() {
+    if (state->done.load() || state->launched.exchange(true)) {
+      return;
+    }
+
+    guard->run([&]() {
+      LOG(INFO) << "Hedge node " << node.toString() << " with " << hedges.size() << " replicas, delay " << delay << "ms";
+      std::vector<folly::Future<RowCursorPtr>> futures;
+      futures.reserve(hedges.size());
+      for (const auto& h : hedges) {
+        auto p = std::make_shared<folly::Promise<RowCursorPtr>>();
+        track(connector->makeClient(h.first, pool)
+                ->execute(plan, SpecFilter::include(h.second))
+                .thenTry([p](folly::Try<RowCursorPtr> r) { p->setTry(std::move(r)); }));
+        futures.push_back(p->getFuture());
+      }
+
+      folly::collectAll(futures)
+        .via(&pool)
+        .thenValue([&pool, &plan, settle, fail, guard](std::vector<folly::Try<RowCursorPtr>> x) {
+          // the hedge covers the node only if all its replicas answered
+          for (const auto& r : x) {
+            if (r.hasException()) {
+              fail(r.exception());
+              return;
+            }
+          }
+
+          // merge answers of the replicas, nothing to do if the query is already answered
+          folly::Try<RowCursorPtr> merged;
+          guard->run([&]() {
+            if (x.size() == 1) {
+              merged = std::move(x.at(0));
+              return;
+            }
+
+            const auto& phase = plan.fetch<PhaseType::GLOBAL>();
+            MemoryScope scope(plan.ctx().budget());
+            merged = folly::makeTryWith([&]() {
+              return merge(pool, phase.inputSchema(), phase.fields(), phase.hasAggregation(), x);
+            });
+          });
+
+          if (merged.hasValue()) {
+            settle(merged.value(), true);
+          } else if (merged.hasException()) {
+            fail(merged.exception());
+          }
+        });
+    });
+  };
+
+  // a failed node is hedged right away rather than after the delay
+  track(std::move(primary).thenTry([settle, fail, hedge](folly::Try<RowCursorPtr> result) {
+    if (result.hasValue()) {
+      settle(result.value(), false);
+      return;
+    }
+
+    hedge();
+    fail(result.exception());
+  }));
+
+  folly::futures::sleep(std::chrono::milliseconds(delay))
+    .via(&pool)
+    .thenValue([hedge](folly::Unit) { hedge(); });
+
+  return state->promise.getFuture();
+}
+
 RowCursorPtr ServerExecutor::execute(
   folly::ThreadPoolExecutor& pool,
   const ExecutionPlan& plan,
   const std::shared_ptr<NodeConnector> connector) {
+  return executeAsync(pool, plan, connector).get();
+}
+
+folly::Future<RowCursorPtr> ServerExecutor::executeAsync(
+  folly::ThreadPoolExecutor& pool,
+  const ExecutionPlan& plan,
+  const std::shared_ptr<NodeConnector> connector) {
+  // each replicated spec is targeted to one node to avoid double counting
+  const auto& table = plan.fetch<PhaseType::COMPUTE>().table();
+  const auto targets = route(plan.getNodes(), BlockManager::init()->placement(table));
+  const auto shape = HedgePolicy::shape(plan);
+
   std::vector<folly::Future<RowCursorPtr>> results;
-  for (const NNode& node : plan.getNodes()) {
-    auto c = connector->makeClient(node, pool);
-    auto f = c->execute(plan)
+  results.reserve(targets.size());
+  for (const auto& target : targets) {
+    auto f = dispatch(pool, plan, connector, target, shape)
                // set time out handling
                // TODO(cao) - add error handling too via thenError
-               .onTimeout(RPC_TIMEOUT, [&]() -> RowCursorPtr { 
+               .onTimeout(RPC_TIMEOUT, [&plan, guard = plan.guard()]() -> RowCursorPtr {
                  LOG(WARNING) << "RPC Timeout: " << FLAGS_RPC_TIMEOUT;
+                 guard->run([&plan]() { plan.ctx().markPartial(); });
                  return EmptyRowCursor::instance(); });
 
     results.push_back(std::move(f));
   }
 
-  // collect all returns and turn it into a future
-  auto x = folly::collectAll(results).get();
+  // collect all returns and continue in the pool without blocking current thread
+  return folly::collectAll(results)
+    .via(&pool)
+    .thenValue([&pool, &plan](std::vector<folly::Try<RowCursorPtr>> x) -> RowCursorPtr {
+      // client may be gone while waiting for nodes, or any node runs out of memory for the query
+      const auto& ctx = plan.ctx();
+      const auto& token = ctx.token();
+      ctx.budget()->check();
+      token->check();
 
-  // only one result - don't need any aggregation or composite
-  const auto& phase = plan.fetch<PhaseType::GLOBAL>();
-  const auto& fieldMap = phase.fieldMap();
-  if (x.size() == 1) {
-    const auto& op = x.at(0);
-    if (op.hasException() || !op.hasValue()) {
-      return EmptyRowCursor::instance();
-    }
+      // only one result - don't need any aggregation or composite
+      const auto& phase = plan.fetch<PhaseType::GLOBAL>();
+      const auto& fieldMap = phase.fieldMap();
+      if (x.size() == 1) {
+        const auto& op = x.at(0);
+        if (op.hasException() || !op.hasValue()) {
+          return EmptyRowCursor::instance();
+        }
 
-    return topSort(finalize(op.value(), fieldMap, phase), phase);
-  }
+        return topSort(finalize(op.value(), fieldMap, phase), phase);
+      }
 
-  // multiple results using input schema as output schema used by finalize only
-  auto result = merge(pool, phase.inputSchema(), phase.fields(), phase.hasAggregation(), x);
+      // multiple results using input schema as output schema used by finalize only
+      MemoryScope scope(ctx.budget());
+      auto result = merge(pool, phase.inputSchema(), phase.fields(), phase.hasAggregation(), x, token.get());
 
-  // result holds the final total rows in the query before applying limit
-  auto resultSize = result->size();
-  auto& stats = plan.ctx().stats();
-  stats.rowsRet = resultSize;
+      // result holds the final total rows in the query before applying limit
+      auto resultSize = result->size();
+      auto& stats = plan.ctx().stats();
+      stats.rowsRet = resultSize;
 
-  // apply sorting and limit if available
-  return topSort(finalize(result, fieldMap, phase), phase);
+      // apply sorting and limit if available
+      return topSort(finalize(result, fieldMap, phase), phase);
+    });
 }
 
 } // namespace core
@@ -16,7 +16,9 @@
 
 #pragma once
 
+#include <atomic>
 #include <glog/logging.h>
+#include <mutex>
 
 #include "NodeClient.h"
 #include "NodeConnector.h"
@@ -32,6 +34,41 @@ namespace nebula {
 namespace execution {
 namespace core {
 
+// a node request to scan its blocks except the replicated specs assigned to other nodes
+struct NodeTarget {
+  nebula::meta::NNode node;
+  SpecSet skips;
+  // replicas to hedge a slow request with, each takes over part of the specs assigned to the node.
+  // empty if any spec of the node has no replica.
+  nebula::common::unordered_map<nebula::meta::NNode, SpecSet, nebula::meta::NodeHash, nebula::meta::NodeEqual> hedges;
+};
+
+// hedging policy tracks recent node latency by query shape,
+// a node request not answered by the configured percentile is reissued to replicas.
+class HedgePolicy {
+  // latency samples of a query shape in a ring buffer
+  struct Samples {
+    std::vector<size_t> values;
+    size_t next = 0;
+  };
+
+public:
+  static HedgePolicy& singleton();
+
+  // record latency of a node request in ms
+  void record(const std::string& shape, size_t ms);
+
+  // delay in ms to hedge a node request of given shape, 0 if not enough samples
+  size_t delay(const std::string& shape) const;
+
+  // shape of a plan - table, keys, aggregation and window scale
+  static std::string shape(const ExecutionPlan&);
+
+private:
+  mutable std::mutex mux_;
+  nebula::common::unordered_map<std::string, Samples> samples_;
+};
+
 class ServerExecutor {
   static const std::shared_ptr<NodeConnector> inproc() {
     static const std::shared_ptr<NodeConnector> IN_PROC = std::make_shared<NodeConnector>();
@@ -48,6 +85,28 @@ public:
     const ExecutionPlan&,
     const std::shared_ptr<NodeConnector> = inproc());
 
+  // execute the query plan without blocking current thread, plan needs to live until the future completes
+  folly::Future<nebula::surface::RowCursorPtr> executeAsync(
+    folly::ThreadPoolExecutor&,
+    const ExecutionPlan&,
+    const std::shared_ptr<NodeConnector> = inproc());
+
+  // route a query to given nodes by spec placement, every node is queried.
+  // when specs are replicated, each spec is scanned by exactly one of its holders and skipped by the others.
+  // specs unknown to the placement yet, such as new or open blocks, are scanned by their nodes.
+  static std::vector<NodeTarget> route(
+    const std::vector<nebula::meta::NNode>&,
+    const nebula::common::unordered_map<std::string, std::vector<nebula::meta::NNode>>&);
+
+private:
+  // dispatch the plan to a node target, hedge it with replicas if it is slow
+  folly::Future<nebula::surface::RowCursorPtr> dispatch(
+    folly::ThreadPoolExecutor&,
+    const ExecutionPlan&,
+    const std::shared_ptr<NodeConnector>,
+    const NodeTarget&,
+    const std::string&);
+
 private:
   const std::string server_;
 };
@@ -0,0 +1,383 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BlockStore.h"
+
+#include <fcntl.h>
+#include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/system/MemoryMapping.h>
+#include <gflags/gflags.h>
+#include <unistd.h>
+
+#include "common/Binary.h"
+#include "common/Evidence.h"
+#include "storage/local/File.h"
+#include "type/Serde.h"
+
+DEFINE_string(BLOCK_DIR, "", "local directory to keep sealed blocks for warm restart, empty to disable it");
+
+/**
+ * Local disk store of sealed blocks for warm restart of a node and tiering of cold blocks.
+ */
+namespace nebula {
+namespace execution {
+namespace io {
+
+using nebula::common::BinaryReader;
+using nebula::common::BinaryWriter;
+using nebula::common::Evidence;
+using nebula::memory::Batch;
+using nebula::meta::BlockSignature;
+using nebula::meta::BlockState;
+using nebula::meta::Column;
+using nebula::meta::ColumnProps;
+using nebula::meta::PartitionInfo;
+using nebula::meta::Table;
+using nebula::type::TypeSerializer;
+
+static constexpr auto BLOCK_EXT = ".block";
+static constexpr auto TEMP_EXT = ".tmp";
+
+static bool endsWith(const std::string& name, const std::string& ext) {
+  return name.size() > ext.size() && name.compare(name.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+BlockStore& BlockStore::singleton() {
+  static BlockStore store{ FLAGS_BLOCK_DIR };
+  return store;
+}
+
+BlockStore::BlockStore(const std::string& dir)
+  : dir_{ dir },
+    writer_{ dir.empty() ? nullptr : std::make_unique<folly::CPUThreadPoolExecutor>(1) } {}
+
+BlockStore::~BlockStore() {
+  // files queued are still written or deleted
+  if (writer_) {
+    writer_->join();
+  }
+}
+
+// signature may have any characters in its spec, so file is named by its hash
+std::string BlockStore::path(const BatchBlock& block) const {
+  return path(block.hash());
+}
+
+std::string BlockStore::path(size_t hash) const {
+  return fmt::format("{0}/{1:016x}{2}", dir_, hash, BLOCK_EXT);
+}
+
+void BlockStore::persist(const BatchBlock& block) noexcept {
+  write(block, {});
+}
+
+bool BlockStore::write(const BatchBlock& block, const std::vector<size_t>& replaced) noexcept {
+  const auto& batch = block.data();
+  const auto& sign = block.signature();
+  if (!enabled() || batch == nullptr || !batch->sealed() || sign.isEphemeral()) {
+    return false;
+  }
+
+  // a block never changes once sealed, the file exists if it is restored from it.
+  // a merged block may have the same signature as one of its blocks, its file is written anyways.
+  const auto file = path(block);
+  if (replaced.empty() && ::access(file.c_str(), F_OK) == 0) {
+    return true;
+  }
+
+  const auto temp = file + TEMP_EXT;
+  try {
+    Evidence::Duration duration;
+    BinaryWriter writer;
+    writer.write(MAGIC);
+    writer.write(VERSION);
+
+    // hashes of blocks merged into this one
+    writer.write<uint64_t>(replaced.size());
+    for (auto hash : replaced) {
+      writer.write<uint64_t>(hash);
+    }
+
+    writer.string(sign.table);
+    writer.write<uint64_t>(sign.id);
+    writer.write<uint64_t>(sign.start);
+    writer.write<uint64_t>(sign.end);
+    writer.string(sign.spec);
+    writer.write<uint64_t>(block.state().numRows);
+    writer.write<uint64_t>(block.state().rawSize);
+
+    // enough of the table to build the same batch again
+    writer.string(TypeSerializer::to(batch->schema()));
+    writer.write<uint64_t>(batch->columns().size());
+    for (const auto& c : batch->columns()) {
+      const auto& column = c.second;
+      writer.string(c.first);
+      writer.write(column.withBloomFilter);
+      writer.write(column.withDict);
+      writer.write(column.withCompress);
+      writer.string(column.defaultValue);
+      writer.write<uint64_t>(column.partition.values.size());
+      for (const auto& v : column.partition.values) {
+        writer.string(v);
+      }
+      writer.write<uint64_t>(column.partition.chunk);
+      writer.string(column.codec);
+    }
+
+    // order of partition keys follows column properties map, it is verified when restored
+    const auto& pod = batch->pod();
+    const size_t keys = pod ? pod->numKeys() : 0;
+    writer.write<uint64_t>(keys);
+    for (size_t i = 0; i < keys; ++i) {
+      writer.string(pod->key(i));
+    }
+
+    writer.write<uint64_t>(batch->pid());
+    batch->persist(writer);
+
+    // write a temp file and rename it, so a crash never leaves a partial block file
+    const auto& buffer = writer.buffer();
+    {
+      folly::File f(temp, O_WRONLY | O_CREAT | O_TRUNC);
+      auto ret = folly::writeFull(f.fd(), buffer.data(), buffer.size());
+      N_ENSURE_EQ((size_t)ret, buffer.size(), "failed to write block file");
+    }
+
+    N_ENSURE_EQ(::rename(temp.c_str(), file.c_str()), 0, "failed to rename block file");
+    VLOG(1) << "Persisted block " << sign.toString() << " as " << buffer.size()
+            << " bytes in " << duration.elapsedMs() << "ms";
+    return true;
+  } catch (const std::exception& ex) {
+    LOG(WARNING) << "Failed to persist block " << sign.toString() << ": " << ex.what();
+    ::unlink(temp.c_str());
+    return false;
+  }
+}
+
+void BlockStore::remove(const BatchBlock& block) noexcept {
+  if (enabled() && block.data() != nullptr) {
+    ::unlink(path(block).c_str());
+  }
+}
+
+void BlockStore::persistAsync(std::shared_ptr<BatchBlock> block) noexcept {
+  if (writer_) {
+    writer_->add([this, block = std::move(block)]() { persist(*block); });
+  }
+}
+
+void BlockStore::removeAsync(std::shared_ptr<BatchBlock> block) noexcept {
+  if (writer_) {
+    writer_->add([this, block = std::move(block)]() { remove(*block); });
+  }
+}
+
+void BlockStore::replaceAsync(std::vector<std::shared_ptr<BatchBlock>> blocks, std::shared_ptr<BatchBlock> merged) noexcept {
+  if (!writer_) {
+    return;
+  }
+
+  writer_->add([this, blocks = std::move(blocks), merged = std::move(merged)]() {
+    std::vector<size_t> replaced;
+    replaced.reserve(blocks.size());
+    for (const auto& b : blocks) {
+      if (b->hash() != merged->hash()) {
+        replaced.push_back(b->hash());
+      }
+    }
+
+    // the merged file commits the replacement, deleting the replaced files after it is only cleanup.
+    // replaced files are kept if it fails, they still restore the same rows.
+    if (write(*merged, replaced)) {
+      for (auto hash : replaced) {
+        ::unlink(path(hash).c_str());
+      }
+    }
+  });
+}
+
+folly::Future<folly::Unit> BlockStore::flush() {
+  if (!writer_) {
+    return folly::makeFuture();
+  }
+
+  return folly::via(writer_.get(), []() {});
+}
+
+size_t BlockStore::restore() {
+  if (!enabled()) {
+    return 0;
+  }
+
+  Evidence::Duration duration;
+  std::vector<std::pair<std::string, std::shared_ptr<BatchBlock>>> blocks;
+  nebula::common::unordered_set<size_t> replaced;
+  nebula::storage::local::File fs;
+  for (const auto& info : fs.list(dir_)) {
+    const auto file = fmt::format("{0}/{1}", dir_, info.name);
+    if (info.isDir) {
+      continue;
+    }
+
+    // left by a crash in the middle of writing
+    if (endsWith(info.name, TEMP_EXT)) {
+      ::unlink(file.c_str());
+      continue;
+    }
+
+    if (!endsWith(info.name, BLOCK_EXT)) {
+      continue;
+    }
+
+    try {
+      std::vector<size_t> merged;
+      auto block = load(file, merged);
+      if (block != nullptr) {
+        blocks.emplace_back(file, block);
+        replaced.insert(merged.begin(), merged.end());
+        continue;
+      }
+    } catch (const std::exception& ex) {
+      LOG(WARNING) << "Failed to restore block file " << file << ": " << ex.what();
+    }
+
+    ::unlink(file.c_str());
+  }
+
+  // a crash may leave files of blocks merged into another block already
+  size_t count = 0;
+  std::lock_guard<std::mutex> lock(mux_);
+  for (auto& b : blocks) {
+    if (replaced.find(b.second->hash()) != replaced.end()) {
+      ::unlink(b.first.c_str());
+      continue;
+    }
+
+    restored_[b.second->spec()].push_front(b.second);
+    ++count;
+  }
+
+  LOG(INFO) << "Restored " << count << " blocks from " << dir_ << " in " << duration.elapsedMs() << "ms";
+  return count;
+}
+
+BlockList BlockStore::claim(const std::string& spec) {
+  std::lock_guard<std::mutex> lock(mux_);
+  auto found = restored_.find(spec);
+  if (found == restored_.end()) {
+    return {};
+  }
+
+  auto blocks = std::move(found->second);
+  restored_.erase(found);
+  LOG(INFO) << "Claimed restored blocks of spec " << spec;
+  return blocks;
+}
+
+size_t BlockStore::release() {
+  std::lock_guard<std::mutex> lock(mux_);
+  size_t count = 0;
+  for (const auto& spec : restored_) {
+    for (const auto& b : spec.second) {
+      ::unlink(path(*b).c_str());
+      ++count;
+    }
+  }
+
+  restored_.clear();
+  LOG(INFO) << "Released " << count << " restored blocks not claimed by any spec";
+  return count;
+}
+
+folly::Future<std::shared_ptr<BatchBlock>> BlockStore::pageAsync(std::shared_ptr<BatchBlock> block) noexcept {
+  if (!enabled()) {
+    return folly::makeFuture<std::shared_ptr<BatchBlock>>(nullptr);
+  }
+
+  // on the writer thread, a write of the block queued earlier is done and a delete queued later is not yet
+  return folly::via(writer_.get(), [this, block = std::move(block)]() -> std::shared_ptr<BatchBlock> {
+    const auto file = path(*block);
+    if (::access(file.c_str(), F_OK) != 0) {
+      return nullptr;
+    }
+
+    try {
+      std::vector<size_t> replaced;
+      return load(file, replaced);
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "Failed to page block file " << file << ": " << ex.what();
+      return nullptr;
+    }
+  });
+}
+
+std::shared_ptr<BatchBlock> BlockStore::load(const std::string& file, std::vector<size_t>& replaced) const {
+  // the mapping is owned by the batch as its pages are read in place
+  auto mapping = std::make_shared<folly::MemoryMapping>(file.c_str());
+  auto range = mapping->range();
+  BinaryReader reader((const char*)range.data(), range.size());
+  if (reader.read<uint32_t>() != MAGIC || reader.read<uint32_t>() != VERSION) {
+    LOG(WARNING) << "Block file of unknown format: " << file;
+    return nullptr;
+  }
+
+  for (size_t i = 0, size = reader.read<uint64_t>(); i < size; ++i) {
+    replaced.push_back(reader.read<uint64_t>());
+  }
+
+  const std::string table{ reader.string() };
+  const auto id = reader.read<uint64_t>();
+  const auto start = reader.read<uint64_t>();
+  const auto end = reader.read<uint64_t>();
+  const std::string spec{ reader.string() };
+  const auto rows = reader.read<uint64_t>();
+  const auto rawSize = reader.read<uint64_t>();
+
+  auto schema = TypeSerializer::from(std::string(reader.string()));
+  ColumnProps columns;
+  for (size_t i = 0, size = reader.read<uint64_t>(); i < size; ++i) {
+    const std::string name{ reader.string() };
+    const auto bf = reader.read<bool>();
+    const auto dict = reader.read<bool>();
+    const auto compress = reader.read<bool>();
+    const std::string dv{ reader.string() };
+    PartitionInfo partition;
+    for (size_t v = 0, values = reader.read<uint64_t>(); v < values; ++v) {
+      partition.values.emplace_back(reader.string());
+    }
+    partition.chunk = reader.read<uint64_t>();
+    const std::string codec{ reader.string() };
+    columns.emplace(name, Column{ bf, dict, compress, dv, {}, std::move(partition), codec });
+  }
+
+  Table t{ table, schema, std::move(columns), {} };
+  const auto pod = t.pod();
+  const size_t keys = reader.read<uint64_t>();
+  N_ENSURE_EQ(keys, pod ? pod->numKeys() : 0, "partition keys mismatch");
+  for (size_t i = 0; i < keys; ++i) {
+    N_ENSURE_EQ(std::string(reader.string()), pod->key(i), "partition keys are in different order");
+  }
+
+  const auto pid = reader.read<uint64_t>();
+  auto batch = std::make_shared<Batch>(t, rows, pid);
+  batch->restore(reader, mapping);
+  return std::make_shared<BatchBlock>(BlockSignature{ table, id, start, end, spec }, batch, BlockState{ rows, rawSize });
+}
+
+} // namespace io
+} // namespace execution
+} // namespace nebula
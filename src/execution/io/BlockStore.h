@@ -0,0 +1,115 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/futures/Future.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BlockLoader.h"
+#include "common/Hash.h"
+
+/**
+ * Local disk store of sealed blocks for warm restart of a node.
+ * A block is written into its own file as it is sealed, in the same encoding it has in memory:
+ * compressed pages, dictionaries, null bitmaps, histograms and bloom filters.
+ * On restart, files are mapped back and pages are read in place. Restored blocks are held until
+ * their specs are assigned to this node again, so a node serves them in seconds instead of ingesting
+ * them from the source, while blocks of specs gone or moved to other nodes are never served.
+ * The same files back cold blocks moved out of memory, only their metadata stays in memory.
+ * Files are written and deleted by a writer thread of the store in the order they are queued,
+ * so adding or removing a block never waits for disk.
+ */
+namespace nebula {
+namespace execution {
+namespace io {
+
+class BlockStore {
+  // "NBBK" in file header, followed by format version
+  static constexpr uint32_t MAGIC = 0x4b42424e;
+  static constexpr uint32_t VERSION = 2;
+
+public:
+  explicit BlockStore(const std::string& dir);
+  virtual ~BlockStore();
+
+  // store in BLOCK_DIR, disabled if it is not set
+  static BlockStore& singleton();
+
+public:
+  inline bool enabled() const {
+    return !dir_.empty();
+  }
+
+  // write a sealed local block into its file, nothing is done if it is written already.
+  // failures are logged only, the block is just not restored on restart.
+  void persist(const BatchBlock&) noexcept;
+
+  // delete file of a block removed from this node
+  void remove(const BatchBlock&) noexcept;
+
+  // queue writing file of a block to the writer thread,
+  // a crash before it is written only loses the file as restore skips a missing file.
+  void persistAsync(std::shared_ptr<BatchBlock>) noexcept;
+
+  // queue deleting file of a block, after any write of it queued earlier
+  void removeAsync(std::shared_ptr<BatchBlock>) noexcept;
+
+  // queue replacing files of blocks by file of the block merged from them.
+  // merged file lists the blocks it replaces, so they are dropped in restore
+  // even if a crash happens before their files are deleted.
+  void replaceAsync(std::vector<std::shared_ptr<BatchBlock>>, std::shared_ptr<BatchBlock>) noexcept;
+
+  // complete when all files queued so far are written or deleted
+  folly::Future<folly::Unit> flush();
+
+  // load all blocks stored and hold them to be claimed by their specs, return number of blocks loaded.
+  // files not readable by this version or replaced by a merged block are deleted.
+  size_t restore();
+
+  // take restored blocks of given spec, every block is claimed once
+  BlockList claim(const std::string&);
+
+  // delete files of restored blocks not claimed so far, their specs are not hosted by this node
+  size_t release();
+
+  // the same block reading its pages from its file on demand, loaded by the writer thread
+  // after any write of the block queued earlier. nullptr if the block has no file.
+  folly::Future<std::shared_ptr<BatchBlock>> pageAsync(std::shared_ptr<BatchBlock>) noexcept;
+
+private:
+  std::string path(const BatchBlock&) const;
+  std::string path(size_t) const;
+  bool write(const BatchBlock&, const std::vector<size_t>&) noexcept;
+  std::shared_ptr<BatchBlock> load(const std::string&, std::vector<size_t>&) const;
+
+private:
+  const std::string dir_;
+
+  // single thread keeps writes and deletes of the same block in order, null if store is disabled
+  std::unique_ptr<folly::CPUThreadPoolExecutor> writer_;
+
+  // restored blocks by spec waiting to be claimed
+  nebula::common::unordered_map<std::string, BlockList> restored_;
+  std::mutex mux_;
+};
+
+} // namespace io
+} // namespace execution
+} // namespace nebula
@@ -14,17 +14,28 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <fmt/format.h>
+#include <folly/executors/ManualExecutor.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 #include <yorel/yomm2/cute.hpp>
 
+#include "execution/BlockManager.h"
 #include "execution/ExecutionPlan.h"
+#include "execution/TableState.h"
+#include "execution/core/Admission.h"
 #include "execution/core/BlockExecutor.h"
+#include "execution/core/BlockScheduler.h"
+#include "execution/core/PartialCache.h"
+#include "execution/core/ServerExecutor.h"
+#include "execution/io/BlockStore.h"
 #include "execution/serde/RowCursorSerde.h"
 #include "memory/Batch.h"
 #include "meta/TestTable.h"
+#include "storage/local/File.h"
 #include "surface/MockSurface.h"
+#include "surface/StaticData.h"
 #include "surface/eval/UDF.h"
 #include "surface/eval/ValueEval.h"
 
@@ -33,6 +44,9 @@ namespace execution {
 namespace test {
 
 using nebula::execution::core::BlockExecutor;
+using nebula::execution::core::HedgePolicy;
+using nebula::execution::core::PartialCache;
+using nebula::execution::core::ServerExecutor;
 using nebula::memory::Batch;
 using nebula::memory::EvaledBlock;
 using nebula::surface::MockRowData;
@@ -127,10 +141,10 @@ TEST(ExecutionTest, TestRowCursorSerde) {
   {
     nebula::meta::TestTable test;
     auto size = 10;
-    Batch batch(test, size);
+    auto batch = std::make_shared<Batch>(test, size);
     MockRowData row;
     for (auto i = 0; i < size; ++i) {
-      batch.add(row);
+      batch->add(row);
     }
 
     LOG(INFO) << "build up a block compute result";
@@ -148,7 +162,7 @@ TEST(ExecutionTest, TestRowCursorSerde) {
       .aggregate(0, { false, false, false })
       .limit(size);
 
-    EvaledBlock eb{ &batch, BlockEval::PARTIAL };
+    EvaledBlock eb{ batch, BlockEval::PARTIAL };
     auto cursor = nebula::execution::core::compute(eb, plan);
     auto fb = nebula::execution::serde::asBuffer(*cursor, outputSchema, plan.fields());
 
@@ -157,7 +171,7 @@ TEST(ExecutionTest, TestRowCursorSerde) {
 
     // verify every row is the same
     LOG(INFO) << "verify every row is the same as batch";
-    auto accessor = batch.makeAccessor();
+    auto accessor = batch->makeAccessor();
     for (auto i = 0; i < size; ++i) {
       const auto& rb = accessor->seek(i);
       const auto& rf = fb->row(i);
@@ -170,12 +184,12 @@ TEST(ExecutionTest, TestRowCursorSerde) {
   {
     nebula::meta::TestTable test;
     auto size = 10;
-    Batch batch(test, size);
+    auto batch = std::make_shared<Batch>(test, size);
     MockRowData row;
     MockRowData sameRow;
     int idSum = 0;
     for (auto i = 0; i < size; ++i) {
-      batch.add(row);
+      batch->add(row);
       idSum += sameRow.readInt("id");
     }
 
@@ -193,7 +207,7 @@ TEST(ExecutionTest, TestRowCursorSerde) {
       .keys({ 0 })
       .aggregate(1, { false, true });
 
-    EvaledBlock eb{ &batch, BlockEval::PARTIAL };
+    EvaledBlock eb{ batch, BlockEval::PARTIAL };
     auto cursor = nebula::execution::core::compute(eb, plan);
     auto fb = nebula::execution::serde::asBuffer(*cursor, outputSchema, plan.fields());
 
@@ -207,11 +221,11 @@ TEST(ExecutionTest, TestRowCursorSerde) {
 TEST(ExecutionTest, TestCustomColumn) {
   nebula::meta::TestTable test;
   auto size = 1;
-  Batch batch(test, size);
+  auto batch = std::make_shared<Batch>(test, size);
   MockRowData row;
   MockRowData sameRow;
   for (auto i = 0; i < size; ++i) {
-    batch.add(row);
+    batch->add(row);
   }
 
   LOG(INFO) << "build up a block compute result with custom column";
@@ -231,7 +245,7 @@ TEST(ExecutionTest, TestCustomColumn) {
     .compute(std::move(selects))
     .filter(constant<bool>(true));
 
-  EvaledBlock eb{ &batch, BlockEval::PARTIAL };
+  EvaledBlock eb{ batch, BlockEval::PARTIAL };
   auto cursor = nebula::execution::core::compute(eb, plan);
   while (cursor->hasNext()) {
     const auto& row = cursor->next();
@@ -241,6 +255,550 @@ TEST(ExecutionTest, TestCustomColumn) {
   }
 }
 
+TEST(ExecutionTest, TestOpenBlocks) {
+  nebula::meta::TestTable test;
+  auto batch = std::make_shared<Batch>(test, 100);
+  batch->open();
+
+  TableState state{ test.name() };
+  auto block = nebula::execution::io::BlockLoader::from(
+    nebula::meta::BlockSignature{ test.name(), 0, 0, 0, "stream" }, batch);
+  state.open("stream", block);
+  EXPECT_EQ(state.numOpenBlocks(), 1);
+
+  // empty open block is not queried
+  EXPECT_EQ(state.query({ 0, 100 }).size(), 0);
+
+  // rows appended after open are visible by time histogram
+  for (int32_t i = 10; i < 20; ++i) {
+    nebula::surface::StaticRow row{ i, i, "events", nullptr, false, 0, 0, 0 };
+    batch->add(row);
+  }
+
+  EXPECT_EQ(state.query({ 0, 5 }).size(), 0);
+  EXPECT_EQ(state.query({ 15, 100 }).size(), 1);
+
+  // spec subset limits blocks to query
+  EXPECT_EQ(state.query({ 15, 100 }, { "stream" }).size(), 1);
+  EXPECT_EQ(state.query({ 15, 100 }, { "other" }).size(), 0);
+
+  // open blocks are not counted in metrics until sealed
+  EXPECT_EQ(state.numBlocks(), 0);
+  EXPECT_EQ(state.numRows(), 0);
+
+  // closing the open block
+  state.open("stream", nullptr);
+  EXPECT_EQ(state.numOpenBlocks(), 0);
+  EXPECT_EQ(state.query({ 15, 100 }).size(), 0);
+}
+
+TEST(ExecutionTest, TestBlockStore) {
+  nebula::meta::TestTable test;
+  nebula::storage::local::File fs;
+  nebula::execution::io::BlockStore store{ fs.temp(true) };
+  const size_t count = 1000;
+  const auto spec = "s3://bucket/x/y.parquet";
+  auto batch = std::make_shared<Batch>(test, count);
+  for (size_t i = 0; i < count; ++i) {
+    nebula::surface::StaticRow row{ (int64_t)i, (int)i, fmt::format("e{0}", i % 3), nullptr, i % 2 == 0, 1, 0, 0.5 };
+    batch->add(row);
+  }
+
+  // batch is not persisted until sealed
+  auto block = nebula::execution::io::BlockLoader::from(
+    nebula::meta::BlockSignature{ test.name(), 1, 0, count - 1, spec }, batch);
+  store.persist(*block);
+  EXPECT_EQ(store.restore(), 0);
+
+  batch->seal();
+  store.persist(*block);
+  EXPECT_EQ(store.restore(), 1);
+
+  // restored blocks are served only for the spec claiming them, once
+  EXPECT_TRUE(store.claim("s3://bucket/x/z.parquet").empty());
+  auto blocks = store.claim(spec);
+  ASSERT_EQ(std::distance(blocks.begin(), blocks.end()), 1);
+  EXPECT_TRUE(store.claim(spec).empty());
+  auto restored = blocks.front();
+  EXPECT_EQ(restored->signature(), block->signature());
+  EXPECT_EQ(restored->state().numRows, count);
+
+  auto accessor = restored->data()->makeAccessor();
+  for (size_t i = 0; i < count; ++i) {
+    const auto& r = accessor->seek(i);
+    EXPECT_EQ(r.readInt("id"), (int)i);
+    EXPECT_EQ(r.readString("event"), fmt::format("e{0}", i % 3));
+    EXPECT_EQ(r.readBool("flag"), i % 2 == 0);
+  }
+
+  // removed block is not restored again
+  store.remove(*restored);
+  EXPECT_EQ(store.restore(), 0);
+
+  // queued writes and deletes are applied in order
+  store.persistAsync(block);
+  store.flush().get();
+  EXPECT_EQ(store.restore(), 1);
+  store.persistAsync(block);
+  store.removeAsync(block);
+  store.flush().get();
+  store.release();
+  EXPECT_EQ(store.restore(), 0);
+
+  // a merged block replaces files of its blocks, a file left by a crash is dropped in restore
+  auto merged = nebula::execution::io::BlockLoader::from(
+    nebula::meta::BlockSignature{ test.name(), 2, 0, count - 1, spec }, batch);
+  store.persistAsync(block);
+  store.replaceAsync({ block }, merged);
+  store.flush().get();
+  EXPECT_EQ(store.restore(), 1);
+  blocks = store.claim(spec);
+  ASSERT_EQ(std::distance(blocks.begin(), blocks.end()), 1);
+  EXPECT_EQ(blocks.front()->signature(), merged->signature());
+
+  store.persist(*block);
+  EXPECT_EQ(store.restore(), 1);
+  EXPECT_EQ(store.claim(spec).front()->signature(), merged->signature());
+
+  // unclaimed blocks are deleted on release
+  EXPECT_EQ(store.restore(), 1);
+  EXPECT_EQ(store.release(), 1);
+  EXPECT_EQ(store.restore(), 0);
+}
+
+TEST(ExecutionTest, TestBlockTier) {
+  nebula::meta::TestTable test;
+  nebula::storage::local::File fs;
+  nebula::execution::io::BlockStore store{ fs.temp(true) };
+  const size_t count = 100000;
+  auto batch = std::make_shared<Batch>(test, count);
+  for (size_t i = 0; i < count; ++i) {
+    nebula::surface::StaticRow row{ (int64_t)i, (int)i, fmt::format("e{0}", i % 3), nullptr, i % 2 == 0, 1, 0, 0.5 };
+    batch->add(row);
+  }
+
+  batch->seal();
+  auto block = nebula::execution::io::BlockLoader::from(
+    nebula::meta::BlockSignature{ "tier", 1, 0, 9, "s1" }, batch);
+
+  // a block without file is not paged
+  EXPECT_TRUE(store.pageAsync(block).get() == nullptr);
+
+  // paged after its queued write, pages of the same block are read from the file
+  store.persistAsync(block);
+  auto paged = store.pageAsync(block).get();
+  ASSERT_TRUE(paged != nullptr);
+  EXPECT_EQ(paged->signature(), block->signature());
+  EXPECT_FALSE(batch->paged());
+  EXPECT_TRUE(paged->data()->paged());
+  EXPECT_LT(paged->data()->getMemory(), batch->getMemory());
+
+  paged->data()->prefetch();
+  auto accessor = paged->data()->makeAccessor();
+  for (size_t i = 0; i < count; i += 7) {
+    const auto& r = accessor->seek(i);
+    EXPECT_EQ(r.readInt("id"), (int)i);
+    EXPECT_EQ(r.readString("event"), fmt::format("e{0}", i % 3));
+  }
+
+  // old block is cold, swapping it is not a change of blocks
+  auto bm = BlockManager::init();
+  bm->add(block);
+  auto cold = bm->cold(10, 0);
+  EXPECT_TRUE(std::find(cold.begin(), cold.end(), block) != cold.end());
+  auto recent = bm->cold(5, 0);
+  EXPECT_TRUE(std::find(recent.begin(), recent.end(), block) == recent.end());
+
+  // under memory limit, any block can be cold
+  auto lru = bm->cold(0, 1);
+  EXPECT_TRUE(std::find(lru.begin(), lru.end(), block) != lru.end());
+
+  const auto version = bm->version();
+  EXPECT_TRUE(bm->swap(block, paged));
+  EXPECT_FALSE(bm->swap(block, paged));
+  EXPECT_EQ(bm->version(), version);
+
+  // paged block is never picked again
+  cold = bm->cold(10, 0);
+  EXPECT_TRUE(std::find(cold.begin(), cold.end(), paged) == cold.end());
+  EXPECT_EQ(bm->removeBySpec("tier", "s1"), 1);
+}
+
+TEST(ExecutionTest, TestBlockJournal) {
+  nebula::meta::TestTable test;
+  auto bm = BlockManager::init();
+  const auto epoch = bm->epoch();
+  const auto version = bm->version();
+  const std::string table = "journal";
+  const std::string spec = "s1";
+
+  // local changes are journaled
+  for (size_t i = 0; i < 3; ++i) {
+    auto batch = std::make_shared<Batch>(test, 10);
+    batch->seal();
+    bm->add(nebula::execution::io::BlockLoader::from(
+      nebula::meta::BlockSignature{ table, i, i * 10, i * 10 + 9, spec }, batch));
+  }
+
+  std::vector<BlockChange> changes;
+  EXPECT_TRUE(bm->changes(epoch, version, changes));
+  EXPECT_EQ(changes.size(), 3);
+  EXPECT_TRUE(changes.at(0).added);
+
+  // blocks ending before 25 are removed
+  EXPECT_EQ(bm->removeBefore(table, spec, 25), 2);
+  changes.clear();
+  EXPECT_TRUE(bm->changes(epoch, version + 3, changes));
+  EXPECT_EQ(changes.size(), 2);
+  EXPECT_FALSE(changes.at(0).added);
+  EXPECT_EQ(changes.at(0).sign.id, 0);
+
+  // unknown epoch requires a full list
+  EXPECT_FALSE(bm->changes(epoch + 1, version, changes));
+  EXPECT_EQ(bm->removeBySpec(table, spec), 1);
+
+  // only the latest change of each block is listed, blocks added then removed are removals
+  changes.clear();
+  EXPECT_TRUE(bm->changes(epoch, version, changes));
+  EXPECT_EQ(changes.size(), 3);
+  EXPECT_TRUE(std::none_of(changes.begin(), changes.end(), [](const BlockChange& c) { return c.added; }));
+
+  // apply changes of a remote node
+  nebula::meta::NNode node{ nebula::meta::NRole::NODE, "journal", 9199 };
+  auto remote = [&node, &table, &spec](size_t id) {
+    return std::make_shared<nebula::execution::io::BatchBlock>(
+      nebula::meta::BlockSignature{ table, id, id * 10, id * 10 + 9, spec },
+      node,
+      nebula::meta::BlockState{ 10, 100 });
+  };
+
+  EXPECT_EQ(bm->cursor(node), std::make_pair<size_t, size_t>(0, 0));
+  bm->apply(node, BlockDelta{ 7, 2, true, { remote(0), remote(1) }, {} });
+  EXPECT_EQ(bm->states(node).at(table)->numBlocks(), 2);
+  EXPECT_EQ(bm->cursor(node), std::make_pair<size_t, size_t>(7, 2));
+
+  // re-added block is not duplicated, removed block is gone
+  bm->apply(node, BlockDelta{ 7, 4, false, { remote(1), remote(2) }, { remote(0)->signature() } });
+  EXPECT_EQ(bm->states(node).at(table)->numBlocks(), 2);
+  EXPECT_EQ(bm->states(node).at(table)->numRows(), 20);
+  EXPECT_EQ(bm->cursor(node), std::make_pair<size_t, size_t>(7, 4));
+
+  // table without blocks is dropped
+  bm->apply(node, BlockDelta{ 7, 6, false, {}, { remote(1)->signature(), remote(2)->signature() } });
+  EXPECT_EQ(bm->states(node).count(table), 0);
+}
+
+TEST(ExecutionTest, TestReplicaRouting) {
+  nebula::meta::NNode n1{ nebula::meta::NRole::NODE, "replica1", 9199 };
+  nebula::meta::NNode n2{ nebula::meta::NRole::NODE, "replica2", 9199 };
+  nebula::meta::NNode n3{ nebula::meta::NRole::NODE, "replica3", 9199 };
+  const std::string table = "replicas";
+  auto block = [&table](const nebula::meta::NNode& node, const std::string& spec) {
+    return std::make_shared<nebula::execution::io::BatchBlock>(
+      nebula::meta::BlockSignature{ table, 0, 0, 9, spec },
+      node,
+      nebula::meta::BlockState{ 10, 100 });
+  };
+
+  // s1 and s2 are replicated, s3 lives in n3 only
+  auto bm = BlockManager::init();
+  bm->apply(n1, BlockDelta{ 1, 1, true, { block(n1, "s1"), block(n1, "s2") }, {} });
+  bm->apply(n2, BlockDelta{ 1, 1, true, { block(n2, "s1"), block(n2, "s2") }, {} });
+  bm->apply(n3, BlockDelta{ 1, 1, true, { block(n3, "s3") }, {} });
+
+  auto placement = bm->placement(table);
+  EXPECT_EQ(placement.size(), 3);
+  EXPECT_EQ(placement.at("s1").size(), 2);
+  EXPECT_EQ(placement.at("s3").size(), 1);
+
+  // every node is queried and every spec is scanned by exactly one node
+  auto targets = ServerExecutor::route({ n1, n2, n3 }, placement);
+  EXPECT_EQ(targets.size(), 3);
+  nebula::common::unordered_map<std::string, size_t> scans;
+  for (const auto& t : targets) {
+    for (const auto& spec : bm->states(t.node).at(table)->specs()) {
+      if (t.skips.find(spec) == t.skips.end()) {
+        ++scans[spec];
+      }
+    }
+
+    // only replicated specs are skipped
+    EXPECT_EQ(t.skips.count("s3"), 0);
+
+    // node with unreplicated spec can not be hedged
+    if (t.node.equals(n3)) {
+      EXPECT_TRUE(t.hedges.empty());
+    } else {
+      EXPECT_FALSE(t.hedges.empty());
+    }
+  }
+
+  EXPECT_EQ(scans.size(), 3);
+  for (const auto& s : scans) {
+    EXPECT_EQ(s.second, 1);
+  }
+
+  // no replication, each node scans all its blocks
+  placement.erase("s1");
+  placement.erase("s2");
+  targets = ServerExecutor::route({ n1, n3 }, placement);
+  EXPECT_EQ(targets.size(), 2);
+  EXPECT_TRUE(targets.at(0).skips.empty());
+
+  // a node skipping replicated specs still scans its new and open blocks unknown to placement
+  auto filter = nebula::execution::SpecFilter::skip({ "s1" });
+  EXPECT_TRUE(filter.excluded("s1"));
+  EXPECT_FALSE(filter.excluded("new"));
+  EXPECT_FALSE(nebula::execution::SpecFilter{}.excluded("s1"));
+
+  // a hedge request scans only the specs it takes over
+  filter = nebula::execution::SpecFilter::include({ "s2" });
+  EXPECT_TRUE(filter.excluded("s1"));
+  EXPECT_FALSE(filter.excluded("s2"));
+
+  // table state reports specs of its blocks
+  auto state = bm->states(n1).at(table);
+  EXPECT_EQ(state->specs().size(), 2);
+}
+
+TEST(ExecutionTest, TestPlanGuard) {
+  auto guard = std::make_shared<nebula::execution::PlanGuard>();
+  size_t runs = 0;
+  EXPECT_TRUE(guard->run([&runs]() { ++runs; }));
+  EXPECT_EQ(runs, 1);
+
+  // closing doesn't wait for tasks not running, a late task drops its work
+  guard->close();
+  EXPECT_FALSE(guard->run([&runs]() { ++runs; }));
+  EXPECT_EQ(runs, 1);
+}
+
+TEST(ExecutionTest, TestHedgePolicy) {
+  auto& policy = HedgePolicy::singleton();
+  const std::string shape = "hedge/1/true/3";
+
+  // not enough samples to hedge
+  EXPECT_EQ(policy.delay(shape), 0);
+  for (size_t i = 1; i <= 100; ++i) {
+    policy.record(shape, i * 10);
+  }
+
+  // p95 of recent samples
+  EXPECT_EQ(policy.delay(shape), 960);
+  EXPECT_EQ(policy.delay("unknown"), 0);
+}
+
+TEST(ExecutionTest, TestBlockScheduler) {
+  folly::ManualExecutor pool;
+  core::BlockScheduler scheduler;
+  scheduler.weight("dash", 2);
+
+  std::vector<std::string> order;
+  auto task = [&order](const std::string& name) {
+    return [&order, name]() { order.push_back(name); };
+  };
+
+  // a heavy query queues its blocks first, a light one arrives later
+  for (auto i = 0; i < 3; ++i) {
+    scheduler.schedule(pool, "adhoc", Priority::LOW, 100, task("heavy"));
+  }
+
+  scheduler.schedule(pool, "dash", Priority::HIGH, 100, task("light"));
+  EXPECT_EQ(scheduler.pending(), 4);
+
+  // light query overtakes all remaining blocks of the heavy one
+  pool.drain();
+  EXPECT_EQ(scheduler.pending(), 0);
+  EXPECT_EQ(order, std::vector<std::string>({ "light", "heavy", "heavy", "heavy" }));
+
+  // tenants of the same priority share by weight: dash gets two blocks per adhoc block
+  order.clear();
+  for (auto i = 0; i < 4; ++i) {
+    scheduler.schedule(pool, "adhoc", Priority::NORMAL, 100, task("adhoc"));
+    scheduler.schedule(pool, "dash", Priority::NORMAL, 100, task("dash"));
+  }
+
+  pool.drain();
+  EXPECT_EQ(order.size(), 8);
+  EXPECT_EQ(std::count(order.begin(), order.begin() + 6, "dash"), 4);
+  EXPECT_FALSE(scheduler.next());
+
+  // tasks placed on NUMA nodes are all taken, a thread steals blocks of other nodes
+  order.clear();
+  for (size_t i = 0; i < 4; ++i) {
+    scheduler.schedule(pool, "adhoc", Priority::NORMAL, 100, task("numa"), i % 2);
+  }
+
+  pool.drain();
+  EXPECT_EQ(order.size(), 4);
+  EXPECT_EQ(scheduler.pending(), 0);
+}
+
+TEST(ExecutionTest, TestAdmission) {
+  EXPECT_EQ(core::Admission::classify(10), Priority::HIGH);
+  EXPECT_EQ(core::Admission::classify(std::numeric_limits<size_t>::max()), Priority::LOW);
+
+  core::Admission admission{ 2, 3 };
+  auto t1 = admission.admit("a", 100).get();
+  auto t2 = admission.admit("a", 100).get();
+  EXPECT_EQ(admission.running(), 2);
+
+  // busy server queues queries, the fourth one waiting is rejected
+  auto w1 = admission.admit("a", 10);
+  auto w2 = admission.admit("b", 1000);
+  auto w3 = admission.admit("a", 1);
+  EXPECT_THROW(admission.admit("c", 1).get(), NException);
+  EXPECT_EQ(admission.waiting(), 3);
+  EXPECT_FALSE(w1.isReady());
+
+  // tenant b has nothing running so it goes first despite its cost
+  t1.reset();
+  EXPECT_TRUE(w2.isReady());
+  EXPECT_FALSE(w1.isReady());
+
+  // then the cheapest query of tenant a
+  t2.reset();
+  EXPECT_TRUE(w3.isReady());
+  EXPECT_FALSE(w1.isReady());
+  EXPECT_EQ(admission.running(), 2);
+
+  std::move(w2).get().reset();
+  EXPECT_TRUE(w1.isReady());
+  EXPECT_EQ(admission.waiting(), 0);
+
+  // a cancelled query leaves the queue without taking a slot
+  auto token = std::make_shared<nebula::execution::CancelToken>();
+  auto w4 = admission.admit("c", 1, token);
+  auto w5 = admission.admit("c", 100);
+  token->cancel();
+  std::move(w3).get().reset();
+  EXPECT_THROW(std::move(w4).get(), NException);
+  EXPECT_TRUE(w5.isReady());
+  EXPECT_EQ(admission.waiting(), 0);
+}
+
+TEST(ExecutionTest, TestCancelToken) {
+  nebula::execution::CancelToken token;
+  EXPECT_FALSE(token.cancelled());
+  EXPECT_NO_THROW(token.check());
+
+  // deadline only moves earlier
+  auto later = nebula::execution::CancelToken::Clock::now() + std::chrono::hours(1);
+  token.expireAt(later);
+  token.expireAfter(std::chrono::hours(2));
+  EXPECT_EQ(token.deadline(), later);
+  token.expireAt(std::chrono::system_clock::time_point::max());
+  EXPECT_EQ(token.deadline(), later);
+  EXPECT_FALSE(token.cancelled());
+
+  // subscribers are notified once cancelled, or immediately after that
+  size_t notified = 0;
+  auto id = token.subscribe([&notified]() { ++notified; });
+  auto gone = token.subscribe([&notified]() { notified += 10; });
+  token.unsubscribe(gone);
+  token.cancel();
+  token.cancel();
+  EXPECT_EQ(notified, 1);
+  EXPECT_GT(id, 0);
+  EXPECT_EQ(token.subscribe([&notified]() { ++notified; }), 0);
+  EXPECT_EQ(notified, 2);
+  EXPECT_THROW(token.check(), NException);
+
+  // a passed deadline cancels without explicit call
+  nebula::execution::CancelToken expired;
+  expired.expireAfter(std::chrono::milliseconds(-1));
+  EXPECT_TRUE(expired.cancelled());
+
+  // block execution of a cancelled or expired query stops by exception
+  nebula::meta::TestTable test;
+  auto batch = std::make_shared<Batch>(test, 10);
+  MockRowData row;
+  for (auto i = 0; i < 10; ++i) {
+    batch->add(row);
+  }
+
+  auto outputSchema = TypeSerializer::from("ROW<key:int, agg:int>");
+  nebula::execution::BlockPhase plan(test.schema(), outputSchema);
+  nebula::surface::eval::Fields selects;
+  selects.reserve(2);
+  selects.push_back(constant<int32_t>(20));
+  selects.push_back(std::make_unique<TestUdaf>());
+  plan.scan(test.name())
+    .compute(std::move(selects))
+    .filter(constant<bool>(true))
+    .keys({ 0 })
+    .aggregate(1, { false, true });
+
+  EvaledBlock eb{ batch, BlockEval::PARTIAL };
+  nebula::execution::CancelToken live;
+  EXPECT_EQ(nebula::execution::core::compute(eb, plan, &live)->size(), 1);
+  EXPECT_THROW(nebula::execution::core::compute(eb, plan, &token), NException);
+  EXPECT_THROW(nebula::execution::core::compute(eb, plan, &expired), NException);
+}
+
+TEST(ExecutionTest, TestPartialCache) {
+  nebula::meta::TestTable test;
+  auto size = 10;
+  auto batch = std::make_shared<Batch>(test, size);
+  MockRowData row;
+  for (auto i = 0; i < size; ++i) {
+    batch->add(row);
+  }
+
+  auto outputSchema = TypeSerializer::from("ROW<key:int, agg:int>");
+  nebula::execution::BlockPhase plan(test.schema(), outputSchema);
+  nebula::surface::eval::Fields selects;
+  selects.reserve(2);
+  selects.push_back(constant<int32_t>(20));
+  selects.push_back(std::make_unique<TestUdaf>());
+  plan.scan(test.name())
+    .compute(std::move(selects))
+    .filter(constant<bool>(true))
+    .keys({ 0 })
+    .aggregate(1, { false, true });
+
+  // results are keyed by block, another block has a different key
+  nebula::execution::QueryWindow window{ 0, 1 };
+  auto key = PartialCache::key(plan, window, *batch);
+  EXPECT_FALSE(key.empty());
+  Batch another(test, size);
+  another.add(row);
+  EXPECT_NE(batch->id(), another.id());
+  EXPECT_NE(key, PartialCache::key(plan, window, another));
+
+  PartialCache cache{ 1024 * 1024 };
+  EXPECT_EQ(cache.get(key, outputSchema, plan.fields()), nullptr);
+
+  EvaledBlock eb{ batch, BlockEval::PARTIAL };
+  auto cursor = nebula::execution::core::compute(eb, plan);
+  auto& result = static_cast<BlockExecutor&>(*cursor).result();
+  auto memory = result.memory();
+  cache.put(batch->id(), key, result, plan.fields());
+  EXPECT_EQ(cache.size(), 1);
+
+  // the live result is not serialized in place
+  EXPECT_EQ(result.memory(), memory);
+  EXPECT_EQ(result.getRows(), 1);
+
+  // a hit rebuilds the result with fields of the hitting query
+  auto cached = cache.get(key, outputSchema, plan.fields());
+  ASSERT_NE(cached, nullptr);
+  EXPECT_EQ(cached->getRows(), 1);
+  EXPECT_EQ(cached->row(0).readInt("key"), 20);
+  EXPECT_EQ(cache.stats(), std::make_pair<size_t, size_t>(1, 1));
+
+  // removed block drops its results
+  cache.evict(another.id());
+  EXPECT_EQ(cache.size(), 1);
+  cache.evict(batch->id());
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_EQ(cache.bytes(), 0);
+
+  // open blocks are not cached
+  another.open();
+  EXPECT_TRUE(PartialCache::key(plan, window, another).empty());
+}
+
 } // namespace test
 } // namespace execution
 } // namespace nebula
\ No newline at end of file
@@ -0,0 +1,153 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BlockCompact.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "common/Numa.h"
+#include "execution/meta/TableService.h"
+
+DECLARE_uint64(NBLOCK_MAX_ROWS);
+DEFINE_uint64(COMPACT_MIN_ROWS, 20000, "blocks having less rows than this are candidates of compaction");
+
+/**
+ * Background compaction of small blocks in current node.
+ */
+namespace nebula {
+namespace ingest {
+
+using nebula::execution::BlockManager;
+using nebula::execution::io::BatchBlock;
+using nebula::execution::io::BlockLoader;
+using nebula::execution::meta::TableService;
+using nebula::memory::Batch;
+using nebula::meta::BessType;
+using nebula::meta::BlockSignature;
+using nebula::meta::Table;
+
+BlockCompact& BlockCompact::singleton() {
+  static BlockCompact compact;
+  return compact;
+}
+
+std::shared_ptr<BatchBlock> BlockCompact::merge(const Table& table, const std::vector<std::shared_ptr<BatchBlock>>& blocks) {
+  N_ENSURE(!blocks.empty(), "requires blocks to merge");
+  nebula::common::Numa::Placement placement;
+
+  // merged block takes the largest id, ids of stream blocks are offsets a restart resumes from
+  const auto& first = blocks.front();
+  auto id = first->getId();
+  auto start = first->start();
+  auto end = first->end();
+  size_t rows = 0;
+  for (auto& b : blocks) {
+    id = std::max(id, b->getId());
+    start = std::min(start, b->start());
+    end = std::max(end, b->end());
+    rows += b->data()->getRows();
+  }
+
+  // all blocks in the group share the same partition
+  auto pod = table.pod();
+  auto batch = std::make_shared<Batch>(table, rows, first->data()->pid());
+  for (auto& b : blocks) {
+    auto accessor = b->data()->makeAccessor();
+    for (size_t i = 0, size = b->data()->getRows(); i < size; ++i) {
+      const auto& row = accessor->seek(i);
+
+      // recompute bess from partition column values
+      BessType bess = -1;
+      if (pod) {
+        pod->pod(row, bess);
+      }
+
+      batch->add(row, bess);
+    }
+  }
+
+  batch->seal();
+  return BlockLoader::from(BlockSignature{ table.name(), id, start, end, first->spec() }, batch);
+}
+
+folly::Future<size_t> BlockCompact::run(folly::ThreadPoolExecutor& pool) noexcept {
+  // last round is still merging
+  if (running_.exchange(true)) {
+    return folly::makeFuture<size_t>(0);
+  }
+
+  // skip blocks of tables unknown to this node since we can't build batch for them
+  auto bm = BlockManager::init();
+  auto ts = TableService::singleton();
+  auto groups = std::make_shared<std::vector<std::vector<std::shared_ptr<BatchBlock>>>>(
+    bm->compactable(FLAGS_COMPACT_MIN_ROWS, FLAGS_NBLOCK_MAX_ROWS));
+  groups->erase(
+    std::remove_if(groups->begin(), groups->end(), [&ts](const auto& group) {
+      return !ts->exists(group.front()->table());
+    }),
+    groups->end());
+
+  if (groups->empty()) {
+    running_ = false;
+    return folly::makeFuture<size_t>(0);
+  }
+
+  // merge every group in parallel with low priority
+  std::vector<folly::Future<std::shared_ptr<BatchBlock>>> futures;
+  futures.reserve(groups->size());
+  for (size_t i = 0, size = groups->size(); i < size; ++i) {
+    auto table = ts->query(groups->at(i).front()->table()).table();
+    auto p = std::make_shared<folly::Promise<std::shared_ptr<BatchBlock>>>();
+    pool.addWithPriority(
+      [table, groups, i, p]() {
+        try {
+          p->setValue(merge(*table, groups->at(i)));
+        } catch (std::exception& ex) {
+          LOG(ERROR) << "Failed to merge blocks: " << ex.what();
+          p->setValue(nullptr);
+        }
+      },
+      folly::Executor::LO_PRI);
+    futures.push_back(p->getFuture());
+  }
+
+  // swap merged blocks in one continuation, the caller (scheduler thread) is not blocked by merging
+  return folly::collectAll(futures)
+    .via(&pool)
+    .thenValue([bm, groups](std::vector<folly::Try<std::shared_ptr<BatchBlock>>> results) {
+      size_t removed = 0;
+      for (size_t i = 0, size = results.size(); i < size; ++i) {
+        auto& r = results.at(i);
+        if (!r.hasValue() || r.value() == nullptr) {
+          continue;
+        }
+
+        // replaced blocks are released once running queries scanning them are done
+        auto& group = groups->at(i);
+        if (bm->replace(group, r.value())) {
+          removed += group.size() - 1;
+        }
+      }
+
+      LOG(INFO) << "Compacted blocks: " << removed << " in groups: " << groups->size();
+      return removed;
+    })
+    .ensure([this]() { running_ = false; });
+}
+
+} // namespace ingest
+} // namespace nebula
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include "common/Folly.h"
+#include "execution/BlockManager.h"
+#include "meta/Table.h"
+
+/**
+ * Background compaction of small blocks in current node.
+ * Small blocks come from kafka streams, late arriving files and sparse partitions,
+ * each of them pays fixed cost per query and weakens block pruning.
+ *
+ * Blocks are merged only within the same spec and partition,
+ * so that spec level expiration and partition values remain valid for merged blocks.
+ */
+namespace nebula {
+namespace ingest {
+
+class BlockCompact {
+public:
+  static BlockCompact& singleton();
+
+public:
+  // run one round of compaction without blocking the caller: merge candidate groups in parallel
+  // in given pool, then swap merged blocks into block manager in a continuation.
+  // a round is skipped if last one is still running, the future has number of blocks removed.
+  folly::Future<size_t> run(folly::ThreadPoolExecutor&) noexcept;
+
+  // merge a group of blocks into a single sealed block
+  // dictionaries, histograms and bloom filters are rebuilt while adding rows.
+  static std::shared_ptr<nebula::execution::io::BatchBlock> merge(
+    const nebula::meta::Table&,
+    const std::vector<std::shared_ptr<nebula::execution::io::BatchBlock>>&);
+
+private:
+  BlockCompact() = default;
+
+private:
+  // only one round in flight, so a block is never merged twice
+  std::atomic<bool> running_{ false };
+};
+
+} // namespace ingest
+} // namespace nebula
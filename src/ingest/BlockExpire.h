@@ -17,6 +17,7 @@
 
 #include <fmt/format.h>
 
+#include "KafkaStream.h"
 #include "common/Hash.h"
 #include "common/Task.h"
 #include "execution/BlockManager.h"
@@ -58,7 +59,11 @@ public:
 
     // process the block expire list
     auto removed = 0;
+    auto& streams = KafkaStreams::singleton();
     for (auto& spec : specs_) {
+      // stop streaming the spec if it's a stream
+      streams.detach(spec.second);
+
       // if system has this block, remove it, otherwise skip it
       removed += bm->removeBySpec(spec.first, spec.second);
     }
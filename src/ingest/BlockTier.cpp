@@ -0,0 +1,107 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BlockTier.h"
+
+#include <algorithm>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "common/Evidence.h"
+#include "execution/io/BlockStore.h"
+
+DEFINE_uint64(TIER_AGE_SECONDS, 0, "blocks ending more than these seconds ago are moved to disk, 0 to disable");
+DEFINE_uint64(TIER_MEMORY_LIMIT, 0, "bytes of block memory in this node to keep, least recently queried blocks are moved to disk, 0 to disable");
+
+/**
+ * Tiering of cold blocks in current node from memory to local disk.
+ */
+namespace nebula {
+namespace ingest {
+
+using nebula::common::Evidence;
+using nebula::execution::BlockManager;
+using nebula::execution::io::BatchBlock;
+using nebula::execution::io::BlockStore;
+
+BlockTier& BlockTier::singleton() {
+  static BlockTier tier;
+  return tier;
+}
+
+folly::Future<size_t> BlockTier::run(folly::ThreadPoolExecutor& pool) noexcept {
+  // blocks are paged from files in block store
+  auto& store = BlockStore::singleton();
+  if (!store.enabled() || (FLAGS_TIER_AGE_SECONDS == 0 && FLAGS_TIER_MEMORY_LIMIT == 0)) {
+    return folly::makeFuture<size_t>(0);
+  }
+
+  // last round is still paging
+  if (running_.exchange(true)) {
+    return folly::makeFuture<size_t>(0);
+  }
+
+  auto bm = BlockManager::init();
+  const auto now = Evidence::unix_timestamp();
+  const auto before = (FLAGS_TIER_AGE_SECONDS > 0 && now > FLAGS_TIER_AGE_SECONDS) ? now - FLAGS_TIER_AGE_SECONDS : 0;
+  auto blocks = std::make_shared<std::vector<std::shared_ptr<BatchBlock>>>(
+    bm->cold(before, FLAGS_TIER_MEMORY_LIMIT));
+  if (blocks->empty()) {
+    running_ = false;
+    return folly::makeFuture<size_t>(0);
+  }
+
+  std::vector<folly::Future<std::shared_ptr<BatchBlock>>> futures;
+  futures.reserve(blocks->size());
+  for (auto& block : *blocks) {
+    futures.push_back(store.pageAsync(block));
+  }
+
+  // swap paged blocks in one continuation, the caller (scheduler thread) is not blocked by disk
+  auto duration = std::make_shared<Evidence::Duration>();
+  return folly::collectAll(futures)
+    .via(&pool)
+    .thenValue([bm, blocks, duration](std::vector<folly::Try<std::shared_ptr<BatchBlock>>> results) {
+      size_t released = 0;
+      size_t count = 0;
+      for (size_t i = 0, size = results.size(); i < size; ++i) {
+        auto& r = results.at(i);
+        if (!r.hasValue() || r.value() == nullptr) {
+          continue;
+        }
+
+        // a block removed or merged meanwhile is not swapped
+        auto& block = blocks->at(i);
+        auto& paged = r.value();
+        if (bm->swap(block, paged)) {
+          const auto memory = block->data()->getMemory();
+          released += memory - std::min(memory, paged->data()->getMemory());
+          ++count;
+        }
+      }
+
+      if (count > 0) {
+        LOG(INFO) << "Tiered blocks: " << count << " releasing bytes: " << released
+                  << " in " << duration->elapsedMs() << "ms";
+      }
+
+      return count;
+    })
+    .ensure([this]() { running_ = false; });
+}
+
+} // namespace ingest
+} // namespace nebula
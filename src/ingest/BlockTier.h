@@ -0,0 +1,55 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include "common/Folly.h"
+#include "execution/BlockManager.h"
+
+/**
+ * Tiering of cold blocks in current node from memory to local disk.
+ * Blocks older than an age, or least recently queried ones when memory is over a limit,
+ * are swapped with the same blocks reading their pages from their files in BLOCK_DIR.
+ *
+ * Metadata of a block - histograms, bloom filters, dictionaries and null bitmaps - stays in memory,
+ * so blocks are still pruned without any disk read. Pages are mapped from the file and read
+ * on demand when a query scans them, selected blocks are read ahead by block manager.
+ * A swapped out block is released once the last query task scanning its in-memory batch is done.
+ */
+namespace nebula {
+namespace ingest {
+
+class BlockTier {
+public:
+  static BlockTier& singleton();
+
+public:
+  // run one round of tiering without blocking the caller: cold blocks are paged from their files
+  // by the writer thread of block store, then swapped into block manager in a continuation in given pool.
+  // a round is skipped if last one is still running, the future has number of blocks moved out of memory.
+  folly::Future<size_t> run(folly::ThreadPoolExecutor&) noexcept;
+
+private:
+  BlockTier() = default;
+
+private:
+  // only one round in flight, so a block is never paged twice
+  std::atomic<bool> running_{ false };
+};
+
+} // namespace ingest
+} // namespace nebula
@@ -20,11 +20,15 @@
 #include <gperftools/heap-profiler.h>
 #include <rapidjson/document.h>
 
+#include "KafkaStream.h"
 #include "TimeRow.h"
 #include "common/Evidence.h"
+#include "common/Numa.h"
 #include "execution/BlockManager.h"
+#include "execution/io/BlockStore.h"
 #include "execution/meta/TableService.h"
 #include "meta/TestTable.h"
+#include "storage/ArrowReader.h"
 #include "storage/CsvReader.h"
 #include "storage/JsonReader.h"
 #include "storage/NFS.h"
@@ -38,6 +42,7 @@
 // table-wise customization
 DEFINE_string(NTEST_LOADER, "NebulaTest", "define the loader name for loading nebula test data");
 DEFINE_uint64(NBLOCK_MAX_ROWS, 100000, "max rows per block");
+DEFINE_uint64(KAFKA_STREAM_SEAL_SECONDS, 60, "max seconds a kafka stream block stays open before sealed");
 
 /**
  * We will sync etcd configs for cluster info into this memory object
@@ -52,6 +57,7 @@ using nebula::execution::BlockManager;
 using nebula::execution::io::BatchBlock;
 using nebula::execution::io::BlockList;
 using nebula::execution::io::BlockLoader;
+using nebula::execution::io::BlockStore;
 using nebula::execution::meta::TableService;
 using nebula::memory::Batch;
 using nebula::meta::BessType;
@@ -63,11 +69,13 @@ using nebula::meta::TableSpecPtr;
 using nebula::meta::TestTable;
 using nebula::meta::TimeSpec;
 using nebula::meta::TimeType;
+using nebula::storage::ArrowReader;
 using nebula::storage::CsvReader;
 using nebula::storage::JsonReader;
 using nebula::storage::JsonVectorReader;
 using nebula::storage::ParquetReader;
 using nebula::storage::http::HttpService;
+using nebula::storage::kafka::KafkaPartition;
 using nebula::storage::kafka::KafkaReader;
 using nebula::storage::kafka::KafkaSegment;
 using nebula::surface::RowCursor;
@@ -90,6 +98,10 @@ static constexpr auto BATCH_SIZE = "batch";
 bool build(TablePtr, RowCursor&, BlockList&,
            size_t, const std::string&, TimeRow&) noexcept;
 
+// build blocks from an arrow file column by column
+bool build(TablePtr, ArrowReader&, BlockList&,
+           size_t, const std::string&, TimeRow&) noexcept;
+
 // load some nebula test data into current process
 void loadNebulaTestData(const TableSpecPtr& table, const std::string& spec) {
   // load test data to run this query
@@ -112,6 +124,9 @@ void loadNebulaTestData(const TableSpecPtr& table, const std::string& spec) {
 }
 
 bool IngestSpec::work() noexcept {
+  // blocks built by this task are placed on their NUMA nodes
+  nebula::common::Numa::Placement placement;
+
   // TODO(cao) - refator this to have better hirachy for different ingest types.
   const auto& loader = table_->loader;
   if (loader == FLAGS_NTEST_LOADER) {
@@ -119,6 +134,11 @@ bool IngestSpec::work() noexcept {
     return true;
   }
 
+  // blocks kept on local disk are served again rather than ingested from the source
+  if (this->restore()) {
+    return true;
+  }
+
   // either swap, they are reading files
   if (loader == LOADER_SWAP) {
     return this->loadSwap();
@@ -141,6 +161,21 @@ bool IngestSpec::work() noexcept {
   return false;
 }
 
+bool IngestSpec::restore() noexcept {
+  // a kafka stream claims its restored blocks when it is attached, to resume after messages in them
+  if (DataSource::KAFKA == table_->source && KafkaSegment::from(path_).isStream()) {
+    return false;
+  }
+
+  auto blocks = BlockStore::singleton().claim(id_);
+  if (blocks.empty()) {
+    return false;
+  }
+
+  BlockManager::init()->add(blocks);
+  return true;
+}
+
 bool IngestSpec::load(BlockList& blocks) noexcept {
   // TODO(cao) - columar format reader (parquet) should be able to
   // access cloud storage directly to save networkbandwidth, but right now
@@ -303,6 +338,12 @@ bool IngestSpec::loadKafka() noexcept {
   // build up the segment to consume
   // note that: Kafka path is composed by this pattern: "{partition}_{offset}_{size}"
   auto segment = KafkaSegment::from(path_);
+
+  // a segment without size is a stream of the partition
+  if (segment.isStream()) {
+    return this->streamKafka(segment);
+  }
+
   KafkaReader reader(table_, std::move(segment));
 
   // time function
@@ -358,6 +399,49 @@ bool IngestSpec::loadKafka() noexcept {
   return true;
 }
 
+// attach a continuous stream for a kafka partition
+bool IngestSpec::streamKafka(const KafkaSegment& segment) noexcept {
+  auto& streams = nebula::ingest::KafkaStreams::singleton();
+  if (streams.has(id_)) {
+    return true;
+  }
+
+  // enroll the table in case it is the first time
+  TableService::singleton()->enroll(table_->to());
+
+  try {
+    auto consumer = std::make_unique<KafkaPartition>(
+      table_->location, table_->name, segment.partition, table_->settings);
+
+    // stream starts from retention window of the table if offset is not given
+    auto offset = segment.offset;
+    if (offset < 0) {
+      auto startMs = 1000 * (Evidence::unix_timestamp() - table_->max_hr * Evidence::HOUR_SECONDS);
+      offset = consumer->offsetForTime(startMs);
+    }
+
+    // blocks of this stream restored from local disk are served again, it resumes after messages in them
+    auto restored = BlockStore::singleton().claim(id_);
+    for (const auto& b : restored) {
+      offset = std::max(offset, (int64_t)b->getId());
+    }
+    BlockManager::init()->add(restored);
+
+    // check if this table has set batch size to overwrite the default one
+    size_t bRows = FLAGS_NBLOCK_MAX_ROWS;
+    auto itr = table_->settings.find(BATCH_SIZE);
+    if (itr != table_->settings.end()) {
+      bRows = folly::to<size_t>(itr->second);
+    }
+
+    return streams.attach(std::make_unique<nebula::ingest::PartitionStream>(
+      table_, id_, std::move(consumer), offset, bRows, FLAGS_KAFKA_STREAM_SEAL_SECONDS));
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "Failed to attach kafka stream " << id_ << ": " << ex.what();
+    return false;
+  }
+}
+
 #define OVERWRITE_IF_EXISTS(VAR, KEY, FUNC) \
   {                                         \
     auto itr = table_->settings.find(KEY);  \
@@ -405,6 +489,17 @@ bool IngestSpec::ingest(const std::string& file, BlockList& blocks) noexcept {
   } else if (table_->format == "parquet") {
     // schema is modified with time column, we need original schema here
     source = std::make_unique<ParquetReader>(file, schema);
+  } else if (table_->format == "arrow") {
+    // arrow rows are laid out by table schema, record batches are appended column by column.
+    // rows of a partitioned table go to different batches, so they are appended positionally one by one.
+    auto reader = std::make_unique<ArrowReader>(file, table->schema());
+    if (table->pod() == nullptr) {
+      size_t bRows = FLAGS_NBLOCK_MAX_ROWS;
+      OVERWRITE_IF_EXISTS(bRows, BATCH_SIZE, [](auto& s) { return folly::to<size_t>(s); })
+      return build(table, *reader, blocks, bRows, id_, timeRow);
+    }
+
+    source = std::move(reader);
   } else {
     LOG(ERROR) << "Unsupported file format: " << table_->format;
     return false;
@@ -503,9 +598,8 @@ bool build(
 
   // move all blocks in map into block manager
   for (auto& itr : batches) {
-    // TODO(cao) - the block maybe too small
-    // to waste lots of memory especially in case of sparse storage
-    // we need to try to compress them if useful to save memory
+    // the block maybe too small especially in case of sparse storage,
+    // small blocks of the same spec and partition are merged by BlockCompact later.
     blocks.push_front(makeBlock(blockId++, itr.second));
   }
 
@@ -517,5 +611,76 @@ bool build(
   return true;
 }
 
+bool build(
+  TablePtr table,
+  ArrowReader& reader,
+  BlockList& blocks,
+  size_t bRows,
+  const std::string& spec,
+  TimeRow& timeRow) noexcept {
+  try {
+    // time column is produced by time spec row by row, others are filled by arrow columns in bulk
+    const auto schema = table->schema();
+    size_t timeSlot = std::numeric_limits<size_t>::max();
+    for (size_t i = 0, size = schema->size(); i < size; ++i) {
+      if (schema->childType(i)->name() == Table::TIME_COLUMN) {
+        timeSlot = i;
+      }
+    }
+
+    std::pair<size_t, size_t> range{ std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::min() };
+    std::shared_ptr<Batch> batch = nullptr;
+    size_t blockId = 0;
+    auto seal = [&]() {
+      batch->seal();
+      LOG(INFO) << "Push a block: " << batch->state();
+      blocks.push_front(BlockLoader::from(
+        BlockSignature{ table->name(), blockId++, range.first, range.second, spec }, batch));
+      batch = nullptr;
+      range = { std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::min() };
+    };
+
+    auto& row = reader.row();
+    while (reader.nextBatch()) {
+      const auto rows = reader.batchRows();
+      for (int64_t start = 0; start < rows;) {
+        if (batch == nullptr) {
+          batch = std::make_shared<Batch>(*table, bRows);
+        }
+
+        const auto count = std::min<size_t>(rows - start, bRows - batch->getRows());
+        batch->add(count, [&](size_t slot, nebula::memory::DataNode& node) {
+          if (slot != timeSlot) {
+            row.fill(slot, node, start, count);
+            return;
+          }
+
+          for (size_t i = 0; i < count; ++i) {
+            row.seek(start + i);
+            const size_t time = timeRow.set(&row).readLong(Table::TIME_COLUMN);
+            range.first = std::min(range.first, time);
+            range.second = std::max(range.second, time);
+            node.append<int64_t>(time);
+          }
+        });
+
+        start += count;
+        if (batch->getRows() >= bRows) {
+          seal();
+        }
+      }
+    }
+
+    if (batch != nullptr && batch->getRows() > 0) {
+      seal();
+    }
+
+    return true;
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "Failed to build blocks from arrow: " << ex.what();
+    return false;
+  }
+}
+
 } // namespace ingest
 } // namespace nebula
\ No newline at end of file
@@ -24,6 +24,7 @@
 #include "execution/io/BlockLoader.h"
 #include "meta/NNode.h"
 #include "meta/TableSpec.h"
+#include "storage/kafka/KafkaTopic.h"
 
 /**
  * A ingest spec is generated from table setting based on its ingestion type.
@@ -111,6 +112,22 @@ public:
     return !node_.isInvalid();
   }
 
+  // nodes hosting replicas of this spec besides its affinity node
+  inline const std::vector<nebula::meta::NNode>& replicas() const {
+    return replicas_;
+  }
+
+  inline void setReplicas(std::vector<nebula::meta::NNode> nodes) {
+    replicas_ = std::move(nodes);
+  }
+
+  // check if given node is a replica of this spec
+  inline bool isReplica(const nebula::meta::NNode& node) const {
+    return std::any_of(replicas_.begin(), replicas_.end(), [&node](const auto& r) {
+      return r.equals(node);
+    });
+  }
+
   inline bool needSync() const {
     return state_ != SpecState::READY;
   }
@@ -140,6 +157,9 @@ public:
   bool work() noexcept;
 
 private:
+  // serve blocks of this spec restored from local disk, false if there is none
+  bool restore() noexcept;
+
   // load swap
   bool loadSwap() noexcept;
 
@@ -152,6 +172,9 @@ private:
   // load kafka
   bool loadKafka() noexcept;
 
+  // attach a continuous stream of a kafka partition
+  bool streamKafka(const nebula::storage::kafka::KafkaSegment&) noexcept;
+
   // load google sheet
   bool loadGSheet(nebula::execution::io::BlockList& blocks) noexcept;
 
@@ -175,6 +198,9 @@ private:
   // node info if the spec has affinity on a node
   nebula::meta::NNode node_;
 
+  // replica nodes of the spec when its table has replication
+  std::vector<nebula::meta::NNode> replicas_;
+
   // global unique identifier.
   // not like id which is unique for a given table
   std::string id_;
@@ -0,0 +1,277 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "KafkaStream.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "common/Evidence.h"
+#include "common/Numa.h"
+#include "execution/BlockManager.h"
+#include "storage/kafka/KafkaReader.h"
+
+DECLARE_uint64(KAFKA_CONSUME_BATCH);
+DECLARE_uint64(KAFKA_CONSUME_DEADLINE_MS);
+
+/**
+ * Continuous micro-batch ingestion of kafka partitions.
+ */
+namespace nebula {
+namespace ingest {
+
+using nebula::common::Evidence;
+using nebula::execution::BlockManager;
+using nebula::execution::io::BlockList;
+using nebula::execution::io::BlockLoader;
+using nebula::memory::Batch;
+using nebula::meta::BlockSignature;
+using nebula::meta::Table;
+using nebula::meta::TableSpecPtr;
+using nebula::storage::kafka::KafkaReader;
+using nebula::storage::kafka::PartitionConsumer;
+
+PartitionStream::PartitionStream(
+  TableSpecPtr table,
+  const std::string& spec,
+  std::unique_ptr<PartitionConsumer> consumer,
+  int64_t offset,
+  size_t maxRows,
+  size_t maxSeconds)
+  : tableSpec_{ table },
+    table_{ table->to() },
+    spec_{ spec },
+    consumer_{ std::move(consumer) },
+    parser_{ KafkaReader::makeParser(*table, true) },
+    row_{ SLICE_SIZE, true },
+    timeRow_{ table->timeSpec, 0 },
+    maxRows_{ maxRows },
+    maxSeconds_{ maxSeconds },
+    batch_{ nullptr },
+    open_{ nullptr },
+    opened_{ 0 },
+    range_{ std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::min() },
+    next_{ offset },
+    ingested_{ offset },
+    committed_{ offset } {
+  N_ENSURE(consumer_->seek(offset), "failed to seek kafka partition");
+
+  // bind row slots to table schema, every message is parsed and added to batch
+  // before next consume call, so string fields can reference message payload.
+  row_.bind(table_->schema());
+}
+
+void PartitionStream::seal(BlockList& blocks) noexcept {
+  // a block is identified by the offset after its last message, a restart resumes from it
+  batch_->seal();
+  blocks.push_front(BlockLoader::from(
+    BlockSignature{ table_->name(), (size_t)next_, range_.first, range_.second, spec_ },
+    batch_));
+
+  // all messages handled so far are in sealed blocks
+  ingested_ = next_;
+
+  // next batch will be opened by next message
+  batch_ = nullptr;
+  open_ = nullptr;
+  range_ = { std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::min() };
+}
+
+size_t PartitionStream::pump(BlockList& blocks) noexcept {
+  nebula::common::Numa::Placement placement;
+  const auto& messages = consumer_->consume(FLAGS_KAFKA_CONSUME_BATCH, FLAGS_KAFKA_CONSUME_DEADLINE_MS);
+
+  // rows of this round are appended to the open batch in one section rather than locking per row
+  std::unique_ptr<Batch::Section> section;
+  for (const auto& msg : messages) {
+    if (msg.error) {
+      continue;
+    }
+
+    next_ = msg.offset + 1;
+    KafkaReader::parse(*parser_, msg, row_);
+    const auto& row = timeRow_.set(&row_);
+
+    // TODO(cao) - Kafka may produce NULL row due to corruption or exception
+    // let's skip null row as segment ingestion does.
+    size_t time = row.readLong(Table::TIME_COLUMN);
+    if (time == 0) {
+      continue;
+    }
+
+    // open a new batch when needed, it is readable by queries once published
+    if (batch_ == nullptr) {
+      batch_ = std::make_shared<Batch>(*table_, maxRows_);
+      batch_->open();
+      opened_ = Evidence::unix_timestamp();
+      open_ = BlockLoader::from(
+        BlockSignature{ table_->name(), (size_t)next_, opened_, opened_, spec_ },
+        batch_);
+    }
+
+    if (section == nullptr) {
+      section = std::make_unique<Batch::Section>(*batch_);
+    }
+
+    range_.first = std::min(range_.first, time);
+    range_.second = std::max(range_.second, time);
+    batch_->add(row);
+
+    // seal by row count
+    if (batch_->getRows() >= maxRows_) {
+      section = nullptr;
+      seal(blocks);
+    }
+  }
+
+  // publish rows appended in this round
+  section = nullptr;
+
+  // seal by time so that a slow partition still publish its data
+  if (batch_ != nullptr && Evidence::unix_timestamp() - opened_ >= maxSeconds_) {
+    seal(blocks);
+  }
+
+  // nothing pending in an open batch, skipped messages are ingested too
+  if (batch_ == nullptr) {
+    ingested_ = next_;
+  }
+
+  return messages.size();
+}
+
+void PartitionStream::commit() noexcept {
+  if (ingested_ > committed_) {
+    consumer_->commit(ingested_);
+    committed_ = ingested_;
+  }
+}
+
+KafkaStreams& KafkaStreams::singleton() {
+  static KafkaStreams streams;
+  return streams;
+}
+
+KafkaStreams::KafkaStreams()
+  : sink_{ [](BlockList& blocks) {
+      BlockManager::init()->add(blocks);
+    } } {}
+
+bool KafkaStreams::attach(std::unique_ptr<PartitionStream> stream) noexcept {
+  std::lock_guard<std::mutex> lock(mux_);
+  const auto& spec = stream->spec();
+  if (streams_.find(spec) != streams_.end()) {
+    return false;
+  }
+
+  LOG(INFO) << "Attach kafka stream: " << spec;
+  streams_.emplace(spec, std::shared_ptr<PartitionStream>(std::move(stream)));
+  return true;
+}
+
+bool KafkaStreams::detach(const std::string& spec) noexcept {
+  std::lock_guard<std::mutex> lock(mux_);
+  return streams_.erase(spec) > 0;
+}
+
+bool KafkaStreams::has(const std::string& spec) const noexcept {
+  std::lock_guard<std::mutex> lock(mux_);
+  return streams_.find(spec) != streams_.end();
+}
+
+folly::Future<size_t> KafkaStreams::pump(folly::ThreadPoolExecutor& pool) noexcept {
+  // last round is still fetching or delivering
+  if (pumping_.exchange(true)) {
+    return folly::makeFuture<size_t>(0);
+  }
+
+  // take a snapshot of current streams
+  std::vector<std::shared_ptr<PartitionStream>> streams;
+  {
+    std::lock_guard<std::mutex> lock(mux_);
+    streams.reserve(streams_.size());
+    for (auto& s : streams_) {
+      streams.push_back(s.second);
+    }
+  }
+
+  if (streams.empty()) {
+    pumping_ = false;
+    return folly::makeFuture<size_t>(0);
+  }
+
+  // each partition is pumped in parallel
+  std::vector<folly::Future<BlockList>> futures;
+  futures.reserve(streams.size());
+  for (auto& s : streams) {
+    auto p = std::make_shared<folly::Promise<BlockList>>();
+    pool.addWithPriority(
+      [s, p]() {
+        BlockList blocks;
+        s->pump(blocks);
+        p->setValue(std::move(blocks));
+      },
+      folly::Executor::LO_PRI);
+    futures.push_back(p->getFuture());
+  }
+
+  // deliver sealed blocks in one continuation, a stream commits only after its blocks are added.
+  // the caller (scheduler thread) is not blocked by fetching
+  return folly::collectAll(futures)
+    .via(&pool)
+    .thenValue([this, streams = std::move(streams)](std::vector<folly::Try<BlockList>> results) {
+      size_t sealed = 0;
+      auto bm = BlockManager::init();
+      for (size_t i = 0, size = results.size(); i < size; ++i) {
+        // the stream may be detached while pumping
+        const auto& stream = streams.at(i);
+        if (!has(stream->spec())) {
+          continue;
+        }
+
+        // publish the latest open block before sealed ones to avoid counting rows twice
+        const auto& table = stream->table();
+        bm->open(table->name, stream->spec(), stream->current());
+
+        auto& r = results.at(i);
+        if (!r.hasValue() || r.value().empty()) {
+          // skipped messages may still move the ingested offset
+          stream->commit();
+          continue;
+        }
+
+        auto& blocks = r.value();
+        sealed += std::distance(blocks.begin(), blocks.end());
+        sink_(blocks);
+
+        // sealed blocks are delivered, a restart resumes after them
+        stream->commit();
+
+        // expire blocks of this stream out of table retention
+        auto now = Evidence::unix_timestamp();
+        auto retention = table->max_hr * Evidence::HOUR_SECONDS;
+        if (now > retention) {
+          bm->removeBefore(table->name, stream->spec(), now - retention);
+        }
+      }
+
+      return sealed;
+    })
+    .ensure([this]() { pumping_ = false; });
+}
+
+} // namespace ingest
+} // namespace nebula
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include "TimeRow.h"
+#include "common/Folly.h"
+#include "common/Hash.h"
+#include "execution/io/BlockLoader.h"
+#include "memory/Batch.h"
+#include "memory/FlatRow.h"
+#include "meta/TableSpec.h"
+#include "storage/RowParser.h"
+#include "storage/kafka/KafkaPartition.h"
+
+/**
+ * Continuous micro-batch ingestion of kafka partitions.
+ * Unlike a kafka segment spec which reads a fixed offset range and tears down,
+ * a stream keeps a long-lived consumer and an ingestion cursor per partition.
+ * Messages are consumed in batches and sealed into blocks by row count or time.
+ * The batch being appended is published as an open block so that it is queryable
+ * before it is sealed.
+ */
+namespace nebula {
+namespace ingest {
+
+// ingestion cursor of a single kafka partition
+class PartitionStream {
+  static constexpr size_t SLICE_SIZE = 1024;
+
+public:
+  PartitionStream(nebula::meta::TableSpecPtr,
+                  const std::string&,
+                  std::unique_ptr<nebula::storage::kafka::PartitionConsumer>,
+                  int64_t,
+                  size_t,
+                  size_t);
+  virtual ~PartitionStream() = default;
+
+public:
+  // consume one batch of messages into the open batch,
+  // push sealed blocks into the given list, return number of messages consumed.
+  size_t pump(nebula::execution::io::BlockList&) noexcept;
+
+  inline const std::string& spec() const noexcept {
+    return spec_;
+  }
+
+  inline const nebula::meta::TableSpecPtr& table() const noexcept {
+    return tableSpec_;
+  }
+
+  inline int64_t position() const noexcept {
+    return consumer_->position();
+  }
+
+  // next offset to resume from, messages before it are all in sealed blocks
+  inline int64_t ingested() const noexcept {
+    return ingested_;
+  }
+
+  // commit ingested offset to kafka once sealed blocks are delivered
+  void commit() noexcept;
+
+  // the open block being appended, nullptr if no open batch
+  inline const std::shared_ptr<nebula::execution::io::BatchBlock>& current() const noexcept {
+    return open_;
+  }
+
+private:
+  // seal current open batch as a block
+  void seal(nebula::execution::io::BlockList&) noexcept;
+
+private:
+  nebula::meta::TableSpecPtr tableSpec_;
+  nebula::meta::TablePtr table_;
+  std::string spec_;
+  std::unique_ptr<nebula::storage::kafka::PartitionConsumer> consumer_;
+  std::unique_ptr<nebula::storage::RowParser> parser_;
+  nebula::memory::FlatRow row_;
+  TimeRow timeRow_;
+
+  // seal policy: max rows per block and max seconds a batch stays open
+  size_t maxRows_;
+  size_t maxSeconds_;
+
+  // open batch and its states
+  std::shared_ptr<nebula::memory::Batch> batch_;
+  std::shared_ptr<nebula::execution::io::BatchBlock> open_;
+  size_t opened_;
+  std::pair<size_t, size_t> range_;
+
+  // offset after last message handled, and offsets ingested / committed
+  int64_t next_;
+  int64_t ingested_;
+  int64_t committed_;
+};
+
+// all kafka streams hosted in current node
+class KafkaStreams {
+public:
+  static KafkaStreams& singleton();
+
+public:
+  // attach a partition stream, return false if the spec is already streaming
+  bool attach(std::unique_ptr<PartitionStream>) noexcept;
+
+  // detach the stream of given spec if exists
+  bool detach(const std::string&) noexcept;
+
+  // check if a spec is streaming
+  bool has(const std::string&) const noexcept;
+
+  // pump all partitions in parallel for one round without blocking the caller,
+  // sealed blocks are delivered to the sink which defaults to block manager,
+  // open blocks are registered in block manager to serve fresh data.
+  // a round is skipped if last one is still running, the future has number of sealed blocks.
+  folly::Future<size_t> pump(folly::ThreadPoolExecutor&) noexcept;
+
+  // use a custom sink for sealed blocks rather than block manager
+  inline void sink(std::function<void(nebula::execution::io::BlockList&)> sink) noexcept {
+    sink_ = std::move(sink);
+  }
+
+private:
+  KafkaStreams();
+
+private:
+  mutable std::mutex mux_;
+  nebula::common::unordered_map<std::string, std::shared_ptr<PartitionStream>> streams_;
+  std::function<void(nebula::execution::io::BlockList&)> sink_;
+
+  // only one round in flight, so a partition is never pumped by two threads
+  std::atomic<bool> pumping_{ false };
+};
+
+} // namespace ingest
+} // namespace nebula
@@ -14,11 +14,13 @@
  * limitations under the License.
  */
 
+#include <cmath>
 #include <fmt/format.h>
 #include <folly/Conv.h>
 
 #include "SpecRepo.h"
 #include "common/Evidence.h"
+#include "common/HashRing.h"
 #include "storage/NFS.h"
 #include "storage/kafka/KafkaTopic.h"
 
@@ -27,6 +29,10 @@ DEFINE_uint64(KAFKA_SPEC_ROWS,
               "rows per sepc for kafka ingestion"
               "this value is used in spec identifier so do not modify");
 DEFINE_uint64(KAFKA_TIMEOUT_MS, 5000, "Timeout of each Kafka API call");
+DEFINE_double(SPEC_LOAD_FACTOR,
+              1.25,
+              "bounded load of spec placement, "
+              "max specs a node takes relative to the cluster average");
 
 /**
  * We will sync etcd configs for cluster info into this memory object
@@ -36,6 +42,7 @@ namespace nebula {
 namespace ingest {
 
 using nebula::common::Evidence;
+using nebula::common::HashRing;
 using nebula::common::unordered_map;
 using nebula::meta::ClusterInfo;
 using nebula::meta::DataSource;
@@ -53,9 +60,13 @@ constexpr auto DAY_SECONDS = HOUR_SECONDS * 24;
 
 // specified batch size in table config - not kafka specific
 constexpr auto S_BATCH = "batch";
+// specified number of nodes hosting each spec of a table - not kafka specific
+constexpr auto S_REPLICAS = "replicas";
 // specified kafka partition /offset to consume - kafka specific
 constexpr auto S_PARTITION = "k.partition";
 constexpr auto S_OFFSET = "k.offset";
+// consume kafka partitions continuously rather than by offset segments - kafka specific
+constexpr auto S_STREAM = "k.stream";
 
 // generate a list of ingestion spec based on cluster info
 void SpecRepo::refresh(const ClusterInfo& ci) noexcept {
@@ -192,6 +203,13 @@ void genKafkaSpec(const std::string& version,
     }
   };
 
+  // stream mode: one spec per partition, node keeps consuming it continuously
+  auto itr_s = settings.find(S_STREAM);
+  if (itr_s != settings.end() && folly::to<bool>(itr_s->second)) {
+    convert(topic.streams());
+    return;
+  }
+
   // if specific partition / offset specified, we only consume it.
   // this is usually for debugging purpose
   auto itr_p = settings.find(S_PARTITION);
@@ -273,6 +291,7 @@ void SpecRepo::update(const std::vector<std::shared_ptr<IngestSpec>>& specs) noe
       // by default, we carry over existing spec's properties
       const auto& node = prev->affinity();
       specPtr->setAffinity(node);
+      specPtr->setReplicas(prev->replicas());
       specPtr->setState(prev->state());
 
       // TODO(cao) - use only size for the checker for now, may extend to other properties
@@ -323,56 +342,159 @@ bool SpecRepo::confirm(const std::string& spec, const nebula::meta::NNode& node)
     return true;
   }
 
-  // not in the same node
+  // in the same node or one of its replicas
   auto& assignment = sp->affinity();
-  if (!assignment.equals(node)) {
-    LOG(INFO) << "Spec [" << spec << "] moves from " << node.server << " to " << assignment.server;
-    return false;
+  if (assignment.equals(node) || sp->isReplica(node)) {
+    return true;
   }
 
-  return true;
+  // keep an existing copy as a replica if the spec needs more
+  if (sp->replicas().size() + 1 < replication(*sp)) {
+    auto replicas = sp->replicas();
+    replicas.push_back(node);
+    sp->setReplicas(std::move(replicas));
+    return true;
+  }
+
+  LOG(INFO) << "Spec [" << spec << "] moves from " << node.server << " to " << assignment.server;
+  return false;
 }
 
+// a node on the placement ring, identified by its address
+class RingMember final : public nebula::common::Identifiable {
+public:
+  RingMember(const NNode& node) : node_{ node }, id_{ node.toString() } {}
+  virtual ~RingMember() = default;
+
+  virtual const std::string& id() const override {
+    return id_;
+  }
+
+  inline const NNode& node() const {
+    return node_;
+  }
+
+private:
+  NNode node_;
+  std::string id_;
+};
+
 void SpecRepo::assign(const std::vector<NNode>& nodes) noexcept {
-  // we're looking for a stable assignmet, given the same set of nodes
-  // this order is most likely having stable order
-  // std::sort(nodes.begin(), nodes.end(), [](auto& n1, auto& n2) {
-  //   return n1.server.compare(n2.server);
-  // });
-  const auto size = nodes.size();
-
-  if (size == 0) {
-    LOG(WARNING) << "No nodes to assign nebula specs.";
+  // place specs on a consistent hash ring of active nodes keyed by spec id (table + spec),
+  // so that placement is stable across server restarts and a node joining or leaving
+  // only impacts ~1/N of the specs. Assigned specs stick to their nodes.
+  std::vector<std::unique_ptr<RingMember>> members;
+  unordered_map<std::string, size_t> load;
+  for (const auto& n : nodes) {
+    if (n.isActive()) {
+      members.push_back(std::make_unique<RingMember>(n));
+      load.emplace(members.back()->id(), 0);
+    }
+  }
+
+  if (members.empty()) {
+    LOG(WARNING) << "No active nodes to assign nebula specs.";
     return;
   }
 
-  size_t idx = 0;
+  const auto numNodes = members.size();
 
-  // for each spec
-  // TODO(cao): should we do hash-based shuffling here to ensure a stable assignment?
-  // Round-robin is easy to break the position affinity whenever new spec is coming
-  // Or we can keep order of the specs so that any old spec is associated.
+  // count load of copies staying on active nodes, collect specs lacking copies to be placed
+  size_t copies = 0;
+  std::vector<SpecPtr> pending;
   for (auto& spec : specs_) {
-    // not assigned yet
-    auto sp = spec.second;
+    auto& sp = spec.second;
+    const auto replication = std::min(SpecRepo::replication(*sp), numNodes);
+    copies += replication;
+
+    if (sp->assigned()) {
+      auto found = load.find(sp->affinity().toString());
+      if (found != load.end()) {
+        ++found->second;
+      } else {
+        // its node left the cluster
+        sp->setAffinity(NNode::invalid());
+      }
+    }
+
+    // replicas on nodes that left the cluster are dropped
+    std::vector<NNode> replicas;
+    for (const auto& r : sp->replicas()) {
+      auto found = load.find(r.toString());
+      if (found != load.end()) {
+        ++found->second;
+        replicas.push_back(r);
+      }
+    }
+
+    if (replicas.size() != sp->replicas().size()) {
+      sp->setReplicas(std::move(replicas));
+    }
+
+    if (!sp->assigned() || sp->replicas().size() + 1 < replication) {
+      pending.push_back(sp);
+    }
+  }
+
+  if (pending.empty()) {
+    return;
+  }
+
+  // bounded load: no node takes more than (1 + e) of the average, hot nodes spill over clockwise
+  const auto capacity = std::max<size_t>(
+    1, std::ceil(copies * FLAGS_SPEC_LOAD_FACTOR / numNodes));
+
+  // place in id order so that result doesn't depend on hash map iteration order
+  std::sort(pending.begin(), pending.end(), [](const auto& s1, const auto& s2) {
+    return s1->id() < s2->id();
+  });
+
+  HashRing<RingMember, IngestSpec> ring(members);
+  for (auto& sp : pending) {
+    // a node hosts at most one copy of a spec
+    auto hosting = [&sp](const RingMember& m) {
+      return sp->affinity().equals(m.node()) || sp->isReplica(m.node());
+    };
+
     if (!sp->assigned()) {
-      auto startId = idx;
-      while (true) {
-        auto& n = nodes.at(idx);
-        if (n.isActive()) {
-          sp->setAffinity(n);
-          idx = (idx + 1) % size;
-          break;
-        }
-
-        idx = (idx + 1) % size;
-        if (idx == startId) {
-          LOG(ERROR) << "No active node found to assign spec.";
-          return;
-        }
+      const auto& member = ring.locate(sp->id(), [&load, capacity](const RingMember& m) {
+        return load.at(m.id()) < capacity;
+      });
+
+      sp->setAffinity(member.node());
+      ++load[member.id()];
+    }
+
+    // replicas take following distinct nodes on the ring
+    const auto replication = std::min(SpecRepo::replication(*sp), numNodes);
+    auto replicas = sp->replicas();
+    while (replicas.size() + 1 < replication) {
+      const auto& member = ring.locate(sp->id(), [&load, &hosting, capacity](const RingMember& m) {
+        return !hosting(m) && load.at(m.id()) < capacity;
+      });
+
+      // every node is either full or hosting this spec
+      if (hosting(member)) {
+        break;
       }
+
+      replicas.push_back(member.node());
+      sp->setReplicas(replicas);
+      ++load[member.id()];
     }
   }
+
+  LOG(INFO) << "Placed " << pending.size() << " specs on " << numNodes << " nodes with capacity " << capacity;
+}
+
+size_t SpecRepo::replication(const IngestSpec& spec) noexcept {
+  const auto& settings = spec.table()->settings;
+  auto itr = settings.find(S_REPLICAS);
+  if (itr != settings.end()) {
+    return std::max<size_t>(1, folly::to<size_t>(itr->second));
+  }
+
+  return 1;
 }
 
 } // namespace ingest
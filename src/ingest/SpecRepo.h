@@ -48,7 +48,7 @@ public:
   // refresh spec repo based on cluster configs
   void refresh(const nebula::meta::ClusterInfo&) noexcept;
 
-  // this method can be sub-routine of refresh
+  // place unassigned specs on given nodes through a consistent hash ring with bounded load
   void assign(const std::vector<nebula::meta::NNode>&) noexcept;
 
   // expose all current specs in repo
@@ -60,6 +60,9 @@ public:
   // assign the spec for given node
   bool confirm(const std::string& spec, const nebula::meta::NNode& node) noexcept;
 
+  // number of nodes to host each spec of its table, configured by table setting "replicas"
+  static size_t replication(const IngestSpec&) noexcept;
+
 private:
   // process a table spec and generate all specs into the given specs container
   void process(const std::string&, const nebula::meta::TableSpecPtr&, std::vector<SpecPtr>&) noexcept;
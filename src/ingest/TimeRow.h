@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <algorithm>
+
 #include "meta/TableSpec.h"
 
 /**
@@ -28,18 +30,40 @@ namespace ingest {
 class TimeRow : public nebula::surface::RowData {
 public:
   TimeRow(const nebula::meta::TimeSpec& ts, size_t mdate)
-    : timeFunc_{ makeTimeFunc(ts, mdate) } {}
+    : timeFunc_{ makeTimeFunc(ts, mdate) }, row_{ nullptr }, timeSlot_{ NO_SLOT } {}
   ~TimeRow() = default;
 
   const TimeRow& set(const nebula::surface::RowData* row) {
     row_ = row;
+
+    // locate time slot when the wrapped row comes with a new slot layout
+    const auto& slots = row->slots();
+    if (UNLIKELY(slots.get() != layout_.get())) {
+      layout_ = slots;
+      timeSlot_ = NO_SLOT;
+      if (slots != nullptr) {
+        auto itr = std::find(slots->begin(), slots->end(), nebula::meta::Table::TIME_COLUMN);
+        if (itr != slots->end()) {
+          timeSlot_ = std::distance(slots->begin(), itr);
+        }
+      }
+    }
+
     return *this;
   }
 
+  // same slot layout as the wrapped row
+  const nebula::surface::Slots& slots() const noexcept override {
+    return layout_;
+  }
+
 // raw date to _time_ columm in ingestion time
-#define TRANSFER(TYPE, FUNC)                           \
-  TYPE FUNC(const std::string& field) const override { \
-    return row_->FUNC(field);                          \
+#define TRANSFER(TYPE, FUNC)                                \
+  TYPE FUNC(const std::string& field) const override {      \
+    return row_->FUNC(field);                               \
+  }                                                         \
+  TYPE FUNC(nebula::surface::IndexType slot) const override { \
+    return row_->FUNC(slot);                                \
   }
 
   TRANSFER(bool, readBool)
@@ -72,6 +96,22 @@ public:
     return row_->readLong(field);
   }
 
+  bool isNull(nebula::surface::IndexType slot) const override {
+    if (UNLIKELY(slot == timeSlot_)) {
+      return false;
+    }
+
+    return row_->isNull(slot);
+  }
+
+  int64_t readLong(nebula::surface::IndexType slot) const override {
+    if (UNLIKELY(slot == timeSlot_)) {
+      return timeFunc_(row_);
+    }
+
+    return row_->readLong(slot);
+  }
+
 private:
   // A method to convert time spec into a time function
   std::function<int64_t(const nebula::surface::RowData*)> makeTimeFunc(const nebula::meta::TimeSpec& ts, size_t mdate) {
@@ -163,8 +203,14 @@ private:
   }
 
 private:
+  static constexpr nebula::surface::IndexType NO_SLOT = std::numeric_limits<nebula::surface::IndexType>::max();
+
   std::function<int64_t(const nebula::surface::RowData*)> timeFunc_;
   const nebula::surface::RowData* row_;
+
+  // slot layout of the wrapped row and slot of time column in it
+  nebula::surface::Slots layout_;
+  nebula::surface::IndexType timeSlot_;
 };
 
 } // namespace ingest
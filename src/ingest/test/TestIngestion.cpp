@@ -18,11 +18,17 @@
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include "common/Evidence.h"
+#include "execution/BlockManager.h"
+#include "ingest/BlockCompact.h"
 #include "ingest/IngestSpec.h"
+#include "ingest/KafkaStream.h"
 #include "ingest/SpecRepo.h"
 #include "meta/ClusterInfo.h"
 #include "meta/MetaDb.h"
 #include "meta/TableSpec.h"
+#include "meta/TestTable.h"
+#include "surface/StaticData.h"
 
 namespace nebula {
 namespace ingest {
@@ -70,6 +76,220 @@ TEST(IngestTest, TestSpecGeneration) {
   }
 #endif
 }
+// an in-process fake partition serving messages from memory
+class FakePartition : public nebula::storage::kafka::PartitionConsumer {
+public:
+  FakePartition(int32_t partition, std::vector<std::string> payloads, int64_t* committed = nullptr)
+    : partition_{ partition }, position_{ 0 }, payloads_{ std::move(payloads) }, committed_{ committed } {}
+  virtual ~FakePartition() = default;
+
+  virtual int32_t partition() const noexcept override {
+    return partition_;
+  }
+
+  virtual int64_t position() const noexcept override {
+    return position_;
+  }
+
+  virtual bool seek(int64_t offset) noexcept override {
+    position_ = std::max<int64_t>(offset, 0);
+    return true;
+  }
+
+  virtual int64_t committed() const noexcept override {
+    return committed_ ? *committed_ : -1;
+  }
+
+  virtual void commit(int64_t offset) noexcept override {
+    if (committed_) {
+      *committed_ = offset;
+    }
+  }
+
+  virtual const std::vector<nebula::storage::kafka::KafkaMessage>& consume(size_t max, size_t) noexcept override {
+    batch_.clear();
+    const auto time = nebula::common::Evidence::unix_timestamp();
+    while (batch_.size() < max && position_ < (int64_t)payloads_.size()) {
+      auto& p = payloads_.at(position_);
+      batch_.push_back({ position_++, time, p.data(), p.size(), false });
+    }
+
+    return batch_;
+  }
+
+private:
+  int32_t partition_;
+  int64_t position_;
+  std::vector<std::string> payloads_;
+  std::vector<nebula::storage::kafka::KafkaMessage> batch_;
+  int64_t* committed_;
+};
+
+static nebula::meta::TableSpecPtr streamTable() {
+  nebula::meta::TimeSpec ts;
+  ts.type = nebula::meta::TimeType::PROVIDED;
+  nebula::meta::AccessSpec as;
+  nebula::meta::ColumnProps cp;
+  nebula::meta::BucketInfo bi = nebula::meta::BucketInfo::empty();
+  nebula::meta::KafkaSerde sd;
+  std::unordered_map<std::string, std::string> settings;
+  return std::make_shared<nebula::meta::TableSpec>(
+    "k.stream.test", 1000, 10, "ROW<id:int, name:string>", nebula::meta::DataSource::KAFKA,
+    "Streaming", "localhost:9092", "", "json",
+    std::move(sd), std::move(cp), std::move(ts),
+    std::move(as), std::move(bi), std::move(settings));
+}
+
+static std::vector<std::string> jsonMessages(size_t count) {
+  std::vector<std::string> messages;
+  messages.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    messages.push_back(fmt::format("{{\"id\": {0}, \"name\": \"n{0}\"}}", i));
+  }
+
+  return messages;
+}
+
+TEST(IngestTest, TestPartitionStreamSeal) {
+  auto table = streamTable();
+
+  // seal by row count only, the rest stays in open batch
+  {
+    nebula::ingest::PartitionStream stream(
+      table, "p0", std::make_unique<FakePartition>(0, jsonMessages(25)), 0, 10, 3600);
+    nebula::execution::io::BlockList blocks;
+    EXPECT_EQ(stream.pump(blocks), 25);
+    EXPECT_EQ(std::distance(blocks.begin(), blocks.end()), 2);
+    for (auto& b : blocks) {
+      EXPECT_EQ(b->state().numRows, 10);
+      EXPECT_EQ(b->spec(), "p0");
+    }
+    EXPECT_EQ(stream.position(), 25);
+
+    // the last 5 messages are in open batch, not ingested yet
+    EXPECT_EQ(stream.ingested(), 20);
+
+    // nothing more to consume
+    blocks.clear();
+    EXPECT_EQ(stream.pump(blocks), 0);
+    EXPECT_TRUE(blocks.empty());
+  }
+
+  // seal by time, all rows are published in one round
+  {
+    nebula::ingest::PartitionStream stream(
+      table, "p1", std::make_unique<FakePartition>(1, jsonMessages(25)), 5, 8, 0);
+    nebula::execution::io::BlockList blocks;
+    EXPECT_EQ(stream.pump(blocks), 20);
+    size_t rows = 0;
+    for (auto& b : blocks) {
+      rows += b->state().numRows;
+    }
+    EXPECT_EQ(std::distance(blocks.begin(), blocks.end()), 3);
+    EXPECT_EQ(rows, 20);
+  }
+}
+
+TEST(IngestTest, TestKafkaStreamsPump) {
+  auto table = streamTable();
+  auto& streams = nebula::ingest::KafkaStreams::singleton();
+
+  size_t sealed = 0;
+  streams.sink([&sealed](nebula::execution::io::BlockList& blocks) {
+    sealed += std::distance(blocks.begin(), blocks.end());
+  });
+
+  // partitions are pumped in parallel
+  std::vector<int64_t> committed(4, -1);
+  for (auto i = 0; i < 4; ++i) {
+    auto spec = fmt::format("s{0}", i);
+    EXPECT_TRUE(streams.attach(std::make_unique<nebula::ingest::PartitionStream>(
+      table, spec, std::make_unique<FakePartition>(i, jsonMessages(110), &committed[i]), 0, 50, 3600)));
+    EXPECT_TRUE(streams.has(spec));
+  }
+
+  // the same spec can not be attached twice
+  EXPECT_FALSE(streams.attach(std::make_unique<nebula::ingest::PartitionStream>(
+    table, "s0", std::make_unique<FakePartition>(0, jsonMessages(1)), 0, 50, 3600)));
+
+  folly::CPUThreadPoolExecutor pool{ 4 };
+  EXPECT_EQ(streams.pump(pool).get(), 8);
+  EXPECT_EQ(sealed, 8);
+
+  // offsets are committed up to sealed blocks, the open batch will be re-read after restart
+  for (auto c : committed) {
+    EXPECT_EQ(c, 100);
+  }
+
+  for (auto i = 0; i < 4; ++i) {
+    EXPECT_TRUE(streams.detach(fmt::format("s{0}", i)));
+  }
+  EXPECT_EQ(streams.pump(pool).get(), 0);
+}
+
+TEST(IngestTest, TestBlockCompact) {
+  nebula::meta::TestTable test;
+  auto bm = nebula::execution::BlockManager::init();
+
+  // 5 small blocks of 10 rows each in the same spec
+  const auto spec = "compact_spec";
+  std::vector<std::shared_ptr<nebula::execution::io::BatchBlock>> blocks;
+  for (size_t b = 0; b < 5; ++b) {
+    auto batch = std::make_shared<nebula::memory::Batch>(test, 10);
+    for (int32_t i = 0; i < 10; ++i) {
+      auto v = (int32_t)(b * 10 + i);
+      nebula::surface::StaticRow row{ v, v, "events", nullptr, false, 0, 0, 0 };
+      batch->add(row);
+    }
+    batch->seal();
+
+    auto block = nebula::execution::io::BlockLoader::from(
+      nebula::meta::BlockSignature{ test.name(), b, b * 10, b * 10 + 9, spec }, batch);
+    blocks.push_back(block);
+    bm->add(block);
+  }
+
+  // a running query holds the first block selected for it
+  nebula::memory::EvaledBlock running{ blocks.front()->data(), nebula::surface::eval::BlockEval::ALL };
+  std::weak_ptr<nebula::memory::Batch> first = running.first;
+
+  // merge them directly and check rebuilt stats
+  auto merged = BlockCompact::merge(test, blocks);
+  EXPECT_EQ(merged->getId(), 4);
+  EXPECT_EQ(merged->start(), 0);
+  EXPECT_EQ(merged->end(), 49);
+  EXPECT_EQ(merged->spec(), spec);
+  EXPECT_EQ(merged->data()->getRows(), 50);
+  auto h = merged->data()->histogram<nebula::surface::eval::IntHistogram>("id");
+  EXPECT_EQ(h.count, 50);
+  EXPECT_EQ(h.min(), 0);
+  EXPECT_EQ(h.max(), 49);
+  EXPECT_TRUE(merged->data()->probably("id", 33));
+
+  // compaction swaps them in block manager
+  auto rows = bm->state(test.name()).numRows();
+  folly::CPUThreadPoolExecutor pool{ 2 };
+  EXPECT_GE(BlockCompact::singleton().run(pool).get(), 4);
+  auto state = bm->state(test.name());
+  EXPECT_EQ(state.numRows(), rows);
+
+  size_t count = 0;
+  state.iterate([&count, &spec](const nebula::execution::io::BatchBlock& b) {
+    if (b.spec() == spec) {
+      ++count;
+    }
+  });
+  EXPECT_EQ(count, 1);
+  bm->removeBySpec(test.name(), spec);
+
+  // replaced blocks are released once no query references them
+  blocks.clear();
+  EXPECT_FALSE(first.expired());
+  EXPECT_EQ(running.first->getRows(), 10);
+  running.first = nullptr;
+  EXPECT_TRUE(first.expired());
+}
+
 } // namespace test
 } // namespace ingest
 } // namespace nebula
\ No newline at end of file
@@ -15,13 +15,21 @@
  */
 
 #include "Batch.h"
+#include <algorithm>
 #include <numeric>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "common/Likely.h"
+#include "common/Numa.h"
 
 DEFINE_int32(BESS_PAGE_SIZE, 1024, "page size for bess encoded data");
 
 namespace nebula {
 namespace memory {
 
+using nebula::common::BinaryReader;
+using nebula::common::BinaryWriter;
 using nebula::meta::BessType;
 using nebula::meta::Table;
 using nebula::surface::RowData;
@@ -29,19 +37,30 @@ using nebula::type::Schema;
 using nebula::type::TreeBase;
 using nebula::type::TypeBase;
 
+// ids of batches are never reused in a process
+static std::atomic<size_t> BATCH_ID{ 0 };
+
 Batch::Batch(const Table& table, size_t capacity, size_t pid)
-  : schema_{ table.schema() },
+  : id_{ ++BATCH_ID },
+    node_{ nebula::common::Numa::singleton().place() },
+    schema_{ table.schema() },
     data_{ DataNode::buildDataTree(table, capacity) },
     pod_{ table.pod() },
     pid_{ pid },
     bess_{ pod_ != nullptr ? (size_t)FLAGS_BESS_PAGE_SIZE : 0 },
     rows_{ 0 },
     fields_{ schema_->size() },
-    sealed_{ false } {
+    sealed_{ false },
+    nullFree_{ false },
+    positional_{ false },
+    open_{ false },
+    appending_{ false },
+    touched_{ nebula::common::Evidence::unix_timestamp() } {
   // build a field name to data node
   for (size_t i = 0, size = schema_->size(); i < size; ++i) {
     auto f = dynamic_cast<TypeBase*>(schema_->TreeBase::childAt(i).get());
     fields_[f->name()] = data_->childAt<PDataNode>(i).value();
+    columns_.emplace(f->name(), table.column(f->name()));
   }
 
   // if current batch belongs to a pod, then we can decode spaces for each dimensions
@@ -57,20 +76,109 @@ Batch::Batch(const Table& table, size_t capacity, size_t pid)
 // thread-safe on sync guarded - exclusive lock?
 size_t Batch::add(const RowData& row, BessType bess) {
   N_ENSURE(!sealed_, "can not add rows into sealed batch");
+
+  // memory of this batch goes to its node in a placement scope, no-op if the thread already prefers it
+  nebula::common::Numa::singleton().prefer(node_);
+
+  // exclusive with readers only when this batch is published open and not in a section
+  std::unique_lock<std::shared_mutex> lock(mux_, std::defer_lock);
+  if (!appending_ && open_.load(std::memory_order_relaxed)) {
+    lock.lock();
+  }
+
+  // only writer changes rows, relaxed load is enough
+  const auto rows = rows_.load(std::memory_order_relaxed);
+
   // bess is already calculated by caller just write it out
   // TODO(cao): compress bess value which should be very small
   // width = sum(bits width of each dimension)
   if (pod_ != nullptr) {
-    bess_.writeBits(rows_ * bessBits_, bessBits_, bess);
+    bess_.writeBits(rows * bessBits_, bessBits_, bess);
   }
 
   // read data from row data and save it to batch
-  auto result = data_->append<const RowData&>(row);
+  auto result = positional(row) ? data_->appendSlots(row) : data_->append<const RowData&>(row);
 
   // record the row size
   VLOG(1) << "Total row size  = " << result;
 
-  return rows_++;
+  // publish the new watermark
+  rows_.store(rows + 1, std::memory_order_release);
+  return rows;
+}
+
+size_t Batch::add(size_t rows, const std::function<void(size_t, DataNode&)>& filler) {
+  N_ENSURE(!sealed_, "can not add rows into sealed batch");
+  N_ENSURE(pod_ == nullptr, "partitioned batch is added row by row");
+  N_ENSURE(!open_.load(std::memory_order_relaxed), "open batch is added row by row");
+
+  nebula::common::Numa::singleton().prefer(node_);
+
+  const auto base = rows_.load(std::memory_order_relaxed);
+  size_t size = 0;
+  for (size_t i = 0, count = schema_->size(); i < count; ++i) {
+    auto node = data_->childAt<PDataNode>(i).value();
+    const auto raw = node->rawSize();
+    filler(i, *node);
+    N_ENSURE_EQ(node->entries(), base + rows, "column is filled with unexpected number of values");
+    size += node->rawSize() - raw;
+  }
+
+  // root node does not see the values appended to its children
+  data_->appendRows(rows, size);
+
+  rows_.store(base + rows, std::memory_order_release);
+  return base;
+}
+
+bool Batch::positional(const RowData& row) {
+  const auto& slots = row.slots();
+  if (LIKELY(slots.get() == layout_.get())) {
+    return positional_;
+  }
+
+  // a new layout, verify it once by comparing field names in order
+  layout_ = slots;
+  positional_ = false;
+  if (slots == nullptr || slots->size() != schema_->size()) {
+    return false;
+  }
+
+  for (size_t i = 0, size = schema_->size(); i < size; ++i) {
+    if (slots->at(i) != schema_->childType(i)->name()) {
+      return false;
+    }
+  }
+
+  positional_ = true;
+  return true;
+}
+
+void Batch::open() {
+  N_ENSURE(!sealed_, "can not open a sealed batch");
+  open_.store(true, std::memory_order_release);
+}
+
+Batch::Section::Section(Batch& batch)
+  : batch_{ batch }, lock_{ batch.mux_, std::defer_lock } {
+  N_ENSURE(!batch_.sealed_, "can not append to a sealed batch");
+  if (batch_.open_.load(std::memory_order_relaxed)) {
+    lock_.lock();
+    batch_.appending_ = true;
+  }
+}
+
+Batch::Section::~Section() {
+  // rows are already published by release store, unlock lets readers snapshot them
+  batch_.appending_ = false;
+}
+
+std::shared_lock<std::shared_mutex> Batch::snapshot() const {
+  if (!open_.load(std::memory_order_acquire)) {
+    return {};
+  }
+
+  return std::shared_lock<std::shared_mutex>(mux_);
 }
 
 // random access to a row - may require internal seek
@@ -99,21 +207,71 @@ std::string Batch::state() const {
 
   // TODO(cao): output a JSON string
   return fmt::format("[raw: {0}, size: {1}, allocation: {2}, rows: {3}, bess: {4}]",
-                     data_->rawSize(), std::get<1>(s), std::get<0>(s), rows_, bess_.capacity());
+                     data_->rawSize(), std::get<1>(s), std::get<0>(s), getRows(), bess_.capacity());
 }
 
 void Batch::seal() {
   N_ENSURE(!sealed_, "batch is already sealed.");
+
+  // wait for readers of an open batch to finish
+  std::unique_lock<std::shared_mutex> lock(mux_, std::defer_lock);
+  if (open_.load(std::memory_order_relaxed)) {
+    lock.lock();
+  }
+
   sealed_ = true;
+  nebula::common::Numa::singleton().prefer(node_);
 
   // seal every node
   data_->seal();
+  nullFree_ = std::all_of(fields_.begin(), fields_.end(), [](const auto& f) {
+    return f.second->nulls() == nebula::memory::serde::Nulls::NONE;
+  });
 
   // seal bess as well
   if (pod_) {
-    auto bits = (rows_ * bessBits_);
+    auto bits = (getRows() * bessBits_);
     bess_.seal(bits / 8 + 1);
   }
+
+  // sealed batch is immutable, readers need no lock
+  open_.store(false, std::memory_order_release);
+}
+
+void Batch::persist(BinaryWriter& writer) const {
+  N_ENSURE(sealed_, "only sealed batch can be persisted");
+  const auto rows = getRows();
+  writer.write<uint64_t>(rows);
+  writer.write<bool>(nullFree_);
+  writer.blob(bess_.ptr(), pod_ ? rows * bessBits_ / 8 + 1 : 0);
+  data_->persist(writer);
+}
+
+void Batch::restore(BinaryReader& reader, std::shared_ptr<const void> backing) {
+  N_ENSURE(!sealed_ && getRows() == 0, "only new batch can be restored");
+  const auto begin = reader.cursor();
+  const auto rows = reader.read<uint64_t>();
+  nullFree_ = reader.read<bool>();
+  auto bess = reader.blob();
+  bess_.write(0, bess.data(), bess.size());
+  data_->restore(reader);
+
+  paged_ = std::string_view(begin, reader.cursor() - begin);
+  backing_ = std::move(backing);
+  sealed_ = true;
+  rows_.store(rows, std::memory_order_release);
+}
+
+void Batch::prefetch() const {
+  if (paged_.empty()) {
+    return;
+  }
+
+  // advice range starts at a page boundary, failure is harmless as pages are still read on demand
+  static const uintptr_t PAGE = ::sysconf(_SC_PAGESIZE);
+  const auto begin = reinterpret_cast<uintptr_t>(paged_.data()) & ~(PAGE - 1);
+  const auto end = reinterpret_cast<uintptr_t>(paged_.data() + paged_.size());
+  ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
 }
 
 } // namespace memory
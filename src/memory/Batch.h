@@ -16,10 +16,13 @@
 
 #pragma once
 
+#include <atomic>
+#include <shared_mutex>
 #include <string_view>
 
 #include "DataNode.h"
 
+#include "common/Evidence.h"
 #include "meta/Table.h"
 #include "surface/DataSurface.h"
 #include "surface/eval/Histogram.h"
@@ -45,13 +48,46 @@ public: // read row from and write row to
   // add a row into current batch
   size_t add(const nebula::surface::RowData& row, nebula::meta::BessType bess = 0);
 
+  // add a run of rows column by column rather than row by row, such as a record batch of arrow.
+  // the filler is called with index and data node of every column in schema order,
+  // and appends exactly the given number of values to it.
+  // not for a partitioned batch or an open batch. return row ID of the first row.
+  size_t add(size_t rows, const std::function<void(size_t, DataNode&)>& filler);
+
   // random access to a row - may require internal seek
   std::unique_ptr<RowAccessor> makeAccessor() const;
 
+  // mark this batch open before publishing it to readers while still appending.
+  // an open batch has a single writer, an add outside of a section takes exclusive lock.
+  void open();
+
+  // the single writer of an open batch appends a group of rows in a section,
+  // which takes exclusive lock once rather than per row.
+  // readers see rows of a section together when it ends, no-op for a batch not open.
+  class Section {
+  public:
+    explicit Section(Batch&);
+    ~Section();
+
+  private:
+    Batch& batch_;
+    std::unique_lock<std::shared_mutex> lock_;
+  };
+
+  inline bool isOpen() const {
+    return open_.load(std::memory_order_acquire);
+  }
+
+  // readers of an open batch hold the returned lock while reading it, rows and stats are consistent
+  // up to the watermark. the writer waits for it, so a long scan takes it per range of rows;
+  // rows below the watermark never change but their memory may move once the lock is released.
+  // it is a no-op lock for a closed or sealed batch.
+  std::shared_lock<std::shared_mutex> snapshot() const;
+
 public: /* implement interface of Block.h */
-  // get total rows in the batch
+  // get total rows in the batch - the watermark published by the writer
   inline size_t getRows() const override {
-    return rows_;
+    return rows_.load(std::memory_order_acquire);
   }
 
   nebula::type::TypeNode columnType(const std::string& col) const override {
@@ -116,6 +152,21 @@ public: /* implement interface of Block.h */
   }
 
 public:
+  // unique id of this batch in current process, results computed on it can be keyed by it
+  inline size_t id() const {
+    return id_;
+  }
+
+  // partition id of this batch, 0 if table is not partitioned
+  inline size_t pid() const {
+    return pid_;
+  }
+
+  // NUMA node holding memory of this batch, always 0 on a single node machine
+  inline size_t node() const {
+    return node_;
+  }
+
   inline size_t getMemory() const {
     return data_->storageAllocation();
   }
@@ -135,6 +186,53 @@ public:
   // This helps release some necessary memory used in batch building
   void seal();
 
+  // no column of this sealed batch has null values, readers can skip null checks
+  inline bool nullFree() const {
+    return nullFree_;
+  }
+
+  inline bool sealed() const {
+    return sealed_;
+  }
+
+  inline const nebula::type::Schema& schema() const {
+    return schema_;
+  }
+
+  // pod of the table if partitioned
+  inline const std::shared_ptr<nebula::meta::Pod>& pod() const {
+    return pod_;
+  }
+
+  // properties of columns this batch is built with
+  inline const nebula::meta::ColumnProps& columns() const {
+    return columns_;
+  }
+
+  // write a sealed batch
+  void persist(nebula::common::BinaryWriter&) const;
+
+  // restore a persisted batch into this new one built for the same table, it is sealed after that.
+  // pages are read in place of the reader's buffer, the batch keeps its owner alive.
+  void restore(nebula::common::BinaryReader&, std::shared_ptr<const void>);
+
+  // a restored batch reads its pages from its backing buffer on demand
+  inline bool paged() const {
+    return backing_ != nullptr;
+  }
+
+  // last time in seconds this batch is picked by a query, it is never touched before created
+  inline size_t touched() const {
+    return touched_.load(std::memory_order_relaxed);
+  }
+
+  inline void touch() const {
+    touched_.store(nebula::common::Evidence::unix_timestamp(), std::memory_order_relaxed);
+  }
+
+  // hint OS to read pages of a paged batch ahead of scanning it, it returns without waiting
+  void prefetch() const;
+
   // a bloom filter tester
   template <typename T>
   inline bool probably(const std::string& col, const T& value) const {
@@ -150,7 +248,14 @@ public:
   }
 
 private:
+  // check if given row slots are in the same order of schema fields
+  bool positional(const nebula::surface::RowData&);
+
+private:
+  const size_t id_;
+  const size_t node_;
   nebula::type::Schema schema_;
+  nebula::meta::ColumnProps columns_;
   nebula::memory::DataTree data_;
 
   // encoding bess for each partition columns if partitioned
@@ -162,8 +267,8 @@ private:
   size_t bessBits_;
   nebula::common::ExtendableSlice bess_;
 
-  // recording number of rows
-  size_t rows_;
+  // recording number of rows, published to readers after each row is fully written
+  std::atomic<size_t> rows_;
 
   // A row accessor cursor to read data of given row
   friend class RowAccessor;
@@ -172,10 +277,33 @@ private:
   DnMap fields_;
 
   bool sealed_;
+  bool nullFree_;
+
+  // slot layout of last row seen and whether it matches schema order,
+  // rows in a matched layout are added positionally without name lookups
+  // the layout is held so that its identity is not reused by another layout
+  nebula::surface::Slots layout_;
+  bool positional_;
+
+  // single writer and multiple readers on an open batch
+  std::atomic<bool> open_;
+  mutable std::shared_mutex mux_;
+  // writer is in a section holding the exclusive lock
+  bool appending_;
+
+  // buffer a restored batch reads its pages from, such as a mapped file
+  std::shared_ptr<const void> backing_;
+  // range of this batch in the backing buffer
+  std::string_view paged_;
+
+  // last access time for LRU of tiering
+  mutable std::atomic<size_t> touched_;
 };
 
 using BatchPtr = std::shared_ptr<Batch>;
-using EvaledBlock = std::pair<Batch*, nebula::surface::eval::BlockEval>;
+// a block selected for a query holds its batch alive until all tasks scanning it are done,
+// so a block replaced by compaction or tiering is released once its last reader finishes.
+using EvaledBlock = std::pair<BatchPtr, nebula::surface::eval::BlockEval>;
 
 class RowAccessor : public nebula::surface::RowData {
 public:
@@ -27,6 +27,8 @@
 namespace nebula {
 namespace memory {
 
+using nebula::common::BinaryReader;
+using nebula::common::BinaryWriter;
 using nebula::common::Hasher;
 using nebula::memory::serde::TypeMetadata;
 using nebula::meta::Table;
@@ -122,9 +124,9 @@ size_t DataNode::append(std::string_view str) {
   // histogram
   meta_->histogram(str);
 
-  if (meta_->hasDict()) {
+  if (meta_->encodeDict(index)) {
     auto dictIdx = meta_->dictItem(str);
-    meta_->setOffsetSize(index, dictIdx);
+    meta_->setDictItem(index, dictIdx);
     INCREMENT_RAW_SIZE_AND_RETURN()
   }
 
@@ -135,6 +137,48 @@ size_t DataNode::append(std::string_view str) {
   INCREMENT_RAW_SIZE_AND_RETURN()
 }
 
+#define APPEND_VALUES(K)                                                                                    \
+  template <>                                                                                               \
+  size_t DataNode::appendValues(                                                                            \
+    const nebula::type::TypeTraits<Kind::K>::CppType* values, size_t count, const uint8_t* validity, int64_t offset) { \
+    N_ENSURE(type_.k() == Kind::K, #K " type expected");                                                    \
+    N_ENSURE(!meta_->isPartition(), "partition column is not appended in bulk");                            \
+    constexpr size_t width = nebula::type::Type<Kind::K>::width;                                            \
+    const auto base = count_;                                                                               \
+    data_->addRun(values, count, validity, offset);                                                         \
+    size_t size = 0;                                                                                        \
+    for (size_t i = 0; i < count; ++i) {                                                                    \
+      if (nebula::memory::serde::isValid(validity, offset + i)) {                                           \
+        meta_->histogram(values[i]);                                                                        \
+        size += width;                                                                                      \
+      } else {                                                                                              \
+        meta_->setNull(base + i);                                                                           \
+        size += NULL_SIZE;                                                                                  \
+      }                                                                                                     \
+    }                                                                                                       \
+    count_ += count;                                                                                        \
+    INCREMENT_RAW_SIZE_AND_RETURN()                                                                         \
+  }
+
+APPEND_VALUES(TINYINT)
+APPEND_VALUES(SMALLINT)
+APPEND_VALUES(INTEGER)
+APPEND_VALUES(BIGINT)
+APPEND_VALUES(REAL)
+APPEND_VALUES(DOUBLE)
+APPEND_VALUES(INT128)
+
+#undef APPEND_VALUES
+
+void DataNode::appendRows(size_t rows, size_t size) {
+  N_ENSURE(type_.k() == Kind::STRUCT, "struct type expected");
+  for (size_t i = 0; i < rows; ++i) {
+    meta_->histogram(nullptr);
+  }
+
+  rawSize_ += size;
+}
+
 #define DISPATCH_KIND(KIND, lambda, object, func)                          \
   case Kind::KIND: {                                                       \
     lambda = [&object, &list](auto i) { return object->append(func(i)); }; \
@@ -219,8 +263,8 @@ size_t DataNode::append(const nebula::surface::MapData& map) {
     break;                                       \
   }
 
-template <>
-size_t DataNode::append(const nebula::surface::RowData& row) {
+template <typename K>
+size_t DataNode::appendRow(const nebula::surface::RowData& row, K&& keyOf) {
   // TODO(cao): NULL row is not supported.
   // Need to modify if we want to support row/struct column type in the future
   N_ENSURE(type_.k() == Kind::STRUCT, "struct type expected");
@@ -231,30 +275,31 @@ size_t DataNode::append(const nebula::surface::RowData& row) {
     const auto& child = this->childAt<PDataNode>(i).value();
     const auto kind = child->type_.k();
     const auto& name = child->type_.name();
+    const auto& key = keyOf(i, name);
 
     // null field
-    if (row.isNull(name)) {
+    if (row.isNull(key)) {
       size += child->appendNull();
       continue;
     }
 
     switch (kind) {
-      DISPATCH_KIND(size, BOOLEAN, child, row.readBool(name))
-      DISPATCH_KIND(size, TINYINT, child, row.readByte(name))
-      DISPATCH_KIND(size, SMALLINT, child, row.readShort(name))
-      DISPATCH_KIND(size, INTEGER, child, row.readInt(name))
-      DISPATCH_KIND(size, BIGINT, child, row.readLong(name))
-      DISPATCH_KIND(size, REAL, child, row.readFloat(name))
-      DISPATCH_KIND(size, DOUBLE, child, row.readDouble(name))
-      DISPATCH_KIND(size, INT128, child, row.readInt128(name))
-      DISPATCH_KIND(size, VARCHAR, child, row.readString(name))
+      DISPATCH_KIND(size, BOOLEAN, child, row.readBool(key))
+      DISPATCH_KIND(size, TINYINT, child, row.readByte(key))
+      DISPATCH_KIND(size, SMALLINT, child, row.readShort(key))
+      DISPATCH_KIND(size, INTEGER, child, row.readInt(key))
+      DISPATCH_KIND(size, BIGINT, child, row.readLong(key))
+      DISPATCH_KIND(size, REAL, child, row.readFloat(key))
+      DISPATCH_KIND(size, DOUBLE, child, row.readDouble(key))
+      DISPATCH_KIND(size, INT128, child, row.readInt128(key))
+      DISPATCH_KIND(size, VARCHAR, child, row.readString(key))
     case Kind::ARRAY: {
-      auto list = row.readList(name);
+      auto list = row.readList(key);
       size += child->append<const ListData&>(*list);
       break;
     }
     case Kind::MAP: {
-      auto map = row.readMap(name);
+      auto map = row.readMap(key);
       size += child->append<const MapData&>(*map);
       break;
     }
@@ -270,6 +315,21 @@ size_t DataNode::append(const nebula::surface::RowData& row) {
   INCREMENT_RAW_SIZE_AND_RETURN()
 }
 
+template <>
+size_t DataNode::append(const nebula::surface::RowData& row) {
+  // look up every field by name
+  return appendRow(row, [](size_t, const std::string& name) -> const std::string& {
+    return name;
+  });
+}
+
+size_t DataNode::appendSlots(const nebula::surface::RowData& row) {
+  // read every field by its slot index, no name lookup
+  return appendRow(row, [](size_t i, const std::string&) -> IndexType {
+    return i;
+  });
+}
+
 #undef DISPATCH_KIND
 
 #undef INCREMENT_RAW_SIZE_AND_RETURN
@@ -300,19 +360,47 @@ std::string_view DataNode::read(size_t index) {
     return data_->defaultValue<std::string_view>();
   }
 
-  // if with dictionary, we need to check
-  // whether this points to another index so using offsetSize
-  // instead of offsetSizeDirect
-  if (meta_->hasDict()) {
-    auto os = meta_->offsetSize(index);
-    return meta_->dictItem(os.second);
+  // if with dictionary, the value is read from dictionary by its index
+  if (meta_->isDict(index)) {
+    return meta_->dictItem((size_t)meta_->dictIndex(index));
   }
 
-  auto os = meta_->offsetSize(index);
+  auto os = meta_->plainOffsetSize(index);
   return data_->read(os.first, os.second);
 }
 
 #undef TYPE_READ_DELEGATE
 
+void DataNode::persist(BinaryWriter& writer) {
+  writer.write<uint64_t>(count_);
+  writer.write<uint64_t>(rawSize_);
+  writer.write<uint64_t>(size_);
+  meta_->persist(writer);
+  data_->persist(writer);
+
+  // children in schema order
+  for (size_t i = 0, count = TreeBase::size(); i < count; ++i) {
+    this->childAt(i).value()->persist(writer);
+  }
+}
+
+void DataNode::restore(BinaryReader& reader) {
+  count_ = reader.read<uint64_t>();
+  rawSize_ = reader.read<uint64_t>();
+  size_ = reader.read<uint64_t>();
+  meta_->restore(reader);
+  data_->restore(reader);
+
+  // allocation is what the restored tree holds in memory, pages read in place of the buffer are not counted
+  size_t alloc = data_->capacity();
+  for (size_t i = 0, count = TreeBase::size(); i < count; ++i) {
+    auto child = this->childAt(i).value();
+    child->restore(reader);
+    alloc += child->storageAllocation();
+  }
+
+  storage_ = alloc;
+}
+
 } // namespace memory
 } // namespace nebula
\ No newline at end of file
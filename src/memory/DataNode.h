@@ -79,6 +79,18 @@ public: // data appending API
   template <typename T>
   size_t append(T v);
 
+  // append a row whose fields are read by slot index,
+  // caller ensures the row slots are in the same order of this struct node's children.
+  size_t appendSlots(const nebula::surface::RowData&);
+
+  // append a run of fixed width values in bulk, such as a column array of arrow.
+  // validity is an optional bitmap in LSB bit order starting at given bit, a value is null if its bit is 0.
+  template <typename T>
+  size_t appendValues(const T*, size_t, const uint8_t* validity = nullptr, int64_t offset = 0);
+
+  // record a run of rows of this struct node whose children are appended column by column
+  void appendRows(size_t rows, size_t size);
+
 public: // data reading API
   // use std::optional to simplify the interface
   // instead of
@@ -91,6 +103,11 @@ public: // data reading API
     return meta_->isNull(index);
   }
 
+  // null state of a sealed node
+  inline nebula::memory::serde::Nulls nulls() const {
+    return meta_->nulls();
+  }
+
   template <typename T>
   T read(size_t index);
 
@@ -135,7 +152,7 @@ public: // basic metadata exposure
   }
 
   inline void seal() {
-    meta_->seal();
+    meta_->seal(count_);
 
     // rollup the storage size and storage allocation
     size_t alloc = 0;
@@ -162,7 +179,15 @@ public: // basic metadata exposure
     storage_ = alloc;
   }
 
+  // write a sealed node with its children, or restore them into a new tree of the same schema
+  void persist(nebula::common::BinaryWriter&);
+  void restore(nebula::common::BinaryReader&);
+
 private:
+  // append all fields of a row, key function maps child index and name to the field key
+  template <typename K>
+  size_t appendRow(const nebula::surface::RowData&, K&&);
+
   // called for every single value added in current node
   inline size_t cursorAndAdvance() {
     return count_++;
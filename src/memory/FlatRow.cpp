@@ -26,6 +26,13 @@ bool FlatRow::isNull(const std::string& field) const {
   // Note: this is a convinient method but is it performant?
   // we're adding this check for all isNull calls,
   // the advantage is we don't need to ensure all fields are present by purpose.
+  if (bound()) {
+    auto s = slot(field);
+    if (s != NO_SLOT) {
+      return isNull(s);
+    }
+  }
+
   if (nullIfMissing_ && meta_.find(field) == meta_.end()) {
     return true;
   }
@@ -35,10 +42,27 @@ bool FlatRow::isNull(const std::string& field) const {
   return slice_.read<int8_t>(offset) == 0;
 }
 
+bool FlatRow::isNull(IndexType slot) const {
+  auto offset = offsets_.at(slot);
+  if (offset == NO_SLOT) {
+    N_ENSURE(nullIfMissing_, "slot not written");
+    return true;
+  }
+
+  // a string view is never null
+  if (offset == VIEW_SLOT) {
+    return false;
+  }
+
+  return slice_.read<int8_t>(offset) == 0;
+}
+
 #define READ_SCALAR(RT, NAME)                        \
   RT FlatRow::NAME(const std::string& field) const { \
-    auto offset = meta_.at(field);                   \
-    return slice_.read<RT>(offset + 1);              \
+    return slice_.read<RT>(offset(field) + 1);       \
+  }                                                  \
+  RT FlatRow::NAME(IndexType slot) const {           \
+    return slice_.read<RT>(offsets_[slot] + 1);      \
   }
 
 READ_SCALAR(bool, readBool)
@@ -53,14 +77,30 @@ READ_SCALAR(int128_t, readInt128)
 #undef READ_SCALAR
 
 std::string_view FlatRow::readString(const std::string& field) const {
+  if (bound()) {
+    auto s = slot(field);
+    if (s != NO_SLOT) {
+      return readString(s);
+    }
+  }
+
   auto offset = meta_.at(field);
 
   // type check: we can check first byte is string flag
   return slice_.read(offset + 5, slice_.read<int32_t>(offset + 1));
 }
 
+std::string_view FlatRow::readString(IndexType slot) const {
+  auto offset = offsets_[slot];
+  if (offset == VIEW_SLOT) {
+    return views_[slot];
+  }
+
+  return slice_.read(offset + 5, slice_.read<int32_t>(offset + 1));
+}
+
 std::unique_ptr<ListData> FlatRow::readList(const std::string& field) const {
-  auto offset = meta_.at(field);
+  auto offset = this->offset(field);
   auto header = slice_.read<int16_t>(offset);
   auto size = slice_.read<int32_t>(offset + 2);
 
@@ -68,10 +108,21 @@ std::unique_ptr<ListData> FlatRow::readList(const std::string& field) const {
   return std::make_unique<FlatList>(size, header, offset + 6, slice_);
 }
 
+std::unique_ptr<ListData> FlatRow::readList(IndexType slot) const {
+  auto offset = offsets_[slot];
+  auto header = slice_.read<int16_t>(offset);
+  auto size = slice_.read<int32_t>(offset + 2);
+  return std::make_unique<FlatList>(size, header, offset + 6, slice_);
+}
+
 std::unique_ptr<MapData> FlatRow::readMap(const std::string&) const {
   throw NException("Map not supported in flat row");
 }
 
+std::unique_ptr<MapData> FlatRow::readMap(IndexType) const {
+  throw NException("Map not supported in flat row");
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 bool FlatList::isNull(size_t) const {
   // TODO(cao): Currently not supporting nulls in list/vector. Empty string is supported.
@@ -33,6 +33,10 @@
  * 
  * Reset will reset the writing cursor to beginning and wipe out all meta data.
  * Metadata is <key, offset>
+ *
+ * A flat row can be bound to a schema, then every key gets a dense slot in schema order,
+ * offsets are kept in a vector indexed by slot and fields can be read by slot index.
+ * Bound rows also support string views referencing external buffer without copying.
  * 
  * Every value has size prefix, 1byte flag indicating if its null or not
  * Compound types are struct, map and list
@@ -51,6 +55,7 @@ namespace nebula {
 namespace memory {
 
 using nebula::common::ExtendableSlice;
+using nebula::surface::IndexType;
 using nebula::type::Kind;
 using nebula::type::Schema;
 using nebula::type::Tree;
@@ -73,13 +78,60 @@ public:
   static constexpr NByte STRING_FLAG = 127;
   static constexpr int16_t LIST_FLAG = 99 << 8;
 
+  // slot not written in current row, or a slot written as a string view
+  static constexpr size_t NO_SLOT = std::numeric_limits<size_t>::max();
+  static constexpr size_t VIEW_SLOT = NO_SLOT - 1;
+
   FlatRow(size_t initSliceSize, bool nullIfMissing = false)
     : slice_{ initSliceSize }, nullIfMissing_{ nullIfMissing }, cursor_{ 0 } {}
   virtual ~FlatRow() = default;
 
+  // bind all fields of given schema to dense slots in schema order
+  void bind(const Schema& schema) {
+    std::vector<std::string> names;
+    index_.clear();
+    for (size_t i = 0, size = schema->size(); i < size; ++i) {
+      const auto& name = schema->childType(i)->name();
+      index_.emplace(name, i);
+      names.push_back(name);
+    }
+
+    offsets_.assign(names.size(), NO_SLOT);
+    views_.assign(names.size(), {});
+    layout_ = std::make_shared<const std::vector<std::string>>(std::move(names));
+  }
+
+  inline bool bound() const noexcept {
+    return layout_ != nullptr;
+  }
+
+  // slot of given key, NO_SLOT if the row is not bound or key is not in schema
+  inline size_t slot(const std::string& key) const noexcept {
+    auto found = index_.find(key);
+    return found == index_.end() ? NO_SLOT : found->second;
+  }
+
+  // check if a slot is written in current row
+  inline bool written(IndexType slot) const noexcept {
+    return offsets_[slot] != NO_SLOT;
+  }
+
+  virtual const nebula::surface::Slots& slots() const noexcept override {
+    return layout_;
+  }
+
   // initialize states for writing a new row
   void reset() {
     cursor_ = 0;
+    if (bound()) {
+      std::fill(offsets_.begin(), offsets_.end(), NO_SLOT);
+
+      // keys out of bound schema are rare
+      if (meta_.empty()) {
+        return;
+      }
+    }
+
     meta_.clear();
   }
 
@@ -89,31 +141,42 @@ public:
     slice_.write(pos, NULL_BYTE);
   }
 
+  void writeNull(IndexType slot) {
+    auto pos = moveSlot(slot, 1);
+    slice_.write(pos, NULL_BYTE);
+  }
+
   // write data at given memory offset for specified node
   // or using is_arithmetic to limit to types in bool, byte, short, int, long, float, double
   template <typename T>
   auto write(const std::string& key, const T& value)
     -> typename std::enable_if<std::is_scalar<T>::value, size_t>::type {
-    constexpr NByte width = sizeof(T);
-    // flag of width + value
-    auto pos = moveKey(key, width + 1);
-    slice_.write(pos, width);
-    slice_.write(pos + 1, value);
+    return writeAt(moveKey(key, sizeof(T) + 1), value);
+  }
 
-    return width;
+  template <typename T>
+  auto write(IndexType slot, const T& value)
+    -> typename std::enable_if<std::is_scalar<T>::value, size_t>::type {
+    return writeAt(moveSlot(slot, sizeof(T) + 1), value);
   }
 
   size_t write(const std::string& key, const char* str, size_t length) {
     // flag of string [STRING_FLAG][LENGTH][bytes]
-    auto size = 1 + 4 + length;
-    auto pos = moveKey(key, size);
-    slice_.write(pos++, STRING_FLAG);
-    slice_.write(pos, (uint32_t)length);
-    pos += 4;
+    return writeAt(moveKey(key, 1 + 4 + length), str, length);
+  }
 
-    // write string bytes out
-    slice_.write(pos, str, length);
-    return size;
+  size_t write(IndexType slot, const char* str, size_t length) {
+    return writeAt(moveSlot(slot, 1 + 4 + length), str, length);
+  }
+
+  // reference a string in external buffer without copying it into this row,
+  // the buffer has to outlive the reads of current row.
+  size_t view(IndexType slot, const char* str, size_t length) {
+    N_ENSURE_LT(slot, offsets_.size(), "slot out of bound");
+    N_ENSURE(offsets_[slot] == NO_SLOT, "do not overwrite key");
+    offsets_[slot] = VIEW_SLOT;
+    views_[slot] = std::string_view(str, length);
+    return length;
   }
 
   // write spceial value as string
@@ -181,12 +244,20 @@ public:
   }
 
   inline bool hasKey(const std::string& key) const noexcept {
+    if (bound()) {
+      auto s = slot(key);
+      if (s != NO_SLOT) {
+        return offsets_[s] != NO_SLOT;
+      }
+    }
+
     return meta_.find(key) != meta_.end();
   }
 
 public:
-#define INTERFACE_IMPL(RT, NAME) \
-  virtual RT NAME(const std::string&) const override;
+#define INTERFACE_IMPL(RT, NAME)                             \
+  virtual RT NAME(const std::string&) const override;        \
+  virtual RT NAME(IndexType) const override;
 
   INTERFACE_IMPL(bool, isNull)
   INTERFACE_IMPL(bool, readBool)
@@ -204,7 +275,34 @@ public:
 #undef INTERFACE_IMPL
 
 private:
+  template <typename T>
+  inline size_t writeAt(size_t pos, const T& value) {
+    constexpr NByte width = sizeof(T);
+    // flag of width + value
+    slice_.write(pos, width);
+    slice_.write(pos + 1, value);
+    return width;
+  }
+
+  inline size_t writeAt(size_t pos, const char* str, size_t length) {
+    slice_.write(pos++, STRING_FLAG);
+    slice_.write(pos, (uint32_t)length);
+    pos += 4;
+
+    // write string bytes out
+    slice_.write(pos, str, length);
+    return 1 + 4 + length;
+  }
+
   inline size_t moveKey(const std::string& key, size_t size) {
+    // keys out of bound schema still go to the key map
+    if (bound()) {
+      auto s = slot(key);
+      if (s != NO_SLOT) {
+        return moveSlot(s, size);
+      }
+    }
+
     N_ENSURE(meta_.find(key) == meta_.end(), "do not overwrite key");
     // record key offset
     auto current = cursor_;
@@ -215,6 +313,30 @@ private:
     return current;
   }
 
+  inline size_t moveSlot(IndexType slot, size_t size) {
+    N_ENSURE_LT(slot, offsets_.size(), "slot out of bound");
+    N_ENSURE(offsets_[slot] == NO_SLOT, "do not overwrite key");
+    // record slot offset
+    auto current = cursor_;
+    offsets_[slot] = current;
+
+    // move cursor
+    cursor_ = current + size;
+    return current;
+  }
+
+  // offset of a key, throws if it's absent as reading a missing key
+  inline size_t offset(const std::string& key) const {
+    if (bound()) {
+      auto s = slot(key);
+      if (s != NO_SLOT) {
+        return offsets_[s];
+      }
+    }
+
+    return meta_.at(key);
+  }
+
 private:
   // data containers
   ExtendableSlice slice_;
@@ -224,6 +346,13 @@ private:
   // write states
   size_t cursor_;
   nebula::common::unordered_map<std::string, size_t> meta_;
+
+  // bound schema: names and name lookup of slots,
+  // offset of each slot in current row and string views
+  nebula::surface::Slots layout_;
+  nebula::common::unordered_map<std::string, size_t> index_;
+  std::vector<size_t> offsets_;
+  std::vector<std::string_view> views_;
 };
 
 class FlatList : public nebula::surface::ListData {
@@ -11,6 +11,7 @@ add_library(${NEBULA_MEMORY} STATIC
     ${NEBULA_SRC}/memory/encode/RleDecoder.cpp
     ${NEBULA_SRC}/memory/keyed/FlatBuffer.cpp
     ${NEBULA_SRC}/memory/keyed/HashFlat.cpp
+    ${NEBULA_SRC}/memory/keyed/SpillFlat.cpp
     ${NEBULA_SRC}/memory/serde/TypeData.cpp
     ${NEBULA_SRC}/memory/serde/TypeDataFactory.cpp
     ${NEBULA_SRC}/memory/serde/TypeMetadata.cpp)
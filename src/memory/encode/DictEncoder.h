@@ -16,7 +16,8 @@
 
 #pragma once
 
-#include <unordered_map>
+#include <cstring>
+#include <vector>
 
 #include "common/Hash.h"
 #include "common/Memory.h"
@@ -26,60 +27,72 @@ namespace memory {
 namespace encode {
 /**
  * Dictionary encoding for text values.
- * It works like this:
- * 1. Reading tokens from the text value separated by <space>
- * 2. It applies only first 255 characters for using one byte store position info.
- * 3. It only works for token which length is longer than 2.
- * 4. An encoded string are stored like this 
- *      [number dict items(0~255)][p0(0-255)][c0(0-65536)][p1(0-255)]...[pN(0-255)]
+ * Every distinct value is stored once in the dictionary and a value is represented by its index.
+ * While building, values are looked up in a flat open addressing table, each slot keeps the
+ * hash, size and first bytes of its value, so short values are compared inline and longer ones
+ * are only compared in full when everything else matches.
+ * Dictionary values are stored in contiguous slices, a lookup never decompresses a page.
  */
 class DictEncoder {
   // assuming dictionary item can not exceeding max integer
   using IndexType = int32_t;
 
-  // all items share the same hash value
-  using HashItems = std::unordered_multimap<size_t, IndexType>;
-
-  using Range = nebula::common::CRange;
-
   // 6K page size per each dictinoary
   static constexpr auto INDICE_PAGE = 2048;
   static constexpr auto DICT_PAGE = 4096;
   static constexpr auto IndexWidth = sizeof(IndexType);
 
+  // number of leading bytes of a value kept in its slot
+  static constexpr size_t INLINE = 8;
+  static constexpr size_t INIT_SLOTS = 256;
+  static constexpr IndexType EMPTY = -1;
+
+  struct Slot {
+    size_t hash;
+    IndexType index;
+    uint32_t size;
+    char prefix[INLINE];
+  };
+
 public:
   DictEncoder()
-    : hashItems_{ std::make_unique<HashItems>() },
+    : slots_(INIT_SLOTS, Slot{ 0, EMPTY, 0, {} }),
       offsets_{ INDICE_PAGE },
       dict_{ DICT_PAGE },
       items_{ 0 },
       size_{ 0 } {
     offsets_.write(0, 0);
   }
+
   // set item and return its index in dictionary
   int32_t set(std::string_view item) {
     // check if this item is already in our dictionary
-    auto hash = nebula::common::Hasher::hash64(item.data(), item.size());
-    auto range = hashItems_->equal_range(hash);
-    for (auto it = range.first; it != range.second; ++it) {
-      // get offset and length of given index
-
-      const auto index = it->second;
-      auto str = get(index);
+    const auto hash = nebula::common::Hasher::hash64(item.data(), item.size());
+    const auto mask = slots_.size() - 1;
+    for (auto i = hash & mask;; i = (i + 1) & mask) {
+      auto& slot = slots_[i];
+      if (slot.index == EMPTY) {
+        // not found, we're adding this new item
+        slot.hash = hash;
+        slot.size = item.size();
+        std::memcpy(slot.prefix, item.data(), std::min(item.size(), INLINE));
+        slot.index = add(item);
+
+        // keep the table at most half full
+        auto index = slot.index;
+        if ((size_t)items_ * 2 > slots_.size()) {
+          grow();
+        }
 
-      // string view equals
-      if (item == str) {
         return index;
       }
-    }
 
-    // not found, we're adding this new item
-    // write offset of the new item
-    size_ += dict_.write(size_, item.data(), item.size());
-    // add the hash value to the list for next value to lookup
-    hashItems_->emplace(hash, items_);
-    offsets_.write((items_ + 1) * IndexWidth, size_);
-    return items_++;
+      if (slot.hash == hash && slot.size == item.size()
+          && std::memcmp(slot.prefix, item.data(), std::min(item.size(), INLINE)) == 0
+          && (item.size() <= INLINE || get(slot.index) == item)) {
+        return slot.index;
+      }
+    }
   }
 
   // get the item by its index
@@ -91,25 +104,78 @@ public:
     return dict_.read(offset, offset2 - offset);
   }
 
+  // number of distinct items in the dictionary
+  inline size_t items() const {
+    return items_;
+  }
+
   void seal() {
     // release the assitant data structure
-    hashItems_ = nullptr;
+    std::vector<Slot>().swap(slots_);
+
+    offsets_.seal((items_ + 1) * IndexWidth);
+    dict_.seal(std::max(size_, 1));
+  }
+
+  // write a sealed dictionary
+  void persist(nebula::common::BinaryWriter& writer) const {
+    writer.write(items_);
+    writer.write(size_);
+    writer.blob(offsets_.ptr(), (items_ + 1) * IndexWidth);
+    writer.blob(dict_.ptr(), size_);
+  }
+
+  // restore a persisted dictionary into this new one, it is sealed after that
+  void restore(nebula::common::BinaryReader& reader) {
+    N_ENSURE_EQ(items_, 0, "restoring into an empty dictionary only");
+    items_ = reader.read<IndexType>();
+    size_ = reader.read<int32_t>();
+    auto offsets = reader.blob();
+    offsets_.write(0, offsets.data(), offsets.size());
+    auto dict = reader.blob();
+    dict_.write(0, dict.data(), dict.size());
+    seal();
+  }
+
+private:
+  IndexType add(std::string_view item) {
+    size_ += dict_.write(size_, item.data(), item.size());
+    offsets_.write((items_ + 1) * IndexWidth, size_);
+    return items_++;
+  }
+
+  // double the table and place all slots again by their stored hash
+  void grow() {
+    std::vector<Slot> slots(slots_.size() * 2, Slot{ 0, EMPTY, 0, {} });
+    const auto mask = slots.size() - 1;
+    for (const auto& slot : slots_) {
+      if (slot.index == EMPTY) {
+        continue;
+      }
+
+      auto i = slot.hash & mask;
+      while (slots[i].index != EMPTY) {
+        i = (i + 1) & mask;
+      }
+
+      slots[i] = slot;
+    }
 
-    offsets_.seal();
-    dict_.seal();
+    slots_.swap(slots);
   }
 
 private:
-  std::unique_ptr<HashItems> hashItems_;
+  // open addressing table of items, power of 2 slots and at most half full
+  std::vector<Slot> slots_;
 
   // every value has offset and length of the dict item
-  nebula::common::PagedSlice offsets_;
+  nebula::common::ExtendableSlice offsets_;
   // store all dictionary items in order
-  nebula::common::PagedSlice dict_;
+  nebula::common::ExtendableSlice dict_;
   // current size of the dictinaary slice
   int32_t items_;
   int32_t size_;
 };
 } // namespace encode
 } // namespace memory
-} // namespace nebula
\ No newline at end of file
+} // namespace nebula
@@ -17,7 +17,7 @@
 #include "FlatBuffer.h"
 
 #include <gflags/gflags.h>
-DEFINE_uint64(FB_MAIN_PAGE, 1024 * 1024, "Main memory page size");
+DEFINE_uint64(FB_COLUMN_ROWS, 16 * 1024, "Rows per page of column values");
 DEFINE_uint64(FB_DATA_PAGE, 4096 * 1024, "Data memory page size");
 DEFINE_uint64(FB_LIST_PAGE, 2048 * 1024, "List memory page size");
 
@@ -49,9 +49,10 @@ void FlatBuffer::initSchema() noexcept {
     // get the column width
     auto width = widthInMain(kind);
 
-    // for aggregated columns we reserve space even it's null
+    // aggregated columns keep a sketch per row, and the slot holds its serialized binary or range
     if (ia) {
       width = std::max(width, MAX_ALIGNMENT);
+      rowBytes_ += sizeof(std::shared_ptr<nebula::surface::eval::Sketch>);
     }
 
     // generate column parser for each column
@@ -66,10 +67,20 @@ FlatBuffer::FlatBuffer(const nebula::type::Schema& schema,
     fields_{ fields },
     chunk_{ nullptr },
     chunkSize_{ 0 },
-    main_{ std::make_unique<Buffer>(FLAGS_FB_MAIN_PAGE) },
     data_{ std::make_unique<Buffer>(FLAGS_FB_DATA_PAGE) },
-    list_{ std::make_unique<Buffer>(FLAGS_FB_LIST_PAGE) } {
+    list_{ std::make_unique<Buffer>(FLAGS_FB_LIST_PAGE) },
+    last_{ 0, 0 },
+    rows_{ 0 },
+    budget_{ nebula::common::MemoryBudget::current() },
+    rowBytes_{ 0 },
+    indexRows_{ 0 },
+    indexCharged_{ 0 } {
   this->initSchema();
+
+  columns_.reserve(numColumns_);
+  for (const auto& cop : cops_) {
+    columns_.push_back(std::make_unique<FlatColumn>(cop.width, FLAGS_FB_COLUMN_ROWS));
+  }
 }
 
 // initialize a read-only flat buffer with given serialized data
@@ -83,7 +94,13 @@ FlatBuffer::FlatBuffer(const nebula::type::Schema& schema,
     numColumns_{ schema->size() },
     fields_{ fields },
     chunk_{ data },
-    chunkSize_{ 0 } {
+    chunkSize_{ 0 },
+    last_{ 0, 0 },
+    rows_{ 0 },
+    budget_{ nebula::common::MemoryBudget::current() },
+    rowBytes_{ 0 },
+    indexRows_{ 0 },
+    indexCharged_{ 0 } {
   // 1. initialize the column align property based on the meta blob
   this->initSchema();
 
@@ -101,22 +118,17 @@ FlatBuffer::FlatBuffer(const nebula::type::Schema& schema,
     return;
   }
 
-  // this section will have numRows * SIZE_T for each row offset
-  auto offsetOffset = offset;
-
-  // skip it for now to prepare main data
-  offset += numRows * SIZET_SIZE;
-
-  // write main block size
-  auto mainSize = readSizeT();
   auto dataSize = readSizeT();
   auto listSize = readSizeT();
   auto magic = readSizeT();
   N_ENSURE(magic == MAGIC, "magic mismatch: corrupted flat buffer data");
 
-  // build up each buffer
-  main_ = std::make_unique<Buffer>(mainSize, data + offset);
-  offset += mainSize;
+  // every column has its nulls followed by its values
+  columns_.reserve(numColumns_);
+  for (const auto& cop : cops_) {
+    columns_.push_back(std::make_unique<FlatColumn>(cop.width, data + offset, numRows));
+    offset += FlatColumn::nullBytes(numRows) + numRows * cop.width;
+  }
 
   data_ = std::make_unique<Buffer>(dataSize, data + offset);
   offset += dataSize;
@@ -127,21 +139,14 @@ FlatBuffer::FlatBuffer(const nebula::type::Schema& schema,
   // we know how big the chunk is now
   // used for information only, may not be exactly the same memory chunk size.
   chunkSize_ = offset;
+  rows_ = numRows;
 
-  // populate all rows properties
-  rows_.reserve(numRows);
-
-  // reset back to read each offset value
-  offset = offsetOffset;
-  for (size_t i = 0; i < numRows; ++i) {
-    // read each column props of all rows (should it be lazy?)
-    auto rowOffset = readSizeT();
-    rows_.emplace_back(rowOffset, rebuildColumnProps(rowOffset));
-  }
+  rebuildSketches();
+  chargeIndex();
 }
 
-// this defines how many bytes for each column take in main buffer
-// for scalar type, they are fixed width data, so we have width for non-null values
+// this defines how many bytes a value takes in its column slot
+// for scalar type, they are fixed width data
 // for binary type such as string, we store offset in related buffer and length as well
 size_t FlatBuffer::widthInMain(Kind kind) noexcept {
 #define SCALAR_WIDTH_DISTR(KIND)                        \
@@ -160,8 +165,8 @@ size_t FlatBuffer::widthInMain(Kind kind) noexcept {
     SCALAR_WIDTH_DISTR(DOUBLE)
     SCALAR_WIDTH_DISTR(INT128)
   case Kind::VARCHAR: {
-    // 4 bytes offset + 4 bytes length
-    return 8;
+    // size, prefix and inline bytes or offset in data
+    return nebula::common::InlineString::WIDTH;
   }
   case Kind::ARRAY: {
     // 4 bytes number of items + 4 bytes offset in list
@@ -196,11 +201,9 @@ size_t FlatBuffer::append(T value, Buffer& dest, size_t align) {
 
 template <>
 size_t FlatBuffer::append(std::string_view str, Buffer& dest, size_t) {
-  // write variable data into dirty buffer and get offset and length
-  auto len = data_->slice.write(data_->offset, (NByte*)str.data(), str.size());
-
-  // write offset and length in main chunk
-  dest.offset += Range::write(dest.slice, dest.offset, data_->offset, len);
+  // short strings stay inline in their slots, only long ones are written into data buffer
+  auto len = nebula::common::InlineString::write(dest.slice, dest.offset, data_->slice, data_->offset, str);
+  dest.offset += nebula::common::InlineString::WIDTH;
 
   // move forward data offset for next
   data_->offset += len;
@@ -252,14 +255,18 @@ size_t FlatBuffer::appendList(Kind itemKind, std::unique_ptr<ListData> list) {
 
 bool FlatBuffer::rollback() {
   // has last row to roll back
-  if (rows_.size() > 0) {
-    // remove last row
-    rows_.pop_back();
+  if (rows_ > 0) {
+    // remove last row, its slots are overwritten by next row
+    --rows_;
+    for (auto& column : columns_) {
+      if (!column->sketches.empty()) {
+        column->sketches.pop_back();
+      }
+    }
 
     // every buffer reset offset
-    main_->offset = std::get<0>(last_);
-    data_->offset = std::get<1>(last_);
-    list_->offset = std::get<2>(last_);
+    data_->offset = last_.first;
+    list_->offset = last_.second;
 
     return true;
   }
@@ -267,12 +274,14 @@ bool FlatBuffer::rollback() {
   return false;
 }
 
-std::function<void(const RowData&)> FlatBuffer::genParser(
-  const TypeNode& tn, size_t i, nebula::type::Kind kind) noexcept {
+Parser FlatBuffer::genParser(const TypeNode& tn, size_t i, nebula::type::Kind kind) noexcept {
 
-#define SCALAR_DATA_DISTR(KIND, FUNC)                                                         \
-  case Kind::KIND: {                                                                          \
-    return [this, i](const RowData& row) { append(row.FUNC(i), *main_, cops_.at(i).width); }; \
+#define SCALAR_DATA_DISTR(KIND, FUNC)                                        \
+  case Kind::KIND: {                                                         \
+    return [this, i](const RowData& row, size_t r) {                         \
+      auto& column = *columns_[i];                                           \
+      column.values.writeAlign(column.offset(r), row.FUNC(i), column.width); \
+    };                                                                       \
   }
 
   // add solid values for each type
@@ -285,22 +294,30 @@ std::function<void(const RowData&)> FlatBuffer::genParser(
     SCALAR_DATA_DISTR(REAL, readFloat)
     SCALAR_DATA_DISTR(DOUBLE, readDouble)
     SCALAR_DATA_DISTR(INT128, readInt128)
-    SCALAR_DATA_DISTR(VARCHAR, readString)
 
+  case Kind::VARCHAR: {
+    // short strings stay inline in their slots, only long ones are written into data buffer
+    return [this, i](const RowData& row, size_t r) {
+      auto& column = *columns_[i];
+      data_->offset += nebula::common::InlineString::write(
+        column.values, column.offset(r), data_->slice, data_->offset, row.readString(i));
+    };
+  }
   case Kind::ARRAY: {
     auto listType = std::static_pointer_cast<ListType>(tn);
 
-    return [this, childKind = listType->childType(0)->k(), i](const RowData& row) {
+    return [this, childKind = listType->childType(0)->k(), i](const RowData& row, size_t r) {
       auto list = row.readList(i);
 
       // write 4 bytes of N = number of items
       auto listItems = list->getItems();
       auto listOffset = appendList(childKind, std::move(list));
-      main_->offset += Range::write(main_->slice, main_->offset, listItems, listOffset);
+      auto& column = *columns_[i];
+      Range::write(column.values, column.offset(r), listItems, listOffset);
     };
   }
   default:
-    return [i](const RowData&) {
+    return [i](const RowData&, size_t) {
       LOG(INFO) << "Parse on un-supported column: " << i;
     };
   }
@@ -336,46 +353,33 @@ Sketcher FlatBuffer::genSketcher(size_t i) noexcept {
 }
 
 // add a row into current batch
-// if cols is not empty, we only populate those fileds, otherwise, populate all
 size_t FlatBuffer::add(const nebula::surface::RowData& row) {
   // record current state before adding a new row - used for rollback
-  last_ = std::make_tuple(main_->offset, data_->offset, list_->offset);
-
-  // current row offset
-  const auto rowOffset = main_->offset;
-
-  // in the main memory, we're push all nulls for first X bytes (x = numColumns)
-  // This is designed for nulls fast load of memory locality
-  // this is why we have two loops
-  FlatColumnProps columnProps;
-  columnProps.reserve(numColumns_);
-  std::vector<bool> nulls;
-  nulls.reserve(numColumns_);
-  for (size_t i = 0; i < numColumns_; ++i) {
-    auto nv = appendNull(row.isNull(i), cops_.at(i).kind, *main_);
-    nulls.push_back(nv);
-  }
+  last_ = { data_->offset, list_->offset };
 
-  // write data of each column through its parser
+  // write null bit and slot of the new row in every column
+  const auto rowId = rows_;
   for (size_t i = 0; i < numColumns_; ++i) {
-    // push each column props
-    auto nv = nulls.at(i);
-    const auto& cop = cops_.at(i);
-    auto ia = cop.isAggregate();
-    auto sketch = ia ? row.getAggregator(i) : nullptr;
-    columnProps.emplace_back(nv, main_->offset - rowOffset, sketch);
+    auto& column = *columns_[i];
+    const auto& cop = cops_[i];
+    auto nv = row.isNull(i);
+    column.setNull(rowId, nv);
+    if (cop.isAggregate()) {
+      column.sketches.push_back(row.getAggregator(i));
+    }
+
     if (!nv) {
-      cop.parser(row);
-    } else if (ia) {
-      // reserve space for aligned column
-      main_->offset += main_->slice.writeAlign(main_->offset, 0, cop.width);
+      cop.parser(row, rowId);
+    } else {
+      // slot of a null value is still reserved
+      column.values.writeAlign<int8_t>(column.offset(rowId), 0, column.width);
     }
   }
 
-  // after processing all columns, we got the row offset and length, record it here
-  rows_.emplace_back(rowOffset, std::move(columnProps));
+  ++rows_;
+  chargeIndex();
 
-  return rowOffset;
+  return rowId;
 }
 
 // this method is used to pair partial add (when cols set is not empty)
@@ -384,75 +388,63 @@ size_t FlatBuffer::add(const nebula::surface::RowData& row) {
 size_t FlatBuffer::resume(const nebula::surface::RowData& row,
                           const nebula::common::unordered_set<size_t>& cols,
                           const size_t rowId) {
-  N_ENSURE_EQ(rowId + 1, rows_.size(), "must be the last row");
+  N_ENSURE_EQ(rowId + 1, rows_, "must be the last row");
 
-  auto origin = main_->offset;
-  // get row properties for this existing row
-  auto& rowProps = rows_.at(rowId);
-  auto& colPropsList = rows_.at(rowId).colProps;
-  auto rowOffset = rowProps.offset;
+  auto origin = data_->offset + list_->offset;
   for (size_t i : cols) {
     // if the column is null, we keep what it is
-    // otherwise we fill the value and update its column props
-    auto& colProps = colPropsList.at(i);
-    colProps.offset = main_->offset - rowOffset;
-    if (!colProps.isNull) {
-      cops_.at(i).parser(row);
+    // otherwise we fill the value in its slot
+    if (!columns_[i]->isNull(rowId)) {
+      cops_.at(i).parser(row, rowId);
     }
   }
 
   // return the delta size of the resumed values
-  return main_->offset - origin;
+  return data_->offset + list_->offset - origin;
 }
 
 // random access to a row - may require internal seek
 const std::unique_ptr<RowData> FlatBuffer::crow(size_t rowId) const {
-  // pass in row offset and column props of this row
-  return std::make_unique<RowAccessor>(*this, rows_.at(rowId));
+  N_ENSURE_LT(rowId, rows_, "row id out of range");
+  return std::make_unique<RowAccessor>(*this, rowId);
 }
 
 const RowData& FlatBuffer::row(size_t rowId) {
-  // pass in row offset and column props of this row
-  current_ = std::make_unique<RowAccessor>(*this, rows_.at(rowId));
+  // the accessor is reused and moved to given row
+  N_ENSURE_LT(rowId, rows_, "row id out of range");
+  if (UNLIKELY(!current_)) {
+    current_ = std::make_unique<RowAccessor>(*this, rowId);
+  }
+
+  current_->row_ = rowId;
   return *current_;
 }
 
-FlatColumnProps FlatBuffer::rebuildColumnProps(size_t rowOffset) {
-  // do not use constructor with count instances of T
-  FlatColumnProps colProps;
-  colProps.reserve(numColumns_);
-
-  // first numCols bytes store nulls for all columns
-  auto colOffset = numColumns_;
+void FlatBuffer::rebuildSketches() {
+  // for aggregated fields, rebuild sketches from the serialized binary column by column
   for (size_t i = 0; i < numColumns_; ++i) {
-    auto nullByte = main_->slice.read<int8_t>(rowOffset + i);
-    bool nv = (nullByte & HIGH6_1) != 0;
     const auto& cop = cops_.at(i);
-
-    // build column properties without sketch
-    auto& cp = colProps.emplace_back(nv, colOffset);
-    if (!nv) {
-      colOffset += cop.width;
+    if (!cop.isAggregate()) {
+      continue;
     }
 
-    // for aggregated fields, rebuild its sketch from the serialized binary
-    if (cop.isAggregate()) {
-      cp.sketch = cop.sketcher();
-      N_ENSURE_NOT_NULL(cp.sketch, "aggregated field should have sketch");
-      // load data of the sketch from main buffer since it's fit
-      auto offset = rowOffset + cp.offset;
-      if (cp.sketch->fit(cop.width)) {
-        auto size = cp.sketch->load(main_->slice, offset);
+    auto& column = *columns_[i];
+    column.sketches.reserve(rows_);
+    for (size_t r = 0; r < rows_; ++r) {
+      auto& sketch = column.sketches.emplace_back(cop.sketcher());
+      N_ENSURE_NOT_NULL(sketch, "aggregated field should have sketch");
+      // load data of the sketch from its slot since it's fit
+      auto offset = column.offset(r);
+      if (sketch->fit(cop.width)) {
+        auto size = sketch->load(column.values, offset);
         N_ENSURE(size <= cop.width, "sketch guranteed data size smaller than alignment");
       } else {
-        auto r = Range::make(main_->slice, offset);
-        auto size = cp.sketch->load(data_->slice, r.offset);
-        N_ENSURE(size == r.size, "loaded size should be the same as it stored");
+        auto range = Range::make(column.values, offset);
+        auto size = sketch->load(data_->slice, range.offset);
+        N_ENSURE(size == range.size, "loaded size should be the same as it stored");
       }
     }
   }
-
-  return colProps;
 }
 
 // serialize sketches into data section and mark its offset/length at field
@@ -460,28 +452,30 @@ FlatColumnProps FlatBuffer::rebuildColumnProps(size_t rowOffset) {
 size_t FlatBuffer::serializeSketches() const {
   // data size incremented for sketch serialization
   size_t size = 0;
-  for (auto& cp : rows_) {
-    for (size_t i = 0; i < numColumns_; ++i) {
-      // for (auto& p : cp.colProps) {
-      auto& p = cp.colProps.at(i);
+  for (size_t i = 0; i < columns_.size(); ++i) {
+    auto& column = *columns_[i];
+    const auto& cop = cops_.at(i);
+    for (size_t r = 0, count = column.sketches.size(); r < count; ++r) {
       // if we have sketch to serialize out
-      if (p.sketch) {
-        auto offset = (cp.offset + p.offset);
-        const auto& cop = cops_.at(i);
-        // if fit within main
-        if (p.sketch->fit(cop.width)) {
-          N_ENSURE(p.sketch->serialize(main_->slice, offset) <= cop.width,
-                   "serialzied size should not out of space");
-        } else {
-          auto len = p.sketch->serialize(data_->slice, data_->offset);
-          // record the data offset and length for this binary in main
-          Range::write(main_->slice, offset, data_->offset, len);
-          // grow data size
-          data_->offset += len;
-
-          // only counted the data size increase - not counting if fit in main
-          size += len;
-        }
+      const auto& sketch = column.sketches[r];
+      if (!sketch) {
+        continue;
+      }
+
+      auto offset = column.offset(r);
+      // if fit within its slot
+      if (sketch->fit(cop.width)) {
+        N_ENSURE(sketch->serialize(column.values, offset) <= cop.width,
+                 "serialzied size should not out of space");
+      } else {
+        auto len = sketch->serialize(data_->slice, data_->offset);
+        // record the data offset and length for this binary in its slot
+        Range::write(column.values, offset, data_->offset, len);
+        // grow data size
+        data_->offset += len;
+
+        // only counted the data size increase - not counting if fit in slot
+        size += len;
       }
     }
   }
@@ -499,20 +493,11 @@ size_t FlatBuffer::serialize(NByte* buffer) const {
 
   // write num rows always in case reader size check row size
   // rather than binary size
-  const auto numRows = rows_.size();
-  writeSizeT(numRows);
-  if (numRows == 0) {
+  writeSizeT(rows_);
+  if (rows_ == 0) {
     return 0;
   }
 
-  // write all rows' offset
-  for (size_t i = 0; i < numRows; ++i) {
-    writeSizeT(rows_.at(i).offset);
-  }
-
-  // write main block size
-  writeSizeT(main_->offset);
-
   // write data block size
   writeSizeT(data_->offset);
 
@@ -522,8 +507,11 @@ size_t FlatBuffer::serialize(NByte* buffer) const {
   // write a reserved value
   writeSizeT(MAGIC);
 
-  // write all main bits
-  offset += main_->slice.copy(buffer, offset, main_->offset);
+  // write nulls and values column by column
+  for (const auto& column : columns_) {
+    offset += column->nulls.copy(buffer, offset, FlatColumn::nullBytes(rows_));
+    offset += column->values.copy(buffer, offset, column->offset(rows_));
+  }
 
   // write all data bits
   offset += data_->slice.copy(buffer, offset, data_->offset);
@@ -536,17 +524,18 @@ size_t FlatBuffer::serialize(NByte* buffer) const {
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-RowAccessor::RowAccessor(const FlatBuffer& fb, const RowProps& rowProps)
-  : fb_{ fb }, rowProps_{ rowProps } {}
+RowAccessor::RowAccessor(const FlatBuffer& fb, size_t row)
+  : fb_{ fb }, row_{ row } {}
 
 bool RowAccessor::isNull(IndexType index) const {
-  // null position for given field
-  return rowProps_.colProps.at(index).isNull;
+  // null bit for given field
+  return fb_.columns_.at(index)->isNull(row_);
 }
 
-#define READ_FIELD(TYPE, FUNC)                                                               \
-  TYPE RowAccessor::FUNC(IndexType index) const {                                            \
-    return fb_.main_->slice.read<TYPE>(rowProps_.offset + rowProps_.colProps[index].offset); \
+#define READ_FIELD(TYPE, FUNC)                            \
+  TYPE RowAccessor::FUNC(IndexType index) const {         \
+    const auto& column = *fb_.columns_[index];            \
+    return column.values.read<TYPE>(column.offset(row_)); \
   }
 
 READ_FIELD(bool, readBool)
@@ -561,16 +550,14 @@ READ_FIELD(int128_t, readInt128)
 #undef READ_FIELD
 
 std::string_view RowAccessor::readString(IndexType index) const {
-  auto colOffset = rowProps_.colProps[index].offset;
-  return fb_.read(rowProps_.offset, colOffset);
+  return fb_.read(index, row_);
 }
 
 // compound types
 std::unique_ptr<nebula::surface::ListData> RowAccessor::readList(IndexType index) const {
-  auto colOffset = rowProps_.colProps[index].offset;
   // read 4 bytes offset and 4 bytes length
-  auto lo = rowProps_.offset + colOffset;
-  auto r = Range::make(fb_.main_->slice, lo);
+  const auto& column = *fb_.columns_[index];
+  auto r = Range::make(column.values, column.offset(row_));
 
   // can we cache this query or cache listAccessor?
   auto listType = std::dynamic_pointer_cast<nebula::type::ListType>(fb_.schema_->childType(index));
@@ -588,7 +575,8 @@ std::unique_ptr<nebula::surface::MapData> RowAccessor::readMap(const std::string
 }
 
 inline std::shared_ptr<nebula::surface::eval::Sketch> RowAccessor::getAggregator(IndexType index) const {
-  return rowProps_.colProps[index].sketch;
+  const auto& sketches = fb_.columns_[index]->sketches;
+  return sketches.empty() ? nullptr : sketches[row_];
 }
 
 #define FORWARD_NAME_2_INDEX(TYPE, FUNC)                   \
@@ -634,11 +622,7 @@ READ_FIELD(int128_t, readInt128)
 std::string_view ListAccessor::readString(IndexType index) const {
   // we need to plus 1 to skip the first byte of null indicator
   const auto itemOffset = itemOffsets_[index] + 1;
-  // read 4 bytes offset and 4 bytes length
-  auto r = Range::make(buffer_.slice, offset_ + itemOffset);
-
-  // read the real data from data_
-  return strings_.slice.read(r.offset, r.size);
+  return nebula::common::InlineString::read(buffer_.slice, offset_ + itemOffset, strings_.slice);
 }
 
 } // namespace keyed
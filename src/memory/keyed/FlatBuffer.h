@@ -27,17 +27,15 @@
 /**
  * Build a flat buffer that can be used in hash table to build keys and update directly.
  * 
- * Every value has 1byte = HIGH4 (NULL) + LOW4 (TYPE).
+ * Values are stored column by column, every column has a validity bitmap and a fixed width slot
+ * for every row, including null ones, so a value is located by its row id only.
  * Scalar types are embeded and others are referenced by offset and length in buffer.
- * So we have two memory chunks. 
  * 
- * In main memory chunk, it starts with # of bytes for nulls
  * bool/INT/float types: width bytes. 
- * string type: 8 bytes [4 bytes offset, 4 bytes length]
+ * string type: 16 bytes inline string slot, long strings are stored in data_
  * list type: 8 bytes [4 bytes of value N (number of items), 4 bytes offset in list buffer]
- * String data stored in data_
- * List items stores at list_
- * So In main_, we know exactly size of each type if it has non-null value
+ * List items stores at list_, every item has 1 byte = HIGH6 (NULL) + LOW (TYPE) before its value.
+ * Aggregate columns keep a sketch of every row beside its values.
  * map type: not support for now 
  * struct type: not support for now
  */
@@ -49,9 +47,11 @@ using nebula::surface::IndexType;
 
 static constexpr int8_t HIGH6_1 = 1 << 6;
 static constexpr auto SIZET_SIZE = sizeof(size_t);
-static constexpr size_t MAGIC = 0x910928;
-// max column width as 8 bytes (4bytes + 4bytes)
+static constexpr size_t MAGIC = 0x910929;
+// min slot width of aggregate columns to hold a sketch or its range in data buffer
 static constexpr size_t MAX_ALIGNMENT = 8;
+// row index is charged to query memory budget by chunks of rows
+static constexpr size_t INDEX_CHUNK = 1024;
 
 class RowAccessor;
 
@@ -65,37 +65,52 @@ struct Buffer {
   nebula::common::ExtendableSlice slice;
 };
 
-struct ColumnProps {
-  explicit ColumnProps(bool nv, uint32_t os)
-    : ColumnProps(nv, os, nullptr) {}
-  explicit ColumnProps(bool nv, uint32_t os, std::shared_ptr<nebula::surface::eval::Sketch> s)
-    : isNull{ nv }, offset{ os }, sketch{ s } {}
+// all values of one column: validity bits, fixed width slots and sketches if it is aggregated
+struct FlatColumn {
+  FlatColumn(size_t w, size_t rows)
+    : width{ w }, nulls{ std::max<size_t>(rows / 8, 1) }, values{ std::max<size_t>(rows * w, 1) } {}
 
-  // whether it is a null value
-  bool isNull;
+  // read-only column wrapping a serialized buffer
+  FlatColumn(size_t w, const NByte* buffer, size_t rows)
+    : width{ w }, nulls{ buffer, nullBytes(rows) }, values{ buffer + nullBytes(rows), rows * w } {}
 
-  // its relative offset in current row in main buffer
-  uint32_t offset;
+  static inline size_t nullBytes(size_t rows) {
+    return (rows + 7) / 8;
+  }
 
-  // if current field has aggregator object
-  std::shared_ptr<nebula::surface::eval::Sketch> sketch;
-};
+  inline size_t offset(size_t row) const {
+    return row * width;
+  }
 
-// define column properties of given row: nullable, kind, column offset in main.
-using FlatColumnProps = std::vector<ColumnProps>;
+  inline bool isNull(size_t row) const {
+    return (nulls.read<uint8_t>(row >> 3) >> (row & 7)) & 1;
+  }
 
-struct RowProps {
-  explicit RowProps(size_t of, FlatColumnProps cp)
-    : offset{ of }, colProps{ std::move(cp) } {}
-  // row offset in buffer
-  size_t offset;
+  // first row of a byte resets it, so bits of rows rolled back never stay
+  inline void setNull(size_t row, bool nv) {
+    const auto bit = row & 7;
+    uint8_t byte = bit == 0 ? 0 : nulls.read<uint8_t>(row >> 3);
+    if (nv) {
+      byte |= (1 << bit);
+    } else {
+      byte &= ~(1 << bit);
+    }
+
+    nulls.write<uint8_t>(row >> 3, byte);
+  }
+
+  // width of a slot in values
+  const size_t width;
 
-  // column properties
-  FlatColumnProps colProps;
+  nebula::common::ExtendableSlice nulls;
+  nebula::common::ExtendableSlice values;
+
+  // sketch of every row for an aggregate column, empty for others
+  std::vector<std::shared_ptr<nebula::surface::eval::Sketch>> sketches;
 };
 
-// column parser to read data in from a row
-using Parser = std::function<void(const nebula::surface::RowData&)>;
+// column parser to read data in from a row into the slot of given row id
+using Parser = std::function<void(const nebula::surface::RowData&, size_t)>;
 
 // Aggregator on one column to create aggregator object associated with the row
 using Sketcher = std::function<std::shared_ptr<nebula::surface::eval::Sketch>()>;
@@ -136,9 +151,13 @@ public:
     if (chunk_) {
       nebula::common::Pool::getDefault().free(chunk_, chunkSize_);
     }
+
+    if (budget_) {
+      budget_->release(indexCharged_);
+    }
   }
 
-  // add a row into current batch
+  // add a row into current batch, return its row id
   size_t add(const nebula::surface::RowData&);
 
   // this method only rollback last added row and the only one row only.
@@ -153,19 +172,37 @@ public:
   // const version without internal cache
   const std::unique_ptr<nebula::surface::RowData> crow(size_t) const;
 
-  inline auto getRows() const {
-    return rows_.size();
+  inline size_t getRows() const {
+    return rows_;
+  }
+
+  // memory held by this buffer: slices in capacity and estimated sketch arrays
+  inline size_t memory() const {
+    if (!data_) {
+      return indexCharged_;
+    }
+
+    size_t bytes = data_->slice.capacity() + list_->slice.capacity() + indexCharged_;
+    for (const auto& column : columns_) {
+      bytes += column->nulls.capacity() + column->values.capacity();
+    }
+
+    return bytes;
   }
 
   inline size_t prepareSerde() const {
     LOG(INFO) << "sketch size:" << serializeSketches();
-    return SIZET_SIZE +                                   // num rows
-           rows_.size() * SIZET_SIZE +                    // rows offset
-           SIZET_SIZE +                                   // main block size
-           SIZET_SIZE +                                   // data block size
-           SIZET_SIZE +                                   // list block size
-           SIZET_SIZE +                                   // reserved
-           main_->offset + data_->offset + list_->offset; // all binary size
+    size_t columns = 0;
+    for (const auto& cop : cops_) {
+      columns += FlatColumn::nullBytes(rows_) + rows_ * cop.width;
+    }
+
+    return SIZET_SIZE +                   // num rows
+           SIZET_SIZE +                   // data block size
+           SIZET_SIZE +                   // list block size
+           SIZET_SIZE +                   // reserved
+           columns +                      // nulls and values of all columns
+           data_->offset + list_->offset; // all binary size
   }
 
   size_t serialize(NByte*) const;
@@ -195,8 +232,22 @@ private:
 
   Sketcher genSketcher(size_t) noexcept;
 
-  // build column properties of given row offset
-  FlatColumnProps rebuildColumnProps(size_t);
+  // rebuild sketches of all rows from their serialized binary
+  void rebuildSketches();
+
+  // charge row index of next chunk of rows once it grows beyond charged rows
+  inline void chargeIndex() {
+    if (UNLIKELY(rows_ > indexRows_)) {
+      auto rows = (rows_ / INDEX_CHUNK + 1) * INDEX_CHUNK;
+      auto bytes = (rows - indexRows_) * rowBytes_;
+      if (budget_) {
+        budget_->charge(bytes);
+      }
+
+      indexRows_ = rows;
+      indexCharged_ += bytes;
+    }
+  }
 
   // the method is used to write all sketch into the data buffer
   // it is supposed to call once before flat buffer is serialized into wire
@@ -212,8 +263,8 @@ protected:
   void* chunk_;
   size_t chunkSize_;
 
-  // main dat abuffer
-  std::unique_ptr<Buffer> main_;
+  // values of every column, strings and list items
+  std::vector<std::unique_ptr<FlatColumn>> columns_;
   std::unique_ptr<Buffer> data_;
   std::unique_ptr<Buffer> list_;
 
@@ -223,34 +274,38 @@ protected:
   // parsers are function pointers to parse row data of each column
   std::vector<ColumnOperations> cops_;
 
-  // offset of last row used for supporting roll back
-  std::tuple<size_t, size_t, size_t> last_;
+  // data and list offsets before last row used for supporting roll back
+  std::pair<size_t, size_t> last_;
 
-  // record each row's offset and length
-  std::vector<RowProps> rows_;
+  // number of rows
+  size_t rows_;
 
   // A row accessor cursor to read data of given row
   friend class RowAccessor;
   std::unique_ptr<RowAccessor> current_;
 
+  // budget of the query building this buffer, its slices are charged by themselves
+  // while sketch arrays (and hash keys of a hash flat) are estimated per row and charged by chunks.
+  std::shared_ptr<nebula::common::MemoryBudget> budget_;
+  size_t rowBytes_;
+  size_t indexRows_;
+  size_t indexCharged_;
+
   // check if a column is an aggregate column utility
   inline bool isAggregate(size_t col) const noexcept {
     return cops_.at(col).isAggregate();
   }
 
-  // read a string from given row offset and col offset
-  inline std::string_view read(size_t rowOffset, size_t colOffset) const noexcept {
-    auto so = rowOffset + colOffset;
-    auto r = nebula::common::PRange::make(main_->slice, so);
-
-    // read the real data from data_
-    return data_->slice.read(r.offset, r.size);
+  // read a string of given column and row
+  inline std::string_view read(size_t col, size_t row) const noexcept {
+    const auto& column = *columns_[col];
+    return nebula::common::InlineString::read(column.values, column.offset(row), data_->slice);
   }
 };
 
 class RowAccessor : public nebula::surface::RowData {
 public:
-  RowAccessor(const FlatBuffer&, const RowProps&);
+  RowAccessor(const FlatBuffer&, size_t);
   virtual ~RowAccessor() = default;
 
 public:
@@ -291,8 +346,9 @@ public:
 private:
   const FlatBuffer& fb_;
 
-  // current row offset and all column properties
-  const RowProps& rowProps_;
+  // current row id, the cursor of a flat buffer moves it to the next row
+  friend class FlatBuffer;
+  size_t row_;
 };
 
 using nebula::surface::IndexType;
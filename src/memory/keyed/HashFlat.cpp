@@ -22,7 +22,7 @@ namespace nebula {
 namespace memory {
 namespace keyed {
 
-using Range = nebula::common::PRange;
+using nebula::common::InlineString;
 using nebula::common::OneSlice;
 using nebula::surface::eval::Aggregator;
 using nebula::surface::eval::Sketch;
@@ -30,6 +30,8 @@ using nebula::type::Kind;
 using nebula::type::TypeTraits;
 
 void HashFlat::init() {
+  // every row also takes a key slot in the hash set at 0.6 max load factor
+  rowBytes_ += 2 * sizeof(Key);
   ops_.reserve(numColumns_);
   keys_.reserve(numColumns_);
   values_.reserve(numColumns_);
@@ -47,23 +49,6 @@ void HashFlat::init() {
   // reserve a memory chunk to store hash values
   if (keys_.size() > 0) {
     keyHash_ = std::make_unique<OneSlice>(sizeof(size_t) * keys_.size());
-
-    // optimization - if the keys are all primmitive (non-strings), and index are continous
-    // we can just hash the memory chunk (row.offset+col-offset, total-size)
-    size_t last = keys_.at(0) - 1;
-    optimal_ = true;
-    keyWidth_ = 0;
-    for (auto index : keys_) {
-      Kind k = cops_.at(index).kind;
-      keyWidth_ += cops_.at(index).width;
-      if (index != last + 1 || k >= Kind::VARCHAR) {
-        optimal_ = false;
-        break;
-      }
-
-      // assign last for next check
-      last = index;
-    }
   }
 }
 
@@ -73,26 +58,22 @@ Comparator HashFlat::genComparator(size_t i) noexcept {
     return {};
   }
 
-#define PREPARE_AND_NULLCHECK()                     \
-  const auto& row1Props = rows_[row1];              \
-  const auto& row2Props = rows_[row2];              \
-  auto row1Offset = row1Props.offset;               \
-  auto row2Offset = row2Props.offset;               \
-  const auto& colProps1 = row1Props.colProps.at(i); \
-  const auto& colProps2 = row2Props.colProps.at(i); \
-  if (colProps1.isNull != colProps2.isNull) {       \
-    return -1;                                      \
-  }                                                 \
-  if (colProps1.isNull) {                           \
-    return 0;                                       \
+#define PREPARE_AND_NULLCHECK()       \
+  auto& column = *columns_[i];        \
+  auto null1 = column.isNull(row1);   \
+  if (null1 != column.isNull(row2)) { \
+    return -1;                        \
+  }                                   \
+  if (null1) {                        \
+    return 0;                         \
   }
 
-#define TYPE_COMPARE(KIND, TYPE)                                                                       \
-  case Kind::KIND: {                                                                                   \
-    return [this, i](size_t row1, size_t row2) -> int {                                                \
-      PREPARE_AND_NULLCHECK()                                                                          \
-      return main_->slice.compare<TYPE>(row1Offset + colProps1.offset, row2Offset + colProps2.offset); \
-    };                                                                                                 \
+#define TYPE_COMPARE(KIND, TYPE)                                                    \
+  case Kind::KIND: {                                                                \
+    return [this, i](size_t row1, size_t row2) -> int {                             \
+      PREPARE_AND_NULLCHECK()                                                       \
+      return column.values.compare<TYPE>(column.offset(row1), column.offset(row2)); \
+    };                                                                              \
   }
 
   // fetch value
@@ -108,22 +89,13 @@ Comparator HashFlat::genComparator(size_t i) noexcept {
     TYPE_COMPARE(DOUBLE, int64_t)
     TYPE_COMPARE(INT128, int128_t)
   case Kind::VARCHAR: {
-    // read the real data from data_
-    // TODO(cao) - we don't need convert strings from bytes for hash
-    // instead, slice should be able to compare two byte range
+    // slots tell most of the differences, data is only read for long strings of the same prefix
     return [this, i](size_t row1, size_t row2) -> int {
       PREPARE_AND_NULLCHECK()
 
-      // offset and length of each
-      auto r1 = Range::make(main_->slice, row1Offset + colProps1.offset);
-      auto r2 = Range::make(main_->slice, row2Offset + colProps2.offset);
-
-      // length has to be the same
-      if (r1.size != r2.size) {
-        return r1.size - r2.size;
-      }
-
-      return data_->slice.compare(r1.offset, r2.offset, r1.size);
+      auto s1 = InlineString::make(column.values, column.offset(row1));
+      auto s2 = InlineString::make(column.values, column.offset(row2));
+      return s1.compare(s2, data_->slice);
     };
   }
   default:
@@ -143,20 +115,18 @@ Hasher HashFlat::genHasher(size_t i) noexcept {
     return {};
   }
 
-#define PREPARE_AND_NULL()                        \
-  const auto& rowProps = rows_.at(row);           \
-  auto rowOffset = rowProps.offset;               \
-  const auto& colProps = rowProps.colProps.at(i); \
-  if (colProps.isNull) {                          \
-    return 0L;                                    \
+#define PREPARE_AND_NULL()           \
+  const auto& column = *columns_[i]; \
+  if (column.isNull(row)) {          \
+    return 0L;                       \
   }
 
-#define TYPE_HASH(KIND, TYPE)                                      \
-  case Kind::KIND: {                                               \
-    return [this, i](size_t row) -> size_t {                       \
-      PREPARE_AND_NULL()                                           \
-      return main_->slice.hash<TYPE>(rowOffset + colProps.offset); \
-    };                                                             \
+#define TYPE_HASH(KIND, TYPE)                              \
+  case Kind::KIND: {                                       \
+    return [this, i](size_t row) -> size_t {               \
+      PREPARE_AND_NULL()                                   \
+      return column.values.hash<TYPE>(column.offset(row)); \
+    };                                                     \
   }
 
   // fetch value
@@ -171,21 +141,11 @@ Hasher HashFlat::genHasher(size_t i) noexcept {
     TYPE_HASH(DOUBLE, int64_t)
     TYPE_HASH(INT128, int128_t)
   case Kind::VARCHAR: {
-    // read 4 bytes offset and 4 bytes length
+    // short strings are hashed by their slots
     return [this, i](size_t row) -> size_t {
       PREPARE_AND_NULL()
 
-      auto so = rowOffset + colProps.offset;
-      auto r = Range::make(main_->slice, so);
-
-      // read the real data from data_
-      // TODO(cao) - we don't need convert strings from bytes for hash
-      // instead, slice should be able to hash the range[offset, len] much cheaper
-      if (r.size == 0) {
-        return 0L;
-      }
-
-      return data_->slice.hash(r.offset, r.size);
+      return InlineString::make(column.values, column.offset(row)).hash(data_->slice);
     };
   }
   default:
@@ -226,43 +186,20 @@ Copier HashFlat::genCopier(size_t i) noexcept {
   return {};
 }
 
-std::pair<size_t, size_t> HashFlat::optimalKeys(size_t row) const noexcept {
-  const auto& rowProps = rows_.at(row);
-
-  // starting offset of all sequential keys = row offset + first key offset
-  auto offset = rowProps.offset + rowProps.colProps.at(0).offset;
-  auto length = keyWidth_;
-
-  // remove nulls
-  for (auto index : keys_) {
-    const auto& colProps = rowProps.colProps.at(index);
-    if (colProps.isNull) {
-      length -= cops_.at(index).width;
-    }
-  }
-
-  return { offset, length };
-}
-
-// compute hash value of given row and column list
-// The function has very similar logic as row accessor, we inline it for perf
+// compute hash value of given row on all keys, column by column
 size_t HashFlat::hash(size_t rowId) const {
-  // if optimal, let's figure out offset and length of the key bytes
-  if (LIKELY(optimal_)) {
-    auto kp = optimalKeys(rowId);
-    auto ptr = main_->slice.ptr();
-    // just hash the key set
-    return nebula::common::Hasher::hash64(ptr + kp.first, kp.second);
+  // a single key is hashed by its own value
+  if (keys_.size() == 1) {
+    return ops_[keys_[0]].hasher(rowId);
   }
 
   // hash on every column and write value into keyHash_ chunk
   if (LIKELY(keyHash_ != nullptr)) {
     size_t* ptr = (size_t*)keyHash_->ptr();
     auto len = keyHash_->size();
-    std::memset(ptr, 0, len);
 
     for (size_t i = 0, size = keys_.size(); i < size; ++i) {
-      *(ptr + i) = ops_.at(keys_.at(i)).hasher(rowId);
+      *(ptr + i) = ops_[keys_[i]].hasher(rowId);
     }
 
     return nebula::common::Hasher::hash64(ptr, len);
@@ -271,23 +208,10 @@ size_t HashFlat::hash(size_t rowId) const {
   return 0;
 }
 
-// check if two rows are equal to each other on given columns
+// check if two rows are equal to each other on all keys
 bool HashFlat::equal(size_t row1, size_t row2) const {
-  // if optimal, let's figure out offset and length of the key bytes
-  if (LIKELY(optimal_)) {
-    auto kp1 = optimalKeys(row1);
-    auto kp2 = optimalKeys(row2);
-    // if length equals - return false
-    if (kp1.second != kp2.second) {
-      return false;
-    }
-
-    auto ptr = main_->slice.ptr();
-    return std::memcmp(ptr + kp1.first, ptr + kp2.first, kp1.second) == 0;
-  }
-
   for (auto index : keys_) {
-    if (ops_.at(index).comparator(row1, row2) != 0) {
+    if (ops_[index].comparator(row1, row2) != 0) {
       return false;
     }
   }
@@ -322,9 +246,8 @@ bool HashFlat::update(const nebula::surface::RowData& row) {
   rowKeys_.insert(key);
 
   // since this is a new row, create aggregator for all its value fields
-  auto& rowProps = rows_.at(newRow);
   for (size_t i : values_) {
-    auto& sketch = rowProps.colProps.at(i).sketch;
+    auto& sketch = columns_[i]->sketches[newRow];
     if (sketch == nullptr) {
       sketch = cops_.at(i).sketcher();
       // since this is the first time sketch created, merge its own value
@@ -58,16 +58,14 @@ public:
   HashFlat(const nebula::type::Schema schema,
            const nebula::surface::eval::Fields& fields)
     : FlatBuffer(schema, fields),
-      keyHash_{ nullptr },
-      optimal_{ false } {
+      keyHash_{ nullptr } {
     init();
   }
 
   HashFlat(FlatBuffer* in,
            const nebula::surface::eval::Fields& fields)
     : FlatBuffer(in->schema(), fields, (NByte*)in->chunk()),
-      keyHash_{ nullptr },
-      optimal_{ false } {
+      keyHash_{ nullptr } {
     init();
   }
 
@@ -108,39 +106,37 @@ private:
   template <nebula::type::Kind O, nebula::type::Kind I>
   void merge(size_t row1, size_t row2, size_t i) {
     using InputType = typename nebula::type::TypeTraits<I>::CppType;
-    const auto& row1Props = rows_.at(row1);
-    const auto& row2Props = rows_.at(row2);
-    const auto& colProps1 = row1Props.colProps.at(i);
-    auto& colProps2 = row2Props.colProps.at(i);
-    N_ENSURE_NOT_NULL(colProps2.sketch, "merge row should have sketch");
-    if (UNLIKELY(row1 != row2 && colProps1.sketch != nullptr)) {
-      colProps2.sketch->mix(*colProps1.sketch);
+    const auto& column = *columns_[i];
+    const auto& sketch1 = column.sketches[row1];
+    const auto& sketch2 = column.sketches[row2];
+    N_ENSURE_NOT_NULL(sketch2, "merge row should have sketch");
+    if (UNLIKELY(row1 != row2 && sketch1 != nullptr)) {
+      sketch2->mix(*sketch1);
       return;
     }
-    if (colProps1.isNull) {
+    if (column.isNull(row1)) {
       return;
     }
-    InputType value = main_->slice.read<InputType>(row1Props.offset + colProps1.offset);
-    auto agg = std::static_pointer_cast<nebula::surface::eval::Aggregator<O, I>>(colProps2.sketch);
+    InputType value = column.values.read<InputType>(column.offset(row1));
+    auto agg = std::static_pointer_cast<nebula::surface::eval::Aggregator<O, I>>(sketch2);
     agg->merge(value);
   }
 
   template <nebula::type::Kind O>
   void merge_string(size_t row1, size_t row2, size_t i) {
-    const auto& row1Props = rows_.at(row1);
-    const auto& row2Props = rows_.at(row2);
-    const auto& colProps1 = row1Props.colProps.at(i);
-    auto& colProps2 = row2Props.colProps.at(i);
-    N_ENSURE_NOT_NULL(colProps2.sketch, "merge row should have sketch");
-    if (UNLIKELY(row1 != row2 && colProps1.sketch != nullptr)) {
-      colProps2.sketch->mix(*colProps1.sketch);
+    const auto& column = *columns_[i];
+    const auto& sketch1 = column.sketches[row1];
+    const auto& sketch2 = column.sketches[row2];
+    N_ENSURE_NOT_NULL(sketch2, "merge row should have sketch");
+    if (UNLIKELY(row1 != row2 && sketch1 != nullptr)) {
+      sketch2->mix(*sketch1);
       return;
     }
-    if (colProps1.isNull) {
+    if (column.isNull(row1)) {
       return;
     }
-    std::string_view value = read(row1Props.offset, colProps1.offset);
-    auto agg = std::static_pointer_cast<nebula::surface::eval::Aggregator<O, nebula::type::Kind::VARCHAR>>(colProps2.sketch);
+    std::string_view value = read(i, row1);
+    auto agg = std::static_pointer_cast<nebula::surface::eval::Aggregator<O, nebula::type::Kind::VARCHAR>>(sketch2);
     agg->merge(value);
   }
 
@@ -153,18 +149,9 @@ private:
     }
   }
 
-  // in optimal case: where given keys are layout in main slice sequentially
-  std::pair<size_t, size_t> optimalKeys(size_t) const noexcept;
-
 private:
   // lay all hash values in this fixed slice
   std::unique_ptr<nebula::common::OneSlice> keyHash_;
-  // optimal indicates the hash/compare/copy on keys can be optimized
-  // since will be laid out sequentially in main slice only
-  bool optimal_;
-  // expected width for all keys when optimal and no nulls
-  // calculated when optimal is true
-  size_t keyWidth_;
   std::vector<size_t> keys_;
   std::vector<size_t> values_;
   // customized operations for each column
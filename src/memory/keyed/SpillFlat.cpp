@@ -0,0 +1,225 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SpillFlat.h"
+
+#include <folly/FileUtil.h>
+#include <gflags/gflags.h>
+#include <unistd.h>
+
+#include "FlatRowCursor.h"
+#include "common/Evidence.h"
+
+DEFINE_string(SPILL_DIR, "/tmp", "local directory to write spilled aggregation runs");
+DEFINE_uint32(SPILL_PARTITIONS, 16, "number of hash partitions of a spilled aggregation");
+DEFINE_double(SPILL_PRESSURE, 0.6, "aggregation spills when its query or node memory budget is used above this ratio");
+DEFINE_uint64(SPILL_MIN_BYTES, 16777216, "aggregation table smaller than this never spills under memory pressure");
+
+namespace nebula {
+namespace memory {
+namespace keyed {
+
+using nebula::common::Evidence;
+using nebula::common::MemoryBudget;
+using nebula::common::Pool;
+using nebula::surface::RowCursorPtr;
+
+// merge all runs of a partition into a hash flat
+static std::unique_ptr<HashFlat> load(
+  const nebula::type::Schema& schema, const nebula::surface::eval::Fields& fields, const SpillPartition& partition) {
+  auto merged = std::make_unique<HashFlat>(schema, fields);
+  for (const auto& run : partition.runs) {
+    // the run owns its chunk and frees it when done
+    auto chunk = static_cast<NByte*>(Pool::getDefault().allocate(run.second));
+    auto ret = folly::preadFull(partition.file.fd(), chunk, run.second, run.first);
+    if ((size_t)ret != run.second) {
+      Pool::getDefault().free(chunk, run.second);
+      throw NException("failed to read spill file");
+    }
+
+    FlatBuffer fb(schema, fields, chunk);
+    for (size_t i = 0, rows = fb.getRows(); i < rows; ++i) {
+      merged->update(fb.row(i));
+    }
+  }
+
+  return merged;
+}
+
+SpillCursor::SpillCursor(const nebula::type::Schema schema,
+                         const nebula::surface::eval::Fields& fields,
+                         std::vector<SpillPartition> partitions)
+  : nebula::surface::RowCursor(0),
+    schema_{ schema },
+    fields_{ fields },
+    partitions_{ std::move(partitions) },
+    next_{ 0 },
+    offset_{ 0 } {
+  preload();
+  current_ = std::move(following_);
+}
+
+void SpillCursor::preload() {
+  while (next_ < partitions_.size()) {
+    auto merged = load(schema_, fields_, partitions_.at(next_));
+
+    // disk space is released as partition is merged
+    partitions_.at(next_++).file.close();
+    if (merged->getRows() > 0) {
+      size_ += merged->getRows();
+      following_ = std::move(merged);
+      return;
+    }
+  }
+}
+
+const nebula::surface::RowData& SpillCursor::next() {
+  // row returned last time stays valid till this call, move to the following partition now
+  if (index_ - offset_ == current_->getRows()) {
+    offset_ = index_;
+    current_ = std::move(following_);
+  }
+
+  const auto& row = current_->row(index_++ - offset_);
+
+  // merge next partition ahead when current one is done, so that size covers it
+  if (index_ - offset_ == current_->getRows()) {
+    preload();
+  }
+
+  return row;
+}
+
+SpillFlat::SpillFlat(const nebula::type::Schema schema,
+                     const nebula::surface::eval::Fields& fields,
+                     size_t maxBytes)
+  : schema_{ schema },
+    fields_{ fields },
+    maxBytes_{ maxBytes },
+    table_{ std::make_unique<HashFlat>(schema, fields) },
+    spills_{ 0 },
+    nextCheck_{ INDEX_CHUNK } {}
+
+bool SpillFlat::update(const nebula::surface::RowData& row) {
+  auto found = table_->update(row);
+
+  // table only grows by new groups, check it by chunks of them
+  if (UNLIKELY(table_->getRows() >= nextCheck_)) {
+    if (shouldSpill()) {
+      spill();
+    }
+
+    nextCheck_ = table_->getRows() + INDEX_CHUNK;
+  }
+
+  return found;
+}
+
+bool SpillFlat::shouldSpill() const {
+  const auto memory = table_->memory();
+  if (maxBytes_ > 0 && memory > maxBytes_) {
+    return true;
+  }
+
+  // a small table spilling doesn't relieve the pressure but costs a file per partition
+  if (memory < FLAGS_SPILL_MIN_BYTES) {
+    return false;
+  }
+
+  const auto& budget = MemoryBudget::current();
+  return budget && budget->pressure() > FLAGS_SPILL_PRESSURE;
+}
+
+void SpillFlat::spill() {
+  const auto rows = table_->getRows();
+  if (rows == 0) {
+    return;
+  }
+
+  Evidence::Duration duration;
+  const size_t numPartitions = std::max<size_t>(FLAGS_SPILL_PARTITIONS, 1);
+  if (partitions_.empty()) {
+    partitions_.reserve(numPartitions);
+    for (size_t i = 0; i < numPartitions; ++i) {
+      // the file is unlinked right away, its space is reclaimed once closed even if process dies
+      auto path = fmt::format("{0}/nebula-spill-XXXXXX", FLAGS_SPILL_DIR);
+      auto fd = ::mkstemp(path.data());
+      N_ENSURE(fd >= 0, fmt::format("failed to create spill file in {0}", FLAGS_SPILL_DIR));
+      ::unlink(path.c_str());
+      partitions_.push_back({ folly::File(fd, true), 0, {} });
+    }
+  }
+
+  // partition of every row by its key hash, high bits to be independent of table buckets
+  std::vector<uint32_t> owners;
+  owners.reserve(rows);
+  for (size_t i = 0; i < rows; ++i) {
+    owners.push_back((table_->hash(i) >> 32) % numPartitions);
+  }
+
+  // write one partition at a time as a run of serialized flat buffer
+  size_t bytes = 0;
+  for (size_t p = 0; p < numPartitions; ++p) {
+    FlatBuffer run(schema_, fields_);
+    for (size_t i = 0; i < rows; ++i) {
+      if (owners.at(i) == p) {
+        run.add(table_->row(i));
+      }
+    }
+
+    if (run.getRows() == 0) {
+      continue;
+    }
+
+    // sketches are serialized into the buffer too
+    auto size = run.prepareSerde();
+    std::vector<NByte> buffer(size);
+    auto written = run.serialize(buffer.data());
+    N_ENSURE_LE(written, size, "serialized size out of prepared size");
+
+    auto& partition = partitions_.at(p);
+    auto ret = folly::writeFull(partition.file.fd(), buffer.data(), written);
+    N_ENSURE_EQ((size_t)ret, written, "failed to write spill file");
+    partition.runs.emplace_back(partition.size, written);
+    partition.size += written;
+    bytes += written;
+  }
+
+  ++spills_;
+  LOG(INFO) << "Spilled " << rows << " groups (" << table_->memory() << " bytes in memory) as "
+            << bytes << " bytes to disk in " << duration.elapsedMs() << "ms";
+
+  // release memory of current table before starting a new one
+  table_ = nullptr;
+  table_ = std::make_unique<HashFlat>(schema_, fields_);
+}
+
+RowCursorPtr SpillFlat::finish() {
+  if (spills_ == 0) {
+    return std::make_shared<FlatRowCursor>(std::move(table_));
+  }
+
+  // put everything on disk, then partitions are merged one at a time by the cursor
+  spill();
+  table_ = nullptr;
+
+  LOG(INFO) << "Merge " << spills_ << " spills in " << partitions_.size() << " partitions";
+  return std::make_shared<SpillCursor>(schema_, fields_, std::move(partitions_));
+}
+
+} // namespace keyed
+} // namespace memory
+} // namespace nebula
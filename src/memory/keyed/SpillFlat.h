@@ -0,0 +1,112 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/File.h>
+
+#include "HashFlat.h"
+
+/**
+ * Spill flat is a hash aggregation which doesn't have to fit in memory.
+ * It aggregates in a hash flat until the table grows too big or its query budget is under pressure,
+ * then all its rows (partial aggregates with serialized sketches) are hash partitioned and written
+ * to local disk as runs of flat buffers, and the table restarts empty.
+ *
+ * When finished, every partition is merged back one at a time while the groups are consumed,
+ * so only 1/N of all groups are kept in a hash table at once. The same key always goes to
+ * the same partition, hence partitions are merged independently.
+ */
+namespace nebula {
+namespace memory {
+namespace keyed {
+
+// runs of one partition, appended to an unlinked temp file
+struct SpillPartition {
+  folly::File file;
+  size_t size;
+  std::vector<std::pair<size_t, size_t>> runs;
+};
+
+// cursor of groups of a spilled aggregation, it merges a partition when its groups are reached,
+// a partition is released once the cursor moves past it. no random access.
+class SpillCursor : public nebula::surface::RowCursor {
+public:
+  SpillCursor(const nebula::type::Schema, const nebula::surface::eval::Fields&, std::vector<SpillPartition>);
+  virtual ~SpillCursor() = default;
+
+  virtual const nebula::surface::RowData& next() override;
+
+  virtual std::unique_ptr<nebula::surface::RowData> item(size_t) const override {
+    throw NException("Spilled aggregation does not support random access");
+  }
+
+private:
+  // merge next non empty partition as the following one
+  void preload();
+
+private:
+  const nebula::type::Schema schema_;
+  const nebula::surface::eval::Fields& fields_;
+  std::vector<SpillPartition> partitions_;
+  size_t next_;
+  std::unique_ptr<HashFlat> current_;
+  std::unique_ptr<HashFlat> following_;
+  // cursor index of first row of current partition
+  size_t offset_;
+};
+
+class SpillFlat {
+public:
+  // spill once the table holds more than given bytes, 0 to decide by query memory pressure only
+  SpillFlat(const nebula::type::Schema schema,
+            const nebula::surface::eval::Fields& fields,
+            size_t maxBytes = 0);
+  virtual ~SpillFlat() = default;
+
+  // update a row into the aggregation, return true if its key exists in current table
+  bool update(const nebula::surface::RowData&);
+
+  // complete the aggregation and return a cursor of all groups, this object can't be updated after.
+  // a table never spilled is returned as it is, otherwise partitions are merged while being iterated.
+  nebula::surface::RowCursorPtr finish();
+
+  // number of times the table has spilled
+  inline size_t spills() const noexcept {
+    return spills_;
+  }
+
+private:
+  // write all rows of current table into partitions on disk and reset the table
+  void spill();
+
+  bool shouldSpill() const;
+
+private:
+  const nebula::type::Schema schema_;
+  const nebula::surface::eval::Fields& fields_;
+  const size_t maxBytes_;
+  std::unique_ptr<HashFlat> table_;
+  std::vector<SpillPartition> partitions_;
+  size_t spills_;
+
+  // rows count at which spilling is checked next
+  size_t nextCheck_;
+};
+
+} // namespace keyed
+} // namespace memory
+} // namespace nebula
@@ -37,8 +37,17 @@ namespace memory {
 namespace serde {
 
 using nebula::meta::Column;
-static constexpr auto CT_NONE = folly::io::CodecType::NO_COMPRESSION;
-static constexpr auto CT_LZ4 = folly::io::CodecType::LZ4;
+using nebula::common::PageCodec;
+using nebula::common::PagedSlice;
+
+// codec set for the column, or chosen per block if compression is enabled
+static PageCodec pageCodec(const Column& column) {
+  if (!column.codec.empty()) {
+    return PagedSlice::codec(column.codec);
+  }
+
+  return column.withCompress ? PageCodec::AUTO : PageCodec::NONE;
+}
 
 // convert string to void* with nullptr
 void* void_any(const std::string&) {
@@ -48,7 +57,7 @@ void* void_any(const std::string&) {
 #define TYPE_DATA_CONSTR(TYPE, SLICE_PAGE, CONV)                             \
   template <>                                                                \
   TYPE::TypeDataImpl(const Column& column, size_t batchSize)                 \
-    : slice_{ (size_t)SLICE_PAGE, column.withCompress ? CT_LZ4 : CT_NONE },  \
+    : slice_{ (size_t)SLICE_PAGE, pageCodec(column) },                      \
       bf_{ nullptr } {                                                       \
     if (column.withBloomFilter && Scalar) {                                  \
       bf_ = std::make_unique<nebula::common::BloomFilter<NType>>(batchSize); \
@@ -56,6 +65,10 @@ void* void_any(const std::string&) {
                                                                              \
     if (column.defaultValue.size() > 0) {                                    \
       default_ = CONV(column.defaultValue);                                  \
+    }                                                                        \
+                                                                             \
+    if (Packable) {                                                          \
+      slice_.pack(Width);                                                    \
     }                                                                        \
   }
 
@@ -156,6 +169,21 @@ TYPE_ADD_PROXY(int128_t, i128d_)
 TYPE_ADD_PROXY(std::string_view, std_)
 #undef TYPE_ADD_PROXY
 
+#define TYPE_ADD_RUN_PROXY(TYPE, OBJ)                                                                     \
+  template <>                                                                                             \
+  void TypeDataProxy::addRun(const TYPE* values, size_t count, const uint8_t* validity, int64_t offset) { \
+    OBJ->addRun(values, count, validity, offset);                                                         \
+  }
+
+TYPE_ADD_RUN_PROXY(int8_t, btd_)
+TYPE_ADD_RUN_PROXY(int16_t, sd_)
+TYPE_ADD_RUN_PROXY(int32_t, id_)
+TYPE_ADD_RUN_PROXY(int64_t, ld_)
+TYPE_ADD_RUN_PROXY(float, fd_)
+TYPE_ADD_RUN_PROXY(double, dd_)
+TYPE_ADD_RUN_PROXY(int128_t, i128d_)
+#undef TYPE_ADD_RUN_PROXY
+
 #define TYPE_PROBABLY_PROXY(TYPE, OBJ)             \
   template <>                                      \
   bool TypeDataProxy::probably(TYPE value) const { \
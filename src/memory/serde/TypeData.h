@@ -34,6 +34,11 @@ using IndexType = size_t;
 template <nebula::type::Kind>
 class TypeDataImpl;
 
+// check a value in a validity bitmap of LSB bit order, no bitmap means all values are valid
+inline bool isValid(const uint8_t* validity, int64_t bit) {
+  return validity == nullptr || (validity[bit >> 3] >> (bit & 7)) & 1;
+}
+
 /**
  * A data serde to desribe real data for a given type.
  * The base type acts like a proxy to delegate corresponding typed data.
@@ -52,6 +57,10 @@ public:
 
   virtual void seal() = 0;
 
+  // write sealed data or restore it into a new one
+  virtual void persist(nebula::common::BinaryWriter&) const = 0;
+  virtual void restore(nebula::common::BinaryReader&) = 0;
+
 protected:
   // data size in slice_
   size_t size_;
@@ -75,6 +84,10 @@ class TypeDataImpl : public TypeData {
   using NType = typename nebula::type::TypeTraits<KIND>::CppType;
   static constexpr auto Width = nebula::type::TypeTraits<KIND>::width;
   static constexpr auto Scalar = nebula::type::TypeBase::isScalar(KIND);
+  // integer pages may be bit packed by frame of reference
+  static constexpr auto Packable = KIND == nebula::type::Kind::SMALLINT
+                                   || KIND == nebula::type::Kind::INTEGER
+                                   || KIND == nebula::type::Kind::BIGINT;
 
 public:
   TypeDataImpl(const nebula::meta::Column&, size_t);
@@ -96,6 +109,25 @@ public:
     size_ += slice_.write(size_, (NType)0);
   }
 
+  // append a run of values in chunks rather than one by one,
+  // values of null slots are kept as they are but not added to bloom filter.
+  void addRun(const NType* values, size_t count, const uint8_t* validity, int64_t offset) {
+    // a chunk fits in a page so that pages still hold whole values
+    constexpr size_t CHUNK = 1024 / Width;
+    for (size_t i = 0; i < count; i += CHUNK) {
+      const auto n = std::min(CHUNK, count - i);
+      size_ += slice_.write(size_, reinterpret_cast<const char*>(values + i), n * Width);
+    }
+
+    if (UNLIKELY(bf_ != nullptr)) {
+      for (size_t i = 0; i < count && bf_ != nullptr; ++i) {
+        if (isValid(validity, offset + i) && !bf_->add(values[i])) {
+          bf_ = nullptr;
+        }
+      }
+    }
+  }
+
   NType read(IndexType index) const {
     return slice_.template read<NType>(index * Width);
   }
@@ -122,6 +154,26 @@ public:
     slice_.seal();
   }
 
+  virtual void persist(nebula::common::BinaryWriter& writer) const override {
+    writer.write<uint64_t>(size_);
+    slice_.persist(writer);
+    writer.write<bool>(bf_ != nullptr);
+    if (bf_) {
+      bf_->persist(writer);
+    }
+  }
+
+  virtual void restore(nebula::common::BinaryReader& reader) override {
+    size_ = reader.read<uint64_t>();
+    slice_.restore(reader);
+
+    // data is restored with the same column properties it was built with
+    N_ENSURE_EQ(reader.read<bool>(), bf_ != nullptr, "bloom filter mismatches column");
+    if (bf_) {
+      bf_->restore(reader);
+    }
+  }
+
 private:
   // memory chunk managed by paged slice
   nebula::common::PagedSlice slice_;
@@ -153,6 +205,10 @@ public:
     }
   }
 
+  // append a run of fixed width values, see TypeDataImpl::addRun
+  template <typename T>
+  void addRun(const T*, size_t, const uint8_t*, int64_t);
+
 public:
   template <typename T>
   T read(IndexType) const;
@@ -184,6 +240,14 @@ public:
     data_->seal();
   }
 
+  inline void persist(nebula::common::BinaryWriter& writer) const {
+    data_->persist(writer);
+  }
+
+  inline void restore(nebula::common::BinaryReader& reader) {
+    data_->restore(reader);
+  }
+
 private:
   // data_ is owned object while other plain pointers are internal refs
   PTypeData data_;
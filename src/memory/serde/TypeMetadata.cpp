@@ -16,10 +16,117 @@
 
 #include "TypeMetadata.h"
 
+#include <gflags/gflags.h>
+#include <vector>
+
+DEFINE_double(DICT_MAX_RATIO, 0.3,
+              "strings of a block are dictionary encoded while distinct values / rows stays under it, "
+              "0 to encode only columns set with dictionary in schema");
+DEFINE_uint32(DICT_MIN_ROWS, 1024, "rows of a block to see before giving up its automatic dictionary");
+
 namespace nebula {
 namespace memory {
 namespace serde {
 
+bool TypeMetadata::useDict(nebula::type::Kind kind, const nebula::meta::Column& column) {
+  if (column.withDict) {
+    return true;
+  }
+
+  // partition values are encoded in their spaces already
+  return kind == nebula::type::Kind::VARCHAR && !column.partition.valid() && FLAGS_DICT_MAX_RATIO > 0;
+}
+
+bool TypeMetadata::encodeDict(size_t index) {
+  if (dict_ == nullptr || index >= plainFrom_) {
+    return false;
+  }
+
+  // too many distinct values, store this and following values plainly
+  if (!forceDict_ && dictRows_ >= FLAGS_DICT_MIN_ROWS && dict_->items() > dictRows_ * FLAGS_DICT_MAX_RATIO) {
+    plainFrom_ = index;
+    return false;
+  }
+
+  ++dictRows_;
+  return true;
+}
+
+void TypeMetadata::persist(nebula::common::BinaryWriter& writer) const {
+  writer.write<uint64_t>(count_);
+  writer.write<uint8_t>((uint8_t)nullState_);
+  std::vector<char> nulls(nulls_.getSizeInBytes());
+  nulls_.write(nulls.data());
+  writer.blob(nulls.data(), nulls.size());
+
+  writer.write<bool>(offsetSize_ != nullptr);
+  if (offsetSize_) {
+    offsetSize_->persist(writer);
+  }
+
+  // an automatic dictionary depends on flags, so the block keeps what it was built with
+  writer.write<bool>(dict_ != nullptr);
+  if (dict_) {
+    dict_->persist(writer);
+    dictIndex_->persist(writer);
+    writer.write<uint64_t>(dictCount_);
+  }
+
+  writer.write<uint64_t>(dictRows_);
+  writer.write<uint64_t>(plainFrom_);
+
+  writer.write<uint64_t>(histo_->count);
+  if (bh_) {
+    writer.write(bh_->trueValues);
+  } else if (ih_) {
+    writer.write(ih_->v_min);
+    writer.write(ih_->v_max);
+    writer.write(ih_->v_sum);
+  } else if (rh_) {
+    writer.write(rh_->v_min);
+    writer.write(rh_->v_max);
+    writer.write(rh_->v_sum);
+  }
+}
+
+void TypeMetadata::restore(nebula::common::BinaryReader& reader) {
+  count_ = reader.read<uint64_t>();
+  nullState_ = (Nulls)reader.read<uint8_t>();
+  auto nulls = reader.blob();
+  nulls_ = roaring::Roaring::readSafe(nulls.data(), nulls.size());
+
+  N_ENSURE_EQ(reader.read<bool>(), offsetSize_ != nullptr, "offsets mismatch type");
+  if (offsetSize_) {
+    offsetSize_->restore(reader);
+  }
+
+  dict_ = nullptr;
+  dictIndex_ = nullptr;
+  if (reader.read<bool>()) {
+    dict_ = std::make_unique<nebula::memory::encode::DictEncoder>();
+    dict_->restore(reader);
+    dictIndex_ = std::make_unique<nebula::common::PagedSlice>(N_ITEMS);
+    dictIndex_->restore(reader);
+    dictCount_ = reader.read<uint64_t>();
+  }
+
+  dictRows_ = reader.read<uint64_t>();
+  plainFrom_ = reader.read<uint64_t>();
+
+  histo_->count = reader.read<uint64_t>();
+  if (bh_) {
+    bh_->trueValues = reader.read<decltype(bh_->trueValues)>();
+  } else if (ih_) {
+    ih_->v_min = reader.read<decltype(ih_->v_min)>();
+    ih_->v_max = reader.read<decltype(ih_->v_max)>();
+    ih_->v_sum = reader.read<decltype(ih_->v_sum)>();
+  } else if (rh_) {
+    rh_->v_min = reader.read<decltype(rh_->v_min)>();
+    rh_->v_max = reader.read<decltype(rh_->v_max)>();
+    rh_->v_sum = reader.read<decltype(rh_->v_sum)>();
+  }
+}
+
 // define bool histogram method
 template <>
 size_t TypeMetadata::histogram(bool v) {
@@ -29,6 +29,14 @@ namespace nebula {
 namespace memory {
 namespace serde {
 
+// null state of a column known when it is sealed
+enum class Nulls : uint8_t {
+  // not sealed yet, or only some values are null
+  SOME,
+  NONE,
+  ALL
+};
+
 /**
  * A metadata serde to desribe metadata for a given type.
  * This is a super set that works for any type. 
@@ -41,6 +49,10 @@ class TypeMetadata {
 
 public:
   static constexpr IndexType INVALID_INDEX = std::numeric_limits<IndexType>::max();
+
+  // string columns are dictionary encoded if set in schema, or automatically unless disabled
+  static bool useDict(nebula::type::Kind, const nebula::meta::Column&);
+
   TypeMetadata(nebula::type::Kind kind, const nebula::meta::Column& column)
     : partition_{ column.partition.valid() },
       count_{ 0 },
@@ -49,8 +61,14 @@ public:
           nullptr :
           std::make_unique<nebula::common::PagedSlice>(N_ITEMS)
       },
-      dict_{ column.withDict ? std::make_unique<nebula::memory::encode::DictEncoder>() : nullptr },
+      dict_{ useDict(kind, column) ? std::make_unique<nebula::memory::encode::DictEncoder>() : nullptr },
+      dictIndex_{ dict_ ? std::make_unique<nebula::common::PagedSlice>(N_ITEMS) : nullptr },
+      dictCount_{ 0 },
+      forceDict_{ column.withDict },
+      dictRows_{ 0 },
+      plainFrom_{ dict_ ? std::numeric_limits<size_t>::max() : 0 },
       default_{ column.defaultValue.size() > 0 },
+      nullState_{ Nulls::SOME },
       histo_{ nullptr } {
 
     if (offsetSize_ != nullptr) {
@@ -59,6 +77,11 @@ public:
       ++count_;
     }
 
+    // dictionary indices are small integers, bit packed per page
+    if (dictIndex_ != nullptr) {
+      dictIndex_->pack(sizeof(int32_t));
+    }
+
     // initialize histogram object
     histo_ = nullptr;
     bh_ = nullptr;
@@ -101,6 +124,11 @@ public:
   }
 
   inline bool isNull(size_t index) {
+    // a sealed column without nulls or with nulls only skips bitmap lookup
+    if (nullState_ != Nulls::SOME) {
+      return nullState_ == Nulls::ALL;
+    }
+
     // column/node with default value will never be null
     if (default_) {
       return false;
@@ -109,11 +137,17 @@ public:
     return nulls_.contains(index);
   }
 
+  inline Nulls nulls() const {
+    return nullState_;
+  }
+
   inline bool isRealNull(size_t index) const {
     return default_ && nulls_.contains(index);
   }
 
+  // plain values stored after a dictionary falls back are indexed from where it falls back
   void setOffsetSize(size_t index, IndexType items) {
+    index -= plainFrom_;
     auto last = offsetSize_->read<IndexType>((count_ - 1) * INDEX_WIDTH);
 
     // NULLS in the hole
@@ -136,10 +170,24 @@ public:
     return { offset, length };
   }
 
+  // offset and size of a plain value in data
+  inline std::pair<IndexType, IndexType> plainOffsetSize(size_t index) const {
+    return offsetSize(index - plainFrom_);
+  }
+
   inline bool hasDict() const {
     return dict_ != nullptr;
   }
 
+  // whether the value at given index is encoded in dictionary
+  inline bool isDict(size_t index) const {
+    return dict_ != nullptr && index < plainFrom_;
+  }
+
+  // decide if a new value at given index goes into dictionary,
+  // an automatic dictionary stops taking values once values of the block are too distinct
+  bool encodeDict(size_t);
+
   inline int32_t dictItem(std::string_view item) {
     return dict_->set(item);
   }
@@ -148,21 +196,48 @@ public:
     return dict_->get(index);
   }
 
-  inline void seal() {
+  // dictionary index of the value at given index, NULLS in the hole take index 0
+  void setDictItem(size_t index, int32_t item) {
+    while (dictCount_ < index) {
+      dictIndex_->write<int32_t>(dictCount_++ * sizeof(int32_t), 0);
+    }
+
+    dictIndex_->write<int32_t>(dictCount_++ * sizeof(int32_t), item);
+  }
+
+  inline int32_t dictIndex(size_t index) const {
+    return dictIndex_->read<int32_t>(index * sizeof(int32_t));
+  }
+
+  // seal with number of values in the column
+  inline void seal(size_t count) {
     // release hash items for lookup
     if (dict_) {
       dict_->seal();
+      dictIndex_->seal();
     }
 
     // shrink bitmap
     nulls_.shrinkToFit();
 
+    // column with default value is never null,
+    // partition column only counts its null values as its values are kept in partition spaces
+    if (default_ || nulls_.isEmpty()) {
+      nullState_ = Nulls::NONE;
+    } else if (!partition_ && nulls_.cardinality() == count) {
+      nullState_ = Nulls::ALL;
+    }
+
     // seal the slice to release unused memory
     if (offsetSize_) {
       offsetSize_->seal();
     }
   }
 
+  // write sealed metadata or restore it into a new one
+  void persist(nebula::common::BinaryWriter&) const;
+  void restore(nebula::common::BinaryReader&);
+
   inline bool hasDefault() const {
     return default_;
   }
@@ -217,10 +292,24 @@ private:
   // dictionary link one index to another index which has the value
   std::unique_ptr<nebula::memory::encode::DictEncoder> dict_;
 
+  // dictionary index of each value, kept apart from offsets of plain values
+  std::unique_ptr<nebula::common::PagedSlice> dictIndex_;
+  size_t dictCount_;
+
+  // dictionary set by schema is always used, otherwise it is decided by cardinality
+  bool forceDict_;
+  size_t dictRows_;
+
+  // values from this index on are stored plainly, 0 if there is no dictionary
+  size_t plainFrom_;
+
   // indicate if this column has default value setting
   // if yes, it will never be NULL, default value will be returned instead of NULLs
   bool default_;
 
+  // set when sealed
+  Nulls nullState_;
+
   // a histogram object storing concrete typed histogram
   // to avoid runtime casting, we use 3 different pointers internally pointing to the same object
   // they don't maintain referneces.
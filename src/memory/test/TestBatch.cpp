@@ -17,12 +17,14 @@
 #include <fmt/format.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
+#include <thread>
 #include <valarray>
 
 #include "common/Memory.h"
 #include "memory/Batch.h"
 #include "memory/DataNode.h"
 #include "memory/FlatRow.h"
+#include "memory/serde/TypeDataFactory.h"
 #include "meta/TestTable.h"
 #include "surface/DataSurface.h"
 #include "surface/MockSurface.h"
@@ -210,6 +212,62 @@ TEST(BatchTest, TestBloomFilter) {
   EXPECT_LT(falsePositives * 100.0 / count, 0.1f);
 }
 
+TEST(BatchTest, TestOpenBatch) {
+  nebula::meta::TestTable test;
+  int32_t count = 10000;
+
+  Batch batch(test, count);
+  batch.open();
+  EXPECT_TRUE(batch.isOpen());
+
+  // single writer keeps appending while reader scanning snapshots,
+  // rows are added one by one and in sections holding the lock once for a group
+  std::thread writer([&batch, count]() {
+    for (int32_t i = 0; i < count / 2; ++i) {
+      nebula::surface::StaticRow row{ i, i, "events", nullptr, false, 0, 0, 0 };
+      batch.add(row);
+    }
+
+    for (int32_t i = count / 2; i < count;) {
+      Batch::Section section(batch);
+      for (auto end = std::min(i + 100, count); i < end; ++i) {
+        nebula::surface::StaticRow row{ i, i, "events", nullptr, false, 0, 0, 0 };
+        batch.add(row);
+      }
+    }
+  });
+
+  size_t snapshots = 0;
+  size_t last = 0;
+  while (last < (size_t)count) {
+    auto snapshot = batch.snapshot();
+    auto rows = batch.getRows();
+    EXPECT_GE(rows, last);
+    last = rows;
+    if (rows == 0) {
+      continue;
+    }
+
+    // stats are consistent with the watermark
+    auto h = batch.histogram<nebula::surface::eval::IntHistogram>("id");
+    EXPECT_EQ(h.count, rows);
+    EXPECT_EQ((size_t)h.max(), rows - 1);
+
+    // the last visible row is fully written
+    auto accessor = batch.makeAccessor();
+    EXPECT_EQ((size_t)accessor->seek(rows - 1).readInt("id"), rows - 1);
+    ++snapshots;
+  }
+
+  writer.join();
+  LOG(INFO) << "snapshots taken while writing: " << snapshots;
+
+  batch.seal();
+  EXPECT_FALSE(batch.isOpen());
+  EXPECT_EQ(batch.getRows(), count);
+  EXPECT_TRUE(batch.probably("id", count - 1));
+}
+
 TEST(BatchTest, TestStringDictionary) {
   nebula::meta::TestTable test;
   int32_t count = 100000;
@@ -371,6 +429,128 @@ TEST(BatchTest, TestPartitionedBatch) {
   }
 }
 
+TEST(BatchTest, TestNullState) {
+  nebula::meta::TestTable test;
+  int32_t count = 1000;
+  Batch batch(test, count);
+
+  // items are always null and value is null in even rows
+  for (int32_t i = 0; i < count; ++i) {
+    nebula::surface::StaticRow row{ i, i, "events", nullptr, false, (char)(i % 2), 0, 0 };
+    batch.add(row);
+  }
+
+  EXPECT_FALSE(batch.nullFree());
+  batch.seal();
+  EXPECT_FALSE(batch.nullFree());
+
+  auto accessor = batch.makeAccessor();
+  for (int32_t i = 0; i < count; ++i) {
+    const auto& r = accessor->seek(i);
+    EXPECT_FALSE(r.isNull("id"));
+    EXPECT_TRUE(r.isNull("items"));
+    EXPECT_EQ(r.isNull("value"), i % 2 == 0);
+  }
+
+  // null state of a column is known once sealed
+  using nebula::memory::serde::Nulls;
+  nebula::meta::Column column;
+  auto none = nebula::memory::serde::TypeDataFactory::createMeta(nebula::type::Kind::INTEGER, column);
+  auto all = nebula::memory::serde::TypeDataFactory::createMeta(nebula::type::Kind::INTEGER, column);
+  all->setNull(0);
+  all->setNull(1);
+  EXPECT_EQ(none->nulls(), Nulls::SOME);
+  EXPECT_EQ(all->nulls(), Nulls::SOME);
+  none->seal(2);
+  all->seal(2);
+  EXPECT_EQ(none->nulls(), Nulls::NONE);
+  EXPECT_EQ(all->nulls(), Nulls::ALL);
+  EXPECT_TRUE(all->isNull(5));
+}
+
+TEST(BatchTest, TestDictionaryFallback) {
+  nebula::meta::TestTable test;
+  int32_t count = 5000;
+  Batch batch(test, count);
+
+  // values repeat at first and then become all distinct,
+  // the automatic dictionary of tag and stack falls back to plain while event keeps its dictionary
+  auto value = [](int32_t i) {
+    return i < 2000 ? fmt::format("v{0}", i % 5) : fmt::format("value-{0}", i);
+  };
+
+  for (int32_t i = 0; i < count; ++i) {
+    auto str = value(i);
+    nebula::surface::StaticRow row{ i, i, str, nullptr, false, 0, 0, 0 };
+    batch.add(row);
+  }
+
+  batch.seal();
+
+  auto accessor = batch.makeAccessor();
+  for (int32_t i = 0; i < count; ++i) {
+    const auto& r = accessor->seek(i);
+    const auto expected = value(i);
+    EXPECT_EQ(r.readString("event"), expected);
+    EXPECT_EQ(r.readString("tag"), expected);
+    EXPECT_EQ(r.readString("stack"), expected);
+  }
+}
+
+TEST(BatchTest, TestPersistRestore) {
+  nebula::meta::TestTable test;
+  auto count = 10000;
+  Batch batch(test, count);
+
+  std::vector<nebula::surface::StaticRow> rows;
+  MockRowData row{ nebula::common::Evidence::ticks() };
+  for (auto i = 0; i < count; ++i) {
+    rows.push_back({ row.readLong("_time_"),
+                     i,
+                     fmt::format("event-{0}", i % 7),
+                     i % 3 != 0 ? nullptr : row.readList("items"),
+                     row.readBool("flag"),
+                     (char)(i % 100),
+                     row.readInt128("i128"),
+                     row.readDouble("weight") });
+    batch.add(rows.back());
+  }
+
+  batch.seal();
+  nebula::common::BinaryWriter writer;
+  batch.persist(writer);
+
+  // restored batch reads pages in place of the buffer it keeps
+  auto buffer = std::make_shared<std::string>(writer.buffer());
+  nebula::common::BinaryReader reader(buffer->data(), buffer->size());
+  Batch restored(test, count);
+  restored.restore(reader, buffer);
+  EXPECT_EQ(reader.remaining(), 0);
+  EXPECT_EQ(restored.getRows(), count);
+  EXPECT_EQ(restored.getRawSize(), batch.getRawSize());
+  EXPECT_EQ(restored.nullFree(), batch.nullFree());
+  EXPECT_EQ(restored.histogram("id").toString(), batch.histogram("id").toString());
+
+  auto line = [](const nebula::surface::RowData& r) {
+    std::string s;
+    if (!r.isNull("items")) {
+      const auto list = r.readList("items");
+      for (auto k = 0; k < list->getItems(); ++k) {
+        s += fmt::format("{0},", list->readString(k));
+      }
+    }
+
+    return fmt::format("({0}, {1}, {2}, [{3}], {4}, {5}, {6})",
+                       r.readLong("_time_"), r.readInt("id"), r.readString("event"), s,
+                       r.readBool("flag"), r.isNull("value") ? -1 : r.readByte("value"), r.readDouble("weight"));
+  };
+
+  auto accessor = restored.makeAccessor();
+  for (auto i = 0; i < count; ++i) {
+    EXPECT_EQ(line(rows[i]), line(accessor->seek(i)));
+  }
+}
+
 } // namespace test
 } // namespace memory
 } // namespace nebula
\ No newline at end of file
@@ -180,6 +180,33 @@ TEST(DictTest, TestDictionary) {
   }
 }
 
+TEST(DictTest, TestDistinctValues) {
+  nebula::memory::encode::DictEncoder dict;
+  constexpr size_t items = 10000;
+
+  // short values compared inline, long values sharing a prefix and size compared in full
+  auto value = [](size_t i) {
+    return i % 2 == 0 ? fmt::format("{0}", i) : fmt::format("prefix-shared-{0:08}", i);
+  };
+
+  std::vector<int32_t> indices;
+  for (size_t i = 0; i < items; ++i) {
+    indices.push_back(dict.set(value(i)));
+  }
+
+  // all repeated values map to their existing index
+  for (size_t i = 0; i < items; ++i) {
+    EXPECT_EQ(dict.set(value(i)), indices[i]);
+  }
+
+  EXPECT_EQ(dict.items(), items);
+  dict.seal();
+
+  for (size_t i = 0; i < items; ++i) {
+    EXPECT_EQ(dict.get(indices[i]), value(i));
+  }
+}
+
 #undef SIZE
 
 } // namespace test
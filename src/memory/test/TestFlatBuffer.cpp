@@ -22,6 +22,7 @@
 #include "fmt/format.h"
 #include "memory/keyed/FlatBuffer.h"
 #include "memory/keyed/HashFlat.h"
+#include "memory/keyed/SpillFlat.h"
 #include "meta/TestTable.h"
 #include "surface/DataSurface.h"
 #include "surface/MockSurface.h"
@@ -39,6 +40,7 @@ namespace test {
 using nebula::common::Evidence;
 using nebula::memory::keyed::FlatBuffer;
 using nebula::memory::keyed::HashFlat;
+using nebula::memory::keyed::SpillFlat;
 using nebula::surface::MockRowData;
 using nebula::surface::RowData;
 using nebula::type::TypeSerializer;
@@ -185,6 +187,38 @@ TEST(FlatBufferTest, TestSerde) {
   // delete[] buffer;
 }
 
+TEST(FlatBufferTest, TestColumnarRollbackSerde) {
+  nebula::meta::TestTable test;
+  FlatBuffer fb(test.schema(), test.testFields());
+
+  // rows rolled back at every position of a null bitmap byte leave no bits behind
+  MockRowData row(Evidence::unix_timestamp());
+  std::vector<std::string> lines;
+  for (auto i = 0; i < 100; ++i) {
+    fb.add(row);
+    if (i % 3 == 0) {
+      fb.rollback();
+      continue;
+    }
+
+    lines.push_back(line(fb.row(fb.getRows() - 1)));
+  }
+
+  EXPECT_EQ(fb.getRows(), lines.size());
+
+  auto size = fb.prepareSerde();
+  auto buffer = static_cast<NByte*>(nebula::common::Pool::getDefault().allocate(size));
+  EXPECT_EQ(size, fb.serialize(buffer));
+
+  // values of the read-only copy are read column by column from the buffer
+  FlatBuffer fb2(test.schema(), test.testFields(), buffer);
+  EXPECT_EQ(fb2.getRows(), lines.size());
+  for (size_t i = 0; i < lines.size(); ++i) {
+    EXPECT_EQ(line(fb.row(i)), lines.at(i));
+    EXPECT_EQ(line(*fb2.crow(i)), lines.at(i));
+  }
+}
+
 TEST(FlatBufferTest, TestHashFlatSerde) {
   auto schema = TypeSerializer::from("ROW<id:int, count:int>");
 
@@ -243,6 +277,83 @@ TEST(FlatBufferTest, TestHashFlatSerde) {
   }
 }
 
+TEST(FlatBufferTest, TestMemoryBudget) {
+  nebula::meta::TestTable test;
+  using nebula::common::MemoryBudget;
+  using nebula::common::MemoryScope;
+
+  // buffers built in a scope are charged to its budget and released when destroyed
+  auto node = std::make_shared<MemoryBudget>(0);
+  auto query = std::make_shared<MemoryBudget>(64 << 20, node);
+  {
+    MemoryScope scope(query);
+    HashFlat hf(test.schema(), test.testFields());
+    MockRowData row(Evidence::unix_timestamp());
+    for (auto i = 0; i < 2000; ++i) {
+      hf.update(row);
+    }
+
+    EXPECT_GT(query->used(), 0);
+    EXPECT_EQ(node->used(), query->used());
+  }
+
+  EXPECT_EQ(query->used(), 0);
+  EXPECT_EQ(node->used(), 0);
+  EXPECT_GT(query->peak(), 0);
+  EXPECT_FALSE(query->exceeded());
+
+  // a small budget fails the query with a specific error and leaves nothing charged
+  auto tiny = std::make_shared<MemoryBudget>(1 << 20, node);
+  {
+    MemoryScope scope(tiny);
+    EXPECT_THROW(HashFlat(test.schema(), test.testFields()), nebula::common::MemoryExceededException);
+  }
+
+  EXPECT_TRUE(tiny->exceeded());
+  EXPECT_THROW(tiny->check(), nebula::common::MemoryExceededException);
+  EXPECT_EQ(tiny->used(), 0);
+  EXPECT_EQ(node->used(), 0);
+
+  // nothing is charged out of a scope
+  EXPECT_EQ(MemoryBudget::current(), nullptr);
+}
+
+TEST(FlatBufferTest, TestSpillFlat) {
+  auto schema = TypeSerializer::from("ROW<id:int, count:int>");
+  nebula::surface::eval::Fields f;
+  f.reserve(2);
+  f.emplace_back(nebula::surface::eval::constant(1));
+  f.emplace_back(nebula::surface::eval::constant(2));
+
+  // every key shows up twice, the second time after the first one is spilled
+  constexpr auto rows2test = 20000;
+  auto seed = Evidence::unix_timestamp();
+  HashFlat hf(schema, f);
+  SpillFlat sf(schema, f, 1);
+  for (auto pass = 0; pass < 2; ++pass) {
+    MockRowData r1(seed);
+    MockRowData r2(seed);
+    for (auto i = 0; i < rows2test; ++i) {
+      hf.update(r1);
+      sf.update(r2);
+    }
+  }
+
+  EXPECT_GT(sf.spills(), 0);
+  auto result = sf.finish();
+
+  // spilled groups are merged back without duplicates, one partition at a time
+  HashFlat check(schema, f);
+  size_t count = 0;
+  while (result->hasNext()) {
+    EXPECT_FALSE(check.update(result->next()));
+    ++count;
+  }
+
+  EXPECT_EQ(count, hf.getRows());
+  EXPECT_THROW(result->item(0), NException);
+}
+
 } // namespace test
 } // namespace memory
 } // namespace nebula
\ No newline at end of file
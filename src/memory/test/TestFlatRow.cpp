@@ -17,7 +17,10 @@
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include "memory/Batch.h"
 #include "memory/FlatRow.h"
+#include "meta/TestTable.h"
+#include "type/Serde.h"
 
 /**
  * Flat Buffer is used to store / compute run time data. 
@@ -87,6 +90,78 @@ TEST(FlatRowTest, TestFlatRowTreatMissingAsNulls) {
   EXPECT_TRUE(rowTreatsMissingAsNull.isNull("abc"));
 }
 
+TEST(FlatRowTest, TestBoundSlots) {
+  auto schema = nebula::type::TypeSerializer::from("ROW<id:int, name:string, weight:float, flag:bool>");
+  FlatRow row(1024, true);
+  row.bind(schema);
+  EXPECT_TRUE(row.bound());
+  EXPECT_EQ(row.slot("name"), 1);
+  EXPECT_EQ(row.slot("none"), FlatRow::NO_SLOT);
+  EXPECT_EQ(row.slots()->size(), 4);
+
+  const std::string source = "a string in source buffer";
+  for (auto i = 0; i < 10; ++i) {
+    row.reset();
+
+    // write by name and by slot, string is a view of source buffer
+    row.write("id", i);
+    row.view(1, source.data(), 8);
+    row.write(2, 2.5f);
+    row.write("extra", 3);
+
+    // read by slot and by name
+    EXPECT_EQ(row.readInt(0), i);
+    EXPECT_EQ(row.readInt("id"), i);
+    EXPECT_EQ(row.readString(1), "a string");
+    EXPECT_EQ(row.readString("name").data(), source.data());
+    EXPECT_EQ(row.readFloat("weight"), 2.5);
+    EXPECT_TRUE(row.written(2));
+
+    // missing slot is null, key out of schema still readable
+    EXPECT_FALSE(row.written(3));
+    EXPECT_TRUE(row.isNull(3));
+    EXPECT_TRUE(row.isNull("flag"));
+    EXPECT_EQ(row.readInt("extra"), 3);
+  }
+}
+
+TEST(FlatRowTest, TestBatchAddPositional) {
+  nebula::meta::TestTable test;
+  FlatRow row(1024, true);
+  row.bind(test.schema());
+
+  Batch batch(test, 10);
+  for (auto i = 0; i < 10; ++i) {
+    row.reset();
+    row.write(nebula::meta::Table::TIME_COLUMN, (int64_t)i);
+    row.write("id", i);
+    row.view(row.slot("event"), "nebula", 6);
+    batch.add(row);
+  }
+
+  auto accessor = batch.makeAccessor();
+  for (auto i = 0; i < 10; ++i) {
+    const auto& r = accessor->seek(i);
+    EXPECT_EQ(r.readLong(nebula::meta::Table::TIME_COLUMN), i);
+    EXPECT_EQ(r.readInt("id"), i);
+    EXPECT_EQ(r.readString("event"), "nebula");
+    EXPECT_TRUE(r.isNull("weight"));
+  }
+
+  // the same row bound to fields in another order is not read positionally by the batch
+  row.bind(nebula::type::TypeSerializer::from("ROW<id:int, _time_:long, event:string>"));
+  Batch another(test, 10);
+  row.reset();
+  row.write(0, 7);
+  row.write(1, (int64_t)8);
+  row.write(2, "nebula", 6);
+  another.add(row);
+
+  auto added = another.makeAccessor();
+  EXPECT_EQ(added->seek(0).readInt("id"), 7);
+  EXPECT_EQ(added->seek(0).readLong(nebula::meta::Table::TIME_COLUMN), 8);
+}
+
 } // namespace test
 } // namespace memory
 } // namespace nebula
\ No newline at end of file
@@ -213,6 +213,9 @@ Column col(const YAML::Node& settings) {
   std::string dv;
   EVAL_SETTING(default_value, dv, std::string)
 
+  std::string cd;
+  EVAL_SETTING(codec, cd, std::string)
+
   // if access spec defined
   const auto& access = settings["access"];
   AccessSpec as;
@@ -233,7 +236,7 @@ Column col(const YAML::Node& settings) {
     pi.chunk = chunk ? chunk.as<size_t>() : 1;
   }
 
-  return Column{ bf, d, c, std::move(dv), std::move(as), std::move(pi) };
+  return Column{ bf, d, c, std::move(dv), std::move(as), std::move(pi), cd };
 
 #undef EVAL_SETTING
 }
@@ -77,6 +77,11 @@ public:
     return keys_.size();
   }
 
+  // column name of the key at given index
+  inline const std::string& key(size_t index) const {
+    return keys_.at(index)->name();
+  }
+
   inline size_t offset(size_t index) const {
     return offsets_.at(index);
   }
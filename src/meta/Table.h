@@ -86,13 +86,15 @@ struct Column {
                   bool c = false,
                   const std::string& dv = "",
                   std::vector<AccessRule> rls = {},
-                  PartitionInfo pi = {})
+                  PartitionInfo pi = {},
+                  const std::string& cd = "")
     : withBloomFilter{ bf },
       withDict{ d },
       withCompress{ c },
       defaultValue{ dv },
       rules{ std::move(rls) },
-      partition{ std::move(pi) } {}
+      partition{ std::move(pi) },
+      codec{ cd } {}
 
   // by default, we don't build bloom filter
   bool withBloomFilter;
@@ -113,6 +115,10 @@ struct Column {
 
   // partition info - can be used to convert as PartitionKey
   PartitionInfo partition;
+
+  // page codec overriding compression setting: none, lz4, zstd or auto,
+  // such as lz4 for hot columns to decode fast and zstd for cold columns to save space
+  std::string codec;
 };
 
 using ColumnProps = nebula::common::unordered_map<std::string, Column>;
@@ -0,0 +1,284 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <glog/logging.h>
+#include <grpcpp/grpcpp.h>
+#include <thread>
+#include <vector>
+
+/**
+ * Building blocks of gRPC async services served by completion queues.
+ * A handler receives a request and a done callback, it may reply from any thread
+ * later on, so no gRPC thread is held while a query is waiting on its futures.
+ * A small fixed number of I/O threads drive all completion queues.
+ */
+namespace nebula {
+namespace service {
+namespace base {
+
+// a call tagged on completion queue, proceed its state when its tag comes out
+class AsyncCall {
+public:
+  virtual ~AsyncCall() = default;
+  virtual void proceed(bool ok) = 0;
+};
+
+// callback to reply a call, it should be called exactly once per call
+using AsyncDone = std::function<void(grpc::Status)>;
+
+// callback returned by a handler to abandon its work when client cancels the call, can be empty
+using AsyncCancel = std::function<void()>;
+
+// a unary call of given service method which is listening, handling or replying
+template <typename Service, typename Request, typename Reply>
+class UnaryCall final : public AsyncCall {
+public:
+  using RequestMethod = void (Service::*)(
+    grpc::ServerContext*,
+    Request*,
+    grpc::ServerAsyncResponseWriter<Reply>*,
+    grpc::CompletionQueue*,
+    grpc::ServerCompletionQueue*,
+    void*);
+
+  using Handler = std::function<AsyncCancel(grpc::ServerContext*, const Request&, Reply*, AsyncDone)>;
+
+  // listen on next call of the method, the call object manages its own life cycle
+  static void listen(Service* service, RequestMethod method, grpc::ServerCompletionQueue* cq, Handler handler) {
+    new UnaryCall(service, method, cq, std::move(handler));
+  }
+
+  virtual void proceed(bool ok) override {
+    // queue is shutting down before any call comes, closed tag will never be delivered
+    if (!started_ && !ok) {
+      delete this;
+      return;
+    }
+
+    // reply is sent or the queue is shutting down
+    if (replied_ || !ok) {
+      release();
+      return;
+    }
+
+    // accept next call of the same method before handling this one
+    started_ = true;
+    listen(service_, method_, cq_, handler_);
+    cancel_ = handler_(&ctx_, request_, &reply_, [this](grpc::Status status) {
+      replied_ = true;
+      responder_.Finish(reply_, status, this);
+    });
+  }
+
+private:
+  // tag notified when the call is done, either replied or cancelled by client
+  class Closed final : public AsyncCall {
+  public:
+    explicit Closed(UnaryCall* call) : call_{ call } {}
+    virtual void proceed(bool) override {
+      call_->closed();
+    }
+
+  private:
+    UnaryCall* call_;
+  };
+
+  UnaryCall(Service* service, RequestMethod method, grpc::ServerCompletionQueue* cq, Handler handler)
+    : service_{ service },
+      method_{ method },
+      cq_{ cq },
+      handler_{ std::move(handler) },
+      responder_{ &ctx_ },
+      closed_{ this },
+      started_{ false },
+      replied_{ false },
+      tags_{ 2 } {
+    ctx_.AsyncNotifyWhenDone(&closed_);
+    (service_->*method_)(&ctx_, &request_, &responder_, cq_, cq_, this);
+  }
+
+  // both tags are delivered in the same queue thread, so no race on them
+  void closed() {
+    if (ctx_.IsCancelled() && cancel_) {
+      cancel_();
+    }
+
+    release();
+  }
+
+  // the call is released when both its own tag and the closed tag are done
+  void release() {
+    if (--tags_ == 0) {
+      delete this;
+    }
+  }
+
+private:
+  Service* service_;
+  RequestMethod method_;
+  grpc::ServerCompletionQueue* cq_;
+  Handler handler_;
+  AsyncCancel cancel_;
+
+  grpc::ServerContext ctx_;
+  Request request_;
+  Reply reply_;
+  grpc::ServerAsyncResponseWriter<Reply> responder_;
+  Closed closed_;
+  bool started_;
+  bool replied_;
+  size_t tags_;
+};
+
+// completion queues of a server and the I/O threads polling them
+class AsyncQueues {
+public:
+  // queues have to be added to the builder before server starts
+  AsyncQueues(grpc::ServerBuilder& builder, size_t size) {
+    for (size_t i = 0; i < std::max<size_t>(size, 1); ++i) {
+      queues_.push_back(builder.AddCompletionQueue());
+    }
+  }
+
+  ~AsyncQueues() {
+    stop();
+  }
+
+  inline const std::vector<std::unique_ptr<grpc::ServerCompletionQueue>>& queues() const noexcept {
+    return queues_;
+  }
+
+  // start one I/O thread per queue
+  void start() {
+    for (auto& q : queues_) {
+      threads_.emplace_back([cq = q.get()]() {
+        void* tag = nullptr;
+        bool ok = false;
+        while (cq->Next(&tag, &ok)) {
+          static_cast<AsyncCall*>(tag)->proceed(ok);
+        }
+      });
+    }
+
+    LOG(INFO) << "Started " << threads_.size() << " completion queue threads.";
+  }
+
+  // should be called after server shutdown, all pending calls are drained
+  void stop() {
+    if (stopped_) {
+      return;
+    }
+
+    stopped_ = true;
+    for (auto& q : queues_) {
+      q->Shutdown();
+    }
+
+    // a queue has to be drained before destroyed even if it is never polled
+    if (threads_.empty()) {
+      start();
+    }
+
+    for (auto& t : threads_) {
+      t.join();
+    }
+
+    threads_.clear();
+  }
+
+private:
+  std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> queues_;
+  std::vector<std::thread> threads_;
+  bool stopped_ = false;
+};
+
+// a unary call from a client, its callback runs in the client queue thread once the reply or error arrives
+template <typename Reply>
+class ClientCall final : public AsyncCall {
+public:
+  using Callback = std::function<void(const grpc::Status&, Reply&)>;
+
+  explicit ClientCall(Callback callback)
+    : ctx_{ std::make_shared<grpc::ClientContext>() }, callback_{ std::move(callback) } {}
+
+  inline grpc::ClientContext& context() noexcept {
+    return *ctx_;
+  }
+
+  // share the context with whoever may cancel the call, it outlives this call object
+  inline std::shared_ptr<grpc::ClientContext> sharedContext() const noexcept {
+    return ctx_;
+  }
+
+  // start the call prepared by a stub on the client queue, the call object manages its own life cycle
+  void start(std::unique_ptr<grpc::ClientAsyncResponseReader<Reply>> reader) {
+    reader_ = std::move(reader);
+    reader_->StartCall();
+    reader_->Finish(&reply_, &status_, this);
+  }
+
+  virtual void proceed(bool) override {
+    callback_(status_, reply_);
+    delete this;
+  }
+
+private:
+  std::shared_ptr<grpc::ClientContext> ctx_;
+  Reply reply_;
+  grpc::Status status_;
+  std::unique_ptr<grpc::ClientAsyncResponseReader<Reply>> reader_;
+  Callback callback_;
+};
+
+// completion queue shared by async client calls of the process, and the I/O thread polling it
+class ClientQueue {
+public:
+  static ClientQueue& singleton() {
+    static ClientQueue queue;
+    return queue;
+  }
+
+  ~ClientQueue() {
+    cq_.Shutdown();
+    thread_.join();
+  }
+
+  inline grpc::CompletionQueue* cq() noexcept {
+    return &cq_;
+  }
+
+private:
+  ClientQueue()
+    : thread_{ [this]() {
+        void* tag = nullptr;
+        bool ok = false;
+        while (cq_.Next(&tag, &ok)) {
+          static_cast<AsyncCall*>(tag)->proceed(ok);
+        }
+      } } {}
+
+private:
+  grpc::CompletionQueue cq_;
+  std::thread thread_;
+};
+
+} // namespace base
+} // namespace service
+} // namespace nebula
@@ -16,6 +16,7 @@
 
 #include "NebulaService.h"
 
+#include <algorithm>
 #include <curl/curl.h>
 #include <msgpack.hpp>
 #include <rapidjson/stringbuffer.h>
@@ -54,9 +55,11 @@ using nebula::common::TaskType;
 using nebula::common::unordered_map;
 using nebula::common::unordered_set;
 using nebula::execution::ExecutionPlan;
+using nebula::execution::Priority;
 using nebula::execution::QueryContext;
 using nebula::execution::QueryStats;
 using nebula::execution::QueryWindow;
+using nebula::execution::SpecFilter;
 using nebula::ingest::BlockExpire;
 using nebula::ingest::IngestSpec;
 using nebula::ingest::SpecState;
@@ -94,6 +97,7 @@ const std::string ServiceProperties::errorMessage(ErrorCode error) {
     ERROR_MESSSAGE_CASE(FAIL_EXECUTE_QUERY)
     ERROR_MESSSAGE_CASE(AUTH_REQUIRED)
     ERROR_MESSSAGE_CASE(PERMISSION_REQUIRED)
+    ERROR_MESSSAGE_CASE(MEMORY_EXCEEDED)
   default: throw NException("Error Code Not Covered");
   }
 }
@@ -187,7 +191,8 @@ const std::string ServiceProperties::jsonify(const RowCursorPtr data, const Sche
 }
 
 // serialize a query and meta data
-flatbuffers::grpc::Message<QueryPlan> QuerySerde::serialize(const Query& q, const std::string& id, const QueryWindow& window) {
+flatbuffers::grpc::Message<QueryPlan> QuerySerde::serialize(
+  const Query& q, const std::string& id, const QueryWindow& window, const SpecFilter& specs, const QueryContext* ctx) {
   flatbuffers::grpc::MessageBuilder mb;
   std::vector<flatbuffers::Offset<flatbuffers::String>> fields;
   fields.reserve(q.selects_.size());
@@ -211,13 +216,57 @@ flatbuffers::grpc::Message<QueryPlan> QuerySerde::serialize(const Query& q, cons
   auto filter = Serde::serialize(*q.filter_);
   // customs serialization
   auto customs = Serde::serialize(q.customs_);
+
+  // specs to scan only or to skip
+  std::vector<flatbuffers::Offset<flatbuffers::String>> subset;
+  std::vector<flatbuffers::Offset<flatbuffers::String>> skips;
+  auto& list = specs.only ? subset : skips;
+  list.reserve(specs.specs.size());
+  for (auto& s : specs.specs) {
+    list.push_back(mb.CreateString(s));
+  }
+
+  const auto priority = ctx ? ctx->priority() : Priority::NORMAL;
   auto request_offset = CreateQueryPlanDirect(
     mb, id.c_str(), tbl.c_str(), filter.c_str(), customs.c_str(), &fields, &groups, &sorts,
-    q.sortType_ == SortType::DESC, q.limit_, window.first, window.second);
+    q.sortType_ == SortType::DESC, q.limit_, window.first, window.second, &subset,
+    ctx ? ctx->tenant().c_str() : nullptr, (int8_t)priority, &skips);
   mb.Finish(request_offset);
   return mb.ReleaseMessage<QueryPlan>();
 }
 
+SpecFilter QuerySerde::specs(const flatbuffers::grpc::Message<QueryPlan>* query) {
+  SpecFilter filter;
+  auto root = query->GetRoot();
+  auto list = root->specs();
+  if (list && list->size() > 0) {
+    filter.only = true;
+  } else {
+    list = root->skips();
+  }
+
+  if (list) {
+    for (auto itr = list->begin(); itr != list->end(); ++itr) {
+      filter.specs.emplace(itr->str());
+    }
+  }
+
+  return filter;
+}
+
+std::unique_ptr<QueryContext> QuerySerde::context(const flatbuffers::grpc::Message<QueryPlan>* query) {
+  auto plan = query->GetRoot();
+  auto ctx = QueryContext::def();
+  if (plan->user()) {
+    ctx = QueryContext::create(plan->user()->str(), { "nebula-users" });
+  }
+
+  // a priority out of known range from a peer is clamped rather than failing the block scheduler
+  const auto priority = std::clamp<int8_t>(plan->priority(), (int8_t)Priority::HIGH, (int8_t)Priority::LOW);
+  ctx->setPriority((Priority)priority);
+  return ctx;
+}
+
 // TODO(cao) - new fields are serialized by msgpack for simplicity such as "customs"
 // consider to convert all other fields using msgpack instead dealing with complex types in flatbuffer
 nebula::api::dsl::Query QuerySerde::deserialize(
@@ -285,9 +334,9 @@ nebula::api::dsl::Query QuerySerde::deserialize(
   return q;
 }
 
-std::unique_ptr<ExecutionPlan> QuerySerde::from(Query& q, size_t start, size_t end) {
-  // TODO(cao): serialize query context to nodes and mark compile method as const
-  auto plan = q.compile(QueryContext::def());
+std::unique_ptr<ExecutionPlan> QuerySerde::from(Query& q, size_t start, size_t end, std::unique_ptr<QueryContext> ctx) {
+  // TODO(cao): serialize full query context to nodes and mark compile method as const
+  auto plan = q.compile(ctx ? std::move(ctx) : QueryContext::def());
 
   // set a few other properties associated with execution plan
   plan->setWindow({ start, end });
@@ -349,7 +398,11 @@ RowCursorPtr BatchSerde::deserialize(const flatbuffers::grpc::Message<BatchRows>
 // serialize a ingest spec into a task spec to be sent over
 flatbuffers::grpc::Message<TaskSpec> TaskSerde::serialize(const Task& task) {
   flatbuffers::grpc::MessageBuilder mb;
+  mb.Finish(serialize(mb, task));
+  return mb.ReleaseMessage<TaskSpec>();
+}
 
+flatbuffers::Offset<TaskSpec> TaskSerde::serialize(flatbuffers::grpc::MessageBuilder& mb, const Task& task) {
   // this is an ingestion type
   const auto type = task.type();
   const auto sync = task.sync();
@@ -397,7 +450,8 @@ flatbuffers::grpc::Message<TaskSpec> TaskSerde::serialize(const Task& task) {
                          cp.withDict,
                          cp.withCompress,
                          mb.CreateString(cp.defaultValue),
-                         pi));
+                         pi,
+                         mb.CreateString(cp.codec)));
     }
     auto fbColProps = mb.CreateVector<flatbuffers::Offset<ColumnProp>>(colProps);
 
@@ -434,9 +488,7 @@ flatbuffers::grpc::Message<TaskSpec> TaskSerde::serialize(const Task& task) {
                                spec->macroDate());
 
     // create task spec
-    auto ts = CreateTaskSpec(mb, type, sync, it);
-    mb.Finish(ts);
-    return mb.ReleaseMessage<TaskSpec>();
+    return CreateTaskSpec(mb, type, sync, it);
   }
 
   // serialize task of expiration
@@ -454,9 +506,7 @@ flatbuffers::grpc::Message<TaskSpec> TaskSerde::serialize(const Task& task) {
     auto et = CreateExpireTask(mb, mb.CreateVector<flatbuffers::Offset<Spec>>(fbSpecs));
 
     // create task spec
-    auto ts = CreateTaskSpec(mb, type, sync, 0, et);
-    mb.Finish(ts);
-    return mb.ReleaseMessage<TaskSpec>();
+    return CreateTaskSpec(mb, type, sync, 0, et);
   }
 
   if (type == TaskType::COMMAND) {
@@ -464,9 +514,7 @@ flatbuffers::grpc::Message<TaskSpec> TaskSerde::serialize(const Task& task) {
     auto ct = CreateCommandTaskDirect(mb, spec->id().c_str());
 
     // create task spec
-    auto ts = CreateTaskSpec(mb, type, sync, 0, 0, ct);
-    mb.Finish(ts);
-    return mb.ReleaseMessage<TaskSpec>();
+    return CreateTaskSpec(mb, type, sync, 0, 0, ct);
   }
 
   throw NException(fmt::format("Unhandled task type: {0}", type));
@@ -474,8 +522,10 @@ flatbuffers::grpc::Message<TaskSpec> TaskSerde::serialize(const Task& task) {
 
 // parse a task spec into an ingest spec
 Task TaskSerde::deserialize(const flatbuffers::grpc::Message<TaskSpec>* ts) {
-  auto ptr = ts->GetRoot();
+  return deserialize(ts->GetRoot());
+}
 
+Task TaskSerde::deserialize(const TaskSpec* ptr) {
   const auto tst = ptr->type();
   const auto type = static_cast<TaskType>(tst);
   const auto sync = ptr->sync();
@@ -513,7 +563,8 @@ Task TaskSerde::deserialize(const flatbuffers::grpc::Message<TaskSpec>* ts) {
         itr->comp(),
         itr->dv()->str(),
         {},
-        std::move(partInfo)
+        std::move(partInfo),
+        itr->codec() ? itr->codec()->str() : ""
       };
     }
 
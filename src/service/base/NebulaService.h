@@ -24,6 +24,7 @@
 #include "api/dsl/Query.h"
 #include "common/Task.h"
 #include "execution/Context.h"
+#include "execution/TableState.h"
 #include "ingest/IngestSpec.h"
 #include "memory/keyed/FlatBuffer.h"
 #include "meta/ClusterInfo.h"
@@ -62,7 +63,8 @@ enum ErrorCode {
   FAIL_COMPILE_QUERY = 5,
   FAIL_EXECUTE_QUERY = 6,
   AUTH_REQUIRED = 7,
-  PERMISSION_REQUIRED = 8
+  PERMISSION_REQUIRED = 8,
+  MEMORY_EXCEEDED = 9
 };
 
 template <ErrorCode E>
@@ -113,6 +115,11 @@ struct ErrorTraits<ErrorCode::PERMISSION_REQUIRED> {
   static constexpr auto MESSAGE = "User Has No Permission To Execute";
 };
 
+template <>
+struct ErrorTraits<ErrorCode::MEMORY_EXCEEDED> {
+  static constexpr auto MESSAGE = "Query Exceeds Memory Budget, Try Fewer Dimensions Or A Shorter Time Range";
+};
+
 class ServiceProperties final {
 public:
   // nebula server listening port
@@ -139,9 +146,21 @@ public:
  */
 class QuerySerde {
 public:
-  static flatbuffers::grpc::Message<QueryPlan> serialize(const nebula::api::dsl::Query&, const std::string&, const nebula::execution::QueryWindow&);
+  static flatbuffers::grpc::Message<QueryPlan> serialize(
+    const nebula::api::dsl::Query&,
+    const std::string&,
+    const nebula::execution::QueryWindow&,
+    const nebula::execution::SpecFilter& = {},
+    const nebula::execution::QueryContext* = nullptr);
+
+  // spec filter of blocks the query scans in a node
+  static nebula::execution::SpecFilter specs(const flatbuffers::grpc::Message<QueryPlan>*);
+
+  // query context carrying tenant and priority of the query in a node
+  static std::unique_ptr<nebula::execution::QueryContext> context(const flatbuffers::grpc::Message<QueryPlan>*);
   static nebula::api::dsl::Query deserialize(const std::shared_ptr<nebula::meta::MetaService>, const flatbuffers::grpc::Message<QueryPlan>*);
-  static std::unique_ptr<nebula::execution::ExecutionPlan> from(nebula::api::dsl::Query&, size_t, size_t);
+  static std::unique_ptr<nebula::execution::ExecutionPlan> from(
+    nebula::api::dsl::Query&, size_t, size_t, std::unique_ptr<nebula::execution::QueryContext> = nullptr);
 };
 
 /**
@@ -164,6 +183,10 @@ public:
   // we have pair of methods for each task type
   static flatbuffers::grpc::Message<TaskSpec> serialize(const nebula::common::Task&);
   static nebula::common::Task deserialize(const flatbuffers::grpc::Message<TaskSpec>*);
+
+  // serde a task inside a message holding a batch of tasks
+  static flatbuffers::Offset<TaskSpec> serialize(flatbuffers::grpc::MessageBuilder&, const nebula::common::Task&);
+  static nebula::common::Task deserialize(const TaskSpec*);
 };
 
 } // namespace base
@@ -15,6 +15,7 @@
  */
 
 #include "NodeClient.h"
+#include "service/base/AsyncCall.h"
 #include "execution/BlockManager.h"
 
 /**
@@ -26,13 +27,17 @@ namespace node {
 
 using nebula::common::Task;
 using nebula::common::TaskState;
+using nebula::execution::BlockDelta;
 using nebula::execution::BlockManager;
+using nebula::execution::CancelToken;
 using nebula::execution::ExecutionPlan;
-using nebula::execution::TableStates;
+using nebula::execution::SpecFilter;
 using nebula::execution::io::BatchBlock;
 using nebula::meta::BlockSignature;
 using nebula::meta::BlockState;
 using nebula::service::base::BatchSerde;
+using nebula::service::base::ClientCall;
+using nebula::service::base::ClientQueue;
 using nebula::service::base::QuerySerde;
 using nebula::service::base::TaskSerde;
 using nebula::surface::EmptyRowCursor;
@@ -85,46 +90,89 @@ void NodeClient::echos(const std::string& name, size_t count) {
   }
 }
 
-folly::Future<RowCursorPtr> NodeClient::execute(const ExecutionPlan& plan) {
-  auto p = std::make_shared<folly::Promise<RowCursorPtr>>();
+folly::Future<RowCursorPtr> NodeClient::execute(const ExecutionPlan& plan, const SpecFilter& specs) {
+  using Reply = flatbuffers::grpc::Message<BatchRows>;
+  auto p = std::make_shared<folly::Promise<Reply>>();
   auto addr = node_.toString();
+  const auto& token = plan.ctx().token();
+  auto budget = plan.ctx().budget();
 
-  // pass values since we reutrn the whole lambda - don't reference temporary things
-  // such as local stack allocated variables, including "this" the client itself.
-  pool_.add([p, addr, q = query_, &plan]() {
-    // a response message placeholder
-    flatbuffers::grpc::Message<BatchRows> qr;
-
-    const Fields& f = plan.fetch<nebula::execution::PhaseType::PARTIAL>().fields();
-    auto qp = QuerySerde::serialize(*q, plan.id(), plan.getWindow());
-    grpc::ClientContext context;
-    auto channel = ConnectionPool::init()->connection(addr);
-    N_ENSURE(channel != nullptr, "requires a valid channel");
-    auto stub = nebula::service::NodeServer::NewStub(channel);
-    auto status = stub->Query(&context, qp, &qr);
-    if (status.ok()) {
-      auto& stats = plan.ctx().stats();
-      auto fb = BatchSerde::deserialize(&qr, f, stats);
-      stats.rowsRet += fb->size();
-      VLOG(1) << "Received batch as number of rows: " << fb->size();
+  auto channel = ConnectionPool::init()->connection(addr);
+  N_ENSURE(channel != nullptr, "requires a valid channel");
+  auto stub = nebula::service::NodeServer::NewStub(channel);
 
-      // update into current server block management
-      p->setValue(fb);
+  // the call is completed in the client queue thread, no thread waits for the node.
+  // pass values since the callback outlives this client, don't reference "this".
+  auto call = new ClientCall<Reply>([p, addr, token, budget](const grpc::Status& status, Reply& qr) {
+    if (status.ok()) {
+      p->setValue(std::move(qr));
       return;
     }
 
+    // a node running out of memory fails the query, stop waiting for other nodes
+    if (status.error_code() == grpc::StatusCode::RESOURCE_EXHAUSTED) {
+      budget->exceed();
+      token->cancel();
+    }
+
+    // fail the request, the caller may fail over to a replica or mark the result partial
     LOG(ERROR) << "Node failure: " << status.error_message();
-    // else return empty result set
-    p->setValue(EmptyRowCursor::instance());
+    p->setException(NException(fmt::format("Node {0} failed: {1}", addr, status.error_message())));
   });
 
-  return p->getFuture();
+  // a request losing to its hedge is cancelled by interrupting the returned future,
+  // node receives deadline of the query through rpc, and the rpc is cancelled with the query
+  auto shared = call->sharedContext();
+  p->setInterruptHandler([shared](const folly::exception_wrapper&) {
+    shared->TryCancel();
+  });
+
+  auto& context = call->context();
+  const auto deadline = token->deadline();
+  if (deadline != CancelToken::Clock::time_point::max()) {
+    context.set_deadline(std::chrono::system_clock::now() + (deadline - CancelToken::Clock::now()));
+  }
+
+  auto subscription = token->subscribe([shared]() { shared->TryCancel(); });
+  auto f = p->getFuture().ensure([token, subscription]() { token->unsubscribe(subscription); });
+
+  call->start(stub->PrepareAsyncQuery(
+    &context,
+    QuerySerde::serialize(*query_, plan.id(), plan.getWindow(), specs, &plan.ctx()),
+    ClientQueue::singleton().cq()));
+
+  // deserialize the reply in the pool rather than the queue thread.
+  // the plan may be released before a hedged request returns, access it under its guard.
+  return std::move(f)
+    .via(&pool_)
+    .thenValue([&plan, guard = plan.guard()](Reply qr) -> RowCursorPtr {
+      RowCursorPtr result = EmptyRowCursor::instance();
+      guard->run([&]() {
+        const Fields& f = plan.fetch<nebula::execution::PhaseType::PARTIAL>().fields();
+        auto& stats = plan.ctx().stats();
+        auto fb = BatchSerde::deserialize(&qr, f, stats);
+        stats.rowsRet += fb->size();
+        VLOG(1) << "Received batch as number of rows: " << fb->size();
+        result = fb;
+      });
+
+      return result;
+    });
 }
 
 void NodeClient::update() {
+  auto bm = BlockManager::init();
+  auto cursor = bm->cursor(node_);
+  BlockDelta delta;
+  if (poll(cursor.first, cursor.second, delta)) {
+    bm->apply(node_, std::move(delta));
+  }
+}
+
+bool NodeClient::poll(size_t epoch, size_t version, BlockDelta& delta) {
   // build request message through fb builder
   flatbuffers::grpc::MessageBuilder mb;
-  mb.Finish(nebula::service::CreateNodeStateRequest(mb, 1));
+  mb.Finish(nebula::service::CreateNodeStateRequest(mb, 1, epoch, version));
   auto nsRequest = mb.ReleaseMessage<NodeStateRequest>();
 
   // a response message placeholder
@@ -134,31 +182,34 @@ void NodeClient::update() {
   auto status = stub_->Poll(&context, nsRequest, &nsReply);
   if (status.ok()) {
     const NodeStateReply* response = nsReply.GetRoot();
+    delta.epoch = response->epoch();
+    delta.version = response->version();
+    delta.full = response->full();
+
     auto blocks = response->blocks();
-    size_t size = blocks->size();
-
-    // update into current server block management
-    TableStates states;
-    for (size_t i = 0; i < size; ++i) {
-      const DataBlock* db = blocks->Get(i);
-      auto block = std::make_shared<BatchBlock>(
-        BlockSignature{ db->tbl()->str(), db->id(), db->ts(), db->te(), db->spec()->str() },
+    delta.added.reserve(blocks->size());
+    for (auto itr = blocks->begin(); itr != blocks->end(); ++itr) {
+      delta.added.push_back(std::make_shared<BatchBlock>(
+        BlockSignature{ itr->tbl()->str(), itr->id(), itr->ts(), itr->te(), itr->spec()->str() },
         node_,
-        BlockState{ db->rows(), db->rsize() });
+        BlockState{ itr->rows(), itr->rsize() }));
+    }
 
-      // add this block in the new states
-      BlockManager::addBlock(states, block);
+    auto removed = response->removed();
+    if (removed) {
+      delta.removed.reserve(removed->size());
+      for (auto itr = removed->begin(); itr != removed->end(); ++itr) {
+        delta.removed.emplace_back(itr->tbl()->str(), itr->id(), itr->ts(), itr->te(), itr->spec()->str());
+      }
     }
 
-    // TODO(cao): only swap when there is change?
-    // swap the new states in
-    BlockManager::init()->swap(node_, states);
-    return;
+    return true;
   }
 
   LOG(ERROR) << "RPC failed to " << node_.server << ": code=" << status.error_code() << ", msg=" << status.error_message();
   // when this happens, we should try to rebuild the channel to this host
   ConnectionPool::init()->reset(node_);
+  return false;
 }
 
 TaskState NodeClient::task(const Task& task) {
@@ -174,6 +225,34 @@ TaskState NodeClient::task(const Task& task) {
   return TaskState::UNKNOWN;
 }
 
+std::vector<TaskState> NodeClient::tasks(const std::vector<Task>& list) {
+  flatbuffers::grpc::MessageBuilder mb;
+  std::vector<flatbuffers::Offset<TaskSpec>> specs;
+  specs.reserve(list.size());
+  for (const auto& t : list) {
+    specs.push_back(TaskSerde::serialize(mb, t));
+  }
+  mb.Finish(CreateTaskBatchDirect(mb, &specs));
+  auto message = mb.ReleaseMessage<TaskBatch>();
+
+  grpc::ClientContext context;
+  flatbuffers::grpc::Message<TaskBatchReply> reply;
+  auto status = stub_->Tasks(&context, message, &reply);
+  if (status.ok()) {
+    auto states = reply.GetRoot()->states();
+    std::vector<TaskState> result;
+    result.reserve(states->size());
+    for (auto itr = states->begin(); itr != states->end(); ++itr) {
+      result.push_back(static_cast<TaskState>(*itr));
+    }
+
+    return result;
+  }
+
+  LOG(ERROR) << "Batch task RPC failed to " << node_.server << ": " << status.error_message();
+  return std::vector<TaskState>(list.size(), TaskState::UNKNOWN);
+}
+
 } // namespace node
 } // namespace service
 } // namespace nebula
\ No newline at end of file
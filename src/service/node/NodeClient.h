@@ -57,15 +57,22 @@ public:
   // stream multiple responses based on count
   void echos(const std::string&, size_t);
 
-  // execute a plan on remote node
-  virtual folly::Future<nebula::surface::RowCursorPtr> execute(const nebula::execution::ExecutionPlan& plan) override;
+  // execute a plan on remote node, filtered by block specs
+  virtual folly::Future<nebula::surface::RowCursorPtr> execute(
+    const nebula::execution::ExecutionPlan& plan, const nebula::execution::SpecFilter& specs) override;
 
-  // pull node state
+  // pull node state and apply it in block manager
   virtual void update() override;
 
+  // poll block changes of the node since given epoch and version
+  virtual bool poll(size_t, size_t, nebula::execution::BlockDelta&) override;
+
   // send a task to a node
   virtual nebula::common::TaskState task(const nebula::common::Task&) override;
 
+  // send a batch of tasks to a node in one call
+  virtual std::vector<nebula::common::TaskState> tasks(const std::vector<nebula::common::Task>&) override;
+
 private:
   std::shared_ptr<nebula::api::dsl::Query> query_;
   std::unique_ptr<NodeServer::Stub> stub_;
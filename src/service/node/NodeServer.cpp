@@ -27,12 +27,22 @@
 #include "common/TaskScheduler.h"
 #include "execution/BlockManager.h"
 #include "execution/core/NodeExecutor.h"
+#include "execution/io/BlockStore.h"
 #include "execution/serde/RowCursorSerde.h"
+#include "ingest/BlockCompact.h"
+#include "ingest/BlockTier.h"
+#include "ingest/KafkaStream.h"
 #include "service/client/NebulaClient.h"
 #include "surface/DataSurface.h"
 
 DEFINE_int32(MAX_MSG_SIZE, 1073741824, "max message size sending between node and server, default to 1G");
 DEFINE_string(NSERVER, "", "discovery server address - host and port");
+DEFINE_uint64(KAFKA_STREAM_INTERVAL_MS, 500, "interval in ms to pump kafka streams hosted in this node");
+DEFINE_uint64(COMPACT_INTERVAL_MS, 60000, "interval in ms to compact small blocks in this node");
+DEFINE_uint64(TIER_INTERVAL_MS, 60000, "interval in ms to move cold blocks of this node to disk");
+DEFINE_uint32(IO_THREADS, 2, "number of completion queue threads serving rpc calls");
+DEFINE_uint32(INGEST_THREADS, 0, "number of threads for ingestion tasks, 0 to use a quarter of cores");
+DEFINE_uint64(BLOCK_CLAIM_SECONDS, 600, "seconds for blocks restored from local disk to be claimed by their specs");
 
 /**
  * Define node server that does the work as nebula server asks.
@@ -43,25 +53,36 @@ namespace node {
 
 using nebula::common::TaskState;
 using nebula::common::TaskType;
+using nebula::execution::BlockChange;
 using nebula::execution::BlockManager;
+using nebula::execution::ExecutionPlan;
 using nebula::execution::PhaseType;
 using nebula::execution::core::NodeExecutor;
 using nebula::execution::io::BatchBlock;
 using nebula::memory::keyed::FlatBuffer;
+using nebula::service::base::AsyncCancel;
+using nebula::service::base::AsyncDone;
 using nebula::service::base::BatchSerde;
 using nebula::service::base::QuerySerde;
 using nebula::service::base::TaskSerde;
+using nebula::service::base::UnaryCall;
 using nebula::surface::RowCursorPtr;
 
+NodeServerImpl::NodeServerImpl()
+  : tableService_{ nebula::execution::meta::TableService::singleton() },
+    threadPool_{ std::thread::hardware_concurrency(), 2 },
+    ingestPool_{ FLAGS_INGEST_THREADS > 0
+                   ? FLAGS_INGEST_THREADS
+                   : std::max(std::thread::hardware_concurrency() / 4, 1u) } {}
+
 // Single echo implementation
-grpc::Status NodeServerImpl::Echo(
-  grpc::ServerContext*,
-  const flatbuffers::grpc::Message<EchoPing>* request_msg,
+grpc::Status NodeServerImpl::echo(
+  const flatbuffers::grpc::Message<EchoPing>& request_msg,
   flatbuffers::grpc::Message<EchoReply>* response_msg) {
   flatbuffers::grpc::MessageBuilder mb;
   // We call GetRoot to "parse" the message. Verification is already
   // performed by default. See the notes below for more details.
-  const EchoPing* request = request_msg->GetRoot();
+  const EchoPing* request = request_msg.GetRoot();
 
   // Fields are retrieved as usual with FlatBuffers
   const std::string& name = request->name()->str();
@@ -108,45 +129,70 @@ grpc::Status NodeServerImpl::Echos(
 // TODO(cao) - we may want to change this endpoint as streaming
 // So that we don't need to do aggregation here, instead push all block executor results to server for aggregation.
 // Single aggregation - perf?
-grpc::Status NodeServerImpl::Query(
-  grpc::ServerContext*,
-  const flatbuffers::grpc::Message<QueryPlan>* query,
-  flatbuffers::grpc::Message<BatchRows>* batch) {
+AsyncCancel NodeServerImpl::query(
+  const grpc::ServerContext& ctx,
+  const flatbuffers::grpc::Message<QueryPlan>& query,
+  flatbuffers::grpc::Message<BatchRows>* batch,
+  AsyncDone done) {
 #ifdef PPROF
   ProfilerStart("/tmp/ns_query.out");
 #endif
+  std::shared_ptr<ExecutionPlan> plan;
+  folly::Future<RowCursorPtr> future = folly::Future<RowCursorPtr>::makeEmpty();
   try {
-    auto r = query->GetRoot();
-    auto q = QuerySerde::deserialize(tableService_, query);
-    auto plan = QuerySerde::from(q, r->tstart(), r->tend());
+    auto r = query.GetRoot();
+    auto q = QuerySerde::deserialize(tableService_, &query);
+    plan = QuerySerde::from(q, r->tstart(), r->tend(), QuerySerde::context(&query));
 
-    // execute this plan and get results
-    NodeExecutor executor(BlockManager::init());
-    auto cursor = executor.execute(threadPool_, *plan);
-    const auto& phase = plan->fetch<PhaseType::PARTIAL>();
-    const auto& buffer = nebula::execution::serde::asBuffer(*cursor, phase.outputSchema(), phase.fields());
+    // the query is abandoned when server passes its deadline or cancels the call
+    plan->ctx().token()->expireAt(ctx.deadline());
 
-    // serialize row cursor back
-    *batch = BatchSerde::serialize(*buffer, *plan);
+    // execute this plan without blocking, server may target a subset of blocks by specs
+    NodeExecutor executor(BlockManager::init());
+    future = executor.executeAsync(threadPool_, *plan, QuerySerde::specs(&query));
   } catch (const std::exception& exp) {
-    return grpc::Status(grpc::StatusCode::INTERNAL, exp.what());
+    done(grpc::Status(grpc::StatusCode::INTERNAL, exp.what()));
+    return {};
   }
 
+  // the plan is held by the continuation until its result is serialized
+  std::move(future).thenTry([plan, batch, done](folly::Try<RowCursorPtr>&& cursor) {
+    try {
+      const auto& phase = plan->fetch<PhaseType::PARTIAL>();
+      const auto& buffer = nebula::execution::serde::asBuffer(*cursor.value(), phase.outputSchema(), phase.fields());
+
+      // serialize row cursor back
+      *batch = BatchSerde::serialize(*buffer, *plan);
+    } catch (const nebula::common::MemoryExceededException& exp) {
+      // server fails the whole query instead of taking partial results
+      LOG(WARNING) << "Query exceeds memory budget: " << exp.what();
+      done(grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, exp.what()));
+      return;
+    } catch (const std::exception& exp) {
+      done(grpc::Status(grpc::StatusCode::INTERNAL, exp.what()));
+      return;
+    }
+
 #ifdef PPROF
-  ProfilerStop();
+    ProfilerStop();
 #endif
 
-  return grpc::Status::OK;
+    done(grpc::Status::OK);
+  });
+
+  return [token = plan->ctx().token()]() {
+    LOG(INFO) << "Query is cancelled by server.";
+    token->cancel();
+  };
 }
 
 // poll block status of a node
-grpc::Status NodeServerImpl::Poll(
-  grpc::ServerContext*,
-  const flatbuffers::grpc::Message<NodeStateRequest>* req,
+grpc::Status NodeServerImpl::poll(
+  const flatbuffers::grpc::Message<NodeStateRequest>& req,
   flatbuffers::grpc::Message<NodeStateReply>* rep) {
 
   // get node state request
-  const NodeStateRequest* request = req->GetRoot();
+  const NodeStateRequest* request = req.GetRoot();
 
   // Fields are retrieved as usual with FlatBuffers
   if (request->type() != 1) {
@@ -159,18 +205,38 @@ grpc::Status NodeServerImpl::Poll(
   const auto bm = BlockManager::init();
   flatbuffers::grpc::MessageBuilder mb;
   std::vector<flatbuffers::Offset<DataBlock>> db;
-  db.reserve(bm->numBlocks());
-  const auto& states = bm->states();
-  for (const auto& s : states) {
-    s.second->iterate([&mb, &db](const BatchBlock& bb) {
-      const auto& state = bb.state();
-      db.push_back(CreateDataBlockDirect(
-        mb, bb.table().c_str(), bb.getId(), bb.start(), bb.end(),
-        bb.spec().c_str(), bb.storage().c_str(), state.numRows, state.rawSize));
-    });
+  std::vector<flatbuffers::Offset<DataBlock>> removed;
+
+  // reply changes since the version server has seen if the journal covers it
+  std::vector<BlockChange> changes;
+  auto full = !bm->changes(request->epoch(), request->version(), changes);
+  auto version = request->version();
+  if (full) {
+    // take version before the blocks, changes after it may be replayed in next poll
+    version = bm->version();
+    db.reserve(bm->numBlocks());
+    const auto& states = bm->states();
+    for (const auto& s : states) {
+      s.second->iterate([&mb, &db](const BatchBlock& bb) {
+        const auto& state = bb.state();
+        db.push_back(CreateDataBlockDirect(
+          mb, bb.table().c_str(), bb.getId(), bb.start(), bb.end(),
+          bb.spec().c_str(), bb.storage().c_str(), state.numRows, state.rawSize));
+      });
+    }
+  } else {
+    // changes have one entry per block, splitting them into added and removed keeps their outcome
+    for (const auto& c : changes) {
+      const auto& sign = c.sign;
+      auto block = CreateDataBlockDirect(
+        mb, sign.table.c_str(), sign.id, sign.start, sign.end,
+        sign.spec.c_str(), nullptr, c.state.numRows, c.state.rawSize);
+      (c.added ? db : removed).push_back(block);
+      version = c.version;
+    }
   }
 
-  mb.Finish(CreateNodeStateReplyDirect(mb, &db));
+  mb.Finish(CreateNodeStateReplyDirect(mb, &db, &removed, bm->epoch(), version, full));
 
   // The `ReleaseMessage<T>()` function detaches the message from the
   // builder, so we can transfer the resopnse to gRPC while simultaneously
@@ -182,12 +248,11 @@ grpc::Status NodeServerImpl::Poll(
 }
 
 // poll block status of a node
-grpc::Status NodeServerImpl::Task(
-  grpc::ServerContext*,
-  const flatbuffers::grpc::Message<TaskSpec>* req,
+grpc::Status NodeServerImpl::task(
+  const flatbuffers::grpc::Message<TaskSpec>& req,
   flatbuffers::grpc::Message<TaskReply>* rep) {
   // deserialze a task
-  auto task = TaskSerde::deserialize(req);
+  auto task = TaskSerde::deserialize(&req);
 
   // execute it now and return result to client.
   // otherwise enqueue it to async task completion
@@ -206,6 +271,65 @@ grpc::Status NodeServerImpl::Task(
   return grpc::Status::OK;
 }
 
+// execute a batch of tasks in order
+grpc::Status NodeServerImpl::tasks(
+  const flatbuffers::grpc::Message<TaskBatch>& req,
+  flatbuffers::grpc::Message<TaskBatchReply>* rep) {
+  auto tasks = req.GetRoot()->tasks();
+  std::vector<int8_t> states;
+  states.reserve(tasks->size());
+  for (auto itr = tasks->begin(); itr != tasks->end(); ++itr) {
+    auto task = TaskSerde::deserialize(*itr);
+    auto result = task.sync()
+                    ? TaskExecutor::singleton().execute(std::move(task))
+                    : TaskExecutor::singleton().enqueue(std::move(task));
+    states.push_back((int8_t)result);
+  }
+
+  flatbuffers::grpc::MessageBuilder mb;
+  mb.Finish(CreateTaskBatchReplyDirect(mb, &states));
+  *rep = mb.ReleaseMessage<TaskBatchReply>();
+
+  return grpc::Status::OK;
+}
+
+void NodeServerImpl::listen(grpc::ServerCompletionQueue* cq) {
+  using flatbuffers::grpc::Message;
+  using EchoCall = UnaryCall<AsyncNodeService, Message<EchoPing>, Message<EchoReply>>;
+  using QueryCall = UnaryCall<AsyncNodeService, Message<QueryPlan>, Message<BatchRows>>;
+  using PollCall = UnaryCall<AsyncNodeService, Message<NodeStateRequest>, Message<NodeStateReply>>;
+  using TaskCall = UnaryCall<AsyncNodeService, Message<TaskSpec>, Message<TaskReply>>;
+  using TasksCall = UnaryCall<AsyncNodeService, Message<TaskBatch>, Message<TaskBatchReply>>;
+
+  // echo is cheap enough to be replied in the I/O thread
+  EchoCall::listen(this, &AsyncNodeService::RequestEcho, cq, [this](auto, const auto& req, auto rep, AsyncDone done) -> AsyncCancel {
+    done(echo(req, rep));
+    return {};
+  });
+
+  // query is scheduled in the pool and replied by its continuation
+  QueryCall::listen(this, &AsyncNodeService::RequestQuery, cq, [this](auto ctx, const auto& req, auto rep, AsyncDone done) -> AsyncCancel {
+    return query(*ctx, req, rep, std::move(done));
+  });
+
+  // poll and tasks may block on block manager or task execution, offload them to the pool
+  PollCall::listen(this, &AsyncNodeService::RequestPoll, cq, [this](auto, const auto& req, auto rep, AsyncDone done) -> AsyncCancel {
+    threadPool_.add([this, &req, rep, done]() { done(poll(req, rep)); });
+    return {};
+  });
+
+  // sync tasks run ingestion in place, keep them away from queries
+  TaskCall::listen(this, &AsyncNodeService::RequestTask, cq, [this](auto, const auto& req, auto rep, AsyncDone done) -> AsyncCancel {
+    ingestPool_.add([this, &req, rep, done]() { done(task(req, rep)); });
+    return {};
+  });
+
+  TasksCall::listen(this, &AsyncNodeService::RequestTasks, cq, [this](auto, const auto& req, auto rep, AsyncDone done) -> AsyncCancel {
+    ingestPool_.add([this, &req, rep, done]() { done(tasks(req, rep)); });
+    return {};
+  });
+}
+
 } // namespace node
 } // namespace service
 } // namespace nebula
@@ -230,12 +354,24 @@ void RunServer() {
     "0.0.0.0:{0}", nebula::service::base::ServiceProperties::NPORT);
   nebula::service::node::NodeServerImpl node;
 
+  // blocks kept on local disk are loaded before taking any task,
+  // they are served again once server assigns their specs to this node
+  nebula::execution::io::BlockStore::singleton().restore();
+
   grpc::ServerBuilder builder;
   builder.SetMaxReceiveMessageSize(FLAGS_MAX_MSG_SIZE);
   builder.SetMaxSendMessageSize(FLAGS_MAX_MSG_SIZE);
   builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
   builder.RegisterService(&node);
+
+  // a few I/O threads serve all calls, execution continues in the node pool
+  nebula::service::base::AsyncQueues queues(builder, FLAGS_IO_THREADS);
   std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
+  for (const auto& cq : queues.queues()) {
+    node.listen(cq.get());
+  }
+
+  queues.start();
   LOG(INFO) << "Nebula node listening on " << server_address;
 
   // run a task executor to
@@ -255,10 +391,39 @@ void RunServer() {
 
   taskScheduler.setInterval(
     1000,
-    [shutdownHandler, &priorityPool = node.pool()] {
+    [shutdownHandler, &priorityPool = node.ingestPool()] {
       nebula::service::node::TaskExecutor::singleton().process(shutdownHandler, priorityPool);
     });
 
+  // pump all kafka partition streams continuously, a round runs in the ingest pool
+  // so that the scheduler thread is not held by fetching
+  taskScheduler.setInterval(
+    FLAGS_KAFKA_STREAM_INTERVAL_MS,
+    [&priorityPool = node.ingestPool()] {
+      (void)nebula::ingest::KafkaStreams::singleton().pump(priorityPool);
+    });
+
+  // merge small blocks in background
+  taskScheduler.setInterval(
+    FLAGS_COMPACT_INTERVAL_MS,
+    [&priorityPool = node.ingestPool()] {
+      (void)nebula::ingest::BlockCompact::singleton().run(priorityPool);
+    });
+
+  // restored blocks not claimed in time belong to specs not hosted by this node any more
+  taskScheduler.setTimeout(
+    FLAGS_BLOCK_CLAIM_SECONDS * 1000,
+    [] {
+      nebula::execution::io::BlockStore::singleton().release();
+    });
+
+  // move cold blocks to disk in background
+  taskScheduler.setInterval(
+    FLAGS_TIER_INTERVAL_MS,
+    [&priorityPool = node.ingestPool()] {
+      (void)nebula::ingest::BlockTier::singleton().run(priorityPool);
+    });
+
   // for every second, ping discovery server
   const auto discovery = ReadNServer();
   const auto client = nebula::service::client::NebulaClient::make(discovery);
@@ -290,6 +455,9 @@ void RunServer() {
   // Wait for the server to shutdown. Note that some other thread must be
   // responsible for shutting down the server for this call to ever return.
   server->Wait();
+
+  // drain completion queues after server is down
+  queues.stop();
 }
 
 int main(int argc, char** argv) {
@@ -22,6 +22,7 @@
 #include "execution/meta/TableService.h"
 #include "node/node.grpc.fb.h"
 #include "node/node_generated.h"
+#include "service/base/AsyncCall.h"
 #include "service/base/NebulaService.h"
 
 /**
@@ -31,46 +32,58 @@ namespace nebula {
 namespace service {
 namespace node {
 
-class NodeServerImpl final : public NodeServer::Service {
-  virtual grpc::Status Echo(
-    grpc::ServerContext*,
-    const flatbuffers::grpc::Message<EchoPing>*,
-    flatbuffers::grpc::Message<EchoReply>*) override;
+// unary methods are served by completion queues, streaming echos stays synchronous
+using AsyncNodeService = NodeServer::WithAsyncMethod_Echo<
+  NodeServer::WithAsyncMethod_Query<
+    NodeServer::WithAsyncMethod_Poll<
+      NodeServer::WithAsyncMethod_Task<
+        NodeServer::WithAsyncMethod_Tasks<NodeServer::Service>>>>>;
 
+class NodeServerImpl final : public AsyncNodeService {
   virtual grpc::Status Echos(
     grpc::ServerContext*,
     const flatbuffers::grpc::Message<ManyEchoPings>*,
     grpc::ServerWriter<flatbuffers::grpc::Message<EchoReply>>*)
     override;
 
-  virtual grpc::Status Query(
-    grpc::ServerContext*,
-    const flatbuffers::grpc::Message<QueryPlan>*,
-    flatbuffers::grpc::Message<BatchRows>*)
-    override;
+  grpc::Status echo(
+    const flatbuffers::grpc::Message<EchoPing>&,
+    flatbuffers::grpc::Message<EchoReply>*);
 
-  virtual grpc::Status Poll(
-    grpc::ServerContext*,
-    const flatbuffers::grpc::Message<NodeStateRequest>*,
-    flatbuffers::grpc::Message<NodeStateReply>*)
-    override;
+  // query replies when its execution completes in the pool
+  nebula::service::base::AsyncCancel query(
+    const grpc::ServerContext&,
+    const flatbuffers::grpc::Message<QueryPlan>&,
+    flatbuffers::grpc::Message<BatchRows>*,
+    nebula::service::base::AsyncDone);
 
-  virtual grpc::Status Task(
-    grpc::ServerContext*,
-    const flatbuffers::grpc::Message<TaskSpec>*,
-    flatbuffers::grpc::Message<TaskReply>*)
-    override;
+  grpc::Status poll(
+    const flatbuffers::grpc::Message<NodeStateRequest>&,
+    flatbuffers::grpc::Message<NodeStateReply>*);
+
+  grpc::Status task(
+    const flatbuffers::grpc::Message<TaskSpec>&,
+    flatbuffers::grpc::Message<TaskReply>*);
+
+  grpc::Status tasks(
+    const flatbuffers::grpc::Message<TaskBatch>&,
+    flatbuffers::grpc::Message<TaskBatchReply>*);
 
 public:
-  NodeServerImpl()
-    : tableService_{ nebula::execution::meta::TableService::singleton() },
-      threadPool_{ std::thread::hardware_concurrency(), 2 } {}
+  NodeServerImpl();
   virtual ~NodeServerImpl() = default;
 
   folly::ThreadPoolExecutor& pool() {
     return threadPool_;
   }
 
+  folly::ThreadPoolExecutor& ingestPool() {
+    return ingestPool_;
+  }
+
+  // listen on all async methods in given completion queue
+  void listen(grpc::ServerCompletionQueue*);
+
 private:
   std::shared_ptr<nebula::execution::meta::TableService> tableService_;
 
@@ -78,8 +91,13 @@ private:
   // so we can add as many task as we want.
   // Initialize this pool with two priority queues:
   //    higher for query execution.
-  //    lower for task execution.
+  //    lower for rpc handlers.
+  // block tasks of queries are ordered by block scheduler on top of it.
   folly::CPUThreadPoolExecutor threadPool_;
+
+  // ingestion, kafka streams and compaction run in a separate pool
+  // so that ingestion bursts don't stall queries.
+  folly::CPUThreadPoolExecutor ingestPool_;
 };
 
 } // namespace node
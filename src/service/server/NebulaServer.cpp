@@ -29,6 +29,7 @@
 #include <thread>
 
 #include "NodeSync.h"
+#include "ResultCache.h"
 #include "common/Chars.h"
 #include "common/Evidence.h"
 #include "common/Folly.h"
@@ -37,6 +38,7 @@
 #include "common/Spark.h"
 #include "common/TaskScheduler.h"
 #include "execution/BlockManager.h"
+#include "execution/core/Admission.h"
 #include "execution/meta/TableService.h"
 #include "ingest/SpecRepo.h"
 #include "memory/Batch.h"
@@ -56,6 +58,7 @@ DEFINE_uint64(CLS_CONF_UPDATE_INTERVAL, 5000, "interval in milliseconds to updat
 DEFINE_uint64(NODE_SYNC_INTERVAL, 5000, "interval in ms to conduct node sync");
 DEFINE_uint32(MAX_TABLES_RETURN, 500, "max tables to fetch to display");
 DEFINE_int32(MAX_MSG_SIZE, 67108864, "max message size sending between server and client, default to 64M");
+DEFINE_uint32(IO_THREADS, 2, "number of completion queue threads serving rpc calls");
 
 /**
  * A cursor template that help iterating a container.
@@ -72,13 +75,18 @@ using grpc::StatusCode;
 using nebula::common::Chars;
 using nebula::common::Evidence;
 using nebula::common::Identifiable;
+using nebula::common::MemoryExceededException;
 using nebula::common::ParamList;
 using nebula::common::SingleCommandTask;
 using nebula::common::Task;
 using nebula::common::TaskState;
 using nebula::common::TaskType;
 using nebula::execution::BlockManager;
+using nebula::execution::CancelToken;
+using nebula::execution::ExecutionPlan;
 using nebula::execution::QueryContext;
+using nebula::execution::QueryWindow;
+using nebula::execution::core::Admission;
 using nebula::execution::io::BlockLoader;
 using nebula::execution::meta::TableService;
 using nebula::ingest::IngestSpec;
@@ -86,13 +94,17 @@ using nebula::ingest::SpecState;
 using nebula::memory::Batch;
 using nebula::meta::BlockSignature;
 using nebula::meta::ClusterInfo;
+using nebula::meta::DataSource;
 using nebula::meta::Table;
 using nebula::meta::TableSpec;
 using nebula::meta::TableSpecPtr;
 using nebula::service::ServiceInfo;
 using nebula::service::ServiceTier;
+using nebula::service::base::AsyncCancel;
+using nebula::service::base::AsyncDone;
 using nebula::service::base::ErrorCode;
 using nebula::service::base::ServiceProperties;
+using nebula::service::base::UnaryCall;
 using nebula::service::node::RemoteNodeConnector;
 using nebula::storage::NFileSystem;
 using nebula::surface::RowCursorPtr;
@@ -102,7 +114,7 @@ using nebula::type::Schema;
 using nebula::type::TypeNode;
 using nebula::type::TypeSerializer;
 
-Status V1ServiceImpl::Tables(ServerContext*, const ListTables* request, TableList* reply) {
+Status V1ServiceImpl::tables(ServerContext*, const ListTables* request, TableList* reply) {
   auto bm = BlockManager::init();
   auto limit = request->limit();
   if (limit < 1) {
@@ -124,7 +136,7 @@ Status V1ServiceImpl::Tables(ServerContext*, const ListTables* request, TableLis
   return Status::OK;
 }
 
-Status V1ServiceImpl::State(ServerContext*, const TableStateRequest* request, TableStateResponse* reply) {
+Status V1ServiceImpl::state(ServerContext*, const TableStateRequest* request, TableStateResponse* reply) {
   const auto& tbl = request->table();
   LOG(INFO) << "Look up state for table " << tbl;
   if (tbl.size() == 0) {
@@ -159,7 +171,7 @@ Status V1ServiceImpl::State(ServerContext*, const TableStateRequest* request, Ta
   return Status::OK;
 }
 
-Status V1ServiceImpl::Nuclear(ServerContext* ctx, const EchoRequest* req, EchoResponse* reply) {
+Status V1ServiceImpl::nuclear(ServerContext* ctx, const EchoRequest* req, EchoResponse* reply) {
   constexpr auto NUCLEAR = "_nuclear_";
   // message verification to ensure
   if (NUCLEAR == req->name()) {
@@ -209,7 +221,20 @@ std::unique_ptr<QueryContext> buildQueryContext(ServerContext* ctx) {
   return std::make_unique<QueryContext>(user, std::move(groups));
 }
 
-Status V1ServiceImpl::Load(ServerContext* ctx, const LoadRequest* req, LoadResponse* reply) {
+// a stream table keeps appending rows to open blocks in nodes, they are newer than its sealed blocks
+// and unknown to the block fingerprint, so results of a window reaching past sealed blocks are not cached.
+static bool streaming(const std::string& table, const QueryWindow& window) {
+  for (const auto& spec : ClusterInfo::singleton().tables()) {
+    if (spec->name == table) {
+      return spec->source == DataSource::KAFKA
+             && window.second >= BlockManager::init()->window(table).second;
+    }
+  }
+
+  return false;
+}
+
+Status V1ServiceImpl::load(ServerContext* ctx, const LoadRequest* req, LoadResponse* reply) {
   Evidence::Duration tick;
   // get query context
   auto context = buildQueryContext(ctx);
@@ -292,61 +317,113 @@ Status V1ServiceImpl::Load(ServerContext* ctx, const LoadRequest* req, LoadRespo
   return Status::CANCELLED;
 }
 
-Status V1ServiceImpl::Query(ServerContext* ctx, const QueryRequest* request, QueryResponse* reply) {
+void V1ServiceImpl::query(
+  ServerContext* ctx, const QueryRequest& request, QueryResponse* reply, AsyncDone done, std::shared_ptr<CancelToken> token) {
   // validate the query request and build the call
   Evidence::Duration tick;
   ErrorCode error = ErrorCode::NONE;
 
-  auto tableName = request->table();
+  auto tableName = request.table();
 
   // get the table registry and activate it by recording latest used time
   auto tr = TableService::singleton()->query(tableName);
   tr.activate();
 
   // build the query
-  auto query = handler_.build(*tr.table(), *request, error);
+  auto query = handler_.build(*tr.table(), request, error);
   if (error != ErrorCode::NONE) {
-    return replyError(error, reply, 0);
+    done(replyError(error, reply, 0));
+    return;
   }
 
-  // get query context
+  // get query context, its token is cancelled when the client abandons the call
   auto context = buildQueryContext(ctx);
+  context->setToken(token);
 
-  // compile query into a query plan
-  auto plan = handler_.compile(
-    query, { request->start(), request->end() }, std::move(context), error);
+  // compile query into a query plan, it is held by the continuation until reply is sent
+  std::shared_ptr<ExecutionPlan> plan = handler_.compile(
+    query, { request.start(), request.end() }, std::move(context), error);
   if (error != ErrorCode::NONE) {
-    return replyError(error, reply, 0);
+    done(replyError(error, reply, 0));
+    return;
   }
 
-  // create a remote connector and execute the query plan
-  auto connector = std::make_shared<RemoteNodeConnector>(query);
-  RowCursorPtr result = handler_.query(threadPool_, *plan, connector, error);
-  auto durationMs = tick.elapsedMs();
-  if (error != ErrorCode::NONE) {
-    return replyError(error, reply, durationMs);
+  // serve the cached result if blocks of the query window haven't changed since it was cached
+  const auto& window = plan->getWindow();
+  auto& cache = ResultCache::singleton();
+  auto key = ResultCache::key(request, plan->ctx().groups());
+  auto fingerprint = BlockManager::init()->fingerprint(tableName, window);
+  auto cacheable = !streaming(tableName, window);
+  if (cacheable && cache.get(key, fingerprint, *reply)) {
+    auto durationMs = tick.elapsedMs();
+    reply->mutable_stats()->set_querytimems(durationMs);
+    LOG(INFO) << "Served a cached query result in " << durationMs << "ms";
+    done(Status::OK);
+    return;
   }
 
-  // return normal serialized data
-  auto& queryStats = plan->ctx().stats();
-  auto stats = reply->mutable_stats();
-  stats->set_querytimems(durationMs);
-  stats->set_rowsscanned(queryStats.rowsScan);
-  stats->set_blocksscanned(queryStats.blocksScan);
-  stats->set_rowsreturn(queryStats.rowsRet);
-  LOG(INFO) << "Finished a query in " << durationMs << "ms for " << queryStats.toString();
-  tick.reset();
+  // estimate its cost to decide the priority of its block tasks in nodes
+  auto& queryContext = plan->ctx();
+  auto cost = BlockManager::init()->estimate(tableName, window);
+  queryContext.setPriority(Admission::classify(cost));
 
-  // TODO(cao) - use JSON for now, this should come from message request
-  // User/client can specify what kind of format of result it expects
-  reply->set_type(DataType::JSON);
-  reply->set_data(ServiceProperties::jsonify(result, plan->getOutputSchema()));
-  LOG(INFO) << "Serialize result to client takes " << tick.elapsedMs() << "ms";
+  // create a remote connector and execute the query plan once admitted, without blocking current thread.
+  // the admission ticket is held until execution completes.
+  auto connector = std::make_shared<RemoteNodeConnector>(query);
+  Admission::singleton()
+    .admit(queryContext.tenant(), cost, queryContext.token())
+    .via(&threadPool_)
+    .thenValue([this, plan, connector](Admission::TicketPtr ticket) {
+      return handler_.queryAsync(threadPool_, *plan, connector)
+        .thenValue([ticket](RowCursorPtr result) { return result; });
+    })
+    .thenTry([this, plan, connector, reply, done, tick, tableName, key = std::move(key), fingerprint, cacheable](
+               folly::Try<RowCursorPtr>&& result) mutable {
+      auto durationMs = tick.elapsedMs();
+      if (result.hasException()) {
+        LOG(ERROR) << "Error in executing query: " << result.exception().what();
+        auto code = result.exception().is_compatible_with<MemoryExceededException>()
+                      ? ErrorCode::MEMORY_EXCEEDED
+                      : ErrorCode::FAIL_EXECUTE_QUERY;
+        done(replyError(code, reply, durationMs));
+        return;
+      }
 
-  // counting how many queries we have successfully served
-  LOG(INFO) << "Total query served: " << handler_.meta()->incrementQueryServed();
+      // return normal serialized data
+      auto& queryStats = plan->ctx().stats();
+      auto stats = reply->mutable_stats();
+      stats->set_querytimems(durationMs);
+      stats->set_rowsscanned(queryStats.rowsScan);
+      stats->set_blocksscanned(queryStats.blocksScan);
+      stats->set_rowsreturn(queryStats.rowsRet);
+      stats->set_partial(plan->ctx().partial());
+      LOG(INFO) << "Finished a query in " << durationMs << "ms for " << queryStats.toString();
+      tick.reset();
+
+      // TODO(cao) - use JSON for now, this should come from message request
+      // User/client can specify what kind of format of result it expects
+      reply->set_type(DataType::JSON);
+      try {
+        reply->set_data(ServiceProperties::jsonify(result.value(), plan->getOutputSchema()));
+      } catch (const std::exception& exp) {
+        LOG(ERROR) << "Error in serializing query result: " << exp.what();
+        done(replyError(ErrorCode::FAIL_EXECUTE_QUERY, reply, durationMs));
+        return;
+      }
 
-  return Status::OK;
+      LOG(INFO) << "Serialize result to client takes " << tick.elapsedMs() << "ms";
+
+      // results of a query are complete only if every node answered in time
+      if (cacheable && !plan->ctx().partial()) {
+        const auto& window = plan->getWindow();
+        ResultCache::singleton().put(key, tableName, window.first, window.second, fingerprint, *reply);
+      }
+
+      // counting how many queries we have successfully served
+      LOG(INFO) << "Total query served: " << handler_.meta()->incrementQueryServed();
+
+      done(Status::OK);
+    });
 }
 
 Status V1ServiceImpl::replyError(ErrorCode code, QueryResponse* reply, size_t durationMs) const {
@@ -361,7 +438,7 @@ Status V1ServiceImpl::replyError(ErrorCode code, QueryResponse* reply, size_t du
   return Status(StatusCode::INTERNAL, error);
 }
 
-grpc::Status V1ServiceImpl::Url(grpc::ServerContext*, const UrlData* req, UrlData* res) {
+grpc::Status V1ServiceImpl::url(grpc::ServerContext*, const UrlData* req, UrlData* res) {
   const auto& code = req->code();
   const auto& raw = req->raw();
   // if code is available, fill the raw url into raw field
@@ -387,7 +464,7 @@ nebula::meta::NRole fromTier(ServiceTier tier) {
   }
 }
 
-grpc::Status V1ServiceImpl::Ping(grpc::ServerContext*, const ServiceInfo* si, PingResponse*) {
+grpc::Status V1ServiceImpl::ping(grpc::ServerContext*, const ServiceInfo* si, PingResponse*) {
   nebula::meta::NNode node{ fromTier(si->tier()), si->ipv4(), si->port() };
   if (node.server.size() == 0 || node.port == 0) {
     return grpc::Status(StatusCode::INVALID_ARGUMENT,
@@ -400,6 +477,54 @@ grpc::Status V1ServiceImpl::Ping(grpc::ServerContext*, const ServiceInfo* si, Pi
   return Status::OK;
 }
 
+// listen on a method whose handler replies synchronously,
+// the handler runs in the pool so that I/O threads are never blocked.
+template <typename Request, typename Reply>
+void offload(
+  V1ServiceImpl* service,
+  folly::ThreadPoolExecutor& pool,
+  grpc::ServerCompletionQueue* cq,
+  typename UnaryCall<AsyncV1Service, Request, Reply>::RequestMethod method,
+  Status (V1ServiceImpl::*handler)(ServerContext*, const Request*, Reply*)) {
+  UnaryCall<AsyncV1Service, Request, Reply>::listen(
+    service, method, cq, [service, &pool, handler](ServerContext* ctx, const Request& req, Reply* rep, AsyncDone done) -> AsyncCancel {
+      pool.add([service, handler, ctx, &req, rep, done]() {
+        done((service->*handler)(ctx, &req, rep));
+      });
+      return {};
+    });
+}
+
+void V1ServiceImpl::listen(grpc::ServerCompletionQueue* cq) {
+  offload(this, threadPool_, cq, &AsyncV1Service::RequestTables, &V1ServiceImpl::tables);
+  offload(this, threadPool_, cq, &AsyncV1Service::RequestState, &V1ServiceImpl::state);
+  offload(this, threadPool_, cq, &AsyncV1Service::RequestLoad, &V1ServiceImpl::load);
+  offload(this, threadPool_, cq, &AsyncV1Service::RequestNuclear, &V1ServiceImpl::nuclear);
+  offload(this, threadPool_, cq, &AsyncV1Service::RequestUrl, &V1ServiceImpl::url);
+  offload(this, threadPool_, cq, &AsyncV1Service::RequestPing, &V1ServiceImpl::ping);
+
+  // query is built in the pool and replied by the continuation of its execution
+  using QueryCall = UnaryCall<AsyncV1Service, QueryRequest, QueryResponse>;
+  // the query is cancelled if client cancels the call or goes away
+  QueryCall::listen(this, &AsyncV1Service::RequestQuery, cq, [this](ServerContext* ctx, const QueryRequest& req, QueryResponse* rep, AsyncDone done) -> AsyncCancel {
+    auto token = std::make_shared<CancelToken>();
+    token->expireAt(ctx->deadline());
+    threadPool_.add([this, ctx, &req, rep, done, token]() {
+      try {
+        query(ctx, req, rep, done, token);
+      } catch (const std::exception& exp) {
+        LOG(ERROR) << "Error in building query: " << exp.what();
+        done(Status(StatusCode::INTERNAL, exp.what()));
+      }
+    });
+
+    return [token]() {
+      LOG(INFO) << "Query is cancelled by client.";
+      token->cancel();
+    };
+  });
+}
+
 } // namespace server
 } // namespace service
 } // namespace nebula
@@ -442,14 +567,26 @@ void RunServer() {
   // Listen on the given address without any authentication mechanism.
   builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
   // Register "service" as the instance through which we'll communicate with
-  // clients. In this case it corresponds to an *synchronous* service.
+  // clients. In this case it corresponds to an *asynchronous* service served by completion queues.
   builder.RegisterService(&v1Service);
   // set compression level as medium
   builder.SetDefaultCompressionLevel(GRPC_COMPRESS_LEVEL_MED);
+  // a few I/O threads serve all calls, query execution continues in the service pool
+  nebula::service::base::AsyncQueues queues(builder, FLAGS_IO_THREADS);
   // Finally assemble the server.
   std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
+  for (const auto& cq : queues.queues()) {
+    v1Service.listen(cq.get());
+  }
+
+  queues.start();
   LOG(INFO) << "Nebula server listening on " << server_address;
 
+  // cached results are dropped once their blocks change in node sync
+  nebula::execution::BlockManager::init()->listen([](const std::string& table, size_t start, size_t end) {
+    nebula::service::server::ResultCache::singleton().invalidate(table, start, end);
+  });
+
   // a unique spec repo per server
   nebula::ingest::SpecRepo specRepo;
 
@@ -559,6 +696,9 @@ void RunServer() {
   // responsible for shutting down the server for this call to ever return.
   server->Wait();
 
+  // drain completion queues after server is down
+  queues.stop();
+
   // shut down node sync process
   // nsync->shutdown();
 }
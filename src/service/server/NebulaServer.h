@@ -22,6 +22,7 @@
 #include "QueryHandler.h"
 #include "meta/TestTable.h"
 #include "nebula.grpc.pb.h"
+#include "service/base/AsyncCall.h"
 
 /**
  * A cursor template that help iterating a container.
@@ -31,14 +32,30 @@ namespace nebula {
 namespace service {
 namespace server {
 
-class V1ServiceImpl final : public V1::Service {
-  grpc::Status Tables(grpc::ServerContext*, const ListTables*, TableList*);
-  grpc::Status State(grpc::ServerContext*, const TableStateRequest*, TableStateResponse*);
-  grpc::Status Query(grpc::ServerContext*, const QueryRequest*, QueryResponse*);
-  grpc::Status Nuclear(grpc::ServerContext*, const EchoRequest*, EchoResponse*);
-  grpc::Status Load(grpc::ServerContext*, const LoadRequest*, LoadResponse*);
-  grpc::Status Url(grpc::ServerContext*, const UrlData*, UrlData*);
-  grpc::Status Ping(grpc::ServerContext*, const ServiceInfo*, PingResponse*);
+// all methods are served by completion queues, echo is not implemented
+using AsyncV1Service = V1::WithAsyncMethod_Tables<
+  V1::WithAsyncMethod_State<
+    V1::WithAsyncMethod_Query<
+      V1::WithAsyncMethod_Load<
+        V1::WithAsyncMethod_Nuclear<
+          V1::WithAsyncMethod_Url<
+            V1::WithAsyncMethod_Ping<V1::Service>>>>>>>;
+
+class V1ServiceImpl final : public AsyncV1Service {
+  grpc::Status tables(grpc::ServerContext*, const ListTables*, TableList*);
+  grpc::Status state(grpc::ServerContext*, const TableStateRequest*, TableStateResponse*);
+  grpc::Status nuclear(grpc::ServerContext*, const EchoRequest*, EchoResponse*);
+  grpc::Status load(grpc::ServerContext*, const LoadRequest*, LoadResponse*);
+  grpc::Status url(grpc::ServerContext*, const UrlData*, UrlData*);
+  grpc::Status ping(grpc::ServerContext*, const ServiceInfo*, PingResponse*);
+
+  // query replies when its execution completes in the pool
+  void query(
+    grpc::ServerContext*,
+    const QueryRequest&,
+    QueryResponse*,
+    nebula::service::base::AsyncDone,
+    std::shared_ptr<nebula::execution::CancelToken>);
 
   // query handler to handle all the queries
   QueryHandler handler_;
@@ -51,6 +68,9 @@ public:
     return threadPool_;
   }
 
+  // listen on all async methods in given completion queue
+  void listen(grpc::ServerCompletionQueue*);
+
   void setShutdownHandler(std::function<void()>&& handler) {
     this->shutdownHandler_ = handler;
   }
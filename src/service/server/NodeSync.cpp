@@ -16,6 +16,8 @@
 
 #include "NodeSync.h"
 
+#include <atomic>
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include "common/Evidence.h"
@@ -29,6 +31,8 @@
 #include "service/node/NodeClient.h"
 #include "service/node/RemoteNodeConnector.h"
 
+DEFINE_uint32(NODE_SYNC_PARALLELISM, 16, "max number of nodes to talk to concurrently in one node sync");
+
 /**
  * Node Sync from "nodes" to "server"
  */
@@ -41,23 +45,44 @@ using nebula::common::Identifiable;
 using nebula::common::Task;
 using nebula::common::TaskState;
 using nebula::common::TaskType;
+using nebula::execution::BlockDelta;
 using nebula::execution::BlockManager;
-using nebula::execution::TableStates;
 using nebula::execution::meta::TableService;
 using nebula::ingest::BlockExpire;
+using nebula::ingest::IngestSpec;
 using nebula::ingest::SpecRepo;
 using nebula::ingest::SpecState;
 using nebula::meta::ClusterInfo;
 using nebula::meta::NNode;
+using nebula::meta::NodeEqual;
+using nebula::meta::NodeHash;
+
+// run func(i) for i in [0, size) on the pool with at most given number of concurrent workers
+static void parallel(folly::ThreadPoolExecutor& pool, size_t size, size_t parallelism, std::function<void(size_t)> func) {
+  auto next = std::make_shared<std::atomic<size_t>>(0);
+  const auto workers = std::min(size, std::max<size_t>(parallelism, 1));
+  std::vector<folly::Future<bool>> futures;
+  futures.reserve(workers);
+  for (size_t w = 0; w < workers; ++w) {
+    auto p = std::make_shared<folly::Promise<bool>>();
+    pool.add([p, next, size, &func]() {
+      for (auto i = next->fetch_add(1); i < size; i = next->fetch_add(1)) {
+        func(i);
+      }
+
+      p->setValue(true);
+    });
+    futures.push_back(p->getFuture());
+  }
+
+  folly::collectAll(futures).wait();
+}
 
 void NodeSync::sync(
   folly::ThreadPoolExecutor& pool,
   SpecRepo& specRepo) noexcept {
   const Evidence::Duration duration;
   auto connector = std::make_shared<node::RemoteNodeConnector>(nullptr);
-  // TODO(cao) - here, we may have incurred too many communications between server and nodes.
-  // we should batch all requests for each node and communicate once.
-  // but assuming changes delta won't be large in small cluster, should be fast enough for now
   const auto& ci = ClusterInfo::singleton();
   const auto& bm = BlockManager::init();
 
@@ -67,78 +92,90 @@ void NodeSync::sync(
   // clean table registry that past TTL
   TableService::singleton()->clean();
 
-  // do the spec assignment
-  auto nodesTalked = 0;
-
-  const auto& clusterNodes = ci.nodes();
   std::vector<NNode> nodes;
-  nodes.reserve(clusterNodes.size());
-  for (const auto& node : clusterNodes) {
+  for (const auto& node : ci.nodes()) {
     if (node.isActive()) {
-      // fetch node state in server
-      auto client = connector->makeClient(node, pool);
-      client->update();
-
-      // extracting all expired spec from existing blocks on this node
-      // make a copy since it's possible to be removed.
-      const auto& states = bm->states(node);
-
-      // recording expired block ID for given node
-      nebula::common::unordered_set<std::pair<std::string, std::string>> expired;
-      size_t memorySize = 0;
-      for (auto itr = states.begin(); itr != states.end(); ++itr) {
-        const auto& state = itr->second;
-        auto pairs = state->expired([&specRepo](bool ephemeral,
-                                                const std::string& table,
-                                                const std::string& spec,
-                                                const nebula::meta::NNode& node) -> bool {
-          // for ephemeral data, expire them only when their table is gone (TTL).
-          if (ephemeral) {
-            return !TableService::singleton()->exists(table);
-          }
-
-          // otherwise let spec repo to decide if we should expire it
-          return !specRepo.confirm(spec, node);
-        });
-
-        if (!pairs.empty()) {
-          // should be the same as std::unordered_set.merge
-          expired.insert(pairs.begin(), pairs.end());
+      nodes.push_back(node);
+    }
+  }
+
+  // poll block changes of all nodes concurrently,
+  // each node replies changes since the version server has applied.
+  const auto size = nodes.size();
+  std::vector<BlockDelta> deltas(size);
+  std::vector<char> polled(size, false);
+  parallel(pool, size, FLAGS_NODE_SYNC_PARALLELISM, [&](size_t i) {
+    const auto& node = nodes.at(i);
+    auto cursor = bm->cursor(node);
+    auto client = connector->makeClient(node, pool);
+    polled[i] = client->poll(cursor.first, cursor.second, deltas[i]);
+  });
+
+  // apply changes in current thread
+  size_t changes = 0;
+  for (size_t i = 0; i < size; ++i) {
+    if (polled[i]) {
+      changes += deltas[i].added.size() + deltas[i].removed.size();
+      bm->apply(nodes.at(i), std::move(deltas[i]));
+    }
+  }
+
+  // tasks to dispatch for each node
+  std::vector<std::vector<Task>> tasks(size);
+  std::vector<std::vector<std::shared_ptr<IngestSpec>>> specs(size);
+  for (size_t i = 0; i < size; ++i) {
+    auto& node = nodes.at(i);
+
+    // extracting all expired spec from existing blocks on this node
+    const auto& states = bm->states(node);
+
+    // recording expired block ID for given node
+    nebula::common::unordered_set<std::pair<std::string, std::string>> expired;
+    size_t memorySize = 0;
+    for (auto itr = states.begin(); itr != states.end(); ++itr) {
+      const auto& state = itr->second;
+      auto pairs = state->expired([&specRepo](bool ephemeral,
+                                              const std::string& table,
+                                              const std::string& spec,
+                                              const nebula::meta::NNode& node) -> bool {
+        // for ephemeral data, expire them only when their table is gone (TTL).
+        if (ephemeral) {
+          return !TableService::singleton()->exists(table);
         }
 
-        // TODO(cao): use memory size rather than data raw size
-        // accumulate memory usage for this node
-        memorySize += state->rawBytes();
-      }
+        // otherwise let spec repo to decide if we should expire it
+        return !specRepo.confirm(spec, node);
+      });
 
-      // sync expire task to node
-      const auto expireSize = expired.size();
-      if (expireSize > 0) {
-        Task t(TaskType::EXPIRATION, std::shared_ptr<Identifiable>(new BlockExpire(std::move(expired))));
-        TaskState state = client->task(t);
-        LOG(INFO) << fmt::format("Expire {0} specs in node {1}: {2}", expireSize, node.server, (char)state);
+      if (!pairs.empty()) {
+        // should be the same as std::unordered_set.merge
+        expired.insert(pairs.begin(), pairs.end());
       }
 
-      // call node state with expired spec list
-      nodesTalked++;
+      // TODO(cao): use memory size rather than data raw size
+      // accumulate memory usage for this node
+      memorySize += state->rawBytes();
+    }
 
-      // push a node with a size
-      NNode n{ node };
-      n.size = memorySize;
-      nodes.push_back(std::move(n));
+    // expire task goes first in the node batch
+    if (!expired.empty()) {
+      LOG(INFO) << fmt::format("Expire {0} specs in node {1}", expired.size(), node.server);
+      tasks[i].emplace_back(TaskType::EXPIRATION, std::shared_ptr<Identifiable>(new BlockExpire(std::move(expired))));
+      specs[i].push_back(nullptr);
     }
+
+    node.size = memorySize;
   }
 
-  // assign unassigned specs
-  // assign each spec to a node if it needs to be processed
-  // TODO(cao) - build resource constaints here to reach a balance
-  // for now, we just spin new specs into nodes with lower memory size
-  std::sort(nodes.begin(), nodes.end(), [](auto& n1, auto& n2) {
-    return n1.size < n2.size;
-  });
+  // assign unassigned specs through consistent hash placement with bounded load
   specRepo.assign(nodes);
 
-  // iterate over all specs, if it needs to be process, process it
+  // group ingestion tasks of all specs to sync by their nodes
+  nebula::common::unordered_map<NNode, size_t, NodeHash, NodeEqual> index;
+  for (size_t i = 0; i < size; ++i) {
+    index.emplace(nodes.at(i), i);
+  }
+
   auto taskNotified = 0;
   for (auto& spec : specRepo.specs()) {
     auto& sp = spec.second;
@@ -150,32 +187,65 @@ void NodeSync::sync(
       }
 
       if (sp->needSync()) {
+        auto found = index.find(sp->affinity());
+        if (found == index.end()) {
+          continue;
+        }
+
+        taskNotified++;
+        tasks[found->second].emplace_back(TaskType::INGESTION, std::static_pointer_cast<Identifiable>(sp));
+        specs[found->second].push_back(sp);
+      }
+
+      // replicas ingest the same spec independently, node dedups repeated tasks by signature.
+      // spec state is driven by its affinity node only.
+      for (const auto& r : sp->replicas()) {
+        auto found = index.find(r);
+        if (found == index.end() || bm->hasSpec(r, sp->table()->name, sp->id())) {
+          continue;
+        }
+
         taskNotified++;
+        tasks[found->second].emplace_back(TaskType::INGESTION, std::static_pointer_cast<Identifiable>(sp));
+        specs[found->second].push_back(nullptr);
+      }
+    }
+  }
 
-        // connect the node to sync the task over
-        auto client = connector->makeClient(sp->affinity(), pool);
+  // dispatch tasks of each node in one call concurrently
+  std::vector<std::vector<TaskState>> results(size);
+  parallel(pool, size, FLAGS_NODE_SYNC_PARALLELISM, [&](size_t i) {
+    if (!tasks[i].empty()) {
+      auto client = connector->makeClient(nodes.at(i), pool);
+      results[i] = client->tasks(tasks[i]);
+    }
+  });
 
-        // build a task out of this spec
-        Task t(TaskType::INGESTION, std::static_pointer_cast<Identifiable>(sp));
-        TaskState state = client->task(t);
+  // udpate spec states so that they won't be resent
+  for (size_t i = 0; i < size; ++i) {
+    for (size_t t = 0, count = std::min(tasks[i].size(), results[i].size()); t < count; ++t) {
+      auto& sp = specs[i][t];
+      const auto state = results[i][t];
+      if (sp == nullptr) {
+        continue;
+      }
 
-        // udpate spec state so that it won't be resent
-        if (state == TaskState::SUCCEEDED) {
-          sp->setState(SpecState::READY);
-        }
-        // we can remove its assigned node and wait it to be reassin to different node for retry
-        // but what if it keeps failing? we need counter for it
-        else if (state == TaskState::FAILED || state == TaskState::QUEUE) {
-          // TODO(cao) - post process for case if this task failed?
-          LOG(WARNING) << "Task " << t.signature() << " state: " << (char)state;
-        }
+      if (state == TaskState::SUCCEEDED) {
+        sp->setState(SpecState::READY);
+      }
+      // we can remove its assigned node and wait it to be reassin to different node for retry
+      // but what if it keeps failing? we need counter for it
+      else if (state == TaskState::FAILED || state == TaskState::QUEUE) {
+        // TODO(cao) - post process for case if this task failed?
+        LOG(WARNING) << "Task " << tasks[i][t].signature() << " state: " << (char)state;
       }
     }
   }
 
-  if (taskNotified > 0) {
+  if (taskNotified > 0 || changes > 0) {
     LOG(INFO) << "Communicated tasks=" << taskNotified
-              << " to nodes=" << nodesTalked
+              << " block changes=" << changes
+              << " to nodes=" << size
               << " using ms=" << duration.elapsedMs();
   }
 }
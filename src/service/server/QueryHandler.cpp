@@ -143,6 +143,16 @@ RowCursorPtr QueryHandler::query(
   }
 }
 
+folly::Future<RowCursorPtr> QueryHandler::queryAsync(
+  folly::ThreadPoolExecutor& pool,
+  const ExecutionPlan& plan,
+  const std::shared_ptr<NodeConnector> connector) const noexcept {
+  // failure in dispatching the plan is delivered through the future as well
+  return folly::makeFutureWith([&pool, &plan, connector]() {
+    return ServerExecutor(NNode::local().toString()).executeAsync(pool, plan, connector);
+  });
+}
+
 inline SortType orderTypeConvert(OrderType type) {
   return type == OrderType::DESC ? SortType::DESC : SortType::ASC;
 }
@@ -54,6 +54,13 @@ public:
     const std::shared_ptr<nebula::execution::core::NodeConnector> connector,
     nebula::service::base::ErrorCode&) const noexcept;
 
+  // execute the plan without blocking, execution failure is delivered through the future.
+  // the plan needs to live until the future completes.
+  folly::Future<nebula::surface::RowCursorPtr> queryAsync(
+    folly::ThreadPoolExecutor&,
+    const nebula::execution::ExecutionPlan&,
+    const std::shared_ptr<nebula::execution::core::NodeConnector> connector) const noexcept;
+
   inline std::shared_ptr<nebula::meta::MetaService> meta() const noexcept {
     return ms_;
   }
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ResultCache.h"
+
+#include <algorithm>
+#include <folly/compression/Compression.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+DEFINE_uint64(RESULT_CACHE_MB, 256, "memory in MB to cache query results in server, 0 to disable it");
+
+/**
+ * Cache of query results in nebula server.
+ */
+namespace nebula {
+namespace service {
+namespace server {
+
+// compress results in memory, they are small and decompressed fast
+static const auto& codec() {
+  static const auto codec = folly::io::getCodec(folly::io::CodecType::LZ4);
+  return codec;
+}
+
+ResultCache& ResultCache::singleton() {
+  static ResultCache cache{ FLAGS_RESULT_CACHE_MB << 20 };
+  return cache;
+}
+
+std::string ResultCache::key(const QueryRequest& request, const nebula::common::unordered_set<std::string>& groups) {
+  // deterministic serialization has a stable order for all fields
+  std::string bytes;
+  {
+    google::protobuf::io::StringOutputStream stream(&bytes);
+    google::protobuf::io::CodedOutputStream output(&stream);
+    output.SetSerializationDeterministic(true);
+    request.SerializeToCodedStream(&output);
+  }
+
+  // groups in sorted order
+  std::vector<std::string> sorted(groups.begin(), groups.end());
+  std::sort(sorted.begin(), sorted.end());
+  for (const auto& g : sorted) {
+    bytes.push_back('\0');
+    bytes.append(g);
+  }
+
+  return bytes;
+}
+
+bool ResultCache::get(const std::string& key, size_t fingerprint, QueryResponse& reply) {
+  std::string data;
+  size_t raw = 0;
+  {
+    std::lock_guard<std::mutex> lock(mux_);
+    auto found = index_.find(key);
+    if (found == index_.end() || found->second->fingerprint != fingerprint) {
+      ++misses_;
+      return false;
+    }
+
+    // move it to front as most recently used
+    entries_.splice(entries_.begin(), entries_, found->second);
+    const auto& entry = *found->second;
+    data = entry.data;
+    raw = entry.raw;
+    reply.mutable_stats()->CopyFrom(entry.stats);
+    reply.set_type(entry.type);
+    ++hits_;
+  }
+
+  reply.set_data(codec()->uncompress(data, raw));
+  return true;
+}
+
+void ResultCache::put(
+  const std::string& key,
+  const std::string& table,
+  size_t start,
+  size_t end,
+  size_t fingerprint,
+  const QueryResponse& reply) {
+  const auto& raw = reply.data();
+  if (capacity_ == 0 || raw.size() > capacity_ / 8) {
+    return;
+  }
+
+  auto data = codec()->compress(raw);
+  std::lock_guard<std::mutex> lock(mux_);
+  auto found = index_.find(key);
+  if (found != index_.end()) {
+    erase(found->second);
+  }
+
+  entries_.push_front(Entry{ key, table, start, end, fingerprint, std::move(data), raw.size(), reply.stats(), reply.type() });
+  index_.emplace(key, entries_.begin());
+  bytes_ += key.size() + entries_.front().data.size();
+
+  // evict least recently used ones
+  while (bytes_ > capacity_ && !entries_.empty()) {
+    erase(std::prev(entries_.end()));
+  }
+}
+
+void ResultCache::invalidate(const std::string& table, size_t start, size_t end) {
+  std::lock_guard<std::mutex> lock(mux_);
+  size_t count = 0;
+  for (auto itr = entries_.begin(); itr != entries_.end();) {
+    auto current = itr++;
+    if (current->table == table && current->start <= end && current->end >= start) {
+      erase(current);
+      ++count;
+    }
+  }
+
+  if (count > 0) {
+    VLOG(1) << "Invalidated " << count << " cached results of table " << table;
+  }
+}
+
+void ResultCache::erase(std::list<Entry>::iterator itr) {
+  bytes_ -= itr->key.size() + itr->data.size();
+  index_.erase(itr->key);
+  entries_.erase(itr);
+}
+
+} // namespace server
+} // namespace service
+} // namespace nebula
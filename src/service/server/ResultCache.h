@@ -0,0 +1,106 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <list>
+#include <mutex>
+
+#include "common/Hash.h"
+#include "nebula.pb.h"
+
+/**
+ * Cache of query results in nebula server.
+ * Dashboards keep refreshing the same queries while blocks of their windows rarely change.
+ * A result is keyed by the canonical form of its query request, and it is only served if
+ * the fingerprint of blocks in its window is still the same, so a hit is always exact.
+ * Entries of a table are invalidated once node sync observes block changes in their windows,
+ * results are compressed in memory and evicted in LRU order beyond the capacity in bytes.
+ */
+namespace nebula {
+namespace service {
+namespace server {
+
+class ResultCache {
+public:
+  explicit ResultCache(size_t capacity) : capacity_{ capacity }, bytes_{ 0 }, hits_{ 0 }, misses_{ 0 } {}
+  virtual ~ResultCache() = default;
+
+  // cache of the server sized by RESULT_CACHE_MB
+  static ResultCache& singleton();
+
+  // canonical form of a query request by user groups, the same for the same query regardless of how it is encoded.
+  // columns are masked by access rules of user groups, so users of different groups don't share results.
+  static std::string key(const QueryRequest&, const nebula::common::unordered_set<std::string>&);
+
+public:
+  // fill reply data and stats by the cached result of the key if its block fingerprint matches
+  bool get(const std::string&, size_t, QueryResponse&);
+
+  // cache the reply of a query for given table, window and block fingerprint
+  void put(const std::string&, const std::string&, size_t, size_t, size_t, const QueryResponse&);
+
+  // drop results of given table whose window overlaps given time range
+  void invalidate(const std::string&, size_t, size_t);
+
+  inline size_t size() const {
+    std::lock_guard<std::mutex> lock(mux_);
+    return entries_.size();
+  }
+
+  inline size_t bytes() const {
+    std::lock_guard<std::mutex> lock(mux_);
+    return bytes_;
+  }
+
+  inline std::pair<size_t, size_t> stats() const {
+    std::lock_guard<std::mutex> lock(mux_);
+    return { hits_, misses_ };
+  }
+
+private:
+  struct Entry {
+    std::string key;
+    std::string table;
+    size_t start;
+    size_t end;
+    size_t fingerprint;
+
+    // compressed result data and its raw size
+    std::string data;
+    size_t raw;
+    Statistics stats;
+    DataType type;
+  };
+
+  // remove an entry, lock is held by caller
+  void erase(std::list<Entry>::iterator);
+
+private:
+  const size_t capacity_;
+  mutable std::mutex mux_;
+
+  // most recently used at front
+  std::list<Entry> entries_;
+  nebula::common::unordered_map<std::string, std::list<Entry>::iterator> index_;
+  size_t bytes_;
+  size_t hits_;
+  size_t misses_;
+};
+
+} // namespace server
+} // namespace service
+} // namespace nebula
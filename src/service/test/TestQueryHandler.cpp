@@ -29,6 +29,7 @@
 #include "service/base/NebulaService.h"
 #include "service/node/RemoteNodeConnector.h"
 #include "service/server/QueryHandler.h"
+#include "service/server/ResultCache.h"
 #include "surface/DataSurface.h"
 #include "surface/MockSurface.h"
 #include "type/Serde.h"
@@ -51,6 +52,7 @@ using nebula::service::base::ErrorCode;
 using nebula::service::base::QuerySerde;
 using nebula::service::base::ServiceProperties;
 using nebula::service::server::QueryHandler;
+using nebula::service::server::ResultCache;
 using nebula::surface::RowCursorPtr;
 using nebula::surface::RowData;
 using nebula::type::Schema;
@@ -356,6 +358,59 @@ TEST(ServiceTest, TestDataSerde) {
   LOG(INFO) << "result is " << str1;
 }
 
+TEST(ServiceTest, TestResultCache) {
+  QueryRequest request;
+  request.set_table("nebula.test");
+  request.set_start(1000);
+  request.set_end(2000);
+  const nebula::common::unordered_set<std::string> groups{ "eng", "ads" };
+  auto key = ResultCache::key(request, groups);
+  EXPECT_EQ(key, ResultCache::key(QueryRequest(request), { "ads", "eng" }));
+
+  // users of other groups may see other columns masked
+  EXPECT_NE(key, ResultCache::key(request, { "eng" }));
+
+  QueryResponse reply;
+  reply.set_type(DataType::NATIVE);
+  reply.set_data(std::string(1024, 'x'));
+  reply.mutable_stats()->set_rowsscanned(99);
+
+  ResultCache cache{ 64 * 1024 };
+  cache.put(key, "nebula.test", 1000, 2000, 7, reply);
+  EXPECT_EQ(cache.size(), 1);
+
+  // hit only with the same block fingerprint
+  QueryResponse cached;
+  EXPECT_FALSE(cache.get(key, 8, cached));
+  EXPECT_TRUE(cache.get(key, 7, cached));
+  EXPECT_EQ(cached.data(), reply.data());
+  EXPECT_EQ(cached.stats().rowsscanned(), 99);
+  EXPECT_EQ(cache.stats(), std::make_pair<size_t, size_t>(1, 1));
+
+  // block changes out of its window or in other tables keep it
+  cache.invalidate("nebula.test", 3000, 4000);
+  cache.invalidate("nebula.other", 1500, 1600);
+  EXPECT_EQ(cache.size(), 1);
+  cache.invalidate("nebula.test", 1500, 1600);
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_EQ(cache.bytes(), 0);
+
+  // least recently used ones are evicted beyond capacity, random data is not compressible
+  std::string random(1024, 0);
+  for (auto i = 0; i < 100; ++i) {
+    std::generate(random.begin(), random.end(), std::rand);
+    request.set_end(2000 + i);
+    reply.set_data(random);
+    cache.put(ResultCache::key(request, groups), "nebula.test", 1000, 2000 + i, i, reply);
+  }
+
+  EXPECT_LE(cache.bytes(), 64 * 1024);
+  EXPECT_LT(cache.size(), 100);
+  EXPECT_TRUE(cache.get(ResultCache::key(request, groups), 99, cached));
+  request.set_end(2000);
+  EXPECT_FALSE(cache.get(ResultCache::key(request, groups), 0, cached));
+}
+
 } // namespace test
 } // namespace service
 } // namespace nebula
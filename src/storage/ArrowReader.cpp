@@ -0,0 +1,326 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ArrowReader.h"
+#include <arrow/ipc/reader.h>
+#include <cstring>
+#include <fmt/format.h>
+#include <glog/logging.h>
+#include "common/Likely.h"
+
+/**
+ * Arrow IPC reader to read a local arrow file and produce Nebula rows.
+ */
+namespace nebula {
+namespace storage {
+
+using nebula::memory::DataNode;
+using nebula::surface::IndexType;
+using nebula::surface::ListData;
+using nebula::surface::MapData;
+using nebula::surface::RowData;
+using nebula::type::Kind;
+using nebula::type::Schema;
+
+#define ARROW_ENSURE(EXP, MSG)                                        \
+  {                                                                   \
+    auto status = (EXP);                                              \
+    N_ENSURE(status.ok(), fmt::format("{0}: {1}", MSG, status.ToString())); \
+  }
+
+// arrow IPC file format starts with magic bytes, stream format does not
+static constexpr std::string_view ARROW_MAGIC = "ARROW1";
+
+// check if an arrow type can be read as the nebula kind
+static bool compatible(Kind kind, const arrow::DataType& type) {
+  switch (kind) {
+  case Kind::BOOLEAN: return type.id() == arrow::Type::BOOL;
+  case Kind::TINYINT: return type.id() == arrow::Type::INT8;
+  case Kind::SMALLINT: return type.id() == arrow::Type::INT16;
+  case Kind::INTEGER: return type.id() == arrow::Type::INT32;
+  case Kind::BIGINT: return type.id() == arrow::Type::INT64;
+  case Kind::REAL: return type.id() == arrow::Type::FLOAT;
+  case Kind::DOUBLE: return type.id() == arrow::Type::DOUBLE;
+  case Kind::VARCHAR: {
+    if (type.id() == arrow::Type::DICTIONARY) {
+      return compatible(kind, *static_cast<const arrow::DictionaryType&>(type).value_type());
+    }
+
+    return type.id() == arrow::Type::STRING || type.id() == arrow::Type::BINARY;
+  }
+  default: return false;
+  }
+}
+
+ArrowRow::ArrowRow(Schema schema) : row_{ 0 } {
+  for (size_t i = 0, size = schema->size(); i < size; ++i) {
+    auto type = schema->childType(i);
+    names_.push_back(type->name());
+    kinds_.push_back(type->k());
+  }
+
+  layout_ = std::make_shared<const std::vector<std::string>>(names_);
+  slots_.resize(names_.size());
+}
+
+void ArrowRow::bind(const arrow::RecordBatch& batch) {
+  columns_.clear();
+  const auto& schema = *batch.schema();
+  for (int i = 0, size = batch.num_columns(); i < size; ++i) {
+    ArrowColumn c{ batch.column(i), nullptr, nullptr };
+
+    // dictionary column is read through its indices
+    if (c.array->type_id() == arrow::Type::DICTIONARY) {
+      const auto& dict = static_cast<const arrow::DictionaryArray&>(*c.array);
+      c.indices = dict.indices();
+      c.dict = dict.dictionary();
+    }
+
+    columns_[schema.field(i)->name()] = std::move(c);
+  }
+
+  // resolve slots and validate types once per record batch
+  for (size_t i = 0, size = names_.size(); i < size; ++i) {
+    const auto& name = names_.at(i);
+    auto itr = columns_.find(name);
+    if (itr == columns_.end()) {
+      slots_[i] = {};
+      continue;
+    }
+
+    const auto& type = *itr->second.array->type();
+    if (!compatible(kinds_.at(i), type)) {
+      throw NException(fmt::format("Type mismatch for column {0}: {1} to {2}.", name, type.ToString(), kinds_.at(i)));
+    }
+
+    slots_[i] = itr->second;
+  }
+}
+
+const ArrowColumn& ArrowRow::column(const std::string& field) const {
+  static const ArrowColumn ABSENT{ nullptr, nullptr, nullptr };
+  auto itr = columns_.find(field);
+  return itr == columns_.end() ? ABSENT : itr->second;
+}
+
+std::string_view ArrowRow::view(const ArrowColumn& c, int64_t row) const {
+  auto values = c.array.get();
+  auto index = row;
+
+  // look up dictionary value by index
+  if (c.indices != nullptr) {
+    values = c.dict.get();
+    switch (c.indices->type_id()) {
+    case arrow::Type::INT8: index = static_cast<const arrow::Int8Array&>(*c.indices).Value(row); break;
+    case arrow::Type::INT16: index = static_cast<const arrow::Int16Array&>(*c.indices).Value(row); break;
+    case arrow::Type::INT32: index = static_cast<const arrow::Int32Array&>(*c.indices).Value(row); break;
+    case arrow::Type::INT64: index = static_cast<const arrow::Int64Array&>(*c.indices).Value(row); break;
+    default: throw NException("Unsupported dictionary index type");
+    }
+  }
+
+  int32_t len = 0;
+  auto ptr = static_cast<const arrow::BinaryArray*>(values)->GetValue(index, &len);
+  return std::string_view((const char*)ptr, len);
+}
+
+bool ArrowRow::isNull(const std::string& field) const {
+  const auto& array = column(field).array;
+  return array == nullptr || array->IsNull(row_);
+}
+
+bool ArrowRow::isNull(IndexType slot) const {
+  const auto& array = slots_[slot].array;
+  return array == nullptr || array->IsNull(row_);
+}
+
+// slot columns are validated in bind, name lookup may hit columns out of schema
+#define READ_VALUE(TYPE, FUNC, ARRAY, ID)                                                            \
+  TYPE ArrowRow::FUNC(IndexType slot) const {                                                        \
+    return static_cast<const arrow::ARRAY&>(*slots_[slot].array).Value(row_);                        \
+  }                                                                                                  \
+  TYPE ArrowRow::FUNC(const std::string& field) const {                                              \
+    const auto& array = column(field).array;                                                         \
+    N_ENSURE(array != nullptr && array->type_id() == arrow::Type::ID, "type mismatch in " #FUNC); \
+    return static_cast<const arrow::ARRAY&>(*array).Value(row_);                                     \
+  }
+
+READ_VALUE(bool, readBool, BooleanArray, BOOL)
+READ_VALUE(int8_t, readByte, Int8Array, INT8)
+READ_VALUE(int16_t, readShort, Int16Array, INT16)
+READ_VALUE(int32_t, readInt, Int32Array, INT32)
+READ_VALUE(int64_t, readLong, Int64Array, INT64)
+READ_VALUE(float, readFloat, FloatArray, FLOAT)
+READ_VALUE(double, readDouble, DoubleArray, DOUBLE)
+
+#undef READ_VALUE
+
+std::string_view ArrowRow::readString(IndexType slot) const {
+  return view(slots_[slot], row_);
+}
+
+std::string_view ArrowRow::readString(const std::string& field) const {
+  const auto& c = column(field);
+  N_ENSURE(c.array != nullptr && compatible(Kind::VARCHAR, *c.array->type()), "type mismatch in readString");
+  return view(c, row_);
+}
+
+void ArrowRow::fill(size_t slot, DataNode& node, int64_t offset, size_t count) const {
+  const auto& c = slots_.at(slot);
+  if (c.array == nullptr) {
+    for (size_t i = 0; i < count; ++i) {
+      node.appendNull();
+    }
+    return;
+  }
+
+  // bits of the validity bitmap are counted from the start of its buffer, not the array slice
+  const auto& array = *c.array;
+  const uint8_t* validity = array.null_count() > 0 ? array.null_bitmap_data() : nullptr;
+  const auto bit = array.offset() + offset;
+
+#define FILL_VALUES(KIND, ARRAY)                                                                         \
+  case Kind::KIND: {                                                                                     \
+    node.appendValues(static_cast<const arrow::ARRAY&>(array).raw_values() + offset, count, validity, bit); \
+    break;                                                                                               \
+  }
+
+  switch (kinds_.at(slot)) {
+    FILL_VALUES(TINYINT, Int8Array)
+    FILL_VALUES(SMALLINT, Int16Array)
+    FILL_VALUES(INTEGER, Int32Array)
+    FILL_VALUES(BIGINT, Int64Array)
+    FILL_VALUES(REAL, FloatArray)
+    FILL_VALUES(DOUBLE, DoubleArray)
+  case Kind::BOOLEAN: {
+    // booleans are bit packed in arrow
+    const auto& bools = static_cast<const arrow::BooleanArray&>(array);
+    for (size_t i = 0; i < count; ++i) {
+      const auto row = offset + i;
+      if (bools.IsNull(row)) {
+        node.appendNull();
+      } else {
+        node.append<bool>(bools.Value(row));
+      }
+    }
+    break;
+  }
+  case Kind::VARCHAR: {
+    for (size_t i = 0; i < count; ++i) {
+      const auto row = offset + i;
+      if (array.IsNull(row)) {
+        node.appendNull();
+      } else {
+        node.append<std::string_view>(view(c, row));
+      }
+    }
+    break;
+  }
+  default:
+    throw NException(fmt::format("Unsupported column kind to fill: {0}", kinds_.at(slot)));
+  }
+
+#undef FILL_VALUES
+}
+
+#define NOT_SUPPORTED(TYPE, FUNC)                         \
+  TYPE ArrowRow::FUNC(IndexType) const {                  \
+    throw NException(#FUNC " not supported in arrow row"); \
+  }                                                       \
+  TYPE ArrowRow::FUNC(const std::string&) const {         \
+    throw NException(#FUNC " not supported in arrow row"); \
+  }
+
+NOT_SUPPORTED(int128_t, readInt128)
+NOT_SUPPORTED(std::unique_ptr<ListData>, readList)
+NOT_SUPPORTED(std::unique_ptr<MapData>, readMap)
+
+#undef NOT_SUPPORTED
+
+ArrowReader::ArrowReader(const std::string& file, Schema schema)
+  : nebula::surface::RowCursor(0),
+    batch_{ 0 },
+    cursor_{ 0 },
+    rows_{ 0 },
+    row_{ schema } {
+  ARROW_ENSURE(arrow::io::MemoryMappedFile::Open(file, arrow::io::FileMode::READ, &file_), "failed to map arrow file")
+
+  // file format has a footer to locate record batches, stream format has to be scanned.
+  // either way record batches are zero-copy slices of the mapped file.
+  std::shared_ptr<arrow::Buffer> magic;
+  ARROW_ENSURE(file_->ReadAt(0, ARROW_MAGIC.size(), &magic), "failed to read arrow file")
+  if (magic->size() == (int64_t)ARROW_MAGIC.size()
+      && std::memcmp(magic->data(), ARROW_MAGIC.data(), ARROW_MAGIC.size()) == 0) {
+    std::shared_ptr<arrow::ipc::RecordBatchFileReader> reader;
+    ARROW_ENSURE(arrow::ipc::RecordBatchFileReader::Open(file_.get(), &reader), "invalid arrow file")
+    for (int i = 0, size = reader->num_record_batches(); i < size; ++i) {
+      std::shared_ptr<arrow::RecordBatch> batch;
+      ARROW_ENSURE(reader->ReadRecordBatch(i, &batch), "failed to read record batch")
+      batches_.push_back(std::move(batch));
+    }
+  } else {
+    std::shared_ptr<arrow::RecordBatchReader> reader;
+    ARROW_ENSURE(file_->Seek(0), "failed to read arrow stream")
+    ARROW_ENSURE(arrow::ipc::RecordBatchStreamReader::Open(file_, &reader), "invalid arrow stream")
+    while (true) {
+      std::shared_ptr<arrow::RecordBatch> batch;
+      ARROW_ENSURE(reader->ReadNext(&batch), "failed to read record batch")
+      if (batch == nullptr) {
+        break;
+      }
+
+      batches_.push_back(std::move(batch));
+    }
+  }
+
+  for (const auto& batch : batches_) {
+    size_ += batch->num_rows();
+  }
+
+  LOG(INFO) << "Mapped arrow file " << file << " with " << batches_.size() << " batches and " << size_ << " rows";
+}
+
+#undef ARROW_ENSURE
+
+bool ArrowReader::nextBatch() {
+  if (batch_ >= batches_.size()) {
+    return false;
+  }
+
+  const auto& batch = batches_.at(batch_++);
+  row_.bind(*batch);
+  rows_ = batch->num_rows();
+  cursor_ = rows_;
+  index_ += rows_;
+  return true;
+}
+
+const RowData& ArrowReader::next() {
+  // move to next non-empty record batch
+  while (UNLIKELY(cursor_ == rows_)) {
+    const auto& batch = batches_.at(batch_++);
+    row_.bind(*batch);
+    cursor_ = 0;
+    rows_ = batch->num_rows();
+  }
+
+  row_.seek(cursor_++);
+  index_++;
+  return row_;
+}
+
+} // namespace storage
+} // namespace nebula
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <string>
+#include <vector>
+
+#include "common/Errors.h"
+#include "common/Hash.h"
+#include "memory/DataNode.h"
+#include "surface/DataSurface.h"
+#include "type/Type.h"
+
+/**
+ * Arrow IPC reader to read a local arrow file in either file format (feather v2)
+ * or stream format and produce Nebula rows.
+ * The file is memory mapped, record batches reference the mapped region directly,
+ * and rows are views over arrow arrays - no value is copied until it lands in a batch.
+ */
+namespace nebula {
+namespace storage {
+
+// an arrow column resolved by name in a record batch
+struct ArrowColumn {
+  // column array, nullptr if the column is absent in the batch
+  std::shared_ptr<arrow::Array> array;
+  // indices and values of a dictionary encoded column
+  std::shared_ptr<arrow::Array> indices;
+  std::shared_ptr<arrow::Array> dict;
+};
+
+// a row view over a record batch, fields are addressable by name or
+// by slot of the given schema so that a batch can append it positionally.
+class ArrowRow : public nebula::surface::RowData {
+public:
+  ArrowRow(nebula::type::Schema);
+  virtual ~ArrowRow() = default;
+
+public:
+  // bind a record batch, validating column types against the schema
+  void bind(const arrow::RecordBatch&);
+
+  // move to given row in current record batch
+  inline void seek(int64_t row) noexcept {
+    row_ = row;
+  }
+
+  // append a run of rows of the column in given slot to a data node in bulk,
+  // fixed width values are copied from the value buffer along with the validity bitmap.
+  void fill(size_t slot, nebula::memory::DataNode&, int64_t offset, size_t count) const;
+
+  const nebula::surface::Slots& slots() const noexcept override {
+    return layout_;
+  }
+
+  bool isNull(const std::string&) const override;
+  bool isNull(nebula::surface::IndexType) const override;
+
+#define INTERFACE_IMPL(TYPE, FUNC)                           \
+  TYPE FUNC(const std::string&) const override;              \
+  TYPE FUNC(nebula::surface::IndexType) const override;
+
+  INTERFACE_IMPL(bool, readBool)
+  INTERFACE_IMPL(int8_t, readByte)
+  INTERFACE_IMPL(int16_t, readShort)
+  INTERFACE_IMPL(int32_t, readInt)
+  INTERFACE_IMPL(int64_t, readLong)
+  INTERFACE_IMPL(float, readFloat)
+  INTERFACE_IMPL(double, readDouble)
+  INTERFACE_IMPL(int128_t, readInt128)
+  INTERFACE_IMPL(std::string_view, readString)
+  INTERFACE_IMPL(std::unique_ptr<nebula::surface::ListData>, readList)
+  INTERFACE_IMPL(std::unique_ptr<nebula::surface::MapData>, readMap)
+
+#undef INTERFACE_IMPL
+
+private:
+  const ArrowColumn& column(const std::string&) const;
+  std::string_view view(const ArrowColumn&, int64_t) const;
+
+private:
+  std::vector<std::string> names_;
+  nebula::surface::Slots layout_;
+  std::vector<nebula::type::Kind> kinds_;
+
+  // columns of current record batch by slot and by name
+  std::vector<ArrowColumn> slots_;
+  nebula::common::unordered_map<std::string, ArrowColumn> columns_;
+  int64_t row_;
+};
+
+// create an arrow reader to provide nebula rows
+// passed-in schema specifies layout of the produced rows using name matching,
+// fields absent in the file are read as NULL.
+class ArrowReader : public nebula::surface::RowCursor {
+public:
+  ArrowReader(const std::string& file, nebula::type::Schema schema);
+  virtual ~ArrowReader() = default;
+
+  virtual const nebula::surface::RowData& next() override;
+
+  // move to next record batch and bind the row to it, return false if no more.
+  // it is an alternative of next() to consume the file batch by batch, they are not mixed.
+  bool nextBatch();
+
+  // the row bound to current record batch and number of rows in it
+  inline ArrowRow& row() noexcept {
+    return row_;
+  }
+
+  inline int64_t batchRows() const noexcept {
+    return rows_;
+  }
+
+  virtual std::unique_ptr<nebula::surface::RowData> item(size_t) const override {
+    throw NException("Arrow Reader does not support random access by row number");
+  }
+
+private:
+  std::shared_ptr<arrow::io::MemoryMappedFile> file_;
+  std::vector<std::shared_ptr<arrow::RecordBatch>> batches_;
+
+  // next record batch and cursor in current one
+  size_t batch_;
+  int64_t cursor_;
+  int64_t rows_;
+
+  // the row to be visited
+  ArrowRow row_;
+};
+
+} // namespace storage
+} // namespace nebula
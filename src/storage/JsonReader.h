@@ -24,6 +24,7 @@
 #include "RowParser.h"
 #include "common/Conv.h"
 #include "common/Errors.h"
+#include "common/Likely.h"
 #include "memory/FlatRow.h"
 #include "meta/Table.h"
 #include "surface/DataSurface.h"
@@ -38,7 +39,14 @@ namespace storage {
 // represent a reusable row object with single line content
 // we can always parse line for a row object
 class JsonRow final : public RowParser {
-  using fop = std::function<void(nebula::memory::FlatRow&, const std::string&, const rapidjson::Value&)>;
+  // a desired column: its name, slot in a bound flat row and how it is written
+  struct JsonField;
+  using fop = std::function<void(nebula::memory::FlatRow&, const JsonField&, const rapidjson::Value&)>;
+  struct JsonField {
+    std::string name;
+    size_t slot;
+    fop write;
+  };
 
 public:
   JsonRow(nebula::type::Schema schema, bool nullDefault = true)
@@ -47,20 +55,19 @@ public:
 // define how each column read and write to row object
 // if the provided value is string, we use safe_to to convert it to desired type without exception
 // other excpetions, we let it throw
-#define CASE_POP(K, F)                                                                              \
-  case nebula::type::Kind::K: {                                                                     \
-    using T = nebula::type::TypeTraits<nebula::type::Kind::K>;                                      \
-    func_.emplace(name,                                                                             \
-                  [](nebula::memory::FlatRow& r, const std::string& n, const rapidjson::Value& v) { \
-                    if (v.IsNull()) {                                                               \
-                      r.write(n, nebula::type::TypeDetect<T::CppType>::value);                      \
-                    } else if (v.IsString()) {                                                      \
-                      r.write(n, nebula::common::safe_to<T::CppType>(v.GetString()));               \
-                    } else {                                                                        \
-                      r.write(n, (T::CppType)v.F());                                                \
-                    }                                                                               \
-                  });                                                                               \
-    break;                                                                                          \
+#define CASE_POP(K, F)                                                                           \
+  case nebula::type::Kind::K: {                                                                  \
+    using T = nebula::type::TypeTraits<nebula::type::Kind::K>;                                   \
+    add(name, [](nebula::memory::FlatRow& r, const JsonField& f, const rapidjson::Value& v) {    \
+      if (v.IsNull()) {                                                                          \
+        put(r, f, nebula::type::TypeDetect<T::CppType>::value);                                  \
+      } else if (v.IsString()) {                                                                 \
+        put(r, f, nebula::common::safe_to<T::CppType>(v.GetString()));                          \
+      } else {                                                                                   \
+        put(r, f, (T::CppType)v.F());                                                            \
+      }                                                                                          \
+    });                                                                                          \
+    break;                                                                                       \
   }
 
     for (size_t i = 0; i < schema_->size(); ++i) {
@@ -78,22 +85,23 @@ public:
         CASE_POP(REAL, GetFloat)
         CASE_POP(DOUBLE, GetDouble)
       case nebula::type::Kind::VARCHAR:
-        func_.emplace(name,
-                      [](nebula::memory::FlatRow& r, const std::string& n, const rapidjson::Value& v) {
-                        // is null or is not expected string type (malformed data) - Nebula enforce types.
-                        // we have chance to compatible with other types and convert them into string, such as numbers.
-                        if (v.IsNull() || !v.IsString()) {
-                          r.write(n, "");
-                        } else {
-                          r.write(n, v.GetString(), v.GetStringLength());
-                        }
-                      });
+        add(name, [](nebula::memory::FlatRow& r, const JsonField& f, const rapidjson::Value& v) {
+          // is null or is not expected string type (malformed data) - Nebula enforce types.
+          // we have chance to compatible with other types and convert them into string, such as numbers.
+          if (v.IsNull() || !v.IsString()) {
+            put(r, f, "", 0);
+          } else {
+            put(r, f, v.GetString(), v.GetStringLength());
+          }
+        });
         break;
 
       default:
         throw NException("Type not supported in Json Reader");
       }
     }
+
+#undef CASE_POP
   }
 
   ~JsonRow() = default;
@@ -110,6 +118,11 @@ public:
       return false;
     }
 
+    // field slots are resolved once per row layout
+    if (UNLIKELY(row.slots().get() != layout_.get())) {
+      bind(row);
+    }
+
     auto ptr = static_cast<char*>(buf);
 
     // (Worth A Note)
@@ -132,16 +145,21 @@ public:
     auto obj = doc.GetObject();
     for (auto& m : obj) {
       auto name = m.name.GetString();
+
+      // look up the populate function to set the value
+      // we do search here to support JSON has more fields than client wants
+      auto f = fields_.find(name);
       if (m.value.IsNull() && !nullDefault_) {
-        row.writeNull(name);
+        if (f != fields_.end()) {
+          nullify(row, f->second);
+        } else {
+          row.writeNull(name);
+        }
         continue;
       }
 
-      // look up the populate function to set the value
-      // we do search here to support JSON has more fields than client wants
-      auto f = func_.find(name);
-      if (f != func_.end()) {
-        f->second(row, name, m.value);
+      if (f != fields_.end()) {
+        f->second.write(row, f->second, m.value);
       }
     }
 
@@ -149,14 +167,49 @@ public:
   }
 
   virtual void nullify(nebula::memory::FlatRow& row) noexcept override {
+    if (UNLIKELY(row.slots().get() != layout_.get())) {
+      bind(row);
+    }
+
     // write everything a null if encoutering an invalid message
     row.reset();
     if (!hasTime()) {
       row.write(nebula::meta::Table::TIME_COLUMN, 0l);
     }
 
-    for (auto itr = func_.cbegin(); itr != func_.cend(); ++itr) {
-      row.writeNull(itr->first);
+    for (auto itr = fields_.cbegin(); itr != fields_.cend(); ++itr) {
+      nullify(row, itr->second);
+    }
+  }
+
+private:
+  inline void add(const std::string& name, fop write) {
+    fields_.emplace(name, JsonField{ name, nebula::memory::FlatRow::NO_SLOT, std::move(write) });
+  }
+
+  // resolve slot of every field in a row with a new slot layout
+  void bind(const nebula::memory::FlatRow& row) noexcept {
+    layout_ = row.slots();
+    for (auto& f : fields_) {
+      f.second.slot = row.slot(f.second.name);
+    }
+  }
+
+  // write a field by its slot if the row is bound to it, otherwise by its name
+  template <typename... Args>
+  static inline void put(nebula::memory::FlatRow& r, const JsonField& f, Args&&... args) {
+    if (f.slot != nebula::memory::FlatRow::NO_SLOT) {
+      r.write(f.slot, std::forward<Args>(args)...);
+    } else {
+      r.write(f.name, std::forward<Args>(args)...);
+    }
+  }
+
+  static inline void nullify(nebula::memory::FlatRow& r, const JsonField& f) {
+    if (f.slot != nebula::memory::FlatRow::NO_SLOT) {
+      r.writeNull(f.slot);
+    } else {
+      r.writeNull(f.name);
     }
   }
 
@@ -167,8 +220,9 @@ private:
   // flag to indicate if current schema has time column incldued
   bool hasTime_;
 
-  // column writer lambda
-  nebula::common::unordered_map<std::string, fop> func_;
+  // desired fields by name and the slot layout they are resolved against
+  nebula::common::unordered_map<std::string, JsonField> fields_;
+  nebula::surface::Slots layout_;
 };
 
 class JsonReader : public nebula::surface::RowCursor {
@@ -180,6 +234,9 @@ public:
       fstream_{ file },
       json_{ schema, nullDefault },
       row_{ SLICE_SIZE } {
+    // fields are written and read by slots of the schema
+    row_.bind(schema);
+
     // read first line to initialize cursor state
     if (std::getline(fstream_, line_)) {
       ++size_;
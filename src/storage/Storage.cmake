@@ -3,12 +3,14 @@ set(NEBULA_STORAGE NStorage)
 # build nebula.api library
 # target_include_directories(${NEBULA_META} INTERFACE src/meta)
 add_library(${NEBULA_STORAGE} STATIC 
+    ${NEBULA_SRC}/storage/ArrowReader.cpp
     ${NEBULA_SRC}/storage/CsvReader.cpp
     ${NEBULA_SRC}/storage/NFS.cpp
     ${NEBULA_SRC}/storage/ParquetReader.cpp
     ${NEBULA_SRC}/storage/ThriftReader.cpp
     ${NEBULA_SRC}/storage/aws/S3.cpp
     ${NEBULA_SRC}/storage/http/Http.cpp
+    ${NEBULA_SRC}/storage/kafka/KafkaPartition.cpp
     ${NEBULA_SRC}/storage/kafka/KafkaProvider.cpp
     ${NEBULA_SRC}/storage/kafka/KafkaReader.cpp
     ${NEBULA_SRC}/storage/kafka/KafkaTopic.cpp
@@ -26,6 +28,7 @@ target_link_libraries(${NEBULA_STORAGE}
 
 #build test binary
 add_executable(StorageTests
+    ${NEBULA_SRC}/storage/test/TestArrowReader.cpp
     ${NEBULA_SRC}/storage/test/TestHttp.cpp
     ${NEBULA_SRC}/storage/test/TestJsonReader.cpp
     ${NEBULA_SRC}/storage/test/TestKafka.cpp
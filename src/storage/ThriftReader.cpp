@@ -42,12 +42,33 @@ using nebula::memory::FlatRow;
 using nebula::meta::Table;
 
 constexpr auto LEVEL = 1'000;
+constexpr auto NO_SLOT = FlatRow::NO_SLOT;
+
+// parsing states of a thrift message
+struct ThriftContext {
+  TMemoryBuffer& buffer;
+  TBinaryProtocol& proto;
+  const unordered_map<uint32_t, ThriftField>& fields;
+  unordered_set<uint32_t>& fieldsWritten;
+  bool views;
+  size_t written;
+
+  // record a field written, only fields without slot need the set to track
+  inline void mark(uint32_t id, size_t slot) {
+    ++written;
+    if (slot == NO_SLOT) {
+      fieldsWritten.emplace(id);
+    }
+  }
+
+  inline bool isWritten(uint32_t id, size_t slot, const FlatRow& row) const {
+    return slot != NO_SLOT ? row.written(slot) : fieldsWritten.find(id) != fieldsWritten.end();
+  }
+};
+
+void readStruct(uint64_t base, ThriftContext& ctx, FlatRow& row) {
+  auto& proto = ctx.proto;
 
-void readStruct(uint64_t base,
-                TBinaryProtocol& proto,
-                unordered_map<uint32_t, std::string>& fields,
-                unordered_set<uint32_t>& fieldsWritten,
-                FlatRow& row) {
   // field name?
   std::string name;
 
@@ -67,37 +88,68 @@ void readStruct(uint64_t base,
     // adjustment based on base
     auto levelId = id + base;
 
-    // look up which column name this is for
+    // look up which column this is for
     // TODO(cao): I don't know why the same ID will hit twice here
     // let use the first one before figuring out the reason
-    auto w = fieldsWritten.find(levelId);
-    auto f = fields.find(levelId);
+    auto f = ctx.fields.find(levelId);
+    auto desired = f != ctx.fields.end();
+    const auto slot = desired ? f->second.slot : NO_SLOT;
+    if (desired) {
+      // bound row tracks written slots itself, no need a set lookup
+      desired = !ctx.isWritten(levelId, slot, row);
+    }
 
     // if this is not written yet and it's a desired field
-    if (w == fieldsWritten.end() && f != fields.end()) {
-      auto name = f->second;
+    if (desired) {
+      const auto& field = f->second;
 
       // time field special handling
-      if (UNLIKELY(name == Table::TIME_COLUMN)) {
+      if (UNLIKELY(field.time)) {
         int64_t time = Evidence::unix_timestamp();
         proto.readI64(time);
-        row.write(name, Evidence::to_seconds(time));
-        fieldsWritten.emplace(levelId);
+        row.write(field.name, Evidence::to_seconds(time));
+        ctx.mark(levelId, slot);
         proto.readFieldEnd();
         continue;
       }
 
-#define TYPE_EXTRACT(T, CT, M)      \
-  case TType::T: {                  \
-    CT v;                           \
-    proto.M(v);                     \
-    row.write(name, v);             \
-    fieldsWritten.emplace(levelId); \
-    break;                          \
+#define TYPE_EXTRACT(T, CT, M)        \
+  case TType::T: {                    \
+    CT v;                             \
+    proto.M(v);                       \
+    if (slot != NO_SLOT) {            \
+      row.write(slot, v);             \
+    } else {                          \
+      row.write(field.name, v);       \
+    }                                 \
+    ctx.mark(levelId, slot);          \
+    break;                            \
   }
 
       switch (type) {
-        TYPE_EXTRACT(T_STRING, std::string, readBinary)
+      case TType::T_STRING: {
+        if (slot != NO_SLOT && ctx.views) {
+          // binary protocol string: 4 bytes size + bytes, reference bytes in the buffer directly
+          int32_t size = 0;
+          proto.readI32(size);
+          uint32_t len = size;
+          auto ptr = ctx.buffer.borrow(nullptr, &len);
+          N_ENSURE(size >= 0 && ptr != nullptr, "truncated thrift string");
+          row.view(slot, reinterpret_cast<const char*>(ptr), size);
+          ctx.buffer.consume(size);
+        } else {
+          std::string v;
+          proto.readBinary(v);
+          if (slot != NO_SLOT) {
+            row.write(slot, v.data(), v.size());
+          } else {
+            row.write(field.name, v);
+          }
+        }
+
+        ctx.mark(levelId, slot);
+        break;
+      }
         TYPE_EXTRACT(T_BOOL, bool, readBool)
         TYPE_EXTRACT(T_BYTE, int8_t, readByte)
         TYPE_EXTRACT(T_I16, int16_t, readI16)
@@ -109,8 +161,12 @@ void readStruct(uint64_t base,
         TType elemType = apache::thrift::protocol::T_STOP;
         uint32_t listSize;
         proto.readListBegin(elemType, listSize);
-        row.write(name, listSize);
-        fieldsWritten.emplace(levelId);
+        if (slot != NO_SLOT) {
+          row.write(slot, listSize);
+        } else {
+          row.write(field.name, listSize);
+        }
+        ctx.mark(levelId, slot);
         proto.readListEnd();
         break;
       }
@@ -125,7 +181,7 @@ void readStruct(uint64_t base,
       // support simple nesting
       proto.readStructBegin(name);
       // recursively
-      readStruct(levelId * LEVEL, proto, fields, fieldsWritten, row);
+      readStruct(levelId * LEVEL, ctx, row);
       proto.readStructEnd();
     } else {
       proto.skip(type);
@@ -135,25 +191,39 @@ void readStruct(uint64_t base,
   }
 }
 
+void ThriftRow::bind(const FlatRow& row) noexcept {
+  layout_ = row.slots();
+  for (auto& f : fields_) {
+    f.second.slot = row.slot(f.second.name);
+  }
+}
+
 bool ThriftRow::parse(void* buf, size_t size, nebula::memory::FlatRow& row) noexcept {
+  // field slots are resolved once per row layout
+  if (UNLIKELY(row.slots().get() != layout_.get())) {
+    bind(row);
+  }
+
   auto buffer = std::make_shared<TMemoryBuffer>(static_cast<uint8_t*>(buf), size);
   TBinaryProtocol proto(buffer);
 
-  // read all fields
+  // read all fields, written fields are tracked in a set only when row is not bound
   const auto numFields = fields_.size();
   unordered_set<uint32_t> fieldsWritten;
-  fieldsWritten.reserve(numFields);
+  if (layout_ == nullptr) {
+    fieldsWritten.reserve(numFields);
+  }
 
   // TODO(cao): ID path hack, every time it enter into a new level, it times 10K to get next field ID
   // current field;
-  readStruct(0, proto, fields_, fieldsWritten, row);
+  ThriftContext ctx{ *buffer, proto, fields_, fieldsWritten, views_, 0 };
+  readStruct(0, ctx, row);
 
   // in case anything happened, not all fields found from this message
-  const auto numWritten = fieldsWritten.size();
-  if (UNLIKELY(numWritten < numFields)) {
+  if (UNLIKELY(ctx.written < numFields)) {
     for (auto itr = fields_.cbegin(); itr != fields_.cend(); ++itr) {
-      if (fieldsWritten.find(itr->first) == fieldsWritten.end()) {
-        row.writeNull(itr->second);
+      if (!ctx.isWritten(itr->first, itr->second.slot, row)) {
+        row.writeNull(itr->second.name);
       }
     }
   }
@@ -26,15 +26,25 @@
 namespace nebula {
 namespace storage {
 
+// a desired field of thrift object: column name and its slot in a bound flat row
+struct ThriftField {
+  std::string name;
+  size_t slot;
+  bool time;
+};
+
 // Represents a reusable thrift object.
 class ThriftRow final : public RowParser {
 public:
-  ThriftRow(const nebula::common::unordered_map<std::string, uint32_t>& cmap)
-    : hasTime_{ false } {
+  // views: string fields reference the message buffer rather than copied into row,
+  // only use it when the buffer outlives the reads of parsed row.
+  ThriftRow(const nebula::common::unordered_map<std::string, uint32_t>& cmap, bool views = false)
+    : hasTime_{ false }, views_{ views } {
     // reverse mapping of name -> id
     for (auto itr = cmap.begin(); itr != cmap.end(); ++itr) {
-      fields_.emplace(itr->second, itr->first);
-      if (itr->first == nebula::meta::Table::TIME_COLUMN) {
+      auto time = itr->first == nebula::meta::Table::TIME_COLUMN;
+      fields_.emplace(itr->second, ThriftField{ itr->first, nebula::memory::FlatRow::NO_SLOT, time });
+      if (time) {
         hasTime_ = true;
       }
     }
@@ -57,14 +67,21 @@ public:
     }
 
     for (auto itr = fields_.cbegin(); itr != fields_.cend(); ++itr) {
-      row.writeNull(itr->second);
+      row.writeNull(itr->second.name);
     }
   }
 
+private:
+  // resolve slot of every field when the row comes with a new slot layout
+  void bind(const nebula::memory::FlatRow&) noexcept;
+
 private:
   bool hasTime_;
-  // reverse the fields mapping from field ID -> name
-  nebula::common::unordered_map<uint32_t, std::string> fields_;
+  bool views_;
+  // reverse the fields mapping from field ID -> field
+  nebula::common::unordered_map<uint32_t, ThriftField> fields_;
+  // slot layout the fields are resolved against
+  nebula::surface::Slots layout_;
 };
 } // namespace storage
 } // namespace nebula
\ No newline at end of file
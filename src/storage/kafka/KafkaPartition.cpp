@@ -0,0 +1,154 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "KafkaPartition.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "common/Likely.h"
+
+DEFINE_uint64(KAFKA_CONSUME_BATCH, 1000, "max number of messages per kafka consume call");
+DEFINE_uint64(KAFKA_CONSUME_DEADLINE_MS, 200, "max time in ms waiting for a batch of kafka messages");
+
+/**
+ * A long-lived consumer bound to a single topic partition.
+ */
+namespace nebula {
+namespace storage {
+namespace kafka {
+
+bool KafkaPartition::watermark(int64_t& low, int64_t& high) const noexcept {
+  return consumer_->query_watermark_offsets(topic_, partition_, &low, &high, timeoutMs_)
+         == RdKafka::ERR_NO_ERROR;
+}
+
+int64_t KafkaPartition::offsetForTime(size_t timeMs) const noexcept {
+  auto tp = std::unique_ptr<RdKafka::TopicPartition>(
+    RdKafka::TopicPartition::create(topic_, partition_, timeMs));
+  std::vector<RdKafka::TopicPartition*> ps{ tp.get() };
+  if (consumer_->offsetsForTimes(ps, timeoutMs_) == RdKafka::ERR_NO_ERROR && tp->offset() >= 0) {
+    return tp->offset();
+  }
+
+  int64_t lowOffset = 0;
+  int64_t highOffset = 0;
+  watermark(lowOffset, highOffset);
+  return lowOffset;
+}
+
+bool KafkaPartition::seek(int64_t offset) noexcept {
+  // a partition can be asked to read from offset smaller than its valid range
+  // due to range chunking, adjust partition offset if this is the case
+  int64_t lowOffset = -1;
+  int64_t highOffset = -1;
+  if (watermark(lowOffset, highOffset) && lowOffset > offset) {
+    offset = lowOffset;
+    LOG(INFO) << "Adjust partition offset to low bound.";
+  }
+
+  // drop any buffered messages and reassign the partition at new offset
+  release();
+  if (queue_) {
+    rd_kafka_queue_destroy(queue_);
+    queue_ = nullptr;
+  }
+
+  auto tp = std::unique_ptr<RdKafka::TopicPartition>(
+    RdKafka::TopicPartition::create(topic_, partition_, offset));
+  if (consumer_->assign({ tp.get() }) != RdKafka::ERR_NO_ERROR) {
+    LOG(ERROR) << "Kafka: failed to assign partition " << partition_ << " of " << topic_;
+    return false;
+  }
+
+  // detach the partition queue from consumer queue so that we can batch consume on it
+  queue_ = rd_kafka_queue_get_partition(consumer_->c_ptr(), topic_.c_str(), partition_);
+  if (!queue_) {
+    LOG(ERROR) << "Kafka: partition queue not available: " << partition_;
+    return false;
+  }
+
+  rd_kafka_queue_forward(queue_, nullptr);
+  position_ = offset;
+  return true;
+}
+
+int64_t KafkaPartition::committed() const noexcept {
+  auto tp = std::unique_ptr<RdKafka::TopicPartition>(
+    RdKafka::TopicPartition::create(topic_, partition_));
+  std::vector<RdKafka::TopicPartition*> ps{ tp.get() };
+  if (consumer_->committed(ps, timeoutMs_) == RdKafka::ERR_NO_ERROR && tp->err() == RdKafka::ERR_NO_ERROR) {
+    return tp->offset();
+  }
+
+  return RdKafka::Topic::OFFSET_INVALID;
+}
+
+void KafkaPartition::commit(int64_t offset) noexcept {
+  auto tp = std::unique_ptr<RdKafka::TopicPartition>(
+    RdKafka::TopicPartition::create(topic_, partition_, offset));
+  std::vector<RdKafka::TopicPartition*> ps{ tp.get() };
+
+  // a failed commit is retried by next seal with a later offset
+  auto err = consumer_->commitAsync(ps);
+  if (err != RdKafka::ERR_NO_ERROR) {
+    LOG(WARNING) << "Kafka: failed to commit offset " << offset << " of partition " << partition_
+                 << ": " << RdKafka::err2str(err);
+  }
+}
+
+void KafkaPartition::release() noexcept {
+  for (auto m : raw_) {
+    rd_kafka_message_destroy(m);
+  }
+
+  raw_.clear();
+  messages_.clear();
+}
+
+const std::vector<KafkaMessage>& KafkaPartition::consume(size_t max, size_t deadlineMs) noexcept {
+  // messages of last batch are done
+  release();
+
+  if (UNLIKELY(!queue_)) {
+    LOG(ERROR) << "Kafka: consume partition before seek.";
+    return messages_;
+  }
+
+  raw_.resize(max);
+  auto num = rd_kafka_consume_batch_queue(queue_, deadlineMs, raw_.data(), max);
+  raw_.resize(num < 0 ? 0 : num);
+
+  messages_.reserve(raw_.size());
+  for (auto m : raw_) {
+    // convert message timestamp to seconds, nebula use seconds as timestamp
+    rd_kafka_timestamp_type_t type;
+    auto ts = rd_kafka_message_timestamp(m, &type);
+    auto error = m->err != RD_KAFKA_RESP_ERR_NO_ERROR;
+    messages_.push_back({ m->offset, ts < 0 ? 0 : (size_t)ts / 1000, m->payload, m->len, error });
+
+    // partition EOF is reported as error without advancing the cursor
+    if (!error) {
+      position_ = m->offset + 1;
+    }
+  }
+
+  return messages_;
+}
+
+} // namespace kafka
+} // namespace storage
+} // namespace nebula
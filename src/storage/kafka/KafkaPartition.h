@@ -0,0 +1,149 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <rdkafka.h>
+#include <rdkafkacpp.h>
+#include <vector>
+
+#include "KafkaProvider.h"
+#include "common/Errors.h"
+#include "meta/TableSpec.h"
+
+/**
+ * A long-lived consumer bound to a single topic partition.
+ * It consumes messages in batches rather than one message per call.
+ */
+namespace nebula {
+namespace storage {
+namespace kafka {
+
+// a message view handed out by a partition consumer.
+// payload is owned by the consumer and valid until next consume call.
+struct KafkaMessage {
+  int64_t offset;
+  // message timestamp in seconds
+  size_t time;
+  void* payload;
+  size_t len;
+  bool error;
+};
+
+// interface of a partition consumer, a fake one can be provided for testing.
+class PartitionConsumer {
+public:
+  virtual ~PartitionConsumer() = default;
+
+  // partition id of this consumer
+  virtual int32_t partition() const noexcept = 0;
+
+  // next offset this consumer will read from
+  virtual int64_t position() const noexcept = 0;
+
+  // move the cursor to given offset, return false if failed
+  virtual bool seek(int64_t) noexcept = 0;
+
+  // offset committed for this partition to resume from, negative if none
+  virtual int64_t committed() const noexcept = 0;
+
+  // commit next offset to read, all messages before it are ingested
+  virtual void commit(int64_t) noexcept = 0;
+
+  // consume at most max messages waiting no longer than deadline in ms
+  // returned messages are valid until next call
+  virtual const std::vector<KafkaMessage>& consume(size_t max, size_t deadlineMs) noexcept = 0;
+};
+
+class KafkaPartition : public PartitionConsumer {
+public:
+  KafkaPartition(const std::string& brokers,
+                 const std::string& topic,
+                 int32_t partition,
+                 const nebula::meta::Settings& settings,
+                 size_t timeoutMs = 3000)
+    : topic_{ topic },
+      partition_{ partition },
+      timeoutMs_{ timeoutMs },
+      position_{ RdKafka::Topic::OFFSET_INVALID },
+      consumer_{ KafkaProvider::getConsumer(brokers, settings) },
+      queue_{ nullptr } {
+    N_ENSURE_NOT_NULL(consumer_, "failed to create kafka consumer");
+  }
+
+  virtual ~KafkaPartition() {
+    release();
+    if (queue_) {
+      rd_kafka_queue_destroy(queue_);
+    }
+
+    // unassign the partition
+    consumer_->unassign();
+    // TODO(cao): calling close will hanging forever.
+    consumer_->close();
+  }
+
+public:
+  inline virtual int32_t partition() const noexcept override {
+    return partition_;
+  }
+
+  inline virtual int64_t position() const noexcept override {
+    return position_;
+  }
+
+  inline const std::string& topic() const noexcept {
+    return topic_;
+  }
+
+  // get the low and high watermark of this partition
+  bool watermark(int64_t& low, int64_t& high) const noexcept;
+
+  // look up the earliest offset whose timestamp is not older than given time in ms
+  // return low watermark if the broker can not answer it
+  int64_t offsetForTime(size_t) const noexcept;
+
+  virtual bool seek(int64_t) noexcept override;
+
+  virtual int64_t committed() const noexcept override;
+
+  virtual void commit(int64_t) noexcept override;
+
+  virtual const std::vector<KafkaMessage>& consume(size_t, size_t) noexcept override;
+
+private:
+  // release messages consumed in last batch
+  void release() noexcept;
+
+private:
+  std::string topic_;
+  int32_t partition_;
+  size_t timeoutMs_;
+  int64_t position_;
+
+  std::unique_ptr<RdKafka::KafkaConsumer> consumer_;
+
+  // partition queue detached from consumer queue for batch consuming
+  rd_kafka_queue_t* queue_;
+
+  // raw messages owned by current batch and their views
+  std::vector<rd_kafka_message_t*> raw_;
+  std::vector<KafkaMessage> messages_;
+};
+
+} // namespace kafka
+} // namespace storage
+} // namespace nebula
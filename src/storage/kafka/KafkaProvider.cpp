@@ -66,6 +66,9 @@ std::unique_ptr<RdKafka::KafkaConsumer> KafkaProvider::getConsumer(
   // set group id anyways even we don't use consumer group at all
   SET_KEY_VALUE_CHECK("group.id", "nebula.kafka");
 
+  // offsets are committed explicitly once consumed messages are ingested in sealed blocks
+  SET_KEY_VALUE_CHECK("enable.auto.commit", "false");
+
   // const auto INTEGER_MAX = std::to_string(std::numeric_limits<int32_t>::max());
   SET_KEY_VALUE_CHECK("max.poll.interval.ms", "86400000");
 
@@ -31,6 +31,9 @@
 #include "common/Evidence.h"
 #include "meta/Table.h"
 
+DECLARE_uint64(KAFKA_CONSUME_BATCH);
+DECLARE_uint64(KAFKA_CONSUME_DEADLINE_MS);
+
 /**
  * Kafka topic wrapping topic metadata store.
  */
@@ -84,104 +87,113 @@ void KafkaReader::init() {
 
   // subscribe is designed for group balance, we use assign directly
   LOG(INFO) << "Consume " << table_->location << "/" << topic << ":" << segment_.id();
-  partition_ = std::unique_ptr<RdKafka::TopicPartition>(
-    RdKafka::TopicPartition::create(topic, segment_.partition, timeoutMs_));
-
-  auto offset = segment_.offset;
-
-  // assign the partition to start consuming
-  consumer_ = KafkaProvider::getConsumer(table_->location, table_->settings);
-
-  // a segment can have offset even smaller than valid range of the partition
-  // due to range chunking, adjust partition offset if this is the case
-  int64_t lowOffset = -1;
-  int64_t highOffset = -1;
-  if (consumer_->query_watermark_offsets(
-        topic, segment_.partition, &lowOffset, &highOffset, timeoutMs_)
-        == RdKafka::ERR_NO_ERROR
-      && lowOffset > offset) {
-    offset = lowOffset;
-    LOG(INFO) << "Adjust partition offset to low bound.";
+  if (!consumer_) {
+    consumer_ = std::make_unique<KafkaPartition>(
+      table_->location, topic, segment_.partition, table_->settings, timeoutMs_);
   }
 
-  // set partition offset to read and assign to current consumer
-  partition_->set_offset(offset);
-  consumer_->assign({ partition_.get() });
-
-  // create parser
-  // support thrift binary and json
-  if (table_->format == "thrift" && table_->serde.protocol == "binary") {
-    parser_ = std::make_unique<ThriftRow>(table_->serde.cmap);
-  } else if (table_->format == "json") {
-    parser_ = std::make_unique<JsonRow>(nebula::type::TypeSerializer::from(table_->schema));
-  } else {
-    throw NException("Only support thrift(TBinaryProtocol) and JSON for now.");
-  }
+  // set partition offset to read, consumer will adjust it to low bound if needed
+  N_ENSURE(consumer_->seek(segment_.offset), "failed to seek kafka partition");
+
+  // create parser and bind row slots to table schema so that batch reads fields positionally.
+  // string views are not used since next message is fetched before the row is consumed.
+  parser_ = makeParser(*table_);
+  row_.bind(table_->to()->schema());
 
   // set errors to 0 and set maximum messages to load
   errors_ = 0;
   max_ = segment_.offset + segment_.size;
+  batch_ = nullptr;
+  pos_ = 0;
 
   // load the first message
   msg_ = message();
 }
 
-std::unique_ptr<RdKafka::Message> KafkaReader::message() {
+std::unique_ptr<RowParser> KafkaReader::makeParser(const nebula::meta::TableSpec& table, bool views) {
+  if (table.format == "thrift" && table.serde.protocol == "binary") {
+    return std::make_unique<ThriftRow>(table.serde.cmap, views);
+  }
+
+  if (table.format == "json") {
+    return std::make_unique<JsonRow>(nebula::type::TypeSerializer::from(table.schema));
+  }
+
+  throw NException("Only support thrift(TBinaryProtocol) and JSON for now.");
+}
+
+const KafkaMessage* KafkaReader::message() {
+  // number of consecutive empty batches before we give up waiting
+  static constexpr size_t MAX_EMPTY_BATCHES = 3;
+
   // no more message as we have served requested size
   if (this->size_ >= segment_.size) {
     return nullptr;
   }
 
-  // when this message is consumed from queue, please delete it
-  std::unique_ptr<RdKafka::Message> msg(consumer_->consume(timeoutMs_));
+  size_t empty = 0;
+  while (true) {
+    // fetch next batch when current one is exhausted
+    if (!batch_ || pos_ >= batch_->size()) {
+      batch_ = &consumer_->consume(
+        std::min<size_t>(FLAGS_KAFKA_CONSUME_BATCH, segment_.size - this->size_),
+        FLAGS_KAFKA_CONSUME_DEADLINE_MS);
+      pos_ = 0;
+
+      if (batch_->empty()) {
+        if (++empty >= MAX_EMPTY_BATCHES) {
+          LOG(WARNING) << "No more messages available for segment: " << segment_.id();
+          return nullptr;
+        }
+
+        continue;
+      }
+    }
+
+    const auto& msg = batch_->at(pos_++);
 
-  // message may be empty
-  if (msg && msg->len() > 0) {
     // check if the message has error
-    if (msg->err() != RdKafka::ERR_NO_ERROR) {
-      LOG(ERROR) << "Error in reading kafka message: " << msg->errstr();
+    if (msg.error) {
+      LOG(ERROR) << "Error in reading kafka message at offset: " << msg.offset;
 
-      // more than half messages are error, not waiting any more
+      // more than 20% messages are error, not waiting any more
       if (errors_++ >= segment_.size / 5) {
         LOG(ERROR) << "More than 20% messages are error, give up...";
         return nullptr;
       }
+
+      continue;
     }
 
     // for unpredictable element beyond max limit
-    if (msg->offset() > max_) {
+    if (msg.offset > max_) {
       return nullptr;
     }
-  }
 
-  ++this->size_;
-  return msg;
-}
-
-// TODO(cao): do we need to handle different timestamp or availability?
-inline size_t readMessageTimestamp(const RdKafka::Message& msg) {
-  // convert to seconds, nebula use seconds as timestamp
-  return (size_t)msg.timestamp().timestamp / 1000;
-  // if (ts.type != RdKafka::MessageTimestamp::MSG_TIMESTAMP_NOT_AVAILABLE)
-  // if (ts.type == RdKafka::MessageTimestamp::MSG_TIMESTAMP_CREATE_TIME)
-  // if (ts.type == RdKafka::MessageTimestamp::MSG_TIMESTAMP_LOG_APPEND_TIME)
+    ++this->size_;
+    return &msg;
+  }
 }
 
-// next row data of CsvRow
-const nebula::surface::RowData& KafkaReader::next() {
-  // parse this msg into row_ based on serde info
+void KafkaReader::parse(RowParser& parser, const KafkaMessage& msg, FlatRow& row) {
+  // parse this msg into row based on serde info
   // reset the flat row
-  row_.reset();
+  row.reset();
 
   // always write message timestamp into time column
-  if (!parser_->hasTime()) {
-    row_.write(Table::TIME_COLUMN, readMessageTimestamp(*msg_));
+  if (!parser.hasTime()) {
+    row.write(Table::TIME_COLUMN, msg.time);
   }
 
   // parse this payload
-  if (!parser_->parse(msg_->payload(), msg_->len(), row_)) {
-    parser_->nullify(row_);
+  if (!parser.parse(msg.payload, msg.len, row)) {
+    parser.nullify(row);
   }
+}
+
+// next row data of CsvRow
+const nebula::surface::RowData& KafkaReader::next() {
+  parse(*parser_, *msg_, row_);
 
   // move index and load next message
   index_++;
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "KafkaPartition.h"
 #include "KafkaProvider.h"
 #include "KafkaTopic.h"
 
@@ -41,22 +42,24 @@ public:
   KafkaReader(nebula::meta::TableSpecPtr table,
               KafkaSegment segment,
               size_t timeoutMs = 3000)
+    : KafkaReader(table, std::move(segment), nullptr, timeoutMs) {}
+
+  // read the segment through a given partition consumer
+  KafkaReader(nebula::meta::TableSpecPtr table,
+              KafkaSegment segment,
+              std::unique_ptr<PartitionConsumer> consumer,
+              size_t timeoutMs = 3000)
     : nebula::surface::RowCursor(0),
       table_{ table },
       segment_{ std::move(segment) },
       timeoutMs_{ timeoutMs },
-      row_{ SLICE_SIZE, true } {
+      row_{ SLICE_SIZE, true },
+      consumer_{ std::move(consumer) } {
     // initialize consumer and parser
     init();
   }
 
-  virtual ~KafkaReader() {
-    // unassign the partition
-    consumer_->unassign();
-    // consumer->unsubscribe();
-    // TODO(cao): calling close will hanging forever.
-    consumer_->close();
-  }
+  virtual ~KafkaReader() = default;
 
 public:
   // next row data of CsvRow
@@ -66,12 +69,19 @@ public:
     throw NException("Kafka Reader does not support random access by row number");
   }
 
+  // create a message parser based on table format
+  // support thrift binary and json, views is to let thrift strings reference message payload
+  static std::unique_ptr<RowParser> makeParser(const nebula::meta::TableSpec&, bool views = false);
+
+  // parse a message into given row, time column is filled by message time if needed
+  static void parse(RowParser&, const KafkaMessage&, nebula::memory::FlatRow&);
+
 private:
   // load all messages in the repo
   void init();
 
   // next message
-  std::unique_ptr<RdKafka::Message> message();
+  const KafkaMessage* message();
 
 private:
   nebula::meta::TableSpecPtr table_;
@@ -82,12 +92,15 @@ private:
   nebula::memory::FlatRow row_;
 
   // kafka consumer and parser
-  std::unique_ptr<RdKafka::TopicPartition> partition_;
-  std::unique_ptr<RdKafka::KafkaConsumer> consumer_;
+  std::unique_ptr<PartitionConsumer> consumer_;
   std::unique_ptr<RowParser> parser_;
   int64_t max_;
   size_t errors_;
-  std::unique_ptr<RdKafka::Message> msg_;
+
+  // current batch of messages and position in the batch
+  const std::vector<KafkaMessage>* batch_;
+  size_t pos_;
+  const KafkaMessage* msg_;
 };
 
 } // namespace kafka
@@ -52,34 +52,23 @@ bool KafkaTopic::init() noexcept {
   return true;
 }
 
-// based on the start time, return a kafka segment list
-// this function will generate segments for each partition given start time stamp and segment width
-// it is querying the start and end offset by the time condition of each partition
-// and figure out "STARTING point" of each segment by width (W) in the line of
-//  [0, W) [W, 2W) [2W, 3W) .... [NW, (N+1)W)
-std::list<KafkaSegment> KafkaTopic::segmentsByTimestamp(size_t timeMs, size_t width) noexcept {
-  std::list<KafkaSegment> segments;
+// fetch all partition IDs of current topic
+std::vector<int32_t> KafkaTopic::partitions(RdKafka::KafkaConsumer& consumer) noexcept {
+  std::vector<int32_t> pids;
   std::string error;
 
-  // create a consumer
-  auto consumer = std::unique_ptr<RdKafka::KafkaConsumer>(RdKafka::KafkaConsumer::create(conf_.get(), error));
-  if (!consumer) {
-    LOG(ERROR) << "Kafka: " << error;
-    return segments;
-  }
-
   // figure out partition count
-  auto topic = std::unique_ptr<RdKafka::Topic>(RdKafka::Topic::create(consumer.get(), topic_, tconf_.get(), error));
+  auto topic = std::unique_ptr<RdKafka::Topic>(RdKafka::Topic::create(&consumer, topic_, tconf_.get(), error));
   if (!topic) {
     LOG(ERROR) << "Kafka: " << error;
-    return segments;
+    return pids;
   }
 
   // fetch metadata
   RdKafka::Metadata* metadata;
-  if (consumer->metadata(false, topic.get(), &metadata, timeoutMs_) != RdKafka::ERR_NO_ERROR) {
+  if (consumer.metadata(false, topic.get(), &metadata, timeoutMs_) != RdKafka::ERR_NO_ERROR) {
     LOG(ERROR) << "Kafka: can not fetch metadata";
-    return segments;
+    return pids;
   }
 
   // save metadata info
@@ -87,10 +76,8 @@ std::list<KafkaSegment> KafkaTopic::segmentsByTimestamp(size_t timeMs, size_t wi
   auto partitions = topicMetadata->partitions();
   if (partitions->size() == 0) {
     LOG(ERROR) << "Kafka: topic has no partitions.";
-    return segments;
   }
 
-  std::vector<int32_t> pids;
   pids.reserve(partitions->size());
   std::transform(partitions->cbegin(), partitions->cend(),
                  std::back_insert_iterator(pids),
@@ -100,6 +87,49 @@ std::list<KafkaSegment> KafkaTopic::segmentsByTimestamp(size_t timeMs, size_t wi
 
   // delete metadata object and return
   delete metadata;
+  return pids;
+}
+
+std::list<KafkaSegment> KafkaTopic::streams() noexcept {
+  std::list<KafkaSegment> segments;
+  std::string error;
+
+  // create a consumer
+  auto consumer = std::unique_ptr<RdKafka::KafkaConsumer>(RdKafka::KafkaConsumer::create(conf_.get(), error));
+  if (!consumer) {
+    LOG(ERROR) << "Kafka: " << error;
+    return segments;
+  }
+
+  // stream segment has stable identity so that it's assigned once per partition
+  for (auto part : partitions(*consumer)) {
+    segments.emplace_back(part, KafkaSegment::STREAM_OFFSET, 0);
+  }
+
+  consumer->close();
+  return segments;
+}
+
+// based on the start time, return a kafka segment list
+// this function will generate segments for each partition given start time stamp and segment width
+// it is querying the start and end offset by the time condition of each partition
+// and figure out "STARTING point" of each segment by width (W) in the line of
+//  [0, W) [W, 2W) [2W, 3W) .... [NW, (N+1)W)
+std::list<KafkaSegment> KafkaTopic::segmentsByTimestamp(size_t timeMs, size_t width) noexcept {
+  std::list<KafkaSegment> segments;
+  std::string error;
+
+  // create a consumer
+  auto consumer = std::unique_ptr<RdKafka::KafkaConsumer>(RdKafka::KafkaConsumer::create(conf_.get(), error));
+  if (!consumer) {
+    LOG(ERROR) << "Kafka: " << error;
+    return segments;
+  }
+
+  auto pids = partitions(*consumer);
+  if (pids.empty()) {
+    return segments;
+  }
 
   // overwrite width if this topic specified size
   if (serde_.size > 0) {
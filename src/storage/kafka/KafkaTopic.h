@@ -37,6 +37,14 @@ struct KafkaSegment {
   int64_t offset;
   size_t size;
 
+  // a segment without size represents continuous stream of the partition
+  // negative offset in a stream means starting from table retention window
+  static constexpr int64_t STREAM_OFFSET = -1;
+
+  inline bool isStream() const noexcept {
+    return size == 0;
+  }
+
   // build ID as well as a way to serialize the object
   std::string id() const noexcept {
     // this is unique for given topic
@@ -78,6 +86,9 @@ public:
 public:
   std::list<KafkaSegment> segmentsByTimestamp(size_t, size_t) noexcept;
 
+  // one stream segment per partition, each stream is consumed continuously
+  std::list<KafkaSegment> streams() noexcept;
+
   // raw pointer for reference only
   inline RdKafka::Conf* conf() const {
     return conf_.get();
@@ -94,6 +105,9 @@ public:
 private:
   bool init() noexcept;
 
+  // list partition IDs of the topic
+  std::vector<int32_t> partitions(RdKafka::KafkaConsumer&) noexcept;
+
 private:
   std::string brokers_;
   std::string topic_;
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2017-present Shawn Cao
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/writer.h>
+#include <fmt/format.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "memory/Batch.h"
+#include "meta/Table.h"
+#include "storage/ArrowReader.h"
+#include "storage/NFS.h"
+#include "type/Serde.h"
+
+namespace nebula {
+namespace storage {
+namespace test {
+
+using nebula::memory::Batch;
+using nebula::memory::DataNode;
+using nebula::storage::ArrowReader;
+using nebula::type::TypeSerializer;
+
+// build a record batch of [id:int64, event:dictionary<int32, utf8>, value:double]
+// every third value is null
+static std::shared_ptr<arrow::RecordBatch> makeBatch(int64_t rows) {
+  arrow::Int64Builder ids;
+  arrow::Int32Builder indices;
+  arrow::DoubleBuilder values;
+  for (int64_t i = 0; i < rows; ++i) {
+    EXPECT_TRUE(ids.Append(i).ok());
+    EXPECT_TRUE(indices.Append(i % 3).ok());
+    EXPECT_TRUE((i % 3 == 0 ? values.AppendNull() : values.Append(i * 0.5)).ok());
+  }
+
+  arrow::StringBuilder dict;
+  EXPECT_TRUE(dict.AppendValues({ "view", "click", "share" }).ok());
+
+  std::shared_ptr<arrow::Array> id, index, dictionary, event, value;
+  EXPECT_TRUE(ids.Finish(&id).ok());
+  EXPECT_TRUE(indices.Finish(&index).ok());
+  EXPECT_TRUE(dict.Finish(&dictionary).ok());
+  EXPECT_TRUE(values.Finish(&value).ok());
+
+  auto eventType = arrow::dictionary(arrow::int32(), arrow::utf8());
+  EXPECT_TRUE(arrow::DictionaryArray::FromArrays(eventType, index, dictionary, &event).ok());
+
+  auto schema = arrow::schema({ arrow::field("id", arrow::int64()),
+                                arrow::field("event", eventType),
+                                arrow::field("value", arrow::float64()) });
+  return arrow::RecordBatch::Make(schema, rows, { id, event, value });
+}
+
+static void writeArrow(const std::string& file, bool stream, size_t batches, int64_t rows) {
+  std::shared_ptr<arrow::io::FileOutputStream> out;
+  ASSERT_TRUE(arrow::io::FileOutputStream::Open(file, &out).ok());
+
+  auto batch = makeBatch(rows);
+  std::shared_ptr<arrow::ipc::RecordBatchWriter> writer;
+  if (stream) {
+    ASSERT_TRUE(arrow::ipc::RecordBatchStreamWriter::Open(out.get(), batch->schema(), &writer).ok());
+  } else {
+    ASSERT_TRUE(arrow::ipc::RecordBatchFileWriter::Open(out.get(), batch->schema(), &writer).ok());
+  }
+
+  for (size_t i = 0; i < batches; ++i) {
+    ASSERT_TRUE(writer->WriteRecordBatch(*batch).ok());
+  }
+
+  ASSERT_TRUE(writer->Close().ok());
+  ASSERT_TRUE(out->Close().ok());
+}
+
+TEST(ArrowTest, TestArrowReader) {
+  constexpr size_t batches = 3;
+  constexpr int64_t rows = 100;
+  const std::vector<std::string> events{ "view", "click", "share" };
+  auto schema = TypeSerializer::from("ROW<id:bigint, event:string, value:double, extra:int>");
+
+  for (auto stream : { false, true }) {
+    auto local = nebula::storage::makeFS("local");
+    auto file = local->temp();
+    writeArrow(file, stream, batches, rows);
+
+    ArrowReader reader(file, schema);
+    EXPECT_EQ(reader.size(), batches * rows);
+
+    size_t count = 0;
+    while (reader.hasNext()) {
+      const auto& row = reader.next();
+      const int64_t i = count++ % rows;
+
+      // rows are laid out by the given schema
+      EXPECT_EQ(row.slots()->size(), 4);
+      EXPECT_EQ(row.readLong(0), i);
+      EXPECT_EQ(row.readLong("id"), i);
+      EXPECT_EQ(row.readString(1), events.at(i % 3));
+      EXPECT_EQ(row.readString("event"), events.at(i % 3));
+
+      // validity bitmap becomes nulls
+      EXPECT_EQ(row.isNull(2), i % 3 == 0);
+      if (!row.isNull("value")) {
+        EXPECT_EQ(row.readDouble(2), i * 0.5);
+      }
+
+      // column absent in file is null
+      EXPECT_TRUE(row.isNull(3));
+      EXPECT_TRUE(row.isNull("extra"));
+    }
+
+    EXPECT_EQ(count, batches * rows);
+    unlink(file.c_str());
+  }
+}
+
+TEST(ArrowTest, TestArrowBulkFill) {
+  constexpr size_t batches = 2;
+  constexpr int64_t rows = 3000;
+  const std::vector<std::string> events{ "view", "click", "share" };
+  auto schema = TypeSerializer::from("ROW<id:bigint, event:string, value:double, extra:int>");
+
+  auto local = nebula::storage::makeFS("local");
+  auto file = local->temp();
+  writeArrow(file, false, batches, rows);
+
+  // record batches are appended column by column
+  nebula::meta::Table table{ "arrow", schema, {}, {} };
+  Batch batch(table, batches * rows);
+  ArrowReader reader(file, schema);
+  while (reader.nextBatch()) {
+    const auto count = reader.batchRows();
+    EXPECT_EQ(count, rows);
+    batch.add(count, [&reader, count](size_t slot, DataNode& node) {
+      reader.row().fill(slot, node, 0, count);
+    });
+  }
+
+  EXPECT_EQ(batch.getRows(), batches * rows);
+  auto accessor = batch.makeAccessor();
+  for (size_t r = 0; r < batches * rows; ++r) {
+    const auto& row = accessor->seek(r);
+    const int64_t i = r % rows;
+    EXPECT_EQ(row.readLong("id"), i);
+    EXPECT_EQ(row.readString("event"), events.at(i % 3));
+    EXPECT_EQ(row.isNull("value"), i % 3 == 0);
+    if (!row.isNull("value")) {
+      EXPECT_EQ(row.readDouble("value"), i * 0.5);
+    }
+    EXPECT_TRUE(row.isNull("extra"));
+  }
+
+  unlink(file.c_str());
+}
+
+TEST(ArrowTest, TestArrowTypeMismatch) {
+  auto local = nebula::storage::makeFS("local");
+  auto file = local->temp();
+  writeArrow(file, false, 1, 10);
+
+  // id is int64 in file
+  ArrowReader reader(file, TypeSerializer::from("ROW<id:int, event:string>"));
+  EXPECT_THROW(reader.next(), NException);
+  unlink(file.c_str());
+}
+
+} // namespace test
+} // namespace storage
+} // namespace nebula
@@ -26,6 +26,7 @@ namespace storage {
 namespace test {
 
 using nebula::storage::JsonReader;
+using nebula::storage::JsonRow;
 TEST(JsonTest, DISABLED_TestJsonReader) {
   auto file = "/home/shawncao/pme_sample.txt";
   auto schema = nebula::type::TypeSerializer::from(
@@ -43,6 +44,31 @@ TEST(JsonTest, DISABLED_TestJsonReader) {
   LOG(INFO) << "count=" << count;
 }
 
+TEST(JsonTest, TestJsonRowSlots) {
+  auto schema = nebula::type::TypeSerializer::from("ROW<id:int, name:string, weight:double>");
+  JsonRow json(schema);
+  nebula::memory::FlatRow row(1024, true);
+  row.bind(schema);
+
+  std::string msg = R"({"id": 3, "name": "nebula", "weight": 2.5, "other": 1})";
+  row.reset();
+  EXPECT_TRUE(json.parse(msg.data(), msg.size(), row));
+  EXPECT_EQ(row.readInt(0), 3);
+  EXPECT_EQ(row.readString(1), "nebula");
+  EXPECT_EQ(row.readDouble(2), 2.5);
+
+  // binding another schema creates a new layout, fields are resolved to their new slots
+  auto layout = row.slots();
+  row.bind(nebula::type::TypeSerializer::from("ROW<weight:double, id:int>"));
+  EXPECT_NE(row.slots().get(), layout.get());
+
+  row.reset();
+  EXPECT_TRUE(json.parse(msg.data(), msg.size(), row));
+  EXPECT_EQ(row.readDouble(0), 2.5);
+  EXPECT_EQ(row.readInt(1), 3);
+  EXPECT_EQ(row.readString("name"), "nebula");
+}
+
 } // namespace test
 } // namespace storage
 } // namespace nebula
\ No newline at end of file
@@ -18,6 +18,7 @@
 
 #include <cstdint>
 #include <string_view>
+#include <vector>
 
 #include "common/Cursor.h"
 #include "common/Errors.h"
@@ -35,6 +36,10 @@ namespace nebula {
 namespace surface {
 
 // Supported compound types
+// field names of a row in slot order. a layout is immutable, binding different fields creates a new one,
+// so holding it keeps its identity valid for those caching decisions made on it.
+using Slots = std::shared_ptr<const std::vector<std::string>>;
+
 class RowData;
 class ListData;
 class MapData;
@@ -121,6 +126,13 @@ public:
     return nullptr;
   }
 #undef NOT_IMPL_FUNC
+
+  // names of fields in slot order if this row supports reading fields by slot index,
+  // writers having the same field order can read the row positionally.
+  virtual const Slots& slots() const noexcept {
+    static const Slots none;
+    return none;
+  }
 };
 
 class ListData {
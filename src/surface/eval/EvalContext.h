@@ -317,10 +317,10 @@ public:
     return slice.read<T>(offset);
   }
 
-#define NULL_CHECK(R)                \
-  if (UNLIKELY(row_->isNull(col))) { \
-    valid = false;                   \
-    return R;                        \
+#define NULL_CHECK(R)                              \
+  if (!nullFree_ && UNLIKELY(row_->isNull(col))) { \
+    valid = false;                                 \
+    return R;                                      \
   }
 
   template <typename T>
@@ -391,6 +391,12 @@ public:
     return *script_;
   }
 
+  // bind rows to read as having no nulls in any column, such as rows of a sealed block without nulls,
+  // so column reads skip null checks
+  inline void nullFree(bool nullFree) noexcept {
+    nullFree_ = nullFree;
+  }
+
 private:
   EvalContext(bool cache,
               std::shared_ptr<ScriptData> scriptData,
@@ -404,7 +410,8 @@ private:
                                            return scriptData_->name2type->at(col);
                                          }) },
       data_{ std::move(data) },
-      row_{ data_ ? data_.get() : nullptr } {}
+      row_{ data_ ? data_.get() : nullptr },
+      nullFree_{ false } {}
 
 private:
   std::unique_ptr<EvalCache> cache_;
@@ -420,6 +427,9 @@ private:
 
   // row object pointer
   const nebula::surface::RowData* row_;
+
+  // rows have no null values
+  bool nullFree_;
 };
 
 template <>